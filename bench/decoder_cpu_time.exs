@@ -0,0 +1,90 @@
+# Measures the CPU time spent by the VM per decoded frame.
+#
+#   MIX_ENV=test mix run bench/decoder_cpu_time.exs [input.h264 | input.h265]
+#
+# On hosts without the Jetson decoder, run it against the software backend
+# with an emulated decoding time to see the cost of waiting for the decoder:
+#
+#   MMAPI_BACKEND=software MMAPI_SW_DECODE_LATENCY_US=5000 MIX_ENV=test \
+#     mix run bench/decoder_cpu_time.exs
+
+defmodule Bench.FrameCounter do
+  use Membrane.Sink
+
+  def_input_pad :input, accepted_format: _any
+
+  @impl true
+  def handle_init(_ctx, _opts), do: {[], %{frames: 0}}
+
+  @impl true
+  def handle_buffer(:input, _buffer, _ctx, state), do: {[], %{state | frames: state.frames + 1}}
+
+  @impl true
+  def handle_end_of_stream(:input, _ctx, state) do
+    {[notify_parent: {:frames, state.frames}], state}
+  end
+end
+
+defmodule Bench.Pipeline do
+  use Membrane.Pipeline
+
+  @impl true
+  def handle_init(_ctx, opts) do
+    parser =
+      case Path.extname(opts[:path]) do
+        ".h265" -> Membrane.H265.Parser
+        _other -> Membrane.H264.Parser
+      end
+
+    spec =
+      child(%Membrane.File.Source{location: opts[:path]})
+      |> child(parser)
+      |> child(Membrane.Nvidia.MMAPI.Decoder)
+      |> child(:sink, Bench.FrameCounter)
+
+    {[spec: spec], %{parent: opts[:parent]}}
+  end
+
+  @impl true
+  def handle_child_notification({:frames, frames}, :sink, _ctx, state) do
+    send(state.parent, {:frames, frames})
+    {[terminate: :normal], state}
+  end
+end
+
+defmodule Bench.CPU do
+  # utime and stime of the whole VM, in clock ticks
+  def ticks do
+    fields = File.read!("/proc/self/stat") |> String.split(") ") |> List.last() |> String.split()
+    String.to_integer(Enum.at(fields, 11)) + String.to_integer(Enum.at(fields, 12))
+  end
+
+  def ticks_per_second do
+    {ticks, 0} = System.cmd("getconf", ["CLK_TCK"])
+    ticks |> String.trim() |> String.to_integer()
+  end
+end
+
+path = List.first(System.argv(), "test/fixtures/h265/input-60-480p.h265")
+
+cpu_before = Bench.CPU.ticks()
+wall_before = System.monotonic_time(:microsecond)
+
+{:ok, _supervisor, _pipeline} =
+  Membrane.Pipeline.start_link(Bench.Pipeline, path: path, parent: self())
+
+frames =
+  receive do
+    {:frames, frames} -> frames
+  end
+
+cpu_us = (Bench.CPU.ticks() - cpu_before) * 1_000_000 / Bench.CPU.ticks_per_second()
+wall_us = System.monotonic_time(:microsecond) - wall_before
+
+IO.puts("""
+input:          #{path}
+frames:         #{frames}
+wall time:      #{Float.round(wall_us / 1000, 1)} ms
+cpu time:       #{Float.round(cpu_us / 1000, 1)} ms
+cpu per frame:  #{Float.round(cpu_us / max(frames, 1), 1)} us
+""")
@@ -0,0 +1,133 @@
+# Compares the hardware JPEG decoder with a software decode of the same
+# MJPEG stream, in wall time and CPU time per frame.
+#
+#   MIX_ENV=test mix run bench/jpeg_decoder.exs [input.mjpeg] [iterations]
+#
+# The software path is `ffmpeg` decoding to I420 on a single thread, the
+# comparison is skipped when it's not installed.
+
+defmodule Bench.FrameCounter do
+  use Membrane.Sink
+
+  def_input_pad :input, accepted_format: _any
+
+  @impl true
+  def handle_init(_ctx, _opts), do: {[], %{frames: 0}}
+
+  @impl true
+  def handle_buffer(:input, _buffer, _ctx, state), do: {[], %{state | frames: state.frames + 1}}
+
+  @impl true
+  def handle_end_of_stream(:input, _ctx, state) do
+    {[notify_parent: {:frames, state.frames}], state}
+  end
+end
+
+defmodule Bench.Pipeline do
+  use Membrane.Pipeline
+
+  @impl true
+  def handle_init(_ctx, opts) do
+    spec =
+      child(%Membrane.File.Source{location: opts[:path]})
+      |> child(%Membrane.Nvidia.MMAPI.JPEGDecoder{pixel_format: :I420})
+      |> child(:sink, Bench.FrameCounter)
+
+    {[spec: spec], %{parent: opts[:parent]}}
+  end
+
+  @impl true
+  def handle_child_notification({:frames, frames}, :sink, _ctx, state) do
+    send(state.parent, {:frames, frames})
+    {[terminate: :normal], state}
+  end
+end
+
+defmodule Bench.CPU do
+  # utime and stime of the whole VM, in clock ticks
+  def ticks do
+    fields = File.read!("/proc/self/stat") |> String.split(") ") |> List.last() |> String.split()
+    String.to_integer(Enum.at(fields, 11)) + String.to_integer(Enum.at(fields, 12))
+  end
+
+  def ticks_per_second do
+    {ticks, 0} = System.cmd("getconf", ["CLK_TCK"])
+    ticks |> String.trim() |> String.to_integer()
+  end
+end
+
+defmodule Bench.Software do
+  # `ffmpeg -benchmark` reports the user, system and real time of the whole run
+  def run(path) do
+    args =
+      ~w(-hide_banner -benchmark -threads 1 -f mjpeg -i #{path}) ++
+        ~w(-pix_fmt yuv420p -f rawvideo -y /dev/null)
+
+    {output, 0} = System.cmd("ffmpeg", args, stderr_to_stdout: true)
+
+    [_match, utime, stime, rtime] =
+      Regex.run(~r/bench: utime=([\d.]+)s stime=([\d.]+)s rtime=([\d.]+)s/, output)
+
+    # The last progress line has the total number of frames
+    [_match, frames] = ~r/frame=\s*(\d+)/ |> Regex.scan(output) |> List.last()
+
+    %{
+      frames: String.to_integer(frames),
+      wall_us: String.to_float(rtime) * 1_000_000,
+      cpu_us: (String.to_float(utime) + String.to_float(stime)) * 1_000_000
+    }
+  end
+end
+
+defmodule Bench.Hardware do
+  def run(path) do
+    cpu_before = Bench.CPU.ticks()
+    wall_before = System.monotonic_time(:microsecond)
+
+    {:ok, _supervisor, _pipeline} =
+      Membrane.Pipeline.start_link(Bench.Pipeline, path: path, parent: self())
+
+    frames =
+      receive do
+        {:frames, frames} -> frames
+      end
+
+    %{
+      frames: frames,
+      wall_us: System.monotonic_time(:microsecond) - wall_before,
+      cpu_us: (Bench.CPU.ticks() - cpu_before) * 1_000_000 / Bench.CPU.ticks_per_second()
+    }
+  end
+end
+
+report = fn name, runs ->
+  frames = Enum.sum(Enum.map(runs, & &1.frames))
+  wall_us = Enum.sum(Enum.map(runs, & &1.wall_us))
+  cpu_us = Enum.sum(Enum.map(runs, & &1.cpu_us))
+
+  IO.puts("""
+  #{name}
+    frames:         #{frames}
+    wall per frame: #{Float.round(wall_us / max(frames, 1), 1)} us
+    cpu per frame:  #{Float.round(cpu_us / max(frames, 1), 1)} us
+  """)
+end
+
+{path, iterations} =
+  case System.argv() do
+    [path, iterations] -> {path, String.to_integer(iterations)}
+    [path] -> {path, 10}
+    [] -> {"test/fixtures/mjpeg/input-30-240p.mjpeg", 10}
+  end
+
+IO.puts("input: #{path}, #{iterations} iterations\n")
+
+# The first run loads the native library and warms up the decoder
+Bench.Hardware.run(path)
+report.("hardware (JPEGDecoder)", Enum.map(1..iterations, fn _i -> Bench.Hardware.run(path) end))
+
+if System.find_executable("ffmpeg") do
+  report.("software (ffmpeg)", Enum.map(1..iterations, fn _i -> Bench.Software.run(path) end))
+else
+  IO.puts("software: ffmpeg not found, skipped")
+end
@@ -9,30 +9,107 @@ defmodule Membrane.Nvidia.MMAPI.BundlexProject do
     ]
   end
 
-  defp natives(_platform) do
+  # Device and buffer classes shared by all the natives
+  @common_sources [
+    "common/NvApplicationProfiler.cpp",
+    "common/NvBuffer.cpp",
+    "common/NvBufSurface.cpp",
+    "common/NvDeviceBackend.cpp",
+    "common/NvElement.cpp",
+    "common/NvElementProfiler.cpp",
+    "common/NvLatencyRecorder.cpp",
+    "common/NvLogging.cpp",
+    "common/NvPictureCounter.cpp",
+    "common/NvResourceSampler.cpp",
+    "common/NvSoftwareBackend.cpp",
+    "common/NvV4l2Element.cpp",
+    "common/NvV4l2ElementPlane.cpp"
+  ]
+
+  defp natives(platform) do
+    [
+      decoder:
+        [
+          interface: :nif,
+          language: :cpp,
+          sources:
+            [
+              "video_decoder.cpp",
+              "decoder_manager.cpp",
+              "device_poll.cpp",
+              "decoder_nif.cpp",
+              "surface_copy.cpp",
+              "common/NvVideoDecoder.cpp"
+            ] ++ @common_sources,
+          preprocessor: Unifex
+        ] ++ backend_options(backend(platform)),
+      encoder:
+        [
+          interface: :nif,
+          language: :cpp,
+          sources:
+            [
+              "video_encoder.cpp",
+              "device_poll.cpp",
+              "encoder_nif.cpp",
+              "common/NvVideoEncoder.cpp"
+            ] ++ @common_sources,
+          preprocessor: Unifex
+        ] ++ backend_options(backend(platform)),
+      # Links both codecs, so that decoded surfaces can be queued on the encoder
+      transcoder:
+        [
+          interface: :nif,
+          language: :cpp,
+          sources:
+            [
+              "transcoder.cpp",
+              "transcoder_nif.cpp",
+              "video_decoder.cpp",
+              "decoder_manager.cpp",
+              "device_poll.cpp",
+              "video_encoder.cpp",
+              "common/NvVideoDecoder.cpp",
+              "common/NvVideoEncoder.cpp"
+            ] ++ @common_sources,
+          preprocessor: Unifex
+        ] ++ backend_options(backend(platform)),
+      converter:
+        [
+          interface: :nif,
+          language: :cpp,
+          sources: ["converter.cpp", "converter_nif.cpp", "surface_copy.cpp"] ++ @common_sources,
+          preprocessor: Unifex
+        ] ++ backend_options(backend(platform))
+    ]
+  end
+
+  # The software backend emulates the decoder, the encoder and the VIC in host memory,
+  # it allows building and benchmarking the plugin on hosts without the Jetson libraries.
+  defp backend(%{architecture: architecture}) do
+    case System.get_env("MMAPI_BACKEND") do
+      nil when architecture == "aarch64" -> :hardware
+      nil -> :software
+      backend -> String.to_atom(backend)
+    end
+  end
+
+  defp backend_options(:hardware) do
+    [
+      includes: ["/usr/src/jetson_multimedia_api/include/"],
+      lib_dirs: ["/usr/lib/aarch64-linux-gnu", "/usr/lib/aarch64-linux-gnu/tegra"],
+      libs: ["pthread", "nvv4l2", "nvbufsurface", "nvbufsurftransform"],
+      compiler_flags: ["-std=c++17"]
+    ]
+  end
+
+  # Builds against minimal stand-ins of the Jetson Multimedia API headers kept in
+  # c_src, so that the Jetson tree doesn't need to be installed
+  defp backend_options(:software) do
     [
-      decoder: [
-        interface: :nif,
-        language: :cpp,
-        sources: [
-          "decoder.cpp",
-          "decoder_nif.cpp",
-          "common/NvApplicationProfiler.cpp",
-          "common/NvBuffer.cpp",
-          "common/NvBufSurface.cpp",
-          "common/NvElement.cpp",
-          "common/NvElementProfiler.cpp",
-          "common/NvLogging.cpp",
-          "common/NvV4l2Element.cpp",
-          "common/NvV4l2ElementPlane.cpp",
-          "common/NvVideoDecoder.cpp"
-        ],
-        includes: ["/usr/src/jetson_multimedia_api/include/"],
-        lib_dirs: ["/usr/lib/aarch64-linux-gnu", "/usr/lib/aarch64-linux-gnu/tegra"],
-        libs: ["pthread", "nvv4l2", "nvbufsurface", "nvbufsurftransform"],
-        compiler_flags: ["-std=c++17"],
-        preprocessor: Unifex
-      ]
+      includes: [Path.expand("c_src/membrane_nvidia_mmapi_plugin/include", __DIR__)],
+      libs: ["pthread"],
+      compiler_flags: ["-std=c++17", "-DMMAPI_SOFTWARE_BACKEND"]
     ]
   end
 end
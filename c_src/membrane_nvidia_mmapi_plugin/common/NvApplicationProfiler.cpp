@@ -27,6 +27,7 @@
  */
 
 #include "NvApplicationProfiler.h"
+#include "NvResourceSampler.h"
 #include <fstream>
 #include <sstream>
 #include <pthread.h>
@@ -46,8 +47,8 @@ using namespace std;
 
 NvApplicationProfiler::NvApplicationProfiler()
 {
-    char governor[64];
-    uint64_t cpu_freq_khz;
+    char governor[64] = "";
+    uint64_t cpu_freq_khz = 0;
 
     memset(&data, 0, sizeof(data));
 
@@ -95,14 +96,7 @@ NvApplicationProfiler::start(uint32_t sampling_interval_ms)
         return;
     }
 
-    if (!check_cpu_usage)
-    {
-        cerr << "Set governor to " REQUIRED_GOVERNOR " before enabling profiler"
-            << endl;
-        pthread_mutex_unlock(&thread_lock);
-        return;
-    }
-
+    // Without the performance governor only the resources are sampled
     running = true;
     sampling_interval = sampling_interval_ms;
 
@@ -125,7 +119,15 @@ NvApplicationProfiler::start(uint32_t sampling_interval_ms)
 void
 NvApplicationProfiler::stop()
 {
+    pthread_mutex_lock(&thread_lock);
+    if (!running)
+    {
+        pthread_mutex_unlock(&thread_lock);
+        return;
+    }
     running = false;
+    pthread_mutex_unlock(&thread_lock);
+
     pthread_join(profiling_thread, NULL);
 
     pthread_mutex_lock(&thread_lock);
@@ -167,6 +169,8 @@ NvApplicationProfiler::profile()
         data.stop_cpu_clock_time = cur_cpu_clock_time;
     }
     data.num_readings++;
+
+    NvResourceSampler::getInstance().sample();
 }
 
 void *
@@ -174,14 +178,18 @@ NvApplicationProfiler::ProfilerThread(void * data)
 {
     NvApplicationProfiler *profiler = (NvApplicationProfiler *) data;
     struct timespec next_profile_time;
-    struct timeval now;
+    struct timespec now;
     pthread_cond_t sleep_cond;
+    pthread_condattr_t sleep_cond_attr;
 
-    pthread_cond_init(&sleep_cond, NULL);
+    // Sleep on the monotonic clock, so that the intervals don't follow
+    // changes of the system time
+    pthread_condattr_init(&sleep_cond_attr);
+    pthread_condattr_setclock(&sleep_cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sleep_cond, &sleep_cond_attr);
+    pthread_condattr_destroy(&sleep_cond_attr);
 
-    gettimeofday(&now, NULL);
-    next_profile_time.tv_sec = now.tv_sec;
-    next_profile_time.tv_nsec = now.tv_usec * 1000L;
+    clock_gettime(CLOCK_MONOTONIC, &next_profile_time);
 
     pthread_mutex_lock(&profiler->thread_lock);
     while (profiler->running)
@@ -190,13 +198,21 @@ NvApplicationProfiler::ProfilerThread(void * data)
                 &next_profile_time);
         profiler->profile();
 
-        next_profile_time.tv_sec += profiler->sampling_interval / 1000;
-        next_profile_time.tv_nsec += (profiler->sampling_interval % 1000) * 1000000L;
-        next_profile_time.tv_sec += next_profile_time.tv_nsec / 1000000000L;
-        next_profile_time.tv_nsec %= 1000000000L;
-
+        // Intervals missed by a late profile are skipped instead of caught up
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        do
+        {
+            next_profile_time.tv_sec += profiler->sampling_interval / 1000;
+            next_profile_time.tv_nsec += (profiler->sampling_interval % 1000) * 1000000L;
+            next_profile_time.tv_sec += next_profile_time.tv_nsec / 1000000000L;
+            next_profile_time.tv_nsec %= 1000000000L;
+        } while (profiler->sampling_interval > 0 &&
+                (next_profile_time.tv_sec < now.tv_sec ||
+                 (next_profile_time.tv_sec == now.tv_sec &&
+                  next_profile_time.tv_nsec <= now.tv_nsec)));
     }
     pthread_mutex_unlock(&profiler->thread_lock);
+    pthread_cond_destroy(&sleep_cond);
 
     return NULL;
 }
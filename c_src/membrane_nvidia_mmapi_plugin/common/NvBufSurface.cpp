@@ -8,6 +8,10 @@
  */
 
 #include "NvBufSurface.h"
+#include "NvDeviceBackend.h"
+#include "NvResourceSampler.h"
+
+#include <cstring>
 
 using namespace std;
 
@@ -18,10 +22,11 @@ NvBufSurf::NvDestroy(int fd)
     NvBufSurface *nvbuf_surf = 0;
     if (fd <= 0)
       return -1;
-    NvBufSurfaceFromFd(fd, (void**)(&nvbuf_surf));
+    NvDeviceBackend::getBackendInstance().surfaceFromFd(fd, (void**)(&nvbuf_surf));
     if (nvbuf_surf != NULL)
     {
-        ret = NvBufSurfaceDestroy(nvbuf_surf);
+        NvResourceSampler::addDmaBufferBytes(-(int64_t) nvbuf_surf->surfaceList[0].dataSize);
+        ret = NvDeviceBackend::getBackendInstance().surfaceDestroy(nvbuf_surf);
     }
     return ret;
 }
@@ -43,9 +48,12 @@ NvBufSurf::NvAllocate(NvCommonAllocateParams *allocateParams, uint32_t numBuffer
 
     for (uint32_t index = 0; index < numBuffers; index++) {
       NvBufSurface *nvbuf_surf = 0;
-      ret = NvBufSurfaceAllocate(&nvbuf_surf, 1, &input_params);
+      ret = NvDeviceBackend::getBackendInstance().surfaceAllocate(&nvbuf_surf, 1, &input_params);
+      if (ret < 0)
+        return ret;
       fd[index] = nvbuf_surf->surfaceList[0].bufferDesc;
       nvbuf_surf->numFilled = 1;
+      NvResourceSampler::addDmaBufferBytes(nvbuf_surf->surfaceList[0].dataSize);
     }
 
     return ret;
@@ -78,10 +86,10 @@ NvBufSurf::NvTransform(NvCommonTransformParams *transformParams, int src_fd, int
     transform_params.transform_filter = transformParams->filter;
     transform_params.src_rect = &src_rect;
     transform_params.dst_rect = &dest_rect;
-    NvBufSurfaceFromFd(src_fd, (void**)(&nvbuf_surf_src));
-    NvBufSurfaceFromFd(dst_fd, (void**)(&nvbuf_surf_dst));
+    NvDeviceBackend::getBackendInstance().surfaceFromFd(src_fd, (void**)(&nvbuf_surf_src));
+    NvDeviceBackend::getBackendInstance().surfaceFromFd(dst_fd, (void**)(&nvbuf_surf_dst));
 
-    ret = NvBufSurfTransform(nvbuf_surf_src, nvbuf_surf_dst, &transform_params);
+    ret = NvDeviceBackend::getBackendInstance().transform(nvbuf_surf_src, nvbuf_surf_dst, &transform_params);
 
     return ret;
 }
@@ -110,9 +118,9 @@ NvBufSurf::NvTransformAsync(NvCommonTransformParams *transformParams, NvBufSurfT
     transform_params.transform_filter = transformParams->filter;
     transform_params.src_rect = &src_rect;
     transform_params.dst_rect = &dest_rect;
-    NvBufSurfaceFromFd(src_fd, (void**)(&nvbuf_surf_src));
-    NvBufSurfaceFromFd(dst_fd, (void**)(&nvbuf_surf_dst));
-    ret = NvBufSurfTransformAsync(nvbuf_surf_src, nvbuf_surf_dst, &transform_params, sync_obj);
+    NvDeviceBackend::getBackendInstance().surfaceFromFd(src_fd, (void**)(&nvbuf_surf_src));
+    NvDeviceBackend::getBackendInstance().surfaceFromFd(dst_fd, (void**)(&nvbuf_surf_dst));
+    ret = NvDeviceBackend::getBackendInstance().transformAsync(nvbuf_surf_src, nvbuf_surf_dst, &transform_params, sync_obj);
 
     return ret;
 }
@@ -32,7 +32,7 @@
 #include <cstring>
 #include <errno.h>
 #include <sys/mman.h>
-#include <libv4l2.h>
+#include "NvDeviceBackend.h"
 
 #define CAT_NAME "Buffer"
 
@@ -158,7 +158,7 @@ NvBuffer::map()
             return -1;
         }
 
-        planes[j].data = (unsigned char *) mmap(NULL,
+        planes[j].data = (unsigned char *) NvDeviceBackend::getBackendInstance().mmap(NULL,
                                                 planes[j].length,
                                                 PROT_READ | PROT_WRITE,
                                                 MAP_SHARED,
@@ -193,7 +193,7 @@ NvBuffer::unmap()
     {
         if (planes[j].data)
         {
-            munmap(planes[j].data, planes[j].length);
+            NvDeviceBackend::getBackendInstance().munmap(planes[j].data, planes[j].length);
         }
         planes[j].data = NULL;
     }
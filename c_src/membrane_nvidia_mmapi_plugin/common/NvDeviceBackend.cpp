@@ -0,0 +1,121 @@
+#include "NvDeviceBackend.h"
+#include "NvSoftwareBackend.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#ifndef MMAPI_SOFTWARE_BACKEND
+#include <libv4l2.h>
+
+class NvHardwareBackend : public NvDeviceBackend
+{
+public:
+    int open(const char *dev_node, int flags) override
+    {
+        return v4l2_open(dev_node, flags);
+    }
+
+    int close(int fd) override
+    {
+        return v4l2_close(fd);
+    }
+
+    int ioctl(int fd, unsigned long request, void *arg) override
+    {
+        return v4l2_ioctl(fd, request, arg);
+    }
+
+    void *mmap(void *addr, size_t length, int prot, int flags, int fd, int64_t offset) override
+    {
+        return v4l2_mmap(addr, length, prot, flags, fd, offset);
+    }
+
+    int munmap(void *addr, size_t length) override
+    {
+        return v4l2_munmap(addr, length);
+    }
+
+    int surfaceAllocate(NvBufSurface **surf, uint32_t batch_size,
+            NvBufSurfaceAllocateParams *params) override
+    {
+        return NvBufSurfaceAllocate(surf, batch_size, params);
+    }
+
+    int surfaceDestroy(NvBufSurface *surf) override
+    {
+        return NvBufSurfaceDestroy(surf);
+    }
+
+    int surfaceFromFd(int dmabuf_fd, void **surf) override
+    {
+        return NvBufSurfaceFromFd(dmabuf_fd, surf);
+    }
+
+    int surfaceMap(NvBufSurface *surf, int index, int plane,
+            NvBufSurfaceMemMapFlags type) override
+    {
+        return NvBufSurfaceMap(surf, index, plane, type);
+    }
+
+    int surfaceUnMap(NvBufSurface *surf, int index, int plane) override
+    {
+        return NvBufSurfaceUnMap(surf, index, plane);
+    }
+
+    int surfaceSyncForCpu(NvBufSurface *surf, int index, int plane) override
+    {
+        return NvBufSurfaceSyncForCpu(surf, index, plane);
+    }
+
+    int surfaceSyncForDevice(NvBufSurface *surf, int index, int plane) override
+    {
+        return NvBufSurfaceSyncForDevice(surf, index, plane);
+    }
+
+    int transform(NvBufSurface *src, NvBufSurface *dst,
+            NvBufSurfTransformParams *params) override
+    {
+        return NvBufSurfTransform(src, dst, params);
+    }
+
+    int transformAsync(NvBufSurface *src, NvBufSurface *dst,
+            NvBufSurfTransformParams *params, NvBufSurfTransformSyncObj_t *sync_obj) override
+    {
+        return NvBufSurfTransformAsync(src, dst, params, sync_obj);
+    }
+
+    int syncObjWait(NvBufSurfTransformSyncObj_t sync_obj, uint32_t time_out) override
+    {
+        return NvBufSurfTransformSyncObjWait(sync_obj, time_out);
+    }
+
+    int syncObjDestroy(NvBufSurfTransformSyncObj_t *sync_obj) override
+    {
+        return NvBufSurfTransformSyncObjDestroy(sync_obj);
+    }
+
+    // The V4L2 plugin library handles the device in user space, polling
+    // its descriptor doesn't report the decoder state
+    bool pollableDevices() override
+    {
+        return false;
+    }
+};
+#endif
+
+NvDeviceBackend &
+NvDeviceBackend::getBackendInstance()
+{
+#ifdef MMAPI_SOFTWARE_BACKEND
+    return NvSoftwareBackend::getSoftwareBackendInstance();
+#else
+    static NvHardwareBackend hardware_backend;
+    static const char *backend = getenv("MMAPI_BACKEND");
+
+    if (backend && strcmp(backend, "software") == 0)
+    {
+        return NvSoftwareBackend::getSoftwareBackendInstance();
+    }
+    return hardware_backend;
+#endif
+}
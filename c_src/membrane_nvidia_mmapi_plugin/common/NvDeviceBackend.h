@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "nvbufsurface.h"
+#include "nvbufsurftransform.h"
+
+/**
+ * Device backend used by NvV4l2Element, NvV4l2ElementPlane, NvBuffer and
+ * NvBufSurf instead of calling libnvv4l2 and libnvbufsurface directly.
+ *
+ * The hardware backend forwards every call to the Jetson libraries. The
+ * software backend emulates a V4L2 M2M decoder and NvBufSurface allocation
+ * and transform in host memory so the plugin can run on hosts without the
+ * Jetson multimedia engines.
+ */
+class NvDeviceBackend
+{
+public:
+    virtual ~NvDeviceBackend() {}
+
+    virtual int open(const char *dev_node, int flags) = 0;
+    virtual int close(int fd) = 0;
+    virtual int ioctl(int fd, unsigned long request, void *arg) = 0;
+    virtual void *mmap(void *addr, size_t length, int prot, int flags, int fd, int64_t offset) = 0;
+    virtual int munmap(void *addr, size_t length) = 0;
+
+    virtual int surfaceAllocate(NvBufSurface **surf, uint32_t batch_size,
+            NvBufSurfaceAllocateParams *params) = 0;
+    virtual int surfaceDestroy(NvBufSurface *surf) = 0;
+    virtual int surfaceFromFd(int dmabuf_fd, void **surf) = 0;
+    virtual int surfaceMap(NvBufSurface *surf, int index, int plane,
+            NvBufSurfaceMemMapFlags type) = 0;
+    virtual int surfaceUnMap(NvBufSurface *surf, int index, int plane) = 0;
+    virtual int surfaceSyncForCpu(NvBufSurface *surf, int index, int plane) = 0;
+    virtual int surfaceSyncForDevice(NvBufSurface *surf, int index, int plane) = 0;
+
+    virtual int transform(NvBufSurface *src, NvBufSurface *dst,
+            NvBufSurfTransformParams *params) = 0;
+    virtual int transformAsync(NvBufSurface *src, NvBufSurface *dst,
+            NvBufSurfTransformParams *params, NvBufSurfTransformSyncObj_t *sync_obj) = 0;
+    virtual int syncObjWait(NvBufSurfTransformSyncObj_t sync_obj, uint32_t time_out) = 0;
+    virtual int syncObjDestroy(NvBufSurfTransformSyncObj_t *sync_obj) = 0;
+
+    /**
+     * Whether the descriptors returned by open can be polled for buffers
+     * and events to dequeue. Otherwise the device can only be waited on
+     * with the V4L2_CID_MPEG_VIDEO_DEVICE_POLL control.
+     */
+    virtual bool pollableDevices() = 0;
+
+    /**
+     * Returns the backend of the process.
+     *
+     * Builds with MMAPI_SOFTWARE_BACKEND defined only contain the software
+     * backend. Other builds use the hardware backend unless the
+     * MMAPI_BACKEND environment variable is set to "software".
+     */
+    static NvDeviceBackend &getBackendInstance();
+};
@@ -28,9 +28,9 @@
 
 #include <iostream>
 #include <string.h>
-#include <map>
 #include <stdint.h>
 #include "NvElementProfiler.h"
+#include "NvLatencyRecorder.h"
 
 #define LOCK() pthread_mutex_lock(&profiler_lock)
 #define UNLOCK() pthread_mutex_unlock(&profiler_lock)
@@ -41,11 +41,11 @@
         return; \
     }
 
-#define GET_TIME(timeval) gettimeofday(timeval, NULL);
-
-#define TIMESPEC_DIFF_USEC(timespec1, timespec2) \
-    (((timespec1)->tv_sec - (timespec2)->tv_sec) * 1000000L + \
-        (timespec1)->tv_usec - (timespec2)->tv_usec)
+/* The units are timed by a lock-free recorder, the lock only guards
+ * enabling and disabling profiling. unit_id_counter holds the index of the
+ * recorder, set once when profiling is first enabled. */
+#define GET_RECORDER() \
+    NvLatencyRecorder::get(__atomic_load_n(&unit_id_counter, __ATOMIC_ACQUIRE))
 
 using namespace std;
 
@@ -55,21 +55,22 @@ NvElementProfiler::NvElementProfiler(ProfilerField fields)
     enabled = false;
     unit_id_counter = 0;
 
-    reset();
-
     pthread_mutex_init(&profiler_lock, NULL);
 }
 
 NvElementProfiler::~NvElementProfiler()
 {
     LOCK();
-    reset();
+    NvLatencyRecorder::release(unit_id_counter);
+    unit_id_counter = 0;
     UNLOCK();
     pthread_mutex_destroy(&profiler_lock);
 }
 void
 NvElementProfiler::enableProfiling(bool reset_data)
 {
+    NvLatencyRecorder *recorder;
+
     LOCK();
     if (enabled)
     {
@@ -77,11 +78,26 @@ NvElementProfiler::enableProfiling(bool reset_data)
         return;
     }
 
+    if (!unit_id_counter)
+    {
+        // Profiling stays disabled if too many elements are profiled, which
+        // the stats of the element report
+        uint32_t index = NvLatencyRecorder::acquire(this);
+        if (!index)
+        {
+            UNLOCK();
+            return;
+        }
+        __atomic_store_n(&unit_id_counter, index, __ATOMIC_RELEASE);
+    }
+
+    recorder = NvLatencyRecorder::get(unit_id_counter);
     if(reset_data)
     {
-        reset();
+        recorder->reset();
     }
 
+    recorder->enabled = true;
     enabled = true;
     UNLOCK();
 }
@@ -92,76 +108,50 @@ NvElementProfiler::disableProfiling()
     LOCK();
     RETURN_IF_DISABLED();
 
-    data_int.accumulated_time.tv_sec +=
-        (data_int.stop_time.tv_sec - data_int.start_time.tv_sec);
-    data_int.accumulated_time.tv_usec +=
-        (data_int.stop_time.tv_usec - data_int.start_time.tv_usec);
-    data_int.start_time.tv_sec = 0;
-    data_int.start_time.tv_usec = 0;
-    data_int.stop_time.tv_sec = 0;
-    data_int.stop_time.tv_usec = 0;
+    NvLatencyRecorder *recorder = NvLatencyRecorder::get(unit_id_counter);
+    recorder->enabled = false;
+    recorder->pause();
     enabled = false;
     UNLOCK();
 }
 
 void NvElementProfiler::getProfilerData(NvElementProfiler::NvElementProfilerData &data)
 {
-    uint64_t total_time;
-
-    LOCK();
+    NvLatencyRecorder *recorder = GET_RECORDER();
+    uint64_t total_units = 0;
+    uint64_t total_time = 0;
 
-    total_time = data_int.accumulated_time.tv_sec * 1000000L +
-        data_int.accumulated_time.tv_usec +
-        TIMESPEC_DIFF_USEC(&data_int.stop_time, &data_int.start_time);
-
-    if (data_int.total_processed_units == 0 || total_time == 0)
-    {
-        data.average_fps = 0;
-    }
-    else
+    memset(&data, 0, sizeof(data));
+    data.valid_fields = valid_fields;
+    if (!recorder)
     {
-        data.average_fps = ((float) (data_int.total_processed_units - 1)) *
-            1000000 / total_time;
+        return;
     }
 
-    if (data_int.total_processed_units == 0)
+    total_units = recorder->total_units.load(memory_order_acquire);
+    total_time = (recorder->accumulated_time + recorder->stop_time -
+        recorder->start_time) / 1000;
+
+    if (total_units == 0 || total_time == 0)
     {
-        data.max_latency_usec = 0;
-        data.min_latency_usec = 0;
-        data.average_latency_usec = 0;
+        data.average_fps = 0;
     }
     else
     {
-        data.max_latency_usec = data_int.max_latency_usec;
-        data.min_latency_usec = data_int.min_latency_usec;
-        data.average_latency_usec =
-            data_int.total_latency / data_int.total_processed_units;
+        data.average_fps = ((float) (total_units - 1)) * 1000000 / total_time;
     }
 
-    data.profiling_time.tv_sec =
-        data_int.accumulated_time.tv_sec + data_int.stop_time.tv_sec -
-                data_int.start_time.tv_sec;
-
-    data.profiling_time.tv_usec =
-        data_int.accumulated_time.tv_usec + data_int.stop_time.tv_usec -
-                data_int.start_time.tv_usec;
-
-    if (data.profiling_time.tv_usec < 0)
+    if (total_units != 0)
     {
-        data.profiling_time.tv_usec += 1000000;
-        data.profiling_time.tv_sec--;
+        data.max_latency_usec = recorder->max_latency_usec;
+        data.min_latency_usec = recorder->min_latency_usec;
+        data.average_latency_usec = recorder->total_latency_usec / total_units;
     }
 
-    if (data.profiling_time.tv_usec > 1000000)
-    {
-        data.profiling_time.tv_usec -= 1000000;
-        data.profiling_time.tv_sec++;
-    }
-
-    data.total_processed_units = data_int.total_processed_units;
-    data.num_late_units = data_int.num_late_units;
-    data.valid_fields = valid_fields;
-    UNLOCK();
+    data.profiling_time.tv_sec = total_time / 1000000;
+    data.profiling_time.tv_usec = total_time % 1000000;
+    data.total_processed_units = total_units;
+    data.num_late_units = recorder->late_units;
 }
 
 void NvElementProfiler::printProfilerData(ostream &out_stream)
@@ -188,111 +178,71 @@ void NvElementProfiler::printProfilerData(ostream &out_stream)
     }
     if (data.valid_fields & PROFILER_FIELD_LATENCIES)
     {
+        NvLatencyRecorder *recorder = GET_RECORDER();
+
         out_stream << "Average latency(usec) = " <<
             data.average_latency_usec << endl;
         out_stream << "Minimum latency(usec) = " <<
             data.min_latency_usec << endl;
         out_stream << "Maximum latency(usec) = " <<
             data.max_latency_usec << endl;
+        if (recorder)
+        {
+            out_stream << "P50/P99/P99.9 latency(usec) = " <<
+                recorder->percentile(0.5) << "/" << recorder->percentile(0.99) <<
+                "/" << recorder->percentile(0.999) << endl;
+        }
     }
 }
 
 void
 NvElementProfiler::reset()
 {
-    memset(&data_int, 0, sizeof(data_int));
-    data_int.min_latency_usec = (uint64_t) -1;
+    NvLatencyRecorder *recorder = GET_RECORDER();
 
-    unit_start_time_queue.clear();
+    if (recorder)
+    {
+        recorder->reset();
+    }
 }
 
 uint64_t
 NvElementProfiler::startProcessing()
 {
-    struct timeval time;
-    uint64_t ret = 0;
-    LOCK();
-    if (enabled)
-    {
-        std::map<uint64_t,struct timeval>::iterator it =
-            unit_start_time_queue.end();
-
-        unit_id_counter++;
-        GET_TIME(&time);
-
-        unit_start_time_queue.insert(it,
-                std::pair<uint64_t,struct timeval>(unit_id_counter, time));
+    NvLatencyRecorder *recorder = GET_RECORDER();
 
-        ret = unit_id_counter;
+    if (!recorder || !recorder->enabled.load(memory_order_relaxed))
+    {
+        return 0;
     }
-    UNLOCK();
-    return ret;
+    return recorder->start();
 }
 
+/* The id is the key the unit was started with, see
+ * NvLatencyRecorder::setStartKey. */
 void
 NvElementProfiler::finishProcessing(uint64_t id, bool is_late)
 {
-    struct timeval unit_start_time;
-    struct timeval stop_time;
-    uint64_t latency;
+    NvLatencyRecorder *recorder = GET_RECORDER();
+    uint64_t unit_start_time = 0;
+    uint64_t stop_time;
+    bool has_latency = valid_fields & PROFILER_FIELD_LATENCIES;
 
-    LOCK();
-    RETURN_IF_DISABLED();
-
-    if ((valid_fields & PROFILER_FIELD_LATENCIES) &&
-            unit_start_time_queue.empty())
+    if (!recorder || !recorder->enabled.load(memory_order_relaxed))
     {
-        UNLOCK();
         return;
     }
 
-    GET_TIME(&stop_time);
-
-    if (valid_fields & PROFILER_FIELD_LATENCIES)
-    {
-        std::map<uint64_t, struct timeval>::iterator it;
-        if (id)
-        {
-            it = unit_start_time_queue.find(id);
-        }
-        else
-        {
-            it = unit_start_time_queue.begin();
-        }
-
-        if (it == unit_start_time_queue.end())
-        {
-            UNLOCK();
-            return;
-        }
-        unit_start_time = it->second;
-        unit_start_time_queue.erase(it);
-
-        latency = TIMESPEC_DIFF_USEC(&stop_time, &unit_start_time);
-        data_int.total_latency += latency;
-
-        if (latency < data_int.min_latency_usec)
-        {
-            data_int.min_latency_usec = latency;
-        }
-        if(latency > data_int.max_latency_usec)
-        {
-            data_int.max_latency_usec = latency;
-        }
-    }
-
-    data_int.stop_time = stop_time;
-
-    if (!data_int.start_time.tv_sec && !data_int.start_time.tv_usec)
+    if (has_latency && !recorder->finish(id, unit_start_time))
     {
-        data_int.start_time = data_int.stop_time;
+        return;
     }
-
-    if (is_late)
+    // Not timed, or started while too many units were in flight
+    if (unit_start_time == 0)
     {
-        data_int.num_late_units++;
+        has_latency = false;
     }
-    data_int.total_processed_units++;
 
-    UNLOCK();
+    stop_time = NvLatencyRecorder::now();
+    recorder->record((stop_time - unit_start_time) / 1000, stop_time, is_late, has_latency);
 }
@@ -0,0 +1,268 @@
+#include "NvLatencyRecorder.h"
+#include "NvElement.h"
+
+#include <cmath>
+#include <time.h>
+
+using namespace std;
+
+// Recorders are allocated with the first owner of their slot and never
+// freed, so they can be read while being released by another thread. A
+// slot is claimed by setting its owner.
+static atomic<NvLatencyRecorder *> recorders[NvLatencyRecorder::MaxRecorders];
+static atomic<const NvElementProfiler *> owners[NvLatencyRecorder::MaxRecorders];
+static thread_local uint64_t start_key = 0;
+
+// The profiler is a protected member of NvElement
+struct NvElementProfilerAccess : NvElement
+{
+    static const NvElementProfiler *of(NvElement &element)
+    {
+        return &(element.*(&NvElementProfilerAccess::profiler));
+    }
+};
+
+uint32_t
+NvLatencyRecorder::acquire(const NvElementProfiler *owner)
+{
+    for (uint32_t i = 0; i < MaxRecorders; i++)
+    {
+        const NvElementProfiler *expected = NULL;
+        if (!owners[i].compare_exchange_strong(expected, owner))
+            continue;
+
+        NvLatencyRecorder *recorder = recorders[i].load(memory_order_acquire);
+        if (!recorder)
+        {
+            recorder = new NvLatencyRecorder();
+            recorder->head = 0;
+        }
+
+        recorder->owner = owner;
+        recorder->enabled = false;
+        recorder->reset();
+        recorders[i].store(recorder, memory_order_release);
+        return i + 1;
+    }
+    return 0;
+}
+
+void
+NvLatencyRecorder::release(uint32_t index)
+{
+    if (index == 0 || index > MaxRecorders)
+        return;
+
+    recorders[index - 1].load()->enabled = false;
+    owners[index - 1].store(NULL, memory_order_release);
+}
+
+NvLatencyRecorder *
+NvLatencyRecorder::get(uint32_t index)
+{
+    if (index == 0 || index > MaxRecorders)
+        return NULL;
+    return recorders[index - 1].load(memory_order_acquire);
+}
+
+bool
+NvLatencyRecorder::getLatencyPercentiles(NvElement &element, NvLatencyPercentiles &percentiles)
+{
+    const NvElementProfiler *profiler = NvElementProfilerAccess::of(element);
+
+    for (uint32_t i = 0; i < MaxRecorders; i++)
+    {
+        if (owners[i].load(memory_order_acquire) != profiler)
+            continue;
+
+        NvLatencyRecorder *recorder = recorders[i].load(memory_order_acquire);
+        if (!recorder)
+            return false;
+
+        percentiles.p50_usec = recorder->percentile(0.5);
+        percentiles.p99_usec = recorder->percentile(0.99);
+        percentiles.p999_usec = recorder->percentile(0.999);
+
+        // The slot may have been released and claimed again meanwhile
+        return owners[i].load(memory_order_acquire) == profiler;
+    }
+    return false;
+}
+
+uint64_t
+NvLatencyRecorder::now()
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+void
+NvLatencyRecorder::setStartKey(uint64_t key)
+{
+    start_key = key;
+}
+
+void
+NvLatencyRecorder::reset()
+{
+    total_units = 0;
+    late_units = 0;
+    total_latency_usec = 0;
+    min_latency_usec = UINT64_MAX;
+    max_latency_usec = 0;
+    start_time = 0;
+    stop_time = 0;
+    accumulated_time = 0;
+    tail = head.load();
+
+    for (auto &bucket : histogram)
+        bucket = 0;
+}
+
+uint64_t
+NvLatencyRecorder::start()
+{
+    uint64_t h = head.load(memory_order_relaxed);
+
+    // The unit isn't timed if too many are in flight, its slot still holds
+    // the sequence of an older unit
+    if (h - tail.load(memory_order_acquire) < InFlightUnits)
+    {
+        in_flight[h % InFlightUnits].store(now(), memory_order_relaxed);
+        in_flight_key[h % InFlightUnits].store(start_key, memory_order_relaxed);
+        in_flight_seq[h % InFlightUnits].store(h + 1, memory_order_relaxed);
+    }
+    head.store(h + 1, memory_order_release);
+    return h + 1;
+}
+
+bool
+NvLatencyRecorder::finish(uint64_t key, uint64_t &unit_start_time)
+{
+    uint64_t t = tail.load(memory_order_relaxed);
+    uint64_t h = head.load(memory_order_acquire);
+
+    if (t == h)
+        return false;
+
+    // The slots up to the head aren't written by start until the tail
+    // passes them. Units that weren't timed hold the sequence of an older
+    // unit, finished ones a sequence of 0.
+    unit_start_time = 0;
+    for (uint64_t seq = t; seq < h; seq++)
+    {
+        uint32_t slot = seq % InFlightUnits;
+        if (in_flight_seq[slot].load(memory_order_relaxed) == seq + 1 &&
+                in_flight_key[slot].load(memory_order_relaxed) == key)
+        {
+            unit_start_time = in_flight[slot].load(memory_order_relaxed);
+            break;
+        }
+    }
+    if (unit_start_time == 0)
+        return true;
+
+    // Frames come out in presentation order, the units with an earlier key
+    // were consumed without a frame
+    for (uint64_t seq = t; seq < h; seq++)
+    {
+        uint32_t slot = seq % InFlightUnits;
+        if (in_flight_seq[slot].load(memory_order_relaxed) == seq + 1 &&
+                (int64_t) in_flight_key[slot].load(memory_order_relaxed) <= (int64_t) key)
+            in_flight_seq[slot].store(0, memory_order_relaxed);
+    }
+    while (t < h && in_flight_seq[t % InFlightUnits].load(memory_order_relaxed) != t + 1)
+        t++;
+    tail.store(t, memory_order_release);
+    return true;
+}
+
+void
+NvLatencyRecorder::record(uint64_t latency_usec, uint64_t time, bool is_late, bool has_latency)
+{
+    if (has_latency)
+    {
+        std::atomic<uint64_t> &bucket = histogram[bucketIndex(latency_usec)];
+
+        bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        total_latency_usec.store(total_latency_usec.load(memory_order_relaxed) + latency_usec,
+                memory_order_relaxed);
+        if (latency_usec < min_latency_usec.load(memory_order_relaxed))
+            min_latency_usec.store(latency_usec, memory_order_relaxed);
+        if (latency_usec > max_latency_usec.load(memory_order_relaxed))
+            max_latency_usec.store(latency_usec, memory_order_relaxed);
+    }
+
+    stop_time.store(time, memory_order_relaxed);
+    if (start_time.load(memory_order_relaxed) == 0)
+        start_time.store(time, memory_order_relaxed);
+
+    if (is_late)
+        late_units.store(late_units.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    total_units.store(total_units.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+void
+NvLatencyRecorder::pause()
+{
+    uint64_t start = start_time.exchange(0);
+    uint64_t stop = stop_time.exchange(0);
+
+    if (start)
+        accumulated_time += stop - start;
+}
+
+uint64_t
+NvLatencyRecorder::percentile(double quantile)
+{
+    uint64_t counts[Buckets];
+    uint64_t total = 0;
+
+    for (uint32_t i = 0; i < Buckets; i++)
+    {
+        counts[i] = histogram[i].load(memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0)
+        return 0;
+
+    uint64_t target = max<uint64_t>(1, (uint64_t) ceil(quantile * total));
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < Buckets; i++)
+    {
+        seen += counts[i];
+        if (seen >= target)
+            return bucketUpperBound(i);
+    }
+    return bucketUpperBound(Buckets - 1);
+}
+
+/* Values below 16 have a bucket each, the others are bucketed by their
+ * most significant bit and the 4 bits following it. */
+uint32_t
+NvLatencyRecorder::bucketIndex(uint64_t value)
+{
+    const uint64_t sub_buckets = 1 << SubBucketBits;
+
+    if (value < sub_buckets)
+        return value;
+
+    uint32_t msb = 63 - __builtin_clzll(value);
+    uint32_t sub_bucket = (value >> (msb - SubBucketBits)) & (sub_buckets - 1);
+    return ((msb - SubBucketBits + 1) << SubBucketBits) | sub_bucket;
+}
+
+uint64_t
+NvLatencyRecorder::bucketUpperBound(uint32_t index)
+{
+    const uint64_t sub_buckets = 1 << SubBucketBits;
+
+    if (index < sub_buckets)
+        return index;
+
+    uint32_t shift = (index >> SubBucketBits) - 1;
+    uint64_t lower = (sub_buckets + (index & (sub_buckets - 1))) << shift;
+    return lower + ((1ULL << shift) - 1);
+}
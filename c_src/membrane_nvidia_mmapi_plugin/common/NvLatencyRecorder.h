@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+class NvElement;
+class NvElementProfiler;
+
+/**
+ * Latency percentiles of the units processed by an element, reported at
+ * the upper bound of their histogram bucket.
+ */
+struct NvLatencyPercentiles
+{
+    uint64_t p50_usec;
+    uint64_t p99_usec;
+    uint64_t p999_usec;
+};
+
+/**
+ * Lock-free recorder backing NvElementProfiler.
+ *
+ * The start times of the units in flight are kept in a ring, written by
+ * the thread queueing units and read by the thread dequeueing them. A unit
+ * finishing is matched to its start by key, the V4L2 timestamp the device
+ * copies from the output buffer to the capture one. As frames come out in
+ * presentation order, the units with an earlier key are dropped with the
+ * matched one: they were consumed without a frame, like skipped access
+ * units or second fields.
+ * Every counter has a single writer, the dequeueing thread, so
+ * it's updated with plain atomic stores. Latencies are counted in a
+ * log-linear histogram with 16 buckets per power of two of microseconds,
+ * so percentiles are within 1/16 of their value. Times come from the
+ * monotonic clock.
+ *
+ * The declaration of NvElementProfiler comes from the Jetson headers, so a
+ * profiler refers to its recorder by an index into a fixed table instead
+ * of holding it. Released recorders are kept for the next profiler.
+ */
+class NvLatencyRecorder
+{
+public:
+    static const uint32_t MaxRecorders = 256;
+    static const uint32_t InFlightUnits = 64;
+    static const uint32_t SubBucketBits = 4;
+    static const uint32_t Buckets = (64 - SubBucketBits + 1) << SubBucketBits;
+
+    /**
+     * Claims a recorder for the profiler, returns its index or 0 if they
+     * are all in use.
+     */
+    static uint32_t acquire(const NvElementProfiler *owner);
+    static void release(uint32_t index);
+    static NvLatencyRecorder *get(uint32_t index);
+
+    /**
+     * Percentiles of the latencies recorded by the profiler of the element,
+     * returns false if it isn't profiled.
+     */
+    static bool getLatencyPercentiles(NvElement &element, NvLatencyPercentiles &percentiles);
+
+    static uint64_t now();
+    /**
+     * Sets the key of the units started next on the calling thread, the
+     * startProcessing method of NvElementProfiler has no parameter for it.
+     */
+    static void setStartKey(uint64_t key);
+
+    void reset();
+    uint64_t start();
+    /**
+     * Pops the oldest unit in flight with the key and the units with an
+     * earlier key, returns false if no unit is in flight. The start time is
+     * 0 if no unit with the key was timed, nothing is popped then.
+     */
+    bool finish(uint64_t key, uint64_t &start_time);
+    void record(uint64_t latency_usec, uint64_t stop_time, bool is_late, bool has_latency);
+    /** Adds the time since the first unit finished to the accumulated time. */
+    void pause();
+    uint64_t percentile(double quantile);
+
+    std::atomic<bool> enabled;
+    std::atomic<uint64_t> total_units;
+    std::atomic<uint64_t> late_units;
+    std::atomic<uint64_t> total_latency_usec;
+    std::atomic<uint64_t> min_latency_usec;
+    std::atomic<uint64_t> max_latency_usec;
+    /** First and last finish times in nanoseconds, 0 before the first one. */
+    std::atomic<uint64_t> start_time;
+    std::atomic<uint64_t> stop_time;
+    std::atomic<uint64_t> accumulated_time;
+
+private:
+    const NvElementProfiler *owner;
+    std::atomic<uint64_t> in_flight[InFlightUnits];
+    std::atomic<uint64_t> in_flight_key[InFlightUnits];
+    /** Sequence of the unit timed in each slot, from 1, or 0 once finished. */
+    std::atomic<uint64_t> in_flight_seq[InFlightUnits];
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> histogram[Buckets];
+
+    static uint32_t bucketIndex(uint64_t value);
+    static uint64_t bucketUpperBound(uint32_t index);
+};
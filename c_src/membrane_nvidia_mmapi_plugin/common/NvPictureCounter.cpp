@@ -0,0 +1,290 @@
+#include "NvPictureCounter.h"
+#include "v4l2_nv_extensions.h"
+
+#include <linux/videodev2.h>
+
+/* Reads the RBSP of a NAL unit, skipping the emulation prevention bytes.
+ * Reading past the end sets `failed`. */
+class RbspReader
+{
+public:
+    RbspReader(const uint8_t *data, size_t size) : m_data(data), m_size(size) {}
+
+    bool failed = false;
+
+    uint32_t
+    bit()
+    {
+        if (m_bit == 0)
+        {
+            if (m_zeros >= 2 && m_pos < m_size && m_data[m_pos] == 3)
+            {
+                m_pos++;
+                m_zeros = 0;
+            }
+            if (m_pos >= m_size)
+            {
+                failed = true;
+                return 0;
+            }
+            m_zeros = m_data[m_pos] == 0 ? m_zeros + 1 : 0;
+        }
+
+        uint32_t value = (m_data[m_pos] >> (7 - m_bit)) & 1;
+        if (++m_bit == 8)
+        {
+            m_bit = 0;
+            m_pos++;
+        }
+        return value;
+    }
+
+    uint32_t
+    bits(uint32_t count)
+    {
+        uint32_t value = 0;
+        for (uint32_t i = 0; i < count; i++)
+            value = (value << 1) | bit();
+        return value;
+    }
+
+    /* Exp-Golomb code, values past 32 bits fail the read */
+    uint32_t
+    ue()
+    {
+        uint32_t zeros = 0;
+        while (!failed && bit() == 0)
+        {
+            if (++zeros == 32)
+            {
+                failed = true;
+                return 0;
+            }
+        }
+        return (1u << zeros) - 1 + bits(zeros);
+    }
+
+    int32_t
+    se()
+    {
+        uint32_t value = ue();
+        return value & 1 ? (int32_t) ((value + 1) / 2) : -(int32_t) (value / 2);
+    }
+
+private:
+    const uint8_t *m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+    uint32_t m_bit = 0;
+    uint32_t m_zeros = 0;
+};
+
+NvPictureCounter::NvPictureCounter()
+{
+    for (uint32_t i = 0; i < MaxSps; i++)
+        m_sps[i].valid = false;
+    for (uint32_t i = 0; i < MaxPps; i++)
+        m_ppsSps[i] = -1;
+}
+
+int
+NvPictureCounter::count(uint32_t pixfmt, const uint8_t *data, size_t size)
+{
+    if (size == 0)
+        return 0;
+    if (pixfmt != V4L2_PIX_FMT_H264 && pixfmt != V4L2_PIX_FMT_H265)
+        return 1;
+
+    int pictures = 0;
+    bool slices = false;
+    bool first_slices = false;
+    bool nal_units = false;
+
+    for (size_t i = 0; i + 3 < size; i++)
+    {
+        if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1)
+            continue;
+
+        /* The NAL unit ends at the next start code */
+        size_t start = i + 3;
+        size_t end = start;
+        while (end + 2 < size && (data[end] != 0 || data[end + 1] != 0 || data[end + 2] != 1))
+            end++;
+        if (end + 2 >= size)
+            end = size;
+        const uint8_t *nal = data + start;
+        size_t nal_size = end - start;
+        i = end - 1;
+        if (nal_size == 0)
+            continue;
+        nal_units = true;
+
+        if (pixfmt == V4L2_PIX_FMT_H264)
+        {
+            uint8_t type = nal[0] & 0x1f;
+            if (type == 7)
+                parseSps(nal + 1, nal_size - 1);
+            else if (type == 8)
+                parsePps(nal + 1, nal_size - 1);
+            else if (type >= 1 && type <= 5)
+            {
+                bool first = false;
+                slices = true;
+                pictures += countH264Slice(nal + 1, nal_size - 1, type == 5, first);
+                first_slices |= first;
+            }
+        }
+        else
+        {
+            uint8_t type = (nal[0] >> 1) & 0x3f;
+            uint8_t layer = nal_size > 1 ? ((nal[0] & 1) << 5) | (nal[1] >> 3) : 0;
+            if (type < 32 && layer == 0)
+            {
+                slices = true;
+                /* first_slice_segment_in_pic_flag */
+                if (nal_size > 2 && (nal[2] & 0x80))
+                {
+                    first_slices = true;
+                    pictures++;
+                }
+            }
+        }
+    }
+
+    /* Like the hardware decoder, data without any start code is decoded
+     * as a picture */
+    if (!nal_units || (slices && !first_slices))
+        return 1;
+    return pictures;
+}
+
+void
+NvPictureCounter::parseSps(const uint8_t *data, size_t size)
+{
+    RbspReader reader(data, size);
+    uint32_t profile_idc = reader.bits(8);
+    reader.bits(16);
+    uint32_t id = reader.ue();
+    if (reader.failed || id >= MaxSps)
+        return;
+
+    Sps sps = {};
+    if (profile_idc == 100 || profile_idc == 110 || profile_idc == 122 || profile_idc == 244 ||
+            profile_idc == 44 || profile_idc == 83 || profile_idc == 86 || profile_idc == 118 ||
+            profile_idc == 128 || profile_idc == 138 || profile_idc == 139 ||
+            profile_idc == 134 || profile_idc == 135)
+    {
+        uint32_t chroma_format_idc = reader.ue();
+        if (chroma_format_idc == 3)
+            sps.separate_colour_plane = reader.bit();
+        reader.ue();
+        reader.ue();
+        reader.bit();
+        if (reader.bit())
+        {
+            /* Scaling lists, only skipped */
+            for (uint32_t list = 0; list < (chroma_format_idc == 3 ? 12u : 8u); list++)
+            {
+                if (!reader.bit())
+                    continue;
+
+                int32_t last = 8, next = 8;
+                for (uint32_t j = 0; j < (list < 6 ? 16u : 64u) && !reader.failed; j++)
+                {
+                    if (next != 0)
+                        next = (last + reader.se() + 256) % 256;
+                    last = next == 0 ? last : next;
+                }
+            }
+        }
+    }
+
+    sps.log2_max_frame_num = reader.ue() + 4;
+    uint32_t pic_order_cnt_type = reader.ue();
+    if (pic_order_cnt_type == 0)
+        reader.ue();
+    else if (pic_order_cnt_type == 1)
+    {
+        reader.bit();
+        reader.se();
+        reader.se();
+        uint32_t cycle = reader.ue();
+        for (uint32_t j = 0; j < cycle && !reader.failed; j++)
+            reader.se();
+    }
+    reader.ue();
+    reader.bit();
+    reader.ue();
+    reader.ue();
+    sps.frame_mbs_only = reader.bit();
+
+    if (reader.failed || sps.log2_max_frame_num > 16)
+        return;
+    sps.valid = true;
+    m_sps[id] = sps;
+}
+
+void
+NvPictureCounter::parsePps(const uint8_t *data, size_t size)
+{
+    RbspReader reader(data, size);
+    uint32_t id = reader.ue();
+    uint32_t sps_id = reader.ue();
+    if (reader.failed || id >= MaxPps || sps_id >= MaxSps)
+        return;
+    m_ppsSps[id] = sps_id;
+}
+
+/* Returns the frames the slice starts, sets `first` if it's the first
+ * slice of a picture. */
+int
+NvPictureCounter::countH264Slice(const uint8_t *data, size_t size, bool idr, bool &first)
+{
+    RbspReader reader(data, size);
+    uint32_t first_mb_in_slice = reader.ue();
+    reader.ue();
+    uint32_t pps_id = reader.ue();
+    if (reader.failed || first_mb_in_slice != 0)
+        return 0;
+
+    first = true;
+    if (pps_id >= MaxPps || m_ppsSps[pps_id] < 0 || !m_sps[m_ppsSps[pps_id]].valid)
+    {
+        /* Without its parameter sets, the slice is taken as a frame */
+        m_fieldPending = false;
+        return 1;
+    }
+
+    Sps &sps = m_sps[m_ppsSps[pps_id]];
+    if (sps.separate_colour_plane)
+        reader.bits(2);
+    uint32_t frame_num = reader.bits(sps.log2_max_frame_num);
+    bool field = !sps.frame_mbs_only && reader.bit();
+    bool bottom = field && reader.bit();
+    if (reader.failed)
+    {
+        m_fieldPending = false;
+        return 1;
+    }
+
+    if (!field)
+    {
+        m_fieldPending = false;
+        return 1;
+    }
+
+    /* The second field of a pair has the opposite parity and the same frame
+     * number, an IDR field only pairs with an IDR field */
+    if (m_fieldPending && (!idr || m_fieldIdr) && bottom != m_fieldBottom &&
+            frame_num == m_fieldFrameNum)
+    {
+        m_fieldPending = false;
+        return 0;
+    }
+
+    m_fieldPending = true;
+    m_fieldBottom = bottom;
+    m_fieldIdr = idr;
+    m_fieldFrameNum = frame_num;
+    return 1;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Counts the frames a decoder outputs for the access units of a stream,
+ * from their slice headers.
+ *
+ * A H265 picture starts with the slice segment flagged as the first one
+ * of the picture. A H264 picture starts with the slice of its first
+ * macroblock, and the second field of a complementary field pair completes
+ * the frame of the first field instead of starting one. An access unit
+ * holding slices but no start of a picture, which arbitrary slice order
+ * allows, is taken as one picture. Other formats hold one picture per
+ * non-empty access unit.
+ *
+ * The H264 parameter sets are parsed as they come for the size of the
+ * frame number and whether pictures may be fields.
+ */
+class NvPictureCounter
+{
+public:
+    NvPictureCounter();
+
+    int count(uint32_t pixfmt, const uint8_t *data, size_t size);
+
+private:
+    struct Sps
+    {
+        bool valid;
+        bool separate_colour_plane;
+        uint32_t log2_max_frame_num;
+        bool frame_mbs_only;
+    };
+
+    static const uint32_t MaxSps = 32;
+    static const uint32_t MaxPps = 256;
+
+    Sps m_sps[MaxSps];
+    int m_ppsSps[MaxPps];
+    // First field of the last picture, while its pair may still follow
+    bool m_fieldPending = false;
+    bool m_fieldBottom = false;
+    bool m_fieldIdr = false;
+    uint32_t m_fieldFrameNum = 0;
+
+    void parseSps(const uint8_t *data, size_t size);
+    void parsePps(const uint8_t *data, size_t size);
+    int countH264Slice(const uint8_t *data, size_t size, bool idr, bool &first);
+};
@@ -0,0 +1,282 @@
+#include "NvResourceSampler.h"
+#include "NvApplicationProfiler.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+atomic<int64_t> NvResourceSampler::dma_buffer_bytes(0);
+mutex NvResourceSampler::dma_lock;
+NvResourceSampler::DmaChange NvResourceSampler::dma_changes[MaxDmaChanges];
+uint32_t NvResourceSampler::next_dma_change = 0;
+uint32_t NvResourceSampler::num_dma_changes = 0;
+
+static uint64_t
+timespecToUsec(const struct timespec &time)
+{
+    return time.tv_sec * 1000000ULL + time.tv_nsec / 1000;
+}
+
+static bool
+readFile(const char *path, char *buffer, size_t size)
+{
+    FILE *file = fopen(path, "re");
+    if (!file)
+        return false;
+
+    size_t length = fread(buffer, 1, size - 1, file);
+    fclose(file);
+    buffer[length] = 0;
+    return length > 0;
+}
+
+/* The scheduler statistics start with the time spent on the CPU in
+ * nanoseconds, otherwise the user and system times of stat are counted in
+ * clock ticks. */
+static bool
+readThreadCpuTime(pid_t tid, uint64_t &cpu_time_usec)
+{
+    char path[64];
+    char buffer[512];
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", tid);
+    if (readFile(path, buffer, sizeof(buffer)))
+    {
+        cpu_time_usec = strtoull(buffer, NULL, 10) / 1000;
+        return true;
+    }
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+    if (!readFile(path, buffer, sizeof(buffer)))
+        return false;
+
+    // The name may contain spaces, the fields following it start with the state
+    char *fields = strrchr(buffer, ')');
+    unsigned long long utime, stime;
+    if (!fields ||
+            sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                &utime, &stime) != 2)
+        return false;
+
+    cpu_time_usec = (utime + stime) * 1000000ULL / sysconf(_SC_CLK_TCK);
+    return true;
+}
+
+static void
+readThreadName(pid_t tid, char *name, size_t size)
+{
+    char path[64];
+    char buffer[32];
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
+    if (!readFile(path, buffer, sizeof(buffer)))
+        buffer[0] = 0;
+
+    buffer[strcspn(buffer, "\n")] = 0;
+    strncpy(name, buffer, size - 1);
+    name[size - 1] = 0;
+}
+
+static uint64_t
+readRss()
+{
+    char buffer[128];
+    unsigned long long size, resident;
+
+    if (!readFile("/proc/self/statm", buffer, sizeof(buffer)) ||
+            sscanf(buffer, "%llu %llu", &size, &resident) != 2)
+        return 0;
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+NvResourceSampler::NvResourceSampler()
+{
+    sampling = false;
+    clear();
+}
+
+NvResourceSampler &
+NvResourceSampler::getInstance()
+{
+    static NvResourceSampler sampler;
+    return sampler;
+}
+
+void
+NvResourceSampler::start(uint32_t interval_ms)
+{
+    lock_guard<mutex> guard(control_lock);
+
+    if (sampling)
+        NvApplicationProfiler::getProfilerInstance().stop();
+
+    clear();
+    NvApplicationProfiler::getProfilerInstance().start(interval_ms);
+    sampling = true;
+}
+
+void
+NvResourceSampler::stop()
+{
+    lock_guard<mutex> guard(control_lock);
+
+    if (!sampling)
+        return;
+
+    NvApplicationProfiler::getProfilerInstance().stop();
+    sampling = false;
+}
+
+void
+NvResourceSampler::clear()
+{
+    lock_guard<mutex> guard(lock);
+
+    next_sample = 0;
+    num_samples = 0;
+    last_timestamp_usec = 0;
+    last_cpu_time_usec = 0;
+    last_threads.clear();
+}
+
+void
+NvResourceSampler::sample()
+{
+    struct timespec now, cpu_time;
+    vector<NvThreadSample> threads;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_time);
+
+    DIR *tasks = opendir("/proc/self/task");
+    if (tasks)
+    {
+        struct dirent *entry;
+        while ((entry = readdir(tasks)) != NULL)
+        {
+            NvThreadSample thread = {};
+
+            thread.tid = atoi(entry->d_name);
+            if (thread.tid <= 0 || !readThreadCpuTime(thread.tid, thread.cpu_time_usec))
+                continue;
+
+            readThreadName(thread.tid, thread.name, sizeof(thread.name));
+            threads.push_back(thread);
+        }
+        closedir(tasks);
+    }
+
+    sort(threads.begin(), threads.end(),
+            [](const NvThreadSample &a, const NvThreadSample &b) { return a.tid < b.tid; });
+
+    lock_guard<mutex> guard(lock);
+
+    // The first sample is the reference of the following one
+    if (last_timestamp_usec == 0)
+    {
+        last_timestamp_usec = timespecToUsec(now);
+        last_cpu_time_usec = timespecToUsec(cpu_time);
+        last_threads = threads;
+        return;
+    }
+
+    NvResourceSample &sample = samples[next_sample];
+
+    sample.timestamp_usec = timespecToUsec(now);
+    sample.interval_usec = sample.timestamp_usec - last_timestamp_usec;
+    sample.cpu_time_usec = timespecToUsec(cpu_time) - last_cpu_time_usec;
+    sample.rss_bytes = readRss();
+    sample.dma_buffer_bytes = max<int64_t>(0, dma_buffer_bytes.load(memory_order_relaxed));
+
+    // Both lists are sorted by thread id, the threads started during the
+    // interval are counted from their start
+    vector<NvThreadSample> usage;
+    auto last = last_threads.begin();
+    for (const NvThreadSample &thread : threads)
+    {
+        while (last != last_threads.end() && last->tid < thread.tid)
+            last++;
+
+        NvThreadSample delta = thread;
+        if (last != last_threads.end() && last->tid == thread.tid &&
+                last->cpu_time_usec <= thread.cpu_time_usec)
+            delta.cpu_time_usec -= last->cpu_time_usec;
+        usage.push_back(delta);
+    }
+
+    // Only the busiest threads are kept when there are too many
+    stable_sort(usage.begin(), usage.end(),
+            [](const NvThreadSample &a, const NvThreadSample &b) {
+                return a.cpu_time_usec > b.cpu_time_usec;
+            });
+    sample.num_threads = min<size_t>(usage.size(), MaxThreads);
+    copy(usage.begin(), usage.begin() + sample.num_threads, sample.threads);
+
+    next_sample = (next_sample + 1) % MaxSamples;
+    if (num_samples < MaxSamples)
+        num_samples++;
+
+    last_timestamp_usec = sample.timestamp_usec;
+    last_cpu_time_usec = timespecToUsec(cpu_time);
+    last_threads.swap(threads);
+}
+
+vector<NvResourceSample>
+NvResourceSampler::getSamples()
+{
+    lock_guard<mutex> guard(lock);
+    vector<NvResourceSample> result;
+
+    result.reserve(num_samples);
+    for (uint32_t i = 0; i < num_samples; i++)
+        result.push_back(samples[(next_sample + MaxSamples - num_samples + i) % MaxSamples]);
+    return result;
+}
+
+void
+NvResourceSampler::addDmaBufferBytes(int64_t bytes)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    // Buffers are allocated when planes and pools are set up, not per frame
+    lock_guard<mutex> guard(dma_lock);
+    int64_t total = dma_buffer_bytes.fetch_add(bytes, memory_order_relaxed) + bytes;
+
+    dma_changes[next_dma_change] = {timespecToUsec(now), total, bytes};
+    next_dma_change = (next_dma_change + 1) % MaxDmaChanges;
+    if (num_dma_changes < MaxDmaChanges)
+        num_dma_changes++;
+}
+
+vector<uint64_t>
+NvResourceSampler::getDmaBufferBytes(const vector<uint64_t> &timestamps_usec)
+{
+    lock_guard<mutex> guard(dma_lock);
+    vector<uint64_t> result;
+
+    result.reserve(timestamps_usec.size());
+    for (uint64_t timestamp : timestamps_usec)
+    {
+        int64_t bytes = dma_buffer_bytes.load(memory_order_relaxed);
+        for (uint32_t i = 1; i <= num_dma_changes; i++)
+        {
+            const DmaChange &change = dma_changes[(next_dma_change + MaxDmaChanges - i) % MaxDmaChanges];
+            if (change.timestamp_usec <= timestamp)
+            {
+                bytes = change.bytes;
+                break;
+            }
+            bytes = change.bytes - change.delta;
+        }
+        result.push_back(max<int64_t>(0, bytes));
+    }
+    return result;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * CPU time of a thread of the process over the interval of a sample.
+ */
+struct NvThreadSample
+{
+    pid_t tid;
+    char name[16];
+    uint64_t cpu_time_usec;
+};
+
+/**
+ * Resources used by the process at the end of an interval.
+ */
+struct NvResourceSample
+{
+    /** Monotonic time of the sample and length of its interval. */
+    uint64_t timestamp_usec;
+    uint64_t interval_usec;
+    /** CPU time of the whole process over the interval. */
+    uint64_t cpu_time_usec;
+    uint64_t rss_bytes;
+    /** Size of the surfaces allocated through NvBufSurf and not destroyed. */
+    uint64_t dma_buffer_bytes;
+    uint32_t num_threads;
+    NvThreadSample threads[128];
+};
+
+/**
+ * Keeps the last samples of the resources used by the process, taken on
+ * the thread of NvApplicationProfiler.
+ *
+ * The CPU time of each thread (dirty schedulers, dequeue threads, the
+ * decoder service thread...) is read from /proc/self/task, with the
+ * nanosecond scheduler statistics when the kernel has them. Samples are
+ * stored in a fixed-size ring, the oldest ones are overwritten.
+ *
+ * The DMA buffer counter is kept by the NvBufSurf helpers and the planes,
+ * so it only covers the buffers allocated by the native library it's
+ * linked in. Its last changes are kept so that the other libraries can
+ * report it at the time of the samples, see getDmaBufferBytes.
+ */
+class NvResourceSampler
+{
+public:
+    static const uint32_t MaxSamples = 64;
+    static const uint32_t MaxThreads = sizeof(NvResourceSample::threads) /
+        sizeof(NvThreadSample);
+
+    static NvResourceSampler &getInstance();
+
+    /**
+     * Clears the samples and starts the NvApplicationProfiler thread if it
+     * isn't running, so that it samples the resources every interval.
+     */
+    void start(uint32_t interval_ms);
+    void stop();
+    /** Takes a sample, called by the profiling thread. */
+    void sample();
+    /** Returns the samples in the ring, oldest first. */
+    std::vector<NvResourceSample> getSamples();
+
+    static void addDmaBufferBytes(int64_t bytes);
+    /**
+     * Returns the DMA buffer counter of this library at each monotonic
+     * timestamp. Timestamps older than the changes kept get the counter
+     * before the oldest one.
+     */
+    static std::vector<uint64_t> getDmaBufferBytes(const std::vector<uint64_t> &timestamps_usec);
+
+private:
+    NvResourceSampler();
+
+    void clear();
+
+    std::mutex control_lock;
+    bool sampling;
+    std::mutex lock;
+    NvResourceSample samples[MaxSamples];
+    uint32_t next_sample;
+    uint32_t num_samples;
+    /** CPU times of the previous sample, to compute the intervals. */
+    uint64_t last_timestamp_usec;
+    uint64_t last_cpu_time_usec;
+    std::vector<NvThreadSample> last_threads;
+
+    static const uint32_t MaxDmaChanges = 256;
+
+    /** Counter after a change, and the change. */
+    struct DmaChange
+    {
+        uint64_t timestamp_usec;
+        int64_t bytes;
+        int64_t delta;
+    };
+
+    static std::atomic<int64_t> dma_buffer_bytes;
+    static std::mutex dma_lock;
+    static DmaChange dma_changes[MaxDmaChanges];
+    static uint32_t next_dma_change;
+    static uint32_t num_dma_changes;
+};
@@ -0,0 +1,1877 @@
+#include "NvSoftwareBackend.h"
+#include "NvPictureCounter.h"
+#include "v4l2_nv_extensions.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <cinttypes>
+#include <deque>
+#include <errno.h>
+#include <future>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define SW_PITCH_ALIGNMENT 64
+#define SW_PLANE_ALIGNMENT 4096
+#define SW_DEFAULT_WIDTH 320
+#define SW_DEFAULT_HEIGHT 240
+#define SW_DEFAULT_MIN_CAPTURE_BUFFERS 6
+#define SW_DEFAULT_BITRATE 4000000
+#define SW_DEFAULT_IDR_INTERVAL 256
+#define SW_ENCODER_DEV "/dev/nvhost-msenc"
+
+#define ALIGN(value, alignment) (((value) + (alignment) - 1) / (alignment) * (alignment))
+
+using namespace std;
+
+struct SwSurface
+{
+    NvBufSurface surface;
+    NvBufSurfaceParams params;
+    int fd;
+    uint8_t *base;
+    size_t size;
+};
+
+struct SwPlaneLayout
+{
+    uint32_t num_planes;
+    uint32_t bytes_per_pix[NVBUF_MAX_PLANES];
+    uint32_t width_div[NVBUF_MAX_PLANES];
+    uint32_t height_div[NVBUF_MAX_PLANES];
+};
+
+struct SwBuffer
+{
+    uint32_t bytesused;
+    uint32_t flags;
+    struct timeval timestamp;
+    bool owned_by_device;
+    SwSurface *surface;
+    const uint8_t *userptr;
+    /* Surface of the application queued with V4L2_MEMORY_DMABUF */
+    NvBufSurface *dmabuf;
+};
+
+struct SwQueue
+{
+    enum v4l2_memory memory = V4L2_MEMORY_MMAP;
+    vector<SwBuffer> buffers;
+    deque<uint32_t> queued;
+    deque<uint32_t> done;
+    struct v4l2_format format {};
+    bool streamon = false;
+};
+
+/* The coded resolution becomes `width`x`height` at the given access unit. */
+struct SwResolutionChange
+{
+    uint64_t access_unit;
+    uint32_t width;
+    uint32_t height;
+};
+
+struct SwDevice
+{
+    int fd;
+    bool blocking;
+    /* Opened on the encoder node, raw frames are queued on the output plane
+     * and access units dequeued from the capture plane. */
+    bool encoder = false;
+    SwQueue output_queue;
+    SwQueue capture_queue;
+    deque<struct v4l2_event> events;
+    bool resolution_change_subscribed = false;
+    bool resolution_change_pending = true;
+    deque<SwResolutionChange> resolution_changes;
+    bool reconfiguring = false;
+    uint64_t decoded_units = 0;
+    NvPictureCounter pictures;
+    deque<uint32_t> dpb;
+    uint32_t dpb_frames = 0;
+    bool drained = false;
+    bool signaled = false;
+    bool poll_interrupted = false;
+    uint32_t width;
+    uint32_t height;
+    int32_t min_capture_buffers;
+    FILE *replay = NULL;
+    vector<uint8_t> frame;
+    uint64_t frame_count = 0;
+    struct v4l2_fract time_per_frame {1, 30};
+    chrono::microseconds decode_latency {0};
+    thread decode_thread;
+    bool stopping = false;
+    map<uint32_t, int32_t> controls;
+    mutex lock;
+    condition_variable cond;
+};
+
+/* An asynchronous transform runs on its own thread, like on the VIC. */
+struct SwSyncObj
+{
+    future<int> result;
+};
+
+struct SwComponent
+{
+    uint8_t *data;
+    uint32_t pitch;
+    uint32_t step;
+    uint32_t width_div;
+    uint32_t height_div;
+};
+
+static bool
+getPlaneLayout(NvBufSurfaceColorFormat color_format, SwPlaneLayout &layout)
+{
+    switch (color_format)
+    {
+        case NVBUF_COLOR_FORMAT_YUV420:
+        case NVBUF_COLOR_FORMAT_YUV420_ER:
+            layout = {3, {1, 1, 1}, {1, 2, 2}, {1, 2, 2}};
+            return true;
+        case NVBUF_COLOR_FORMAT_NV12:
+        case NVBUF_COLOR_FORMAT_NV12_ER:
+            layout = {2, {1, 2}, {1, 2}, {1, 2}};
+            return true;
+        case NVBUF_COLOR_FORMAT_RGBA:
+        case NVBUF_COLOR_FORMAT_BGRA:
+        case NVBUF_COLOR_FORMAT_BGRx:
+            layout = {1, {4}, {1}, {1}};
+            return true;
+        case NVBUF_COLOR_FORMAT_GRAY8:
+            layout = {1, {1}, {1}, {1}};
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Describes the Y, U and V components of a 4:2:0 surface independently
+ * of whether chroma is planar or interleaved. */
+static bool
+getYuvComponents(NvBufSurfaceParams &params, uint8_t *base, SwComponent components[3])
+{
+    NvBufSurfacePlaneParams &planes = params.planeParams;
+
+    switch (params.colorFormat)
+    {
+        case NVBUF_COLOR_FORMAT_YUV420:
+        case NVBUF_COLOR_FORMAT_YUV420_ER:
+            for (int i = 0; i < 3; i++)
+            {
+                components[i] = {base + planes.offset[i], planes.pitch[i], 1,
+                        i ? 2u : 1u, i ? 2u : 1u};
+            }
+            return true;
+        case NVBUF_COLOR_FORMAT_NV12:
+        case NVBUF_COLOR_FORMAT_NV12_ER:
+            components[0] = {base + planes.offset[0], planes.pitch[0], 1, 1, 1};
+            components[1] = {base + planes.offset[1], planes.pitch[1], 2, 2, 2};
+            components[2] = {base + planes.offset[1] + 1, planes.pitch[1], 2, 2, 2};
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void
+scaleComponent(SwComponent &src, NvBufSurfTransformRect &src_rect,
+        SwComponent &dst, NvBufSurfTransformRect &dst_rect, bool flip_x, bool flip_y)
+{
+    uint32_t src_left = src_rect.left / src.width_div;
+    uint32_t src_top = src_rect.top / src.height_div;
+    uint32_t src_width = src_rect.width / src.width_div;
+    uint32_t src_height = src_rect.height / src.height_div;
+    uint32_t dst_left = dst_rect.left / dst.width_div;
+    uint32_t dst_top = dst_rect.top / dst.height_div;
+    uint32_t dst_width = dst_rect.width / dst.width_div;
+    uint32_t dst_height = dst_rect.height / dst.height_div;
+    vector<uint32_t> x_map(dst_width);
+
+    if (!src_width || !src_height)
+        return;
+
+    for (uint32_t x = 0; x < dst_width; x++)
+    {
+        uint32_t sx = (uint64_t) x * src_width / dst_width;
+        x_map[x] = (src_left + (flip_x ? src_width - 1 - sx : sx)) * src.step;
+    }
+
+    for (uint32_t y = 0; y < dst_height; y++)
+    {
+        uint32_t sy = (uint64_t) y * src_height / dst_height;
+        uint8_t *src_row = src.data + (src_top + (flip_y ? src_height - 1 - sy : sy)) * src.pitch;
+        uint8_t *dst_row = dst.data + (dst_top + y) * dst.pitch + dst_left * dst.step;
+
+        if (src.step == 1 && dst.step == 1 && src_width == dst_width && !flip_x)
+        {
+            memcpy(dst_row, src_row + src_left, dst_width);
+            continue;
+        }
+
+        for (uint32_t x = 0; x < dst_width; x++)
+        {
+            dst_row[x * dst.step] = src_row[x_map[x]];
+        }
+    }
+}
+
+static uint8_t
+clampComponent(int value)
+{
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+/* Offsets of the red and blue components of a packed 32-bit RGB pixel */
+static bool
+getRgbOrder(NvBufSurfaceColorFormat color_format, int &red, int &blue)
+{
+    switch (color_format)
+    {
+        case NVBUF_COLOR_FORMAT_RGBA:
+            red = 0;
+            blue = 2;
+            return true;
+        case NVBUF_COLOR_FORMAT_BGRA:
+        case NVBUF_COLOR_FORMAT_BGRx:
+            red = 2;
+            blue = 0;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Scales a 4:2:0 source into a packed 32-bit RGB surface, converting the
+ * colors with the BT.601 limited range coefficients. */
+static bool
+scaleToRgb(SwComponent src[3], NvBufSurfTransformRect &src_rect, NvBufSurfaceParams &dst,
+        NvBufSurfTransformRect &dst_rect, bool flip_x, bool flip_y)
+{
+    int red;
+    int blue;
+
+    if (!getRgbOrder(dst.colorFormat, red, blue))
+        return false;
+
+    if (!src_rect.width || !src_rect.height)
+        return true;
+
+    uint8_t *base = (uint8_t *) dst.dataPtr + dst.planeParams.offset[0];
+    uint32_t pitch = dst.planeParams.pitch[0];
+
+    for (uint32_t y = 0; y < dst_rect.height; y++)
+    {
+        uint32_t sy = (uint64_t) y * src_rect.height / dst_rect.height;
+        sy = src_rect.top + (flip_y ? src_rect.height - 1 - sy : sy);
+        uint8_t *row = base + (dst_rect.top + y) * pitch + dst_rect.left * 4;
+
+        for (uint32_t x = 0; x < dst_rect.width; x++)
+        {
+            uint32_t sx = (uint64_t) x * src_rect.width / dst_rect.width;
+            sx = src_rect.left + (flip_x ? src_rect.width - 1 - sx : sx);
+
+            int yuv[3];
+            for (int i = 0; i < 3; i++)
+            {
+                yuv[i] = src[i].data[sy / src[i].height_div * src[i].pitch +
+                        sx / src[i].width_div * src[i].step];
+            }
+
+            int c = 298 * (yuv[0] - 16);
+            int d = yuv[1] - 128;
+            int e = yuv[2] - 128;
+            uint8_t *pixel = row + x * 4;
+            pixel[red] = clampComponent((c + 409 * e + 128) >> 8);
+            pixel[1] = clampComponent((c - 100 * d - 208 * e + 128) >> 8);
+            pixel[blue] = clampComponent((c + 516 * d + 128) >> 8);
+            pixel[3] = 255;
+        }
+    }
+    return true;
+}
+
+/* Scales a packed 32-bit RGB source into a packed RGB surface, or into a
+ * 4:2:0 one with the BT.601 limited range coefficients. Chroma is taken
+ * from the top left pixel of each 2x2 block. */
+static bool
+scaleFromRgb(NvBufSurfaceParams &src, NvBufSurfTransformRect &src_rect, NvBufSurfaceParams &dst,
+        NvBufSurfTransformRect &dst_rect, bool flip_x, bool flip_y)
+{
+    SwComponent dst_components[3];
+    int src_red, src_blue, dst_red = 0, dst_blue = 0;
+    bool yuv = getYuvComponents(dst, (uint8_t *) dst.dataPtr, dst_components);
+
+    if (!getRgbOrder(src.colorFormat, src_red, src_blue) ||
+            (!yuv && !getRgbOrder(dst.colorFormat, dst_red, dst_blue)))
+        return false;
+
+    if (!src_rect.width || !src_rect.height)
+        return true;
+
+    uint8_t *src_base = (uint8_t *) src.dataPtr + src.planeParams.offset[0];
+    uint8_t *dst_base = (uint8_t *) dst.dataPtr + dst.planeParams.offset[0];
+
+    for (uint32_t y = 0; y < dst_rect.height; y++)
+    {
+        uint32_t sy = (uint64_t) y * src_rect.height / dst_rect.height;
+        sy = src_rect.top + (flip_y ? src_rect.height - 1 - sy : sy);
+        uint8_t *src_row = src_base + sy * src.planeParams.pitch[0];
+        uint32_t dy = dst_rect.top + y;
+
+        for (uint32_t x = 0; x < dst_rect.width; x++)
+        {
+            uint32_t sx = (uint64_t) x * src_rect.width / dst_rect.width;
+            sx = src_rect.left + (flip_x ? src_rect.width - 1 - sx : sx);
+            uint8_t *pixel = src_row + sx * 4;
+            int r = pixel[src_red], g = pixel[1], b = pixel[src_blue];
+            uint32_t dx = dst_rect.left + x;
+
+            if (!yuv)
+            {
+                uint8_t *out = dst_base + dy * dst.planeParams.pitch[0] + dx * 4;
+                out[dst_red] = r;
+                out[1] = g;
+                out[dst_blue] = b;
+                out[3] = pixel[3];
+                continue;
+            }
+
+            dst_components[0].data[dy * dst_components[0].pitch + dx] =
+                ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+            if (dx % 2 || dy % 2)
+                continue;
+
+            SwComponent &u = dst_components[1];
+            SwComponent &v = dst_components[2];
+            u.data[dy / 2 * u.pitch + dx / 2 * u.step] =
+                ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+            v.data[dy / 2 * v.pitch + dx / 2 * v.step] =
+                ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+        }
+    }
+    return true;
+}
+
+static bool
+readReplayFrame(SwDevice &dev)
+{
+    if (!dev.replay)
+        return false;
+
+    if (fread(dev.frame.data(), 1, dev.frame.size(), dev.replay) == dev.frame.size())
+        return true;
+
+    rewind(dev.replay);
+    return fread(dev.frame.data(), 1, dev.frame.size(), dev.replay) == dev.frame.size();
+}
+
+static void
+fillFrame(SwDevice &dev, SwSurface *surface)
+{
+    NvBufSurfacePlaneParams &planes = surface->params.planeParams;
+    uint8_t *y_plane = surface->base + planes.offset[0];
+    uint8_t *uv_plane = surface->base + planes.offset[1];
+    uint32_t width = dev.width;
+    uint32_t height = dev.height;
+
+    if (readReplayFrame(dev))
+    {
+        const uint8_t *src_y = dev.frame.data();
+        const uint8_t *src_u = src_y + width * height;
+        const uint8_t *src_v = src_u + width * height / 4;
+
+        for (uint32_t y = 0; y < height; y++)
+        {
+            memcpy(y_plane + y * planes.pitch[0], src_y + y * width, width);
+        }
+
+        for (uint32_t y = 0; y < height / 2; y++)
+        {
+            uint8_t *row = uv_plane + y * planes.pitch[1];
+            for (uint32_t x = 0; x < width / 2; x++)
+            {
+                row[2 * x] = src_u[y * width / 2 + x];
+                row[2 * x + 1] = src_v[y * width / 2 + x];
+            }
+        }
+    }
+    else
+    {
+        for (uint32_t y = 0; y < height; y++)
+        {
+            uint8_t *row = y_plane + y * planes.pitch[0];
+            for (uint32_t x = 0; x < width; x++)
+            {
+                row[x] = (x + y + dev.frame_count) & 0xff;
+            }
+        }
+
+        for (uint32_t y = 0; y < height / 2; y++)
+        {
+            memset(uv_plane + y * planes.pitch[1], 128, width);
+        }
+    }
+
+    dev.frame_count++;
+}
+
+/* Drops the frame of a skipped access unit, so that replayed frames stay
+ * in step with the access units. */
+static void
+skipFrame(SwDevice &dev)
+{
+    readReplayFrame(dev);
+    dev.frame_count++;
+}
+
+static void
+configureDevice(SwDevice &dev)
+{
+    const char *resolution = getenv("MMAPI_SW_RESOLUTION");
+    const char *min_buffers = getenv("MMAPI_SW_MIN_CAPTURE_BUFFERS");
+    const char *replay = getenv("MMAPI_SW_REPLAY");
+    const char *decode_latency = getenv("MMAPI_SW_DECODE_LATENCY_US");
+    const char *changes = getenv("MMAPI_SW_RESOLUTION_CHANGES");
+    const char *dpb_frames = getenv("MMAPI_SW_DPB_FRAMES");
+    SwResolutionChange change;
+    int consumed;
+
+    if (!resolution || sscanf(resolution, "%ux%u", &dev.width, &dev.height) != 2)
+    {
+        dev.width = SW_DEFAULT_WIDTH;
+        dev.height = SW_DEFAULT_HEIGHT;
+    }
+
+    dev.min_capture_buffers = min_buffers ? atoi(min_buffers) : SW_DEFAULT_MIN_CAPTURE_BUFFERS;
+    dev.replay = replay ? fopen(replay, "rb") : NULL;
+    dev.decode_latency = chrono::microseconds(decode_latency ? atoi(decode_latency) : 0);
+    dev.dpb_frames = dpb_frames ? atoi(dpb_frames) : 0;
+
+    while (changes && sscanf(changes, "%" SCNu64 ":%ux%u%n", &change.access_unit, &change.width,
+            &change.height, &consumed) == 3)
+    {
+        dev.resolution_changes.push_back(change);
+        changes += consumed;
+        changes += *changes == ',';
+    }
+
+    dev.frame.resize(dev.width * dev.height * 3 / 2);
+}
+
+static SwQueue *
+getQueue(SwDevice &dev, uint32_t type)
+{
+    switch (type)
+    {
+        case V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE:
+            return &dev.output_queue;
+        case V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE:
+            return &dev.capture_queue;
+        default:
+            return NULL;
+    }
+}
+
+/* Whether the queue carries a coded bitstream rather than raw frames */
+static bool
+isBitstream(SwDevice &dev, SwQueue *queue)
+{
+    return queue == (dev.encoder ? &dev.capture_queue : &dev.output_queue);
+}
+
+/* The device descriptor is readable while a capture buffer, the end of
+ * stream or an event can be dequeued, like POLLIN/POLLPRI on the device. */
+static void
+updateReadiness(SwDevice &dev)
+{
+    bool ready = !dev.capture_queue.done.empty() || !dev.events.empty() || dev.drained;
+    uint64_t value = 1;
+
+    if (ready && !dev.signaled)
+    {
+        if (write(dev.fd, &value, sizeof(value)) == sizeof(value))
+            dev.signaled = true;
+    }
+    else if (!ready && dev.signaled)
+    {
+        if (read(dev.fd, &value, sizeof(value)) == sizeof(value))
+            dev.signaled = false;
+    }
+
+    dev.cond.notify_all();
+}
+
+static uint16_t
+getPollEvents(SwDevice &dev)
+{
+    uint16_t events = 0;
+
+    if (!dev.capture_queue.done.empty() || dev.drained)
+        events |= POLLIN;
+    if (!dev.output_queue.done.empty())
+        events |= POLLOUT;
+    if (!dev.events.empty())
+        events |= POLLPRI;
+
+    return events;
+}
+
+/* Whether the oldest queued access unit can be consumed. */
+static bool
+canDecode(SwDevice &dev)
+{
+    SwQueue &output = dev.output_queue;
+    SwQueue &capture = dev.capture_queue;
+
+    if (output.queued.empty() || dev.reconfiguring)
+        return false;
+    if (output.buffers[output.queued.front()].bytesused == 0)
+        return true;
+    return capture.streamon && !capture.queued.empty();
+}
+
+/* Outputs the frames held in the decoded picture buffer beyond `keep`. */
+static void
+outputPictures(SwDevice &dev, size_t keep)
+{
+    while (dev.dpb.size() > keep)
+    {
+        dev.capture_queue.done.push_back(dev.dpb.front());
+        dev.dpb.pop_front();
+    }
+}
+
+/* Signals a new coded resolution. Like the hardware, the access unit is
+ * held back until the capture plane is set up again. */
+static bool
+changeResolution(SwDevice &dev)
+{
+    if (dev.resolution_changes.empty() ||
+            dev.resolution_changes.front().access_unit != dev.decoded_units)
+        return false;
+
+    outputPictures(dev, 0);
+
+    SwResolutionChange &change = dev.resolution_changes.front();
+    dev.width = change.width;
+    dev.height = change.height;
+    dev.frame.resize(dev.width * dev.height * 3 / 2);
+    dev.resolution_changes.pop_front();
+
+    if (dev.resolution_change_subscribed)
+    {
+        struct v4l2_event event;
+        memset(&event, 0, sizeof(event));
+        event.type = V4L2_EVENT_RESOLUTION_CHANGE;
+        event.u.src_change.changes = V4L2_EVENT_SRC_CH_RESOLUTION;
+        dev.events.push_back(event);
+    }
+
+    dev.reconfiguring = true;
+    return true;
+}
+
+/* Reads the size of a JPEG image from its start of frame segment. */
+static bool
+getJpegResolution(const uint8_t *data, uint32_t size, uint32_t &width, uint32_t &height)
+{
+    if (!data || size < 4 || data[0] != 0xff || data[1] != 0xd8)
+        return false;
+
+    uint32_t pos = 2;
+    while (pos + 4 <= size && data[pos] == 0xff)
+    {
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xff)
+        {
+            pos++;
+            continue;
+        }
+
+        /* Every SOFn marker but DHT, JPG and DAC, which share the range */
+        if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 &&
+                marker != 0xcc)
+        {
+            if (pos + 9 > size)
+                return false;
+            height = (data[pos + 5] << 8) | data[pos + 6];
+            width = (data[pos + 7] << 8) | data[pos + 8];
+            return width && height;
+        }
+
+        /* The entropy coded data follows the start of scan */
+        if (marker == 0xda)
+            return false;
+        pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
+    }
+    return false;
+}
+
+/* Motion JPEG images carry their own size, a different one is signaled
+ * like a resolution change of the stream. */
+static void
+followJpegResolution(SwDevice &dev, SwBuffer &in)
+{
+    uint32_t width;
+    uint32_t height;
+
+    if (dev.output_queue.format.fmt.pix_mp.pixelformat != V4L2_PIX_FMT_MJPEG ||
+            !getJpegResolution(in.userptr, in.bytesused, width, height) ||
+            (width == dev.width && height == dev.height))
+        return;
+
+    /* The first image sets the resolution signaled when streaming starts */
+    if (dev.resolution_change_pending)
+    {
+        dev.width = width;
+        dev.height = height;
+        dev.frame.resize(dev.width * dev.height * 3 / 2);
+    }
+    else if (dev.decoded_units && (dev.resolution_changes.empty() ||
+            dev.resolution_changes.front().access_unit != dev.decoded_units))
+    {
+        dev.resolution_changes.push_front({dev.decoded_units, width, height});
+    }
+}
+
+/* Whether the access unit is dropped in the skip frames mode of the device,
+ * judged by the NAL unit header of its first slice. */
+static bool
+skipsAccessUnit(SwDevice &dev, SwBuffer &in)
+{
+    auto it = dev.controls.find(V4L2_CID_MPEG_VIDEO_SKIP_FRAMES);
+    if (it == dev.controls.end() || it->second == V4L2_SKIP_FRAMES_TYPE_NONE || !in.userptr)
+        return false;
+
+    bool h264 = dev.output_queue.format.fmt.pix_mp.pixelformat == V4L2_PIX_FMT_H264;
+    const uint8_t *data = in.userptr;
+
+    for (uint32_t i = 0; i + 3 < in.bytesused; i++)
+    {
+        if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1)
+            continue;
+
+        uint8_t header = data[i + 3];
+        bool idr;
+        bool reference;
+        if (h264)
+        {
+            uint8_t type = header & 0x1f;
+            if (type != 1 && type != 5)
+                continue;
+            idr = type == 5;
+            reference = header & 0x60;
+        }
+        else
+        {
+            /* Even types up to 14 are sub-layer non-reference pictures */
+            uint8_t type = (header >> 1) & 0x3f;
+            if (type >= 32)
+                continue;
+            idr = type == 19 || type == 20;
+            reference = type > 14 || type % 2;
+        }
+
+        if (it->second == V4L2_SKIP_FRAMES_TYPE_DECODE_IDR_ONLY)
+            return !idr;
+        return !reference;
+    }
+    return false;
+}
+
+/* Whether the access unit starts a frame, like the hardware decoder a
+ * second field completes the frame of the first one. Access units without
+ * a user pointer are taken as pictures. */
+static bool
+holdsPicture(SwDevice &dev, SwBuffer &in)
+{
+    if (!in.userptr)
+        return true;
+    uint32_t format = dev.output_queue.format.fmt.pix_mp.pixelformat;
+    return dev.pictures.count(format, in.userptr, in.bytesused) > 0;
+}
+
+/* Consumes the oldest queued access unit. An access unit holding a
+ * picture produces one frame unless it is skipped, an empty one marks the
+ * end of stream. */
+static void
+decodeOne(SwDevice &dev)
+{
+    SwQueue &output = dev.output_queue;
+    SwQueue &capture = dev.capture_queue;
+    uint32_t in_index = output.queued.front();
+    SwBuffer &in = output.buffers[in_index];
+
+    if (in.bytesused)
+        followJpegResolution(dev, in);
+    if (in.bytesused && dev.decoded_units && changeResolution(dev))
+        return;
+
+    /* Parameter sets, SEI and second fields are consumed without a frame */
+    bool picture = in.bytesused && holdsPicture(dev, in);
+    if (picture && skipsAccessUnit(dev, in))
+    {
+        skipFrame(dev);
+        dev.decoded_units++;
+    }
+    else if (picture)
+    {
+        uint32_t out_index = capture.queued.front();
+        SwBuffer &out = capture.buffers[out_index];
+        capture.queued.pop_front();
+
+        fillFrame(dev, out.surface);
+        out.timestamp = in.timestamp;
+        out.bytesused = out.surface->size;
+        out.flags = 0;
+        dev.dpb.push_back(out_index);
+        dev.decoded_units++;
+
+        /* Like a reordering delay, frames are held in the DPB unless it
+         * is disabled */
+        bool dpb_disabled = dev.controls.count(V4L2_CID_MPEG_VIDEO_DISABLE_DPB);
+        outputPictures(dev, dpb_disabled ? 0 : dev.dpb_frames);
+    }
+    else if (!in.bytesused)
+    {
+        outputPictures(dev, 0);
+        dev.drained = true;
+    }
+
+    output.queued.pop_front();
+    output.done.push_back(in_index);
+}
+
+/* Whether the oldest queued frame can be encoded, the end of stream needs
+ * a capture buffer as well to be signaled. */
+static bool
+canEncode(SwDevice &dev)
+{
+    SwQueue &capture = dev.capture_queue;
+
+    return !dev.output_queue.queued.empty() && capture.streamon && !capture.queued.empty();
+}
+
+/* Hashes the luma plane, so that the access units depend on the frames */
+static uint32_t
+hashFrame(NvBufSurfaceParams &params)
+{
+    NvBufSurfacePlaneParams &planes = params.planeParams;
+    uint32_t hash = 2166136261u;
+
+    for (uint32_t y = 0; y < planes.height[0]; y++)
+    {
+        uint8_t *row = (uint8_t *) params.dataPtr + planes.offset[0] + y * planes.pitch[0];
+        for (uint32_t x = 0; x < planes.width[0]; x++)
+        {
+            hash = (hash ^ row[x]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+/* Appends a NAL unit of the given type with `size` bytes of payload. The
+ * payload bytes all have their high bit set, so they never emulate a start
+ * code. */
+static void
+appendNalUnit(vector<uint8_t> &access_unit, bool h264, uint8_t type, size_t size,
+        uint32_t &seed)
+{
+    static const uint8_t start_code[] = {0, 0, 0, 1};
+
+    access_unit.insert(access_unit.end(), start_code, start_code + sizeof(start_code));
+    if (h264)
+    {
+        access_unit.push_back(0x60 | type);
+    }
+    else
+    {
+        access_unit.push_back(type << 1);
+        access_unit.push_back(1);
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        access_unit.push_back(0x80 | ((seed >> 16) & 0x7f));
+    }
+}
+
+static int32_t
+getControlValue(SwDevice &dev, uint32_t id, int32_t default_value)
+{
+    auto it = dev.controls.find(id);
+    return it == dev.controls.end() ? default_value : it->second;
+}
+
+/* Consumes the oldest queued frame. A frame produces one access unit on the
+ * capture plane, an IDR picture every IDR interval or when forced and a
+ * non-IDR slice otherwise, sized after the bitrate and the frame rate. An
+ * empty frame marks the end of stream and produces an empty buffer. */
+static void
+encodeOne(SwDevice &dev)
+{
+    SwQueue &output = dev.output_queue;
+    SwQueue &capture = dev.capture_queue;
+    uint32_t in_index = output.queued.front();
+    uint32_t out_index = capture.queued.front();
+    SwBuffer &in = output.buffers[in_index];
+    SwBuffer &out = capture.buffers[out_index];
+    NvBufSurfaceParams *frame = in.dmabuf ? &in.dmabuf->surfaceList[0] :
+        in.surface ? &in.surface->params : NULL;
+
+    capture.queued.pop_front();
+    out.timestamp = in.timestamp;
+    out.flags = 0;
+
+    if (in.bytesused && frame)
+    {
+        bool h264 = capture.format.fmt.pix_mp.pixelformat == V4L2_PIX_FMT_H264;
+        int32_t idr_interval = getControlValue(dev, V4L2_CID_MPEG_VIDEO_IDR_INTERVAL,
+                SW_DEFAULT_IDR_INTERVAL);
+        bool forced = dev.controls.erase(V4L2_CID_MPEG_VIDEOENC_FORCE_IDR_FRAME);
+        bool idr = forced || idr_interval <= 1 || dev.frame_count % idr_interval == 0;
+        bool parameter_sets = dev.frame_count == 0 ||
+            (idr && getControlValue(dev, V4L2_CID_MPEG_VIDEOENC_INSERT_SPS_PPS_AT_IDR, 0));
+        uint64_t bitrate = getControlValue(dev, V4L2_CID_MPEG_VIDEO_BITRATE,
+                SW_DEFAULT_BITRATE);
+        size_t frame_size = bitrate / 8 * dev.time_per_frame.numerator /
+            dev.time_per_frame.denominator;
+        uint32_t seed = hashFrame(*frame);
+        vector<uint8_t> access_unit;
+
+        if (parameter_sets && !h264)
+            appendNalUnit(access_unit, h264, 32, 8, seed);
+        if (parameter_sets)
+        {
+            appendNalUnit(access_unit, h264, h264 ? 7 : 33, 16, seed);
+            appendNalUnit(access_unit, h264, h264 ? 8 : 34, 4, seed);
+        }
+
+        /* Like the rate control of the hardware, IDR pictures get a larger
+         * share of the bitrate */
+        size_t slice_size = idr ? frame_size * 2 : frame_size;
+        appendNalUnit(access_unit, h264, idr ? (h264 ? 5 : 19) : 1,
+                slice_size ? slice_size : 1, seed);
+
+        out.bytesused = min(access_unit.size(), out.surface->size);
+        memcpy(out.surface->base, access_unit.data(), out.bytesused);
+        if (idr)
+            out.flags |= V4L2_BUF_FLAG_KEYFRAME;
+        dev.frame_count++;
+    }
+    else
+    {
+        out.bytesused = 0;
+        out.flags |= V4L2_BUF_FLAG_LAST;
+        dev.drained = true;
+    }
+
+    capture.done.push_back(out_index);
+    output.queued.pop_front();
+    output.done.push_back(in_index);
+}
+
+static bool
+canProcess(SwDevice &dev)
+{
+    return dev.encoder ? canEncode(dev) : canDecode(dev);
+}
+
+static void
+processOne(SwDevice &dev)
+{
+    if (dev.encoder)
+        encodeOne(dev);
+    else
+        decodeOne(dev);
+}
+
+/* Emulates the processing time of the hardware, access units or frames
+ * are consumed MMAPI_SW_DECODE_LATENCY_US after they can be. */
+static void
+runDecodeThread(SwDevice *dev)
+{
+    unique_lock<mutex> lock(dev->lock);
+
+    while (true)
+    {
+        dev->cond.wait(lock, [&]() { return dev->stopping || canProcess(*dev); });
+        if (dev->stopping)
+            break;
+
+        lock.unlock();
+        this_thread::sleep_for(dev->decode_latency);
+        lock.lock();
+
+        if (!dev->stopping && canProcess(*dev))
+        {
+            processOne(*dev);
+            updateReadiness(*dev);
+        }
+    }
+}
+
+/* Consumes queued access units or frames in order, or hands them over to
+ * the decode thread when a processing latency is emulated. */
+static void
+process(SwDevice &dev)
+{
+    SwQueue &output = dev.output_queue;
+
+    if (!dev.encoder && dev.resolution_change_pending)
+    {
+        for (uint32_t index : output.queued)
+        {
+            if (output.buffers[index].bytesused == 0)
+                continue;
+
+            followJpegResolution(dev, output.buffers[index]);
+            if (dev.resolution_change_subscribed)
+            {
+                struct v4l2_event event;
+                memset(&event, 0, sizeof(event));
+                event.type = V4L2_EVENT_RESOLUTION_CHANGE;
+                event.u.src_change.changes = V4L2_EVENT_SRC_CH_RESOLUTION;
+                dev.events.push_back(event);
+            }
+            dev.resolution_change_pending = false;
+            break;
+        }
+    }
+
+    if (dev.decode_latency.count())
+    {
+        dev.cond.notify_all();
+        return;
+    }
+
+    while (canProcess(dev))
+    {
+        processOne(dev);
+    }
+}
+
+static int
+queryCap(SwDevice &dev, struct v4l2_capability *caps)
+{
+    memset(caps, 0, sizeof(*caps));
+    strncpy((char *) caps->driver, "nvsw", sizeof(caps->driver) - 1);
+    strncpy((char *) caps->card, dev.encoder ? "Software M2M encoder" : "Software M2M decoder",
+            sizeof(caps->card) - 1);
+    caps->capabilities = V4L2_CAP_VIDEO_M2M_MPLANE | V4L2_CAP_STREAMING;
+    caps->device_caps = caps->capabilities;
+    return 0;
+}
+
+static NvBufSurfaceColorFormat
+getColorFormat(uint32_t pixelformat)
+{
+    switch (pixelformat)
+    {
+        case V4L2_PIX_FMT_YUV420M:
+            return NVBUF_COLOR_FORMAT_YUV420;
+        case V4L2_PIX_FMT_NV12M:
+            return NVBUF_COLOR_FORMAT_NV12;
+        default:
+            return NVBUF_COLOR_FORMAT_INVALID;
+    }
+}
+
+/* Fills the plane formats of raw frames of the current resolution */
+static void
+fillRawFormat(SwDevice &dev, struct v4l2_format *format, uint32_t pixelformat)
+{
+    SwPlaneLayout layout;
+    getPlaneLayout(getColorFormat(pixelformat), layout);
+
+    format->fmt.pix_mp.width = dev.width;
+    format->fmt.pix_mp.height = dev.height;
+    format->fmt.pix_mp.pixelformat = pixelformat;
+    format->fmt.pix_mp.num_planes = layout.num_planes;
+    for (uint32_t i = 0; i < layout.num_planes; i++)
+    {
+        uint32_t pitch = ALIGN(dev.width / layout.width_div[i] * layout.bytes_per_pix[i],
+                SW_PITCH_ALIGNMENT);
+        format->fmt.pix_mp.plane_fmt[i].bytesperline = pitch;
+        format->fmt.pix_mp.plane_fmt[i].sizeimage = pitch * (dev.height / layout.height_div[i]);
+    }
+}
+
+static int
+setFormat(SwDevice &dev, struct v4l2_format *format)
+{
+    SwQueue *queue = getQueue(dev, format->type);
+
+    if (!queue || !queue->buffers.empty())
+    {
+        errno = queue ? EBUSY : EINVAL;
+        return -1;
+    }
+
+    uint32_t pixelformat = format->fmt.pix_mp.pixelformat;
+    if (isBitstream(dev, queue))
+    {
+        if (dev.encoder && pixelformat != V4L2_PIX_FMT_H264 && pixelformat != V4L2_PIX_FMT_H265)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        format->fmt.pix_mp.num_planes = 1;
+    }
+    else if (dev.encoder ? getColorFormat(pixelformat) == NVBUF_COLOR_FORMAT_INVALID :
+            pixelformat != V4L2_PIX_FMT_NV12M)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    else
+    {
+        /* The encoder takes frames of any resolution */
+        if (dev.encoder)
+        {
+            dev.width = format->fmt.pix_mp.width;
+            dev.height = format->fmt.pix_mp.height;
+        }
+        fillRawFormat(dev, format, pixelformat);
+    }
+
+    queue->format = *format;
+    return 0;
+}
+
+static int
+getFormat(SwDevice &dev, struct v4l2_format *format)
+{
+    SwQueue *queue = getQueue(dev, format->type);
+
+    if (!queue)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (!dev.encoder && queue == &dev.capture_queue)
+    {
+        memset(&format->fmt, 0, sizeof(format->fmt));
+        fillRawFormat(dev, format, V4L2_PIX_FMT_NV12M);
+    }
+    else
+    {
+        *format = queue->format;
+    }
+    return 0;
+}
+
+static int
+queryBuffer(SwDevice &dev, struct v4l2_buffer *v4l2_buf)
+{
+    SwQueue *queue = getQueue(dev, v4l2_buf->type);
+
+    if (!queue || v4l2_buf->index >= queue->buffers.size())
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    SwBuffer &buffer = queue->buffers[v4l2_buf->index];
+    if (buffer.surface)
+    {
+        NvBufSurfacePlaneParams &planes = buffer.surface->params.planeParams;
+        v4l2_buf->length = planes.num_planes;
+        for (uint32_t i = 0; i < planes.num_planes; i++)
+        {
+            v4l2_buf->m.planes[i].length = planes.psize[i];
+            v4l2_buf->m.planes[i].m.mem_offset = planes.offset[i];
+        }
+    }
+    else
+    {
+        v4l2_buf->length = 1;
+        v4l2_buf->m.planes[0].length = queue->format.fmt.pix_mp.plane_fmt[0].sizeimage;
+    }
+    return 0;
+}
+
+static int
+exportBuffer(SwDevice &dev, struct v4l2_exportbuffer *expbuf)
+{
+    SwQueue *queue = getQueue(dev, expbuf->type);
+
+    if (!queue || expbuf->index >= queue->buffers.size() ||
+            !queue->buffers[expbuf->index].surface)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    expbuf->fd = queue->buffers[expbuf->index].surface->fd;
+    return 0;
+}
+
+static int
+queueBuffer(SwDevice &dev, struct v4l2_buffer *v4l2_buf)
+{
+    SwQueue *queue = getQueue(dev, v4l2_buf->type);
+
+    if (!queue || v4l2_buf->index >= queue->buffers.size() ||
+            queue->buffers[v4l2_buf->index].owned_by_device)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Like the kernel, reject user memory smaller than the payload */
+    if (queue->memory == V4L2_MEMORY_USERPTR &&
+            v4l2_buf->m.planes[0].bytesused > v4l2_buf->m.planes[0].length)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Like the kernel, reject DMA buffers without a descriptor, even empty */
+    if (queue->memory == V4L2_MEMORY_DMABUF && v4l2_buf->m.planes[0].m.fd < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* DMA buffers must hold a frame of the format set on the queue */
+    NvBufSurface *dmabuf = NULL;
+    if (queue->memory == V4L2_MEMORY_DMABUF && v4l2_buf->m.planes[0].bytesused)
+    {
+        if (NvSoftwareBackend::getSoftwareBackendInstance().surfaceFromFd(
+                    v4l2_buf->m.planes[0].m.fd, (void **) &dmabuf) < 0 ||
+                dmabuf->surfaceList[0].width != queue->format.fmt.pix_mp.width ||
+                dmabuf->surfaceList[0].height != queue->format.fmt.pix_mp.height ||
+                dmabuf->surfaceList[0].colorFormat !=
+                    getColorFormat(queue->format.fmt.pix_mp.pixelformat))
+        {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    SwBuffer &buffer = queue->buffers[v4l2_buf->index];
+    buffer.bytesused = v4l2_buf->m.planes[0].bytesused;
+    buffer.timestamp = v4l2_buf->timestamp;
+    buffer.flags = v4l2_buf->flags;
+    buffer.userptr = queue->memory == V4L2_MEMORY_USERPTR ?
+        (const uint8_t *) v4l2_buf->m.planes[0].m.userptr : NULL;
+    buffer.dmabuf = dmabuf;
+    buffer.owned_by_device = true;
+    queue->queued.push_back(v4l2_buf->index);
+
+    process(dev);
+    return 0;
+}
+
+static int
+dequeueBuffer(SwDevice &dev, struct v4l2_buffer *v4l2_buf, unique_lock<mutex> &lock)
+{
+    SwQueue *queue = getQueue(dev, v4l2_buf->type);
+
+    if (!queue)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    while (queue->done.empty())
+    {
+        if (queue == &dev.capture_queue && dev.drained)
+        {
+            v4l2_buf->flags |= V4L2_BUF_FLAG_LAST;
+            errno = EAGAIN;
+            return -1;
+        }
+
+        if (!dev.blocking || !queue->streamon)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        dev.cond.wait(lock);
+    }
+
+    uint32_t index = queue->done.front();
+    SwBuffer &buffer = queue->buffers[index];
+    queue->done.pop_front();
+    buffer.owned_by_device = false;
+
+    v4l2_buf->index = index;
+    v4l2_buf->timestamp = buffer.timestamp;
+    v4l2_buf->flags = buffer.flags;
+    if (buffer.surface && !isBitstream(dev, queue))
+    {
+        NvBufSurfacePlaneParams &planes = buffer.surface->params.planeParams;
+        for (uint32_t i = 0; i < planes.num_planes; i++)
+        {
+            v4l2_buf->m.planes[i].bytesused = planes.psize[i];
+        }
+    }
+    else
+    {
+        v4l2_buf->m.planes[0].bytesused = buffer.bytesused;
+    }
+    return 0;
+}
+
+static int
+setStreamStatus(SwDevice &dev, uint32_t type, bool status)
+{
+    SwQueue *queue = getQueue(dev, type);
+
+    if (!queue)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    queue->streamon = status;
+    if (!status)
+    {
+        for (SwBuffer &buffer : queue->buffers)
+        {
+            buffer.owned_by_device = false;
+        }
+        queue->queued.clear();
+        queue->done.clear();
+
+        if (queue == &dev.capture_queue)
+        {
+            dev.dpb.clear();
+        }
+
+        if (queue == &dev.output_queue)
+        {
+            dev.drained = false;
+        }
+    }
+
+    process(dev);
+    return 0;
+}
+
+static int
+getControl(SwDevice &dev, struct v4l2_control *ctl)
+{
+    if (ctl->id == V4L2_CID_MIN_BUFFERS_FOR_CAPTURE)
+    {
+        ctl->value = dev.min_capture_buffers;
+        return 0;
+    }
+
+    auto it = dev.controls.find(ctl->id);
+    if (it == dev.controls.end())
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    ctl->value = it->second;
+    return 0;
+}
+
+static int
+setExtControls(SwDevice &dev, struct v4l2_ext_controls *ctrls, unique_lock<mutex> &lock)
+{
+    for (uint32_t i = 0; i < ctrls->count; i++)
+    {
+        struct v4l2_ext_control &control = ctrls->controls[i];
+
+        switch (control.id)
+        {
+            case V4L2_CID_MPEG_VIDEO_DEVICE_POLL:
+            {
+                v4l2_ctrl_video_device_poll *poll =
+                    (v4l2_ctrl_video_device_poll *) control.string;
+                dev.cond.wait(lock, [&]() {
+                    return (getPollEvents(dev) & poll->req_events) || dev.poll_interrupted;
+                });
+                poll->resp_events = getPollEvents(dev) & poll->req_events;
+                break;
+            }
+            case V4L2_CID_MPEG_VIDEOENC_HW_PRESET_TYPE_PARAM:
+                dev.controls[control.id] =
+                    ((v4l2_enc_hw_preset_type_param *) control.string)->hw_preset_type;
+                break;
+            case V4L2_CID_MPEG_SET_POLL_INTERRUPT:
+                /* Wakes up the threads waiting in DevicePoll */
+                dev.poll_interrupted = control.value;
+                dev.cond.notify_all();
+                break;
+            default:
+                dev.controls[control.id] = control.value;
+        }
+    }
+    return 0;
+}
+
+static int
+getExtControls(SwDevice &dev, struct v4l2_ext_controls *ctrls)
+{
+    for (uint32_t i = 0; i < ctrls->count; i++)
+    {
+        auto it = dev.controls.find(ctrls->controls[i].id);
+        if (it != dev.controls.end())
+        {
+            ctrls->controls[i].value = it->second;
+        }
+    }
+    return 0;
+}
+
+NvSoftwareBackend &
+NvSoftwareBackend::getSoftwareBackendInstance()
+{
+    static NvSoftwareBackend backend;
+    return backend;
+}
+
+SwDevice *
+NvSoftwareBackend::getDevice(int fd)
+{
+    lock_guard<mutex> guard(lock);
+    auto it = devices.find(fd);
+    return it == devices.end() ? NULL : it->second;
+}
+
+int
+NvSoftwareBackend::open(const char *dev_node, int flags)
+{
+    SwDevice *dev = new SwDevice();
+
+    dev->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (dev->fd < 0)
+    {
+        delete dev;
+        return -1;
+    }
+    dev->blocking = !(flags & O_NONBLOCK);
+    dev->encoder = strcmp(dev_node, SW_ENCODER_DEV) == 0;
+    configureDevice(*dev);
+    if (dev->decode_latency.count())
+        dev->decode_thread = thread(runDecodeThread, dev);
+
+    lock_guard<mutex> guard(lock);
+    devices[dev->fd] = dev;
+    return dev->fd;
+}
+
+int
+NvSoftwareBackend::close(int fd)
+{
+    SwDevice *dev;
+
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = devices.find(fd);
+        if (it == devices.end())
+        {
+            errno = EBADF;
+            return -1;
+        }
+        dev = it->second;
+        devices.erase(it);
+    }
+
+    if (dev->decode_thread.joinable())
+    {
+        {
+            lock_guard<mutex> guard(dev->lock);
+            dev->stopping = true;
+        }
+        dev->cond.notify_all();
+        dev->decode_thread.join();
+    }
+
+    for (SwQueue *queue : {&dev->output_queue, &dev->capture_queue})
+    {
+        for (SwBuffer &buffer : queue->buffers)
+        {
+            if (buffer.surface)
+                destroySurface(buffer.surface);
+        }
+    }
+    if (dev->replay)
+        fclose(dev->replay);
+
+    ::close(fd);
+    delete dev;
+    return 0;
+}
+
+int
+NvSoftwareBackend::ioctl(int fd, unsigned long request, void *arg)
+{
+    SwDevice *dev = getDevice(fd);
+    int ret = 0;
+
+    if (!dev)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    unique_lock<mutex> dev_lock(dev->lock);
+    switch (request)
+    {
+        case VIDIOC_QUERYCAP:
+            ret = queryCap(*dev, (struct v4l2_capability *) arg);
+            break;
+        case VIDIOC_S_FMT:
+            ret = setFormat(*dev, (struct v4l2_format *) arg);
+            break;
+        case VIDIOC_G_FMT:
+            ret = getFormat(*dev, (struct v4l2_format *) arg);
+            break;
+        case VIDIOC_G_CROP:
+        {
+            struct v4l2_crop *crop = (struct v4l2_crop *) arg;
+            crop->c.left = 0;
+            crop->c.top = 0;
+            crop->c.width = dev->width;
+            crop->c.height = dev->height;
+            break;
+        }
+        case VIDIOC_REQBUFS:
+        {
+            struct v4l2_requestbuffers *reqbufs = (struct v4l2_requestbuffers *) arg;
+            SwQueue *queue = getQueue(*dev, reqbufs->type);
+
+            if (!queue || queue->streamon)
+            {
+                errno = queue ? EBUSY : EINVAL;
+                ret = -1;
+                break;
+            }
+
+            for (SwBuffer &buffer : queue->buffers)
+            {
+                if (buffer.surface)
+                    destroySurface(buffer.surface);
+            }
+
+            queue->memory = (enum v4l2_memory) reqbufs->memory;
+            queue->queued.clear();
+            queue->done.clear();
+            queue->buffers.assign(reqbufs->count, SwBuffer {});
+
+            if (queue == &dev->capture_queue)
+            {
+                dev->reconfiguring = dev->reconfiguring && reqbufs->count == 0;
+            }
+
+            /* Bitstream buffers are surfaces of a single row of bytes */
+            if (queue->memory == V4L2_MEMORY_MMAP && isBitstream(*dev, queue))
+            {
+                for (SwBuffer &buffer : queue->buffers)
+                {
+                    buffer.surface = allocateSurface(
+                            queue->format.fmt.pix_mp.plane_fmt[0].sizeimage, 1,
+                            NVBUF_COLOR_FORMAT_GRAY8);
+                }
+            }
+            else if (queue->memory == V4L2_MEMORY_MMAP)
+            {
+                NvBufSurfaceColorFormat color_format = dev->encoder ?
+                    getColorFormat(queue->format.fmt.pix_mp.pixelformat) :
+                    NVBUF_COLOR_FORMAT_NV12;
+                for (SwBuffer &buffer : queue->buffers)
+                {
+                    buffer.surface = allocateSurface(dev->width, dev->height, color_format);
+                }
+            }
+            break;
+        }
+        case VIDIOC_QUERYBUF:
+            ret = queryBuffer(*dev, (struct v4l2_buffer *) arg);
+            break;
+        case VIDIOC_EXPBUF:
+            ret = exportBuffer(*dev, (struct v4l2_exportbuffer *) arg);
+            break;
+        case VIDIOC_QBUF:
+            ret = queueBuffer(*dev, (struct v4l2_buffer *) arg);
+            break;
+        case VIDIOC_DQBUF:
+            ret = dequeueBuffer(*dev, (struct v4l2_buffer *) arg, dev_lock);
+            break;
+        case VIDIOC_STREAMON:
+            ret = setStreamStatus(*dev, *(uint32_t *) arg, true);
+            break;
+        case VIDIOC_STREAMOFF:
+            ret = setStreamStatus(*dev, *(uint32_t *) arg, false);
+            break;
+        case VIDIOC_SUBSCRIBE_EVENT:
+        {
+            struct v4l2_event_subscription *sub = (struct v4l2_event_subscription *) arg;
+            if (sub->type == V4L2_EVENT_RESOLUTION_CHANGE)
+                dev->resolution_change_subscribed = true;
+            break;
+        }
+        case VIDIOC_DQEVENT:
+            if (dev->events.empty())
+            {
+                errno = EAGAIN;
+                ret = -1;
+                break;
+            }
+            *(struct v4l2_event *) arg = dev->events.front();
+            dev->events.pop_front();
+            break;
+        case VIDIOC_S_CTRL:
+        {
+            struct v4l2_control *ctl = (struct v4l2_control *) arg;
+            dev->controls[ctl->id] = ctl->value;
+            break;
+        }
+        case VIDIOC_G_CTRL:
+            ret = getControl(*dev, (struct v4l2_control *) arg);
+            break;
+        case VIDIOC_S_EXT_CTRLS:
+            ret = setExtControls(*dev, (struct v4l2_ext_controls *) arg, dev_lock);
+            break;
+        case VIDIOC_G_EXT_CTRLS:
+            ret = getExtControls(*dev, (struct v4l2_ext_controls *) arg);
+            break;
+        case VIDIOC_S_PARM:
+        {
+            struct v4l2_streamparm *parm = (struct v4l2_streamparm *) arg;
+            if (parm->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE &&
+                    parm->parm.output.timeperframe.denominator)
+                dev->time_per_frame = parm->parm.output.timeperframe;
+            break;
+        }
+        case VIDIOC_S_SELECTION:
+            break;
+        default:
+            errno = ENOTTY;
+            ret = -1;
+    }
+
+    updateReadiness(*dev);
+    return ret;
+}
+
+void *
+NvSoftwareBackend::mmap(void *addr, size_t length, int prot, int flags, int fd, int64_t offset)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = surfaces.find(fd);
+        if (it != surfaces.end())
+        {
+            if (offset + length > it->second->size)
+                return MAP_FAILED;
+            return it->second->base + offset;
+        }
+    }
+
+    return ::mmap(addr, length, prot, flags, fd, offset);
+}
+
+int
+NvSoftwareBackend::munmap(void *addr, size_t length)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        for (auto &it : surfaces)
+        {
+            uint8_t *base = it.second->base;
+            if ((uint8_t *) addr >= base && (uint8_t *) addr < base + it.second->size)
+                return 0;
+        }
+    }
+
+    return ::munmap(addr, length);
+}
+
+SwSurface *
+NvSoftwareBackend::allocateSurface(uint32_t width, uint32_t height,
+        NvBufSurfaceColorFormat color_format)
+{
+    SwPlaneLayout layout;
+    SwSurface *surface;
+
+    if (!getPlaneLayout(color_format, layout))
+        return NULL;
+
+    surface = new SwSurface();
+    NvBufSurfacePlaneParams &planes = surface->params.planeParams;
+    planes.num_planes = layout.num_planes;
+    for (uint32_t i = 0; i < layout.num_planes; i++)
+    {
+        planes.width[i] = width / layout.width_div[i];
+        planes.height[i] = height / layout.height_div[i];
+        planes.bytesPerPix[i] = layout.bytes_per_pix[i];
+        planes.pitch[i] = ALIGN(planes.width[i] * planes.bytesPerPix[i], SW_PITCH_ALIGNMENT);
+        planes.psize[i] = ALIGN(planes.pitch[i] * planes.height[i], SW_PLANE_ALIGNMENT);
+        planes.offset[i] = surface->size;
+        surface->size += planes.psize[i];
+    }
+
+    surface->fd = memfd_create("nvbufsurface", MFD_CLOEXEC);
+    if (surface->fd < 0 || ftruncate(surface->fd, surface->size) < 0)
+    {
+        if (surface->fd >= 0)
+            ::close(surface->fd);
+        delete surface;
+        return NULL;
+    }
+
+    surface->base = (uint8_t *) ::mmap(NULL, surface->size, PROT_READ | PROT_WRITE,
+            MAP_SHARED, surface->fd, 0);
+    if (surface->base == MAP_FAILED)
+    {
+        ::close(surface->fd);
+        delete surface;
+        return NULL;
+    }
+
+    surface->params.width = width;
+    surface->params.height = height;
+    surface->params.pitch = planes.pitch[0];
+    surface->params.colorFormat = color_format;
+    surface->params.layout = NVBUF_LAYOUT_PITCH;
+    surface->params.bufferDesc = surface->fd;
+    surface->params.dataSize = surface->size;
+    surface->params.dataPtr = surface->base;
+
+    surface->surface.batchSize = 1;
+    surface->surface.numFilled = 1;
+    surface->surface.memType = NVBUF_MEM_SURFACE_ARRAY;
+    surface->surface.surfaceList = &surface->params;
+
+    lock_guard<mutex> guard(lock);
+    surfaces[surface->fd] = surface;
+    return surface;
+}
+
+void
+NvSoftwareBackend::destroySurface(SwSurface *surface)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        surfaces.erase(surface->fd);
+    }
+
+    ::munmap(surface->base, surface->size);
+    ::close(surface->fd);
+    delete surface;
+}
+
+int
+NvSoftwareBackend::surfaceAllocate(NvBufSurface **surf, uint32_t batch_size,
+        NvBufSurfaceAllocateParams *params)
+{
+    SwSurface *surface;
+
+    if (batch_size != 1 || !params)
+        return -1;
+
+    surface = allocateSurface(params->params.width, params->params.height,
+            params->params.colorFormat);
+    if (!surface)
+        return -1;
+
+    *surf = &surface->surface;
+    return 0;
+}
+
+int
+NvSoftwareBackend::surfaceDestroy(NvBufSurface *surf)
+{
+    SwSurface *surface;
+
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = surfaces.find(surf->surfaceList[0].bufferDesc);
+        if (it == surfaces.end())
+            return -1;
+        surface = it->second;
+    }
+
+    destroySurface(surface);
+    return 0;
+}
+
+int
+NvSoftwareBackend::surfaceFromFd(int dmabuf_fd, void **surf)
+{
+    lock_guard<mutex> guard(lock);
+    auto it = surfaces.find(dmabuf_fd);
+    if (it == surfaces.end())
+        return -1;
+
+    *surf = &it->second->surface;
+    return 0;
+}
+
+int
+NvSoftwareBackend::surfaceMap(NvBufSurface *surf, int index, int plane,
+        [[maybe_unused]] NvBufSurfaceMemMapFlags type)
+{
+    NvBufSurfaceParams &params = surf->surfaceList[index < 0 ? 0 : index];
+    uint32_t first = plane < 0 ? 0 : plane;
+    uint32_t last = plane < 0 ? params.planeParams.num_planes : plane + 1;
+
+    for (uint32_t i = first; i < last; i++)
+    {
+        params.mappedAddr.addr[i] = (uint8_t *) params.dataPtr + params.planeParams.offset[i];
+    }
+    return 0;
+}
+
+int
+NvSoftwareBackend::surfaceUnMap(NvBufSurface *surf, int index, int plane)
+{
+    NvBufSurfaceParams &params = surf->surfaceList[index < 0 ? 0 : index];
+    uint32_t first = plane < 0 ? 0 : plane;
+    uint32_t last = plane < 0 ? params.planeParams.num_planes : plane + 1;
+
+    for (uint32_t i = first; i < last; i++)
+    {
+        params.mappedAddr.addr[i] = NULL;
+    }
+    return 0;
+}
+
+int
+NvSoftwareBackend::surfaceSyncForCpu([[maybe_unused]] NvBufSurface *surf,
+        [[maybe_unused]] int index, [[maybe_unused]] int plane)
+{
+    return 0;
+}
+
+int
+NvSoftwareBackend::surfaceSyncForDevice([[maybe_unused]] NvBufSurface *surf,
+        [[maybe_unused]] int index, [[maybe_unused]] int plane)
+{
+    return 0;
+}
+
+int
+NvSoftwareBackend::transform(NvBufSurface *src, NvBufSurface *dst,
+        NvBufSurfTransformParams *params)
+{
+    NvBufSurfaceParams &src_params = src->surfaceList[0];
+    NvBufSurfaceParams &dst_params = dst->surfaceList[0];
+    NvBufSurfTransformRect src_rect = {0, 0, src_params.width, src_params.height};
+    NvBufSurfTransformRect dst_rect = {0, 0, dst_params.width, dst_params.height};
+    SwComponent src_components[3];
+    SwComponent dst_components[3];
+    bool flip_x = false;
+    bool flip_y = false;
+
+    if (params->transform_flag & NVBUFSURF_TRANSFORM_CROP_SRC)
+        src_rect = *params->src_rect;
+    if (params->transform_flag & NVBUFSURF_TRANSFORM_CROP_DST)
+        dst_rect = *params->dst_rect;
+
+    if (src_rect.left + src_rect.width > src_params.width ||
+            src_rect.top + src_rect.height > src_params.height ||
+            dst_rect.left + dst_rect.width > dst_params.width ||
+            dst_rect.top + dst_rect.height > dst_params.height)
+        return -1;
+
+    if (params->transform_flag & NVBUFSURF_TRANSFORM_FLIP)
+    {
+        switch (params->transform_flip)
+        {
+            case NvBufSurfTransform_None:
+                break;
+            case NvBufSurfTransform_FlipX:
+                flip_x = true;
+                break;
+            case NvBufSurfTransform_FlipY:
+                flip_y = true;
+                break;
+            case NvBufSurfTransform_Rotate180:
+                flip_x = flip_y = true;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    if (!getYuvComponents(src_params, (uint8_t *) src_params.dataPtr, src_components))
+        return scaleFromRgb(src_params, src_rect, dst_params, dst_rect, flip_x, flip_y) ? 0 : -1;
+
+    if (!getYuvComponents(dst_params, (uint8_t *) dst_params.dataPtr, dst_components))
+        return scaleToRgb(src_components, src_rect, dst_params, dst_rect, flip_x, flip_y) ? 0 : -1;
+
+    for (int i = 0; i < 3; i++)
+    {
+        scaleComponent(src_components[i], src_rect, dst_components[i], dst_rect, flip_x, flip_y);
+    }
+    return 0;
+}
+
+int
+NvSoftwareBackend::transformAsync(NvBufSurface *src, NvBufSurface *dst,
+        NvBufSurfTransformParams *params, NvBufSurfTransformSyncObj_t *sync_obj)
+{
+    if (!sync_obj)
+        return transform(src, dst, params);
+
+    /* The parameters and rectangles usually live on the caller's stack */
+    NvBufSurfTransformParams async_params = *params;
+    NvBufSurfTransformRect src_rect = params->src_rect ? *params->src_rect : NvBufSurfTransformRect {};
+    NvBufSurfTransformRect dst_rect = params->dst_rect ? *params->dst_rect : NvBufSurfTransformRect {};
+    bool has_src_rect = params->src_rect != NULL;
+    bool has_dst_rect = params->dst_rect != NULL;
+
+    SwSyncObj *obj = new SwSyncObj();
+    obj->result = async(launch::async, [=]() mutable {
+        async_params.src_rect = has_src_rect ? &src_rect : NULL;
+        async_params.dst_rect = has_dst_rect ? &dst_rect : NULL;
+        return transform(src, dst, &async_params);
+    });
+
+    *sync_obj = (NvBufSurfTransformSyncObj_t) obj;
+    return 0;
+}
+
+int
+NvSoftwareBackend::syncObjWait(NvBufSurfTransformSyncObj_t sync_obj,
+        uint32_t time_out)
+{
+    SwSyncObj *obj = (SwSyncObj *) sync_obj;
+
+    if (!obj)
+        return -1;
+    if (!obj->result.valid())
+        return 0;
+    if (obj->result.wait_for(chrono::milliseconds(time_out)) != future_status::ready)
+        return -1;
+    return obj->result.get();
+}
+
+int
+NvSoftwareBackend::syncObjDestroy(NvBufSurfTransformSyncObj_t *sync_obj)
+{
+    if (!sync_obj || !*sync_obj)
+        return -1;
+
+    delete (SwSyncObj *) *sync_obj;
+    *sync_obj = NULL;
+    return 0;
+}
+
+bool
+NvSoftwareBackend::pollableDevices()
+{
+    return getenv("MMAPI_SW_UNPOLLABLE") == NULL;
+}
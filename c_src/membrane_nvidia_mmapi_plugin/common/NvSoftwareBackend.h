@@ -0,0 +1,103 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include "NvDeviceBackend.h"
+
+struct SwDevice;
+struct SwSurface;
+
+/**
+ * Host memory stand-in for the Jetson V4L2 decoder and encoder and the
+ * NvBufSurface APIs.
+ *
+ * Every access unit queued on the output plane produces one NV12 frame on
+ * the capture plane, carrying the timestamp of the access unit. Access
+ * units dropped by the skip frames mode produce none, they are told apart
+ * by the NAL unit header of their first slice. Motion JPEG images set the
+ * coded resolution from their start of frame segment, a new size is
+ * signaled as a resolution change. Frames are either replayed
+ * from a raw I420 file or synthesized. Transforms scale 4:2:0 and packed
+ * RGBA, BGRA or BGRx surfaces and convert between them with nearest
+ * neighbour sampling.
+ *
+ * A device opened on the encoder node turns every frame queued on the
+ * output plane into an Annex B access unit on the capture plane, with the
+ * timestamp of the frame. IDR pictures come every IDR interval or when
+ * forced, preceded by the parameter sets on the first frame or when their
+ * insertion at IDR is enabled. Other frames are a single non-IDR slice. The
+ * slices are sized after the bitrate and frame rate, with filler derived
+ * from the frame content. Frames may be queued as surfaces of the
+ * application with V4L2_MEMORY_DMABUF, they must have the size and color
+ * format set on the output plane.
+ *
+ * The stand-in is configured through the environment when a device is
+ * opened:
+ *
+ *  - MMAPI_SW_RESOLUTION: coded resolution reported by the device, as
+ *    `<width>x<height>` (default 320x240).
+ *  - MMAPI_SW_RESOLUTION_CHANGES: later coded resolutions, as a comma
+ *    separated list of `<access unit>:<width>x<height>`. The device signals
+ *    a resolution change before decoding the given access unit and holds it
+ *    back until the capture plane buffers are allocated again.
+ *  - MMAPI_SW_REPLAY: raw I420 file with frames of the coded resolution,
+ *    replayed in a loop (e.g. `reference-*.raw` fixtures).
+ *  - MMAPI_SW_MIN_CAPTURE_BUFFERS: minimum number of capture buffers
+ *    reported by the device (default 6).
+ *  - MMAPI_SW_DPB_FRAMES: frames held in the decoded picture buffer before
+ *    being output, like the reordering delay of the hardware (default 0).
+ *    Frames are output right away once the DPB is disabled.
+ *  - MMAPI_SW_DECODE_LATENCY_US: time spent decoding each access unit, or
+ *    encoding each frame (default 0). They are then processed by a separate
+ *    thread, like on the hardware, instead of when they are queued.
+ *  - MMAPI_SW_UNPOLLABLE: when set, the device descriptors are reported as
+ *    not pollable, like on the hardware.
+ *
+ * Device and surface file descriptors are real descriptors (an eventfd and
+ * memfds), so they can be polled and mapped. Unlike the hardware one, the
+ * device descriptor reports the decoder state: it is readable while a
+ * capture buffer, the end of stream or an event can be dequeued.
+ */
+class NvSoftwareBackend : public NvDeviceBackend
+{
+public:
+    static NvSoftwareBackend &getSoftwareBackendInstance();
+
+    int open(const char *dev_node, int flags) override;
+    int close(int fd) override;
+    int ioctl(int fd, unsigned long request, void *arg) override;
+    void *mmap(void *addr, size_t length, int prot, int flags, int fd, int64_t offset) override;
+    int munmap(void *addr, size_t length) override;
+
+    int surfaceAllocate(NvBufSurface **surf, uint32_t batch_size,
+            NvBufSurfaceAllocateParams *params) override;
+    int surfaceDestroy(NvBufSurface *surf) override;
+    int surfaceFromFd(int dmabuf_fd, void **surf) override;
+    int surfaceMap(NvBufSurface *surf, int index, int plane,
+            NvBufSurfaceMemMapFlags type) override;
+    int surfaceUnMap(NvBufSurface *surf, int index, int plane) override;
+    int surfaceSyncForCpu(NvBufSurface *surf, int index, int plane) override;
+    int surfaceSyncForDevice(NvBufSurface *surf, int index, int plane) override;
+
+    int transform(NvBufSurface *src, NvBufSurface *dst,
+            NvBufSurfTransformParams *params) override;
+    int transformAsync(NvBufSurface *src, NvBufSurface *dst,
+            NvBufSurfTransformParams *params, NvBufSurfTransformSyncObj_t *sync_obj) override;
+    int syncObjWait(NvBufSurfTransformSyncObj_t sync_obj, uint32_t time_out) override;
+    int syncObjDestroy(NvBufSurfTransformSyncObj_t *sync_obj) override;
+    bool pollableDevices() override;
+
+private:
+    NvSoftwareBackend() {}
+
+    SwDevice *getDevice(int fd);
+    SwSurface *allocateSurface(uint32_t width, uint32_t height,
+            NvBufSurfaceColorFormat color_format);
+    void destroySurface(SwSurface *surface);
+
+    std::mutex lock;
+    std::map<int, SwDevice *> devices;
+    std::map<int, SwSurface *> surfaces;
+
+    friend struct SwDevice;
+};
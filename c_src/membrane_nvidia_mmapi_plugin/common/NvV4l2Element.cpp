@@ -32,7 +32,8 @@
 #include <fcntl.h>
 #include <cstring>
 #include <errno.h>
-#include <libv4l2.h>
+#include <unistd.h>
+#include "NvDeviceBackend.h"
 
 #define CAT_NAME "V4l2Element"
 
@@ -57,7 +58,7 @@ NvV4l2Element::NvV4l2Element(const char *comp_name, const char *dev_node, int fl
 
     /*Synchronization issue of libv4l2 open source library fixing here,adding lock for that*/
     pthread_mutex_lock(&initializer_mutex);
-    fd = v4l2_open(dev_node, flags | O_RDWR);
+    fd = NvDeviceBackend::getBackendInstance().open(dev_node, flags | O_RDWR);
     if (fd == -1)
     {
         COMP_SYS_ERROR_MSG("Could not open device '" << dev_node << "'");
@@ -69,7 +70,7 @@ NvV4l2Element::NvV4l2Element(const char *comp_name, const char *dev_node, int fl
 
     COMP_DEBUG_MSG("Opened, fd = " << fd);
 
-    ret = v4l2_ioctl(fd, VIDIOC_QUERYCAP, &caps);
+    ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_QUERYCAP, &caps);
     if (ret != 0)
     {
         COMP_SYS_ERROR_MSG("Error in VIDIOC_QUERYCAP");
@@ -91,7 +92,7 @@ NvV4l2Element::~NvV4l2Element()
 
     if (fd != -1)
     {
-        v4l2_close(fd);
+        NvDeviceBackend::getBackendInstance().close(fd);
         CAT_DEBUG_MSG("Device closed, fd = " << fd);
     }
 }
@@ -103,7 +104,7 @@ NvV4l2Element::dqEvent(struct v4l2_event &ev, uint32_t max_wait_ms)
 
     do
     {
-        ret = v4l2_ioctl(fd, VIDIOC_DQEVENT, &ev);
+        ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_DQEVENT, &ev);
 
         if (ret == 0)
         {
@@ -138,7 +139,7 @@ NvV4l2Element::setControl(uint32_t id, int32_t value)
     ctl.id = id;
     ctl.value = value;
 
-    ret = v4l2_ioctl(fd, VIDIOC_S_CTRL, &ctl);
+    ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_S_CTRL, &ctl);
 
     if (ret < 0)
     {
@@ -160,7 +161,7 @@ NvV4l2Element::getControl(uint32_t id, int32_t &value)
 
     ctl.id = id;
 
-    ret = v4l2_ioctl(fd, VIDIOC_G_CTRL, &ctl);
+    ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_G_CTRL, &ctl);
 
     if (ret < 0)
     {
@@ -179,7 +180,7 @@ NvV4l2Element::setExtControls(v4l2_ext_controls &ctl)
 {
     int ret;
 
-    ret = v4l2_ioctl(fd, VIDIOC_S_EXT_CTRLS, &ctl);
+    ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_S_EXT_CTRLS, &ctl);
 
     if (ret < 0)
     {
@@ -197,7 +198,7 @@ NvV4l2Element::getExtControls(v4l2_ext_controls &ctl)
 {
     int ret;
 
-    ret = v4l2_ioctl(fd, VIDIOC_G_EXT_CTRLS, &ctl);
+    ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_G_EXT_CTRLS, &ctl);
 
     if (ret < 0)
     {
@@ -222,7 +223,7 @@ NvV4l2Element::subscribeEvent(uint32_t type, uint32_t id, uint32_t flags)
     sub.id = id;
     sub.flags = flags;
 
-    ret = v4l2_ioctl(fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
+    ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
     if (ret == 0)
     {
         COMP_DEBUG_MSG("Successfully subscribed to event " << type);
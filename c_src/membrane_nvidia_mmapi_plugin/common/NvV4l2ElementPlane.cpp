@@ -3,10 +3,11 @@
 
 #include <cstring>
 #include <errno.h>
-#include <libv4l2.h>
+#include "NvDeviceBackend.h"
+#include "NvResourceSampler.h"
+#include "NvLatencyRecorder.h"
 #include <sys/mman.h>
 #include <sys/prctl.h>
-#include "nvbufsurface.h"
 
 #define CHECK_V4L2_RETURN(ret, str)              \
     if (ret < 0) {                               \
@@ -67,6 +68,14 @@ NvV4l2ElementPlane::NvV4l2ElementPlane(enum v4l2_buf_type buf_type,
     dqThread_data = NULL;
 }
 
+/* Profiled units are matched by the timestamp the device copies from the
+ * output buffers to the capture ones */
+static uint64_t
+unitKey(const struct v4l2_buffer &v4l2_buf)
+{
+    return v4l2_buf.timestamp.tv_sec * 1000000LL + v4l2_buf.timestamp.tv_usec;
+}
+
 NvV4l2ElementPlane::~NvV4l2ElementPlane()
 {
     pthread_mutex_destroy(&plane_lock);
@@ -95,7 +104,7 @@ NvV4l2ElementPlane::dqBuffer(struct v4l2_buffer &v4l2_buf, NvBuffer ** buffer,
     v4l2_buf.memory = memory_type;
     do
     {
-        ret = v4l2_ioctl(fd, VIDIOC_DQBUF, &v4l2_buf);
+        ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_DQBUF, &v4l2_buf);
 
         if (ret == 0)
         {
@@ -115,7 +124,7 @@ NvV4l2ElementPlane::dqBuffer(struct v4l2_buffer &v4l2_buf, NvBuffer ** buffer,
 
             if (buf_type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
             {
-                v4l2elem_profiler.finishProcessing(0, false);
+                v4l2elem_profiler.finishProcessing(unitKey(v4l2_buf), false);
             }
 
             total_dequeued_buffers++;
@@ -218,10 +227,11 @@ NvV4l2ElementPlane::qBuffer(struct v4l2_buffer &v4l2_buf, NvBuffer * shared_buff
 
     if(buf_type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE)
     {
+        NvLatencyRecorder::setStartKey(unitKey(v4l2_buf));
         v4l2elem_profiler.startProcessing();
     }
 
-    ret = v4l2_ioctl(fd, VIDIOC_QBUF, &v4l2_buf);
+    ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_QBUF, &v4l2_buf);
     if (ret)
     {
         is_in_error = 1;
@@ -251,7 +261,7 @@ NvV4l2ElementPlane::mapOutputBuffers(struct v4l2_buffer &v4l2_buf, int dmabuff_f
     switch (memory_type)
     {
         case V4L2_MEMORY_DMABUF:
-            ret = NvBufSurfaceFromFd (dmabuff_fd, (void**)(&nvbuf_surf));
+            ret = NvDeviceBackend::getBackendInstance().surfaceFromFd(dmabuff_fd, (void**)(&nvbuf_surf));
             if(ret < 0)
             {
                 PLANE_SYS_ERROR_MSG("Error: NvBufSurfaceFromFd Failed\n");
@@ -264,7 +274,7 @@ NvV4l2ElementPlane::mapOutputBuffers(struct v4l2_buffer &v4l2_buf, int dmabuff_f
                 v4l2_buf.m.planes[i].m.fd = buffers[v4l2_buf.index]->planes[i].fd;
                 buffers[v4l2_buf.index]->planes[i].mem_offset = nvbuf_surf->surfaceList[0].planeParams.offset[i];
 
-                ret = NvBufSurfaceMap(nvbuf_surf, 0, i, NVBUF_MAP_READ_WRITE);
+                ret = NvDeviceBackend::getBackendInstance().surfaceMap(nvbuf_surf, 0, i, NVBUF_MAP_READ_WRITE);
                 if (ret < 0)
                 {
                     is_in_error = 1;
@@ -302,7 +312,7 @@ NvV4l2ElementPlane::unmapOutputBuffers(int index, int dmabuff_fd)
         case V4L2_MEMORY_DMABUF:
             for (i = 0; i < n_planes; i++)
             {
-                ret = NvBufSurfaceFromFd (dmabuff_fd, (void**)(&nvbuf_surf));
+                ret = NvDeviceBackend::getBackendInstance().surfaceFromFd(dmabuff_fd, (void**)(&nvbuf_surf));
                 if (ret < 0)
                 {
                     is_in_error = 1;
@@ -311,7 +321,7 @@ NvV4l2ElementPlane::unmapOutputBuffers(int index, int dmabuff_fd)
                     return ret;
                 }
 
-                ret = NvBufSurfaceUnMap(nvbuf_surf, 0, i);
+                ret = NvDeviceBackend::getBackendInstance().surfaceUnMap(nvbuf_surf, 0, i);
                 if (ret < 0)
                 {
                     is_in_error = 1;
@@ -338,7 +348,7 @@ int
 NvV4l2ElementPlane::getFormat(struct v4l2_format &format)
 {
     format.type = buf_type;
-    CHECK_V4L2_RETURN(v4l2_ioctl(fd, VIDIOC_G_FMT, &format),
+    CHECK_V4L2_RETURN(NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_G_FMT, &format),
             "Getting format");
 }
 
@@ -349,7 +359,7 @@ NvV4l2ElementPlane::setFormat(struct v4l2_format &format)
     int j;
 
     format.type = buf_type;
-    ret = v4l2_ioctl(fd, VIDIOC_S_FMT, &format);
+    ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_S_FMT, &format);
     if (ret)
     {
         PLANE_SYS_ERROR_MSG("Error in VIDIOC_S_FMT");
@@ -374,7 +384,7 @@ NvV4l2ElementPlane::getCrop(struct v4l2_crop & crop)
 {
     crop.type = buf_type;
 
-    CHECK_V4L2_RETURN(v4l2_ioctl(fd, VIDIOC_G_CROP, &crop),
+    CHECK_V4L2_RETURN(NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_G_CROP, &crop),
             "Getting crop params");
 }
 
@@ -400,7 +410,7 @@ NvV4l2ElementPlane::setSelection(uint32_t target, uint32_t flags, struct v4l2_re
     select.flags = flags;
     select.r = rect;
 
-    CHECK_V4L2_RETURN(v4l2_ioctl(fd, VIDIOC_S_SELECTION, &select),
+    CHECK_V4L2_RETURN(NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_S_SELECTION, &select),
             "Setting selection");
 }
 
@@ -476,7 +486,7 @@ NvV4l2ElementPlane::reqbufs(enum v4l2_memory mem_type, uint32_t num)
     memory_type = mem_type;
 
     reqbufs.memory = mem_type;
-    ret = v4l2_ioctl(fd, VIDIOC_REQBUFS, &reqbufs);
+    ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_REQBUFS, &reqbufs);
     if (ret)
     {
         PLANE_SYS_ERROR_MSG("Error in VIDIOC_REQBUFS at output plane");
@@ -497,6 +507,13 @@ NvV4l2ElementPlane::reqbufs(enum v4l2_memory mem_type, uint32_t num)
         {
             for (uint32_t i = 0; i < num_buffers; i++)
             {
+                for (uint32_t j = 0; j < n_planes; j++)
+                {
+                    // Exported buffers of MMAP planes are counted as DMA buffers
+                    if (memory_type == V4L2_MEMORY_MMAP && buffers[i]->planes[j].fd >= 0)
+                        NvResourceSampler::addDmaBufferBytes(
+                                -(int64_t) buffers[i]->planes[j].length);
+                }
                 delete buffers[i];
             }
             delete[] buffers;
@@ -523,11 +540,11 @@ NvV4l2ElementPlane::setStreamStatus(bool status)
     pthread_mutex_lock(&plane_lock);
     if (status)
     {
-        ret = v4l2_ioctl(fd, VIDIOC_STREAMON, &buf_type);
+        ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_STREAMON, &buf_type);
     }
     else
     {
-        ret = v4l2_ioctl(fd, VIDIOC_STREAMOFF, &buf_type);
+        ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_STREAMOFF, &buf_type);
     }
     if (ret)
     {
@@ -544,15 +561,8 @@ NvV4l2ElementPlane::setStreamStatus(bool status)
             num_queued_buffers = 0;
             pthread_cond_broadcast(&plane_cond);
         }
-
-        if (buf_type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
-        {
-            if (status == false)
-            {
-                v4l2elem_profiler.disableProfiling();
-            }
-        }
-
+        /* Profiling isn't disabled on capture STREAMOFF, the decoder
+         * streams the capture plane off on every resolution change. */
     }
 
     pthread_mutex_unlock(&plane_lock);
@@ -571,7 +581,7 @@ NvV4l2ElementPlane::setStreamParms(struct v4l2_streamparm &parm)
     int ret;
 
     parm.type = buf_type;
-    ret = v4l2_ioctl(fd, VIDIOC_S_PARM, &parm);
+    ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_S_PARM, &parm);
 
     if(ret == 0)
     {
@@ -600,7 +610,7 @@ NvV4l2ElementPlane::queryBuffer(uint32_t i)
     v4l2_buf.m.planes = planes;
     v4l2_buf.length = n_planes;
 
-    ret = v4l2_ioctl(fd, VIDIOC_QUERYBUF, &v4l2_buf);
+    ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_QUERYBUF, &v4l2_buf);
     if (ret)
     {
         PLANE_SYS_ERROR_MSG("Error in QueryBuf for " << i << "th buffer");
@@ -635,7 +645,7 @@ NvV4l2ElementPlane::exportBuffer(uint32_t i)
     for (j = 0; j < n_planes; j++)
     {
         expbuf.plane = j;
-        ret = v4l2_ioctl(fd, VIDIOC_EXPBUF, &expbuf);
+        ret = NvDeviceBackend::getBackendInstance().ioctl(fd, VIDIOC_EXPBUF, &expbuf);
         if (ret)
         {
             PLANE_SYS_ERROR_MSG("Error in ExportBuf for Buffer " << i <<
@@ -648,6 +658,7 @@ NvV4l2ElementPlane::exportBuffer(uint32_t i)
             PLANE_DEBUG_MSG("ExportBuf successful for Buffer " << i <<
                     ", Plane " << j << ", fd = " << expbuf.fd);
             buffers[i]->planes[j].fd = expbuf.fd;
+            NvResourceSampler::addDmaBufferBytes(buffers[i]->planes[j].length);
         }
     }
     return 0;
@@ -895,7 +906,8 @@ NvV4l2ElementPlane::waitForDQThread(uint32_t max_wait_ms)
 
     if (ret == 0)
     {
-        pthread_join(dq_thread, NULL);
+        if (dq_thread)
+            pthread_join(dq_thread, NULL);
         dq_thread = 0;
         PLANE_DEBUG_MSG("Stopped DQ Thread");
     }
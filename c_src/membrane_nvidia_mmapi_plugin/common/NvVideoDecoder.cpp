@@ -3,7 +3,6 @@
 
 #include <cstring>
 #include <errno.h>
-#include <libv4l2.h>
 
 #define DECODER_DEV "/dev/nvhost-nvdec"
 #define CAT_NAME "NVDEC"
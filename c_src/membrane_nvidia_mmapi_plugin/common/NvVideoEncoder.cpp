@@ -0,0 +1,418 @@
+#include "NvVideoEncoder.h"
+#include "NvLogging.h"
+
+#include <cstring>
+#include <errno.h>
+
+#define ENCODER_DEV "/dev/nvhost-msenc"
+#define CAT_NAME "NVENC"
+
+#define CHECK_V4L2_RETURN(ret, str)              \
+    if (ret < 0) {                               \
+        COMP_SYS_ERROR_MSG(str << ": failed");   \
+        return -1;                               \
+    } else {                                     \
+        COMP_DEBUG_MSG(str << ": success");      \
+        return 0;                                \
+    }
+
+#define RETURN_ERROR_IF_FORMATS_SET() \
+    if (output_plane_pixfmt != 0 || capture_plane_pixfmt != 0) { \
+        COMP_ERROR_MSG("Should be called before setting plane formats") \
+        return -1; \
+    }
+
+#define RETURN_ERROR_IF_BUFFERS_REQUESTED() \
+    if (output_plane.getNumBuffers() != 0 && capture_plane.getNumBuffers() != 0) { \
+        COMP_ERROR_MSG("Should be called before requesting buffers on either plane") \
+        return -1; \
+    }
+
+#define RETURN_ERROR_IF_FORMATS_NOT_SET() \
+    if (output_plane_pixfmt == 0 || capture_plane_pixfmt == 0) { \
+        COMP_ERROR_MSG("Should be called after setting plane formats") \
+        return -1; \
+    }
+
+using namespace std;
+
+NvVideoEncoder::NvVideoEncoder(const char *name, int flags)
+    :NvV4l2Element(name, ENCODER_DEV, flags, valid_fields)
+{
+}
+
+NvVideoEncoder *
+NvVideoEncoder::createVideoEncoder(const char *name, int flags)
+{
+    NvVideoEncoder *enc = new NvVideoEncoder(name, flags);
+    if (enc->isInError())
+    {
+        delete enc;
+        return NULL;
+    }
+    return enc;
+}
+
+NvVideoEncoder::~NvVideoEncoder()
+{
+}
+
+int
+NvVideoEncoder::setCapturePlaneFormat(uint32_t pixfmt, uint32_t width,
+        uint32_t height, uint32_t sizeimage)
+{
+    struct v4l2_format format;
+
+    memset(&format, 0, sizeof(struct v4l2_format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    switch (pixfmt)
+    {
+        case V4L2_PIX_FMT_H264:
+        case V4L2_PIX_FMT_H265:
+        case V4L2_PIX_FMT_VP8:
+        case V4L2_PIX_FMT_VP9:
+        case V4L2_PIX_FMT_AV1:
+            capture_plane_pixfmt = pixfmt;
+            break;
+        default:
+            COMP_ERROR_MSG("Unsupported pixel format for encoder capture plane "
+                    << pixfmt);
+            return -1;
+    }
+
+    format.fmt.pix_mp.pixelformat = pixfmt;
+    format.fmt.pix_mp.width = width;
+    format.fmt.pix_mp.height = height;
+    format.fmt.pix_mp.num_planes = 1;
+    format.fmt.pix_mp.plane_fmt[0].sizeimage = sizeimage;
+
+    return capture_plane.setFormat(format);
+}
+
+int
+NvVideoEncoder::setOutputPlaneFormat(uint32_t pixfmt, uint32_t width,
+        uint32_t height)
+{
+    struct v4l2_format format;
+    uint32_t num_bufferplanes;
+    NvBuffer::NvBufferPlaneFormat planefmts[MAX_PLANES];
+
+    if (pixfmt != V4L2_PIX_FMT_YUV420M && pixfmt != V4L2_PIX_FMT_NV12M &&
+            pixfmt != V4L2_PIX_FMT_YUV444M && pixfmt != V4L2_PIX_FMT_P010M)
+    {
+        COMP_ERROR_MSG("Only YUV420M, NV12M, YUV444M and P010M are supported");
+        return -1;
+    }
+
+    output_plane_pixfmt = pixfmt;
+    NvBuffer::fill_buffer_plane_format(&num_bufferplanes, planefmts, width,
+            height, pixfmt);
+    output_plane.setBufferPlaneFormat(num_bufferplanes, planefmts);
+
+    memset(&format, 0, sizeof(struct v4l2_format));
+    format.type = output_plane.getBufType();
+    format.fmt.pix_mp.width = width;
+    format.fmt.pix_mp.height = height;
+    format.fmt.pix_mp.pixelformat = pixfmt;
+    format.fmt.pix_mp.num_planes = num_bufferplanes;
+
+    return output_plane.setFormat(format);
+}
+
+int
+NvVideoEncoder::setFrameRate(uint32_t framerate_num, uint32_t framerate_den)
+{
+    struct v4l2_streamparm parms;
+
+    RETURN_ERROR_IF_FORMATS_NOT_SET();
+
+    memset(&parms, 0, sizeof(parms));
+    parms.parm.output.timeperframe.numerator = framerate_den;
+    parms.parm.output.timeperframe.denominator = framerate_num;
+
+    CHECK_V4L2_RETURN(output_plane.setStreamParms(parms),
+            "Setting framerate to " << framerate_num << "/" << framerate_den);
+}
+
+int
+NvVideoEncoder::setBitrate(uint32_t bitrate)
+{
+    struct v4l2_ext_control control;
+    struct v4l2_ext_controls ctrls;
+
+    RETURN_ERROR_IF_FORMATS_NOT_SET();
+
+    memset(&control, 0, sizeof(control));
+    memset(&ctrls, 0, sizeof(ctrls));
+
+    ctrls.count = 1;
+    ctrls.controls = &control;
+    ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+    control.id = V4L2_CID_MPEG_VIDEO_BITRATE;
+    control.value = bitrate;
+
+    CHECK_V4L2_RETURN(setExtControls(ctrls),
+            "Setting encoder bitrate to " << bitrate);
+}
+
+int
+NvVideoEncoder::setProfile(uint32_t profile)
+{
+    struct v4l2_ext_control control;
+    struct v4l2_ext_controls ctrls;
+
+    RETURN_ERROR_IF_FORMATS_NOT_SET();
+    RETURN_ERROR_IF_BUFFERS_REQUESTED();
+
+    memset(&control, 0, sizeof(control));
+    memset(&ctrls, 0, sizeof(ctrls));
+
+    ctrls.count = 1;
+    ctrls.controls = &control;
+    ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+    switch (capture_plane_pixfmt)
+    {
+        case V4L2_PIX_FMT_H264:
+            control.id = V4L2_CID_MPEG_VIDEO_H264_PROFILE;
+            break;
+        case V4L2_PIX_FMT_H265:
+            control.id = V4L2_CID_MPEG_VIDEO_H265_PROFILE;
+            break;
+        default:
+            COMP_ERROR_MSG("Unsupported encoder type");
+            return -1;
+    }
+    control.value = profile;
+
+    CHECK_V4L2_RETURN(setExtControls(ctrls),
+            "Setting encoder profile to " << profile);
+}
+
+int
+NvVideoEncoder::setRateControlMode(enum v4l2_mpeg_video_bitrate_mode mode)
+{
+    struct v4l2_ext_control control;
+    struct v4l2_ext_controls ctrls;
+
+    RETURN_ERROR_IF_FORMATS_NOT_SET();
+    RETURN_ERROR_IF_BUFFERS_REQUESTED();
+
+    memset(&control, 0, sizeof(control));
+    memset(&ctrls, 0, sizeof(ctrls));
+
+    ctrls.count = 1;
+    ctrls.controls = &control;
+    ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+    control.id = V4L2_CID_MPEG_VIDEO_BITRATE_MODE;
+    control.value = (int32_t) mode;
+
+    CHECK_V4L2_RETURN(setExtControls(ctrls),
+            "Setting encoder rate control mode to " << mode);
+}
+
+int
+NvVideoEncoder::setIFrameInterval(uint32_t interval)
+{
+    struct v4l2_ext_control control;
+    struct v4l2_ext_controls ctrls;
+
+    RETURN_ERROR_IF_FORMATS_NOT_SET();
+    RETURN_ERROR_IF_BUFFERS_REQUESTED();
+
+    memset(&control, 0, sizeof(control));
+    memset(&ctrls, 0, sizeof(ctrls));
+
+    ctrls.count = 1;
+    ctrls.controls = &control;
+    ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+    control.id = V4L2_CID_MPEG_VIDEO_GOP_SIZE;
+    control.value = interval;
+
+    CHECK_V4L2_RETURN(setExtControls(ctrls),
+            "Setting encoder I-frame interval to " << interval);
+}
+
+int
+NvVideoEncoder::setIDRInterval(uint32_t interval)
+{
+    struct v4l2_ext_control control;
+    struct v4l2_ext_controls ctrls;
+
+    RETURN_ERROR_IF_FORMATS_NOT_SET();
+    RETURN_ERROR_IF_BUFFERS_REQUESTED();
+
+    memset(&control, 0, sizeof(control));
+    memset(&ctrls, 0, sizeof(ctrls));
+
+    ctrls.count = 1;
+    ctrls.controls = &control;
+    ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+    control.id = V4L2_CID_MPEG_VIDEO_IDR_INTERVAL;
+    control.value = interval;
+
+    CHECK_V4L2_RETURN(setExtControls(ctrls),
+            "Setting encoder IDR interval to " << interval);
+}
+
+int
+NvVideoEncoder::forceIDR()
+{
+    struct v4l2_ext_control control;
+    struct v4l2_ext_controls ctrls;
+
+    RETURN_ERROR_IF_FORMATS_NOT_SET();
+
+    memset(&control, 0, sizeof(control));
+    memset(&ctrls, 0, sizeof(ctrls));
+
+    ctrls.count = 1;
+    ctrls.controls = &control;
+    ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+    control.id = V4L2_CID_MPEG_VIDEOENC_FORCE_IDR_FRAME;
+
+    CHECK_V4L2_RETURN(setExtControls(ctrls),
+            "Forcing IDR");
+}
+
+int
+NvVideoEncoder::setHWPresetType(enum v4l2_enc_hw_preset_type type)
+{
+    struct v4l2_ext_control control;
+    struct v4l2_ext_controls ctrls;
+    v4l2_enc_hw_preset_type_param hw_preset_type;
+
+    RETURN_ERROR_IF_FORMATS_NOT_SET();
+    RETURN_ERROR_IF_BUFFERS_REQUESTED();
+
+    memset(&control, 0, sizeof(control));
+    memset(&ctrls, 0, sizeof(ctrls));
+    memset(&hw_preset_type, 0, sizeof(hw_preset_type));
+
+    ctrls.count = 1;
+    ctrls.controls = &control;
+    ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+    hw_preset_type.hw_preset_type = type;
+    hw_preset_type.set_max_enc_clock = false;
+
+    control.id = V4L2_CID_MPEG_VIDEOENC_HW_PRESET_TYPE_PARAM;
+    control.string = (char *)&hw_preset_type;
+
+    CHECK_V4L2_RETURN(setExtControls(ctrls),
+            "Setting encoder HW Preset type to " << type);
+}
+
+int
+NvVideoEncoder::setInsertSpsPpsAtIdrEnabled(bool enabled)
+{
+    struct v4l2_ext_control control;
+    struct v4l2_ext_controls ctrls;
+
+    RETURN_ERROR_IF_FORMATS_NOT_SET();
+    RETURN_ERROR_IF_BUFFERS_REQUESTED();
+
+    memset(&control, 0, sizeof(control));
+    memset(&ctrls, 0, sizeof(ctrls));
+
+    ctrls.count = 1;
+    ctrls.controls = &control;
+    ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+    control.id = V4L2_CID_MPEG_VIDEOENC_INSERT_SPS_PPS_AT_IDR;
+    control.value = enabled;
+
+    CHECK_V4L2_RETURN(setExtControls(ctrls),
+            "Setting encoder SPS PPS at IDR to " << enabled);
+}
+
+int
+NvVideoEncoder::setMaxPerfMode(int flag)
+{
+    struct v4l2_ext_control control;
+    struct v4l2_ext_controls ctrls;
+
+    RETURN_ERROR_IF_FORMATS_NOT_SET();
+    RETURN_ERROR_IF_BUFFERS_REQUESTED();
+
+    memset(&control, 0, sizeof(control));
+    memset(&ctrls, 0, sizeof(ctrls));
+
+    ctrls.count = 1;
+    ctrls.controls = &control;
+    ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+    control.id = V4L2_CID_MPEG_VIDEO_MAX_PERFORMANCE;
+    control.value = flag;
+
+    CHECK_V4L2_RETURN(setExtControls(ctrls),
+            "Enabling Maximum Performance ");
+}
+
+int
+NvVideoEncoder::DevicePoll(v4l2_ctrl_video_device_poll *devicepoll)
+{
+    struct v4l2_ext_control control;
+    struct v4l2_ext_controls ctrls;
+
+    RETURN_ERROR_IF_FORMATS_NOT_SET();
+
+    memset(&control, 0, sizeof(control));
+    memset(&ctrls, 0, sizeof(ctrls));
+
+    ctrls.count = 1;
+    ctrls.controls = &control;
+
+    control.id = V4L2_CID_MPEG_VIDEO_DEVICE_POLL;
+    control.string = (char *)devicepoll;
+
+    CHECK_V4L2_RETURN(setExtControls(ctrls),
+            "Done calling video device poll ");
+}
+
+int
+NvVideoEncoder::SetPollInterrupt()
+{
+    struct v4l2_ext_control control;
+    struct v4l2_ext_controls ctrls;
+
+    RETURN_ERROR_IF_FORMATS_NOT_SET();
+
+    memset(&control, 0, sizeof(control));
+    memset(&ctrls, 0, sizeof(ctrls));
+
+    ctrls.count = 1;
+    ctrls.controls = &control;
+
+    control.id = V4L2_CID_MPEG_SET_POLL_INTERRUPT;
+    control.value = 1;
+
+    CHECK_V4L2_RETURN(setExtControls(ctrls),
+            "Setting encoder poll interrupt to 1 ");
+}
+
+int
+NvVideoEncoder::ClearPollInterrupt()
+{
+    struct v4l2_ext_control control;
+    struct v4l2_ext_controls ctrls;
+
+    RETURN_ERROR_IF_FORMATS_NOT_SET();
+
+    memset(&control, 0, sizeof(control));
+    memset(&ctrls, 0, sizeof(ctrls));
+
+    ctrls.count = 1;
+    ctrls.controls = &control;
+
+    control.id = V4L2_CID_MPEG_SET_POLL_INTERRUPT;
+    control.value = 0;
+
+    CHECK_V4L2_RETURN(setExtControls(ctrls),
+            "Setting encoder poll interrupt to 0 ");
+}
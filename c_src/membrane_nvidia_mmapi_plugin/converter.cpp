@@ -0,0 +1,174 @@
+#include "converter.h"
+#include "surface_copy.h"
+#include <cstring>
+#include <stdexcept>
+
+static bool isYuv420(NvBufSurfaceColorFormat color_format)
+{
+    return color_format == NVBUF_COLOR_FORMAT_YUV420 || color_format == NVBUF_COLOR_FORMAT_NV12;
+}
+
+Converter* Converter::createConverter(const FrameFormat& input, const FrameFormat& output,
+    const NvBufSurfTransformRect& crop, NvBufSurfTransform_Flip flip, int in_flight)
+{
+    if (input.width <= 0 || input.height <= 0 || output.width <= 0 || output.height <= 0 ||
+        (isYuv420(input.color_format) && (input.width % 2 || input.height % 2)) ||
+        (isYuv420(output.color_format) && (output.width % 2 || output.height % 2))) {
+        throw std::runtime_error("invalid frame size");
+    }
+    if (in_flight <= 0) throw std::runtime_error("invalid number of conversions in flight");
+
+    NvBufSurfTransformRect src_rect = crop;
+    if (isYuv420(input.color_format)) {
+        src_rect.left &= ~1;
+        src_rect.top &= ~1;
+        src_rect.width &= ~1;
+        src_rect.height &= ~1;
+    }
+    if (src_rect.left + src_rect.width > (uint32_t)input.width ||
+        src_rect.top + src_rect.height > (uint32_t)input.height) {
+        throw std::runtime_error("invalid crop");
+    }
+
+    Converter* conv = new Converter();
+    NvBufSurf::NvCommonTransformParams& params = conv->m_transformParams;
+    memset(&params, 0, sizeof(params));
+    params.flag = NVBUFSURF_TRANSFORM_FILTER;
+    params.flip = flip;
+    params.filter = NvBufSurfTransformInter_Bilinear;
+    if (flip != NvBufSurfTransform_None) {
+        params.flag = (NvBufSurfTransform_Transform_Flag)(params.flag | NVBUFSURF_TRANSFORM_FLIP);
+    }
+    if (src_rect.width != 0 && src_rect.height != 0) {
+        params.flag = (NvBufSurfTransform_Transform_Flag)
+            (params.flag | NVBUFSURF_TRANSFORM_CROP_SRC);
+        params.src_top = src_rect.top;
+        params.src_left = src_rect.left;
+        params.src_width = src_rect.width;
+        params.src_height = src_rect.height;
+    }
+
+    try {
+        for (int i = 0; i < in_flight; i++) {
+            conv->m_srcSurfaces.push_back(conv->allocateSurface(input));
+            conv->m_dstSurfaces.push_back(conv->allocateSurface(output));
+        }
+    } catch (exception& e) {
+        delete conv;
+        throw;
+    }
+    return conv;
+}
+
+Converter::~Converter()
+{
+    NvDeviceBackend& backend = NvDeviceBackend::getBackendInstance();
+    for (auto& conversion : m_pendingConversions) {
+        backend.syncObjWait(conversion.sync_obj, -1);
+        backend.syncObjDestroy(&conversion.sync_obj);
+    }
+
+    this->destroySurfaces(m_srcSurfaces);
+    this->destroySurfaces(m_dstSurfaces);
+}
+
+// Allocates a surface of the given format, mapped for the lifetime of the
+// converter
+MappedSurface Converter::allocateSurface(const FrameFormat& format)
+{
+    NvDeviceBackend& backend = NvDeviceBackend::getBackendInstance();
+    NvBufSurf::NvCommonAllocateParams params;
+    MappedSurface mapped = {-1, NULL};
+
+    params.memType = NVBUF_MEM_SURFACE_ARRAY;
+    params.width = format.width;
+    params.height = format.height;
+    params.layout = NVBUF_LAYOUT_PITCH;
+    params.colorFormat = format.color_format;
+    params.memtag = NvBufSurfaceTag_VIDEO_CONVERT;
+
+    if (NvBufSurf::NvAllocate(&params, 1, &mapped.fd) < 0) {
+        throw std::runtime_error("could not allocate DMA buffer");
+    }
+
+    if (backend.surfaceFromFd(mapped.fd, (void**)&mapped.surface) < 0 ||
+        backend.surfaceMap(mapped.surface, 0, -1, NVBUF_MAP_READ_WRITE) < 0) {
+        NvBufSurf::NvDestroy(mapped.fd);
+        throw std::runtime_error("could not map buf surface");
+    }
+    return mapped;
+}
+
+void Converter::destroySurfaces(vector<MappedSurface>& surfaces)
+{
+    for (auto& mapped : surfaces) {
+        NvDeviceBackend::getBackendInstance().surfaceUnMap(mapped.surface, 0, -1);
+        NvBufSurf::NvDestroy(mapped.fd);
+    }
+    surfaces.clear();
+}
+
+int Converter::inputFrameSize()
+{
+    return surfaceFrameSize(m_srcSurfaces[0].surface);
+}
+
+int Converter::outputFrameSize()
+{
+    return surfaceFrameSize(m_dstSurfaces[0].surface);
+}
+
+void Converter::process(const unsigned char* data, int size, int64_t pts)
+{
+    if (size != this->inputFrameSize()) throw std::runtime_error("invalid frame size");
+    if (m_pendingConversions.size() >= m_srcSurfaces.size()) {
+        throw std::runtime_error("too many conversions in flight");
+    }
+
+    NvDeviceBackend& backend = NvDeviceBackend::getBackendInstance();
+    int index = m_nextIndex;
+    MappedSurface& src = m_srcSurfaces[index];
+
+    copyBufferToSurface(data, src.surface);
+    if (backend.surfaceSyncForDevice(src.surface, 0, -1) < 0) {
+        throw std::runtime_error("could not sync buf surface");
+    }
+
+    PendingConversion conversion = {index, pts, NULL};
+    if (NvBufSurf::NvTransformAsync(&m_transformParams, &conversion.sync_obj, src.fd,
+            m_dstSurfaces[index].fd) < 0) {
+        throw std::runtime_error("could not transform DMA buffer");
+    }
+
+    m_pendingConversions.push_back(conversion);
+    m_nextIndex = (index + 1) % m_srcSurfaces.size();
+}
+
+optional<pair<NvBufSurface*, int64_t>> Converter::nextFrame()
+{
+    if (m_pendingConversions.empty()) {
+        m_flushing = false;
+        return nullopt;
+    }
+    if (!m_flushing && m_pendingConversions.size() < m_srcSurfaces.size()) return nullopt;
+
+    NvDeviceBackend& backend = NvDeviceBackend::getBackendInstance();
+    PendingConversion conversion = m_pendingConversions.front();
+    m_pendingConversions.pop_front();
+
+    int res = backend.syncObjWait(conversion.sync_obj, -1);
+    backend.syncObjDestroy(&conversion.sync_obj);
+    if (res < 0) throw std::runtime_error("could not transform DMA buffer");
+
+    NvBufSurface* surface = m_dstSurfaces[conversion.index].surface;
+    if (backend.surfaceSyncForCpu(surface, 0, -1) < 0) {
+        throw std::runtime_error("could not sync buf surface");
+    }
+    return make_pair(surface, conversion.pts);
+}
+
+// The following calls to `nextFrame` return all the conversions in flight
+void Converter::flush()
+{
+    m_flushing = true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <deque>
+#include <optional>
+#include <vector>
+#include "NvBufSurface.h"
+#include "common/NvDeviceBackend.h"
+
+using namespace std;
+
+// Size and color format of the frames on one side of the converter
+struct FrameFormat {
+    int width;
+    int height;
+    NvBufSurfaceColorFormat color_format;
+};
+
+// A mapped surface of one of the rings of the converter
+struct MappedSurface {
+    int fd;
+    NvBufSurface* surface;
+};
+
+// A conversion running on the VIC
+struct PendingConversion {
+    int index;
+    int64_t pts;
+    NvBufSurfTransformSyncObj_t sync_obj;
+};
+
+// Converts raw frames in CPU memory with the VIC: each frame is copied into
+// a pooled source surface, scaled, cropped, flipped and converted into a
+// pooled destination surface, then copied out. Conversions are issued ahead
+// of the frame being returned, so that copying a frame in overlaps the
+// conversion of the previous one.
+class Converter
+{
+private:
+    NvBufSurf::NvCommonTransformParams m_transformParams;
+    // Conversion `n` uses the source and destination surfaces `n` modulo
+    // the number of conversions in flight
+    vector<MappedSurface> m_srcSurfaces;
+    vector<MappedSurface> m_dstSurfaces;
+    int m_nextIndex = 0;
+    deque<PendingConversion> m_pendingConversions;
+    bool m_flushing = false;
+
+    MappedSurface allocateSurface(const FrameFormat& format);
+    void destroySurfaces(vector<MappedSurface>& surfaces);
+public:
+    // An empty crop converts the whole frame, it is rounded down to even
+    // values for 4:2:0 inputs
+    static Converter* createConverter(const FrameFormat& input, const FrameFormat& output,
+        const NvBufSurfTransformRect& crop, NvBufSurfTransform_Flip flip, int in_flight);
+    ~Converter();
+
+    // Size of the input and output frames once packed
+    int inputFrameSize();
+    int outputFrameSize();
+
+    void process(const unsigned char* data, int size, int64_t pts);
+    // Returns the destination surface of the oldest conversion once enough
+    // of them are in flight, or all of them after `flush`. The surface is
+    // synchronized for reading and valid until the next call to `process`.
+    optional<pair<NvBufSurface*, int64_t>> nextFrame();
+    void flush();
+};
+
+typedef struct _converter_state {
+    Converter *conv;
+} State;
+
+#include "_generated/converter.h"
@@ -0,0 +1,28 @@
+module Membrane.Nvidia.MMAPI.Converter.Native
+
+state_type "State"
+
+interface [NIF]
+
+spec create(
+       input_format :: atom,
+       input_width :: int,
+       input_height :: int,
+       output_format :: atom,
+       output_width :: int,
+       output_height :: int,
+       crop :: [int],
+       flip :: atom,
+       conversions_in_flight :: int
+     ) :: {:ok :: label, state} | {:error :: label, reason :: atom}
+
+spec convert(payload, timestamp :: int64, state) ::
+       {:ok :: label, [payload], [int64]} | {:error :: label, reason :: atom}
+
+spec flush(state) :: {:ok :: label, [payload], [int64]} | {:error :: label, reason :: atom}
+
+# DMA buffers allocated by this native library at each monotonic timestamp,
+# summed with the other ones by ResourceSampler
+spec dma_buffer_bytes(timestamps_usec :: [uint64]) :: {:ok :: label, bytes :: [uint64]}
+
+dirty :cpu, convert: 3, flush: 1
@@ -0,0 +1,129 @@
+#include "converter.h"
+#include "surface_copy.h"
+#include "common/NvResourceSampler.h"
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+// Copies the converted frames ready to be returned
+void getConvertedFrames(UnifexEnv* env, State* state, vector<UnifexPayload*>& frames,
+    vector<int64_t>& pts_list)
+{
+    while (auto frame = state->conv->nextFrame()) {
+        UnifexPayload* payload = (UnifexPayload*)unifex_alloc(sizeof(UnifexPayload));
+        unifex_payload_alloc(env, UNIFEX_PAYLOAD_BINARY, surfaceFrameSize(frame->first),
+            payload);
+        copySurfaceToBuffer(frame->first, payload->data);
+
+        frames.push_back(payload);
+        pts_list.push_back(frame->second);
+    }
+}
+
+void releaseFrames(vector<UnifexPayload*>& frames)
+{
+    for (auto frame : frames) {
+        unifex_payload_release(frame);
+        unifex_free(frame);
+    }
+}
+
+NvBufSurfaceColorFormat colorFormat(const char* pixel_format)
+{
+    if (strcmp(pixel_format, "I420") == 0) return NVBUF_COLOR_FORMAT_YUV420;
+    if (strcmp(pixel_format, "NV12") == 0) return NVBUF_COLOR_FORMAT_NV12;
+    if (strcmp(pixel_format, "RGBA") == 0) return NVBUF_COLOR_FORMAT_RGBA;
+    if (strcmp(pixel_format, "BGRA") == 0) return NVBUF_COLOR_FORMAT_BGRA;
+    throw std::runtime_error("unsupported pixel format");
+}
+
+NvBufSurfTransform_Flip flipMethod(const char* flip)
+{
+    if (strcmp(flip, "none") == 0) return NvBufSurfTransform_None;
+    if (strcmp(flip, "horizontal") == 0) return NvBufSurfTransform_FlipX;
+    if (strcmp(flip, "vertical") == 0) return NvBufSurfTransform_FlipY;
+    if (strcmp(flip, "rotate_180") == 0) return NvBufSurfTransform_Rotate180;
+    throw std::runtime_error("unknown flip method");
+}
+
+UNIFEX_TERM create(UnifexEnv* env, char* input_format, int input_width, int input_height,
+    char* output_format, int output_width, int output_height, int* crop,
+    unsigned int crop_length, char* flip, int conversions_in_flight) {
+    UNIFEX_TERM res;
+    State* state = unifex_alloc_state(env);
+    state->conv = NULL;
+
+    try {
+        if (crop_length != 0 && crop_length != 4) throw std::runtime_error("invalid crop");
+        if (crop_length == 4 && (crop[0] < 0 || crop[1] < 0 || crop[2] < 0 || crop[3] < 0)) {
+            throw std::runtime_error("invalid crop");
+        }
+
+        FrameFormat input = {input_width, input_height, colorFormat(input_format)};
+        FrameFormat output = {output_width, output_height, colorFormat(output_format)};
+        NvBufSurfTransformRect crop_rect = {0, 0, 0, 0};
+        if (crop_length == 4) {
+            crop_rect = {(uint32_t)crop[1], (uint32_t)crop[0], (uint32_t)crop[2],
+                (uint32_t)crop[3]};
+        }
+
+        state->conv = Converter::createConverter(input, output, crop_rect, flipMethod(flip),
+            conversions_in_flight);
+        res = create_result_ok(env, state);
+    } catch (exception& e) {
+        res = create_result_error(env, e.what());
+    }
+
+    unifex_release_state(env, state);
+    return res;
+}
+
+UNIFEX_TERM convert(UnifexEnv* env, UnifexPayload* payload, int64_t timestamp, State* state) {
+    UNIFEX_TERM res;
+    vector<UnifexPayload*> frames;
+    vector<int64_t> pts;
+
+    try {
+        state->conv->process(payload->data, payload->size, timestamp);
+        getConvertedFrames(env, state, frames, pts);
+
+        res = convert_result_ok(env, frames.data(), frames.size(), pts.data(), pts.size());
+    } catch (exception& e) {
+        res = convert_result_error(env, e.what());
+    }
+
+    releaseFrames(frames);
+    return res;
+}
+
+UNIFEX_TERM flush(UnifexEnv* env, State* state) {
+    UNIFEX_TERM res;
+    vector<UnifexPayload*> frames;
+    vector<int64_t> pts;
+
+    try {
+        state->conv->flush();
+        getConvertedFrames(env, state, frames, pts);
+
+        res = flush_result_ok(env, frames.data(), frames.size(), pts.data(), pts.size());
+    } catch (exception& e) {
+        res = flush_result_error(env, e.what());
+    }
+
+    releaseFrames(frames);
+    return res;
+}
+
+UNIFEX_TERM dma_buffer_bytes(UnifexEnv* env, uint64_t* timestamps_usec,
+    unsigned int timestamps_usec_length) {
+    vector<uint64_t> bytes = NvResourceSampler::getDmaBufferBytes(
+        vector<uint64_t>(timestamps_usec, timestamps_usec + timestamps_usec_length));
+    return dma_buffer_bytes_result_ok(env, bytes.data(), bytes.size());
+}
+
+void handle_destroy_state(UnifexEnv* env, State* state) {
+    if (state->conv != NULL) delete state->conv;
+
+    UNIFEX_UNUSED(env);
+}
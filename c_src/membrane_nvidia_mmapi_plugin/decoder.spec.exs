@@ -4,8 +4,94 @@ state_type "State"
 
 interface [NIF]
 
-spec create(format :: atom, width :: int, height :: int) :: {:ok :: label, state} | {:error :: label, reason :: atom}
+spec create(
+       format :: atom,
+       width :: int,
+       height :: int,
+       zero_copy_input :: bool,
+       async :: bool,
+       output_surfaces :: int,
+       zero_copy_output :: bool,
+       input_buffers :: int,
+       input_buffer_size :: int,
+       disable_dpb :: bool,
+       max_perf :: bool,
+       skip_frames :: atom,
+       pixel_format :: atom,
+       crop :: [int],
+       rendition_widths :: [int],
+       rendition_heights :: [int],
+       rendition_formats :: [atom],
+       profiling :: bool
+     ) :: {:ok :: label, state} | {:error :: label, reason :: atom}
+
+# The frames of every output follow each other, in the order of the outputs
 spec decode(payload, timestamp :: int64, state) :: {:ok :: label, [payload], [int64]} | {:error :: label, reason :: atom}
+
+# Decodes several access units in a single call
+spec decode_batch(payloads :: [payload], timestamps :: [int64], state) ::
+       {:ok :: label, [payload], [int64]} | {:error :: label, reason :: atom}
+
+spec queued_input_buffers(state) ::
+       {:ok :: label, count :: int} | {:error :: label, reason :: atom}
 spec flush(state) :: {:ok :: label, [payload]} | {:error :: label, reason :: atom}
 
-dirty :cpu, decode: 3, flush: 1
+spec set_output_size(output :: int, width :: int, height :: int, state) ::
+       :ok :: label | {:error :: label, reason :: atom}
+
+spec set_crop(x :: int, y :: int, width :: int, height :: int, state) ::
+       :ok :: label | {:error :: label, reason :: atom}
+
+# Variants returning the frames as states holding a pooled surface
+spec decode_surfaces(payload, timestamp :: int64, state) ::
+       {:ok :: label, frames :: [state], [int64]} | {:error :: label, reason :: atom}
+
+spec decode_surfaces_batch(payloads :: [payload], timestamps :: [int64], state) ::
+       {:ok :: label, frames :: [state], [int64]} | {:error :: label, reason :: atom}
+
+spec flush_surfaces(state) ::
+       {:ok :: label, frames :: [state], [int64]} | {:error :: label, reason :: atom}
+
+# Latencies are only measured when the decoder is created with profiling
+spec get_stats(state) ::
+       {:ok :: label, decoded_frames :: uint64, profiling_time_usec :: uint64,
+        average_latency_usec :: uint64, min_latency_usec :: uint64,
+        max_latency_usec :: uint64, p50_latency_usec :: uint64, p99_latency_usec :: uint64,
+        p999_latency_usec :: uint64, queued_input_buffers :: int,
+        queued_capture_buffers :: int, transforms :: uint64, transform_time_usec :: uint64,
+        copies :: uint64, copy_time_usec :: uint64, too_many_profiled_elements :: bool}
+       | {:error :: label, reason :: atom}
+
+# Resources of the whole process, sampled every interval on a native thread
+spec start_resource_sampler(interval_ms :: int) :: :ok :: label
+spec stop_resource_sampler() :: :ok :: label
+
+# The threads of every sample follow each other, in the order of the samples
+spec resource_samples() ::
+       {:ok :: label, timestamps_usec :: [uint64], intervals_usec :: [uint64],
+        cpu_times_usec :: [uint64], rss_bytes :: [uint64],
+        decoder_dma_buffer_bytes :: [uint64],
+        thread_counts :: [int], thread_ids :: [int], thread_names :: [string],
+        thread_cpu_times_usec :: [uint64]}
+
+spec download(frame :: state) :: {:ok :: label, payload} | {:error :: label, reason :: atom}
+
+spec surface_info(frame :: state) ::
+       {:ok :: label, dmabuf_fd :: int, pitches :: [int], offsets :: [int]}
+       | {:error :: label, reason :: atom}
+
+sends {:decoded_frame :: label, [payload], pts :: int64}
+sends {:decoding_error :: label, reason :: atom}
+
+dirty :cpu,
+  decode: 3,
+  decode_batch: 3,
+  flush: 1,
+  decode_surfaces: 3,
+  decode_surfaces_batch: 3,
+  flush_surfaces: 1,
+  download: 1
+
+dirty :io,
+  start_resource_sampler: 1,
+  stop_resource_sampler: 0
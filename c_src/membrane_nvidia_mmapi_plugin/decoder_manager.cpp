@@ -0,0 +1,244 @@
+#include "decoder_manager.h"
+#include "video_decoder.h"
+#include <algorithm>
+#include <stdexcept>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+DecoderManager& DecoderManager::getInstance()
+{
+    static DecoderManager manager;
+    return manager;
+}
+
+DecoderManager::~DecoderManager()
+{
+    if (m_thread.joinable()) {
+        {
+            lock_guard<mutex> guard(m_lock);
+            m_stopping = true;
+        }
+        this->signal();
+        m_ready.notify_all();
+        m_thread.join();
+        for (auto& worker : m_workers) worker.join();
+    }
+
+    // Decoders still registered when the VM exits
+    m_registrations.clear();
+
+    if (m_epollFd >= 0) close(m_epollFd);
+    if (m_wakeFd >= 0) close(m_wakeFd);
+}
+
+// Starts the service thread and the workers on the first registration, with
+// the lock held
+void DecoderManager::start()
+{
+    struct epoll_event event = {};
+
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    event.events = EPOLLIN;
+    event.data.u64 = 0;
+
+    if (m_epollFd < 0 || m_wakeFd < 0 ||
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &event) < 0) {
+        if (m_epollFd >= 0) close(m_epollFd);
+        if (m_wakeFd >= 0) close(m_wakeFd);
+        m_epollFd = m_wakeFd = -1;
+        throw std::runtime_error("could not create the decoder service thread");
+    }
+
+    m_thread = thread(&DecoderManager::run, this);
+    pthread_setname_np(m_thread.native_handle(), "DecoderService");
+
+    unsigned workers = min(max(thread::hardware_concurrency(), 1u), MaxWorkers);
+    for (unsigned i = 0; i < workers; i++) {
+        m_workers.emplace_back(&DecoderManager::work, this);
+        pthread_setname_np(m_workers.back().native_handle(), "DecoderWorker");
+    }
+}
+
+void DecoderManager::add(Decoder* dec, int fd)
+{
+    lock_guard<mutex> guard(m_lock);
+    if (!m_thread.joinable()) this->start();
+
+    auto registration = make_unique<Registration>();
+    registration->id = m_nextId++;
+    registration->dec = dec;
+    registration->fd = fd;
+
+    if (fd < 0) {
+        registration->nextSweep = chrono::steady_clock::now();
+        m_registrations[registration->id] = move(registration);
+        this->signal();
+        return;
+    }
+
+    // Resolution changes are signaled as priority events. Decoders are
+    // armed again once serviced, so that a single worker services them.
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLPRI | EPOLLONESHOT;
+    event.data.u64 = registration->id;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        throw std::runtime_error("could not poll the decoder device");
+    }
+
+    m_registrations[registration->id] = move(registration);
+}
+
+void DecoderManager::remove(Decoder* dec)
+{
+    unique_lock<mutex> lock(m_lock);
+    auto it = find_if(m_registrations.begin(), m_registrations.end(),
+        [dec](auto& entry) { return entry.second->dec == dec; });
+    if (it == m_registrations.end()) return;
+
+    // A worker servicing the decoder uses the registration until done
+    uint64_t id = it->first;
+    auto registration = this->unregister(id);
+    m_serviced.wait(lock, [this, id]() { return m_servicing.count(id) == 0; });
+}
+
+void DecoderManager::wake(Decoder* dec)
+{
+    lock_guard<mutex> guard(m_lock);
+    for (auto& entry : m_registrations) {
+        Registration* registration = entry.second.get();
+        if (registration->dec != dec || registration->fd >= 0) continue;
+
+        registration->sweepInterval = MinSweepInterval;
+        if (registration->busy) {
+            registration->woken = true;
+        } else {
+            registration->nextSweep = chrono::steady_clock::now();
+            this->signal();
+        }
+    }
+}
+
+// Called with the lock held
+unique_ptr<DecoderManager::Registration> DecoderManager::unregister(uint64_t id)
+{
+    auto it = m_registrations.find(id);
+    if (it == m_registrations.end()) return nullptr;
+
+    auto registration = move(it->second);
+    m_registrations.erase(it);
+    m_pending.erase(std::remove(m_pending.begin(), m_pending.end(), id), m_pending.end());
+    if (registration->fd >= 0) epoll_ctl(m_epollFd, EPOLL_CTL_DEL, registration->fd, NULL);
+    return registration;
+}
+
+// Called with the lock held, once the decoder has been serviced. Swept
+// devices back off while they deliver nothing.
+void DecoderManager::rearm(Registration* registration, bool delivered)
+{
+    if (registration->fd >= 0) {
+        struct epoll_event event = {};
+        event.events = EPOLLIN | EPOLLPRI | EPOLLONESHOT;
+        event.data.u64 = registration->id;
+        epoll_ctl(m_epollFd, EPOLL_CTL_MOD, registration->fd, &event);
+        return;
+    }
+
+    auto now = chrono::steady_clock::now();
+    if (delivered || registration->woken) {
+        registration->sweepInterval = MinSweepInterval;
+    } else {
+        registration->sweepInterval = min(registration->sweepInterval * 2, MaxSweepInterval);
+    }
+    registration->nextSweep = registration->woken ? now : now + registration->sweepInterval;
+    registration->busy = false;
+    registration->woken = false;
+    this->signal();
+}
+
+void DecoderManager::signal()
+{
+    uint64_t value = 1;
+    if (write(m_wakeFd, &value, sizeof(value)) < 0) {}
+}
+
+// Called with the lock held. Hands the swept devices that are due to the
+// workers, returns the time until the next one is, in milliseconds, or -1
+// if none is waiting.
+int DecoderManager::sweep()
+{
+    auto now = chrono::steady_clock::now();
+    int timeout = -1;
+
+    for (auto& entry : m_registrations) {
+        Registration* registration = entry.second.get();
+        if (registration->fd >= 0 || registration->busy) continue;
+
+        if (registration->nextSweep <= now) {
+            registration->busy = true;
+            m_pending.push_back(registration->id);
+            continue;
+        }
+
+        auto wait = chrono::ceil<chrono::milliseconds>(registration->nextSweep - now);
+        if (timeout < 0 || wait.count() < timeout) timeout = wait.count();
+    }
+    return timeout;
+}
+
+// Hands the decoders with events to the workers, and sweeps the devices
+// that can't be polled
+void DecoderManager::run()
+{
+    struct epoll_event events[MaxEvents];
+    int timeout = -1;
+
+    while (true) {
+        int count = epoll_wait(m_epollFd, events, MaxEvents, timeout);
+
+        lock_guard<mutex> guard(m_lock);
+        if (m_stopping) return;
+
+        for (int i = 0; i < count; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == 0) {
+                uint64_t value;
+                if (read(m_wakeFd, &value, sizeof(value)) < 0) {}
+                continue;
+            }
+            if (m_registrations.count(id)) m_pending.push_back(id);
+        }
+        timeout = this->sweep();
+        if (!m_pending.empty()) m_ready.notify_all();
+    }
+}
+
+void DecoderManager::work()
+{
+    unique_lock<mutex> lock(m_lock);
+
+    while (true) {
+        m_ready.wait(lock, [this]() { return m_stopping || !m_pending.empty(); });
+        if (m_stopping) return;
+
+        uint64_t id = m_pending.front();
+        m_pending.pop_front();
+        Registration* registration = m_registrations.at(id).get();
+        m_servicing.insert(id);
+        lock.unlock();
+
+        // Removing the decoder waits for it to be serviced, the registration
+        // can be used until then
+        uint64_t delivered = registration->dec->deliveredFrames();
+        bool running = registration->dec->serviceCapture();
+        bool progress = registration->dec->deliveredFrames() != delivered;
+
+        lock.lock();
+        m_servicing.erase(id);
+        if (!running) this->unregister(id);
+        else if (m_registrations.count(id)) this->rearm(registration, progress);
+        m_serviced.notify_all();
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class Decoder;
+
+// Services the capture plane of every asynchronous decoder of the native
+// library: a single thread multiplexes the device descriptors with epoll,
+// and hands each decoder whose device is readable to a small pool of
+// workers, which dequeue, convert and deliver its frames. A decoder is
+// serviced by one worker at a time, so its frames are delivered in order.
+//
+// Devices whose descriptor can't be polled are swept by the same thread
+// instead: it hands them to the workers, which dequeue without waiting, at
+// an interval doubling while they deliver nothing. Queueing an access unit
+// or flushing sweeps the decoder again right away.
+class DecoderManager
+{
+private:
+    static constexpr int MaxEvents = 64;
+    static constexpr unsigned MaxWorkers = 4;
+    static constexpr chrono::milliseconds MinSweepInterval {1};
+    static constexpr chrono::milliseconds MaxSweepInterval {16};
+
+    struct Registration
+    {
+        uint64_t id;
+        Decoder* dec;
+        // Device descriptor, -1 if the device is swept
+        int fd;
+        // For swept devices, set while waiting for a worker or serviced
+        bool busy = false;
+        // Set by `wake` while busy, the decoder is swept again once serviced
+        bool woken = false;
+        chrono::milliseconds sweepInterval = MinSweepInterval;
+        chrono::steady_clock::time_point nextSweep;
+    };
+
+    int m_epollFd = -1;
+    // Wakes the service thread up on shutdown, and when a swept device is
+    // due earlier
+    int m_wakeFd = -1;
+    thread m_thread;
+    vector<thread> m_workers;
+    mutex m_lock;
+    condition_variable m_ready;
+    condition_variable m_serviced;
+    // Registrations by id, the data of their epoll events. Ids aren't
+    // reused, unlike the addresses of the decoders.
+    map<uint64_t, unique_ptr<Registration>> m_registrations;
+    uint64_t m_nextId = 1;
+    // Registrations with events, waiting for a worker
+    deque<uint64_t> m_pending;
+    set<uint64_t> m_servicing;
+    bool m_stopping = false;
+
+    DecoderManager() = default;
+    void start();
+    void run();
+    void work();
+    int sweep();
+    void rearm(Registration* registration, bool delivered);
+    void signal();
+    unique_ptr<Registration> unregister(uint64_t id);
+public:
+    static DecoderManager& getInstance();
+    ~DecoderManager();
+
+    // Starts servicing the decoder once its capture plane is set up. `fd`
+    // is the device descriptor, or -1 if it can't be polled.
+    void add(Decoder* dec, int fd);
+    // Stops servicing the decoder, waits for the workers to be done with it
+    // if it's being serviced
+    void remove(Decoder* dec);
+    // Sweeps the decoder again right away, called once an access unit is
+    // queued. Nothing to do for polled devices.
+    void wake(Decoder* dec);
+};
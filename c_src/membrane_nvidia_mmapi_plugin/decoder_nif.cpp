@@ -1,69 +1,211 @@
 #include "decoder.h"
+#include "surface_copy.h"
+#include "common/NvResourceSampler.h"
 
 using namespace std;
 
-void dmabufToPayload(int dmabuf_fd, uint total_planes, UnifexPayload* payload)
+// Packs the planes of the surface into the payload
+void surfaceToPayload(Decoder* dec, NvBufSurface* nvbuf_surf, UnifexPayload* payload)
 {
-    uint offset = 0;
+    auto start = chrono::steady_clock::now();
+    copySurfaceToBuffer(nvbuf_surf, payload->data);
+    dec->recordCopy(chrono::steady_clock::now() - start);
+}
 
-    for (uint plane = 0; plane < total_planes; plane++) {
-        NvBufSurface *nvbuf_surf = 0;
-        if (NvBufSurfaceFromFd(dmabuf_fd, (void**)(&nvbuf_surf)) < 0) {
-            throw std::runtime_error("could not create buf surface");
-        }
+// Appends the frames ready to be returned to `frames` and `pts_list`. Each
+// frame is appended once per output of the decoder, in the order of the
+// outputs.
+void getDecodedFrames(UnifexEnv* env, State* state, vector<UnifexPayload*>& frames,
+    vector<int64_t>& pts_list)
+{
+    vector<pair<vector<int>, int64_t>> converted;
 
-        if (NvBufSurfaceMap(nvbuf_surf, 0, plane, NVBUF_MAP_READ_WRITE) < 0) {
-            throw std::runtime_error("could not map buf surface");
+    // Convert as many frames as there are destination surfaces before copying
+    // them out, so the capture buffers go back to the decoder while we copy.
+    do {
+        converted.clear();
+        while (converted.size() < (size_t)state->dec->outputSurfaces()) {
+            auto frame = state->dec->nextFrame();
+            if (!frame) break;
+            converted.push_back(*frame);
         }
 
-        NvBufSurfaceSyncForCpu (nvbuf_surf, 0, plane);
+        for (auto& [fds, pts] : converted) {
+            for (int fd : fds) {
+                NvBufSurface* surface = state->dec->surfaceForCpu(fd);
+                UnifexPayload* payload = (UnifexPayload*)unifex_alloc(sizeof(UnifexPayload));
+                unifex_payload_alloc(env, UNIFEX_PAYLOAD_BINARY, surfaceFrameSize(surface),
+                    payload);
+                surfaceToPayload(state->dec, surface, payload);
+                if (state->dec->zeroCopyOutput()) state->dec->releaseSurface(fd);
 
-        int row_size = nvbuf_surf->surfaceList->planeParams.width[plane] * nvbuf_surf->surfaceList->planeParams.bytesPerPix[plane];
-        for (uint i = 0; i < nvbuf_surf->surfaceList->planeParams.height[plane]; ++i)
-        {
-            memcpy(payload->data + offset + i * row_size, 
-                (char*)nvbuf_surf->surfaceList->mappedAddr.addr[plane] + i * nvbuf_surf->surfaceList->planeParams.pitch[plane],
-                row_size
-            );
+                frames.push_back(payload);
+            }
+            pts_list.push_back(pts);
         }
-        offset += nvbuf_surf->surfaceList->planeParams.height[plane] 
-            * nvbuf_surf->surfaceList->planeParams.width[plane] 
-            * nvbuf_surf->surfaceList->planeParams.bytesPerPix[plane];
+    } while (!converted.empty());
+}
 
-        if (NvBufSurfaceUnMap(nvbuf_surf, 0, plane) < 0) {
-            throw std::runtime_error("could not unmap buf surface");
+// In zero-copy mode the decoder reads the payload in place. A copy of its
+// term in an env of its own keeps the binary alive until the decoder is done
+// with it, refc binaries are shared by the copy rather than duplicated.
+void processPayload(UnifexEnv* env, State* state, UnifexPayload* payload, int64_t timestamp)
+{
+    if (!state->dec->zeroCopyInput()) {
+        state->dec->process(payload->data, payload->size, timestamp);
+        return;
+    }
+
+    shared_ptr<UnifexEnv> pin(unifex_alloc_env(NULL), unifex_free_env);
+    ErlNifBinary binary;
+    ERL_NIF_TERM term = enif_make_copy(pin.get(), unifex_payload_to_term(env, payload));
+    if (!enif_inspect_binary(pin.get(), term, &binary)) {
+        throw std::runtime_error("could not keep the payload");
+    }
+    state->dec->process(binary.data, binary.size, timestamp, pin);
+}
+
+void releaseFrames(vector<UnifexPayload*>& frames)
+{
+    for (auto frame : frames) {
+        unifex_payload_release(frame);
+        unifex_free(frame);
+    }
+}
+
+// Wraps each decoded frame in a state holding its surface until garbage
+// collected, one per output like `getDecodedFrames`
+void getDecodedSurfaces(UnifexEnv* env, State* state, vector<State*>& frames,
+    vector<int64_t>& pts_list)
+{
+    try {
+        while (auto frame = state->dec->nextFrame()) {
+            for (int fd : frame->first) {
+                State* surface = unifex_alloc_state(env);
+                surface->dec = NULL;
+                surface->owner = state;
+                surface->dmabuf_fd = fd;
+                unifex_keep_state(env, state);
+
+                frames.push_back(surface);
+            }
+            pts_list.push_back(frame->second);
         }
+    } catch (exception& e) {
+        for (auto frame : frames) unifex_release_state(env, frame);
+        frames.clear();
+        throw;
     }
 }
 
-pair<vector<UnifexPayload*>, vector<int64_t>> getDecodedFrames(UnifexEnv* env, State* state)
+// Runs on a decoder manager worker in asynchronous mode, sends the
+// frame of every output in a single message
+void sendDecodedFrame(Decoder* dec, UnifexPid pid, const vector<int>& dmabuf_fds, int64_t pts)
 {
-    vector<UnifexPayload*> frames;
-    vector<int64_t> pts_list;
-    
-    while(auto pair = state->dec->nextFrame())
-    {
-        auto [fd, pts] { *pair };
-        UnifexPayload* payload = (UnifexPayload*)unifex_alloc(sizeof(UnifexPayload));
-        unifex_payload_alloc(env, UNIFEX_PAYLOAD_BINARY, state->dec->frameSize(), payload);
-        dmabufToPayload(fd, 3, payload);
-        
-        frames.push_back(payload);
-        pts_list.push_back(pts);
+    UnifexEnv* env = unifex_alloc_env(NULL);
+    vector<UnifexPayload> payloads(dmabuf_fds.size());
+    vector<UnifexPayload*> payload_ptrs;
+
+    try {
+        for (size_t i = 0; i < dmabuf_fds.size(); i++) {
+            NvBufSurface* surface = dec->surfaceForCpu(dmabuf_fds[i]);
+            unifex_payload_alloc(env, UNIFEX_PAYLOAD_BINARY, surfaceFrameSize(surface),
+                &payloads[i]);
+            payload_ptrs.push_back(&payloads[i]);
+            surfaceToPayload(dec, surface, &payloads[i]);
+        }
+        send_decoded_frame(env, pid, UNIFEX_SEND_THREADED, payload_ptrs.data(),
+            payload_ptrs.size(), pts);
+    } catch (exception& e) {
+        for (auto payload : payload_ptrs) unifex_payload_release(payload);
+        unifex_free_env(env);
+        throw;
     }
 
-    return {frames, pts_list};
+    for (auto payload : payload_ptrs) unifex_payload_release(payload);
+    unifex_free_env(env);
+}
+
+void sendDecodingError(UnifexPid pid, const char* reason)
+{
+    UnifexEnv* env = unifex_alloc_env(NULL);
+    send_decoding_error(env, pid, UNIFEX_SEND_THREADED, reason);
+    unifex_free_env(env);
+}
+
+enum v4l2_skip_frames_type skipFramesType(const char* skip_frames)
+{
+    if (strcmp(skip_frames, "none") == 0) return V4L2_SKIP_FRAMES_TYPE_NONE;
+    if (strcmp(skip_frames, "non_ref") == 0) return V4L2_SKIP_FRAMES_TYPE_NONREF;
+    if (strcmp(skip_frames, "idr_only") == 0) return V4L2_SKIP_FRAMES_TYPE_DECODE_IDR_ONLY;
+    throw std::runtime_error("unknown skip frames mode");
 }
 
-UNIFEX_TERM create(UnifexEnv *env, char* pix_fmt, int width, int height) {
+NvBufSurfaceColorFormat colorFormat(const char* pixel_format)
+{
+    if (strcmp(pixel_format, "I420") == 0) return NVBUF_COLOR_FORMAT_YUV420;
+    if (strcmp(pixel_format, "NV12") == 0) return NVBUF_COLOR_FORMAT_NV12;
+    if (strcmp(pixel_format, "RGBA") == 0) return NVBUF_COLOR_FORMAT_RGBA;
+    if (strcmp(pixel_format, "BGRA") == 0) return NVBUF_COLOR_FORMAT_BGRA;
+    if (strcmp(pixel_format, "BGRx") == 0) return NVBUF_COLOR_FORMAT_BGRx;
+    throw std::runtime_error("unsupported pixel format");
+}
+
+// The first output has the given size and pixel format, the renditions add
+// one output each
+UNIFEX_TERM create(UnifexEnv *env, char* pix_fmt, int width, int height, int zero_copy_input, int async,
+    int output_surfaces, int zero_copy_output, int input_buffers, int input_buffer_size,
+    int disable_dpb, int max_perf, char* skip_frames, char* pixel_format,
+    int* crop, unsigned int crop_length, int* rendition_widths,
+    unsigned int rendition_widths_length, int* rendition_heights,
+    unsigned int rendition_heights_length, char** rendition_formats,
+    unsigned int rendition_formats_length, int profiling) {
     UNIFEX_TERM res;
     State *state = unifex_alloc_state(env);
+    state->dec = NULL;
+    state->owner = NULL;
     
     try {
-        state->dec = Decoder::createDecoder(pix_fmt, width, height);
+        if (async && zero_copy_output) {
+            throw std::runtime_error("zero copy output is not supported in async mode");
+        }
+
+        if (crop_length != 0 && crop_length != 4) throw std::runtime_error("invalid crop");
+
+        if (rendition_widths_length != rendition_heights_length ||
+            rendition_widths_length != rendition_formats_length) {
+            throw std::runtime_error("invalid renditions");
+        }
+
+        vector<OutputFormat> outputs = {{width, height, colorFormat(pixel_format)}};
+        for (unsigned int i = 0; i < rendition_widths_length; i++) {
+            outputs.push_back({rendition_widths[i], rendition_heights[i],
+                colorFormat(rendition_formats[i])});
+        }
+
+        state->dec = Decoder::createDecoder(pix_fmt, outputs, zero_copy_input, output_surfaces,
+            zero_copy_output, input_buffers, input_buffer_size, disable_dpb, max_perf,
+            skipFramesType(skip_frames), profiling);
+
+        if (crop_length == 4) state->dec->setCrop(crop[0], crop[1], crop[2], crop[3]);
+
+        if (async) {
+            Decoder* dec = state->dec;
+            UnifexPid pid;
+            unifex_self(env, &pid);
+
+            dec->setFrameCallback(
+                [dec, pid](const vector<int>& fds, int64_t pts) {
+                    sendDecodedFrame(dec, pid, fds, pts);
+                },
+                [pid](const char* reason) { sendDecodingError(pid, reason); }
+            );
+        }
+
         res = create_result_ok(env, state);
     } catch (exception& e) {
         res = create_result_error(env, e.what());
+        unifex_release_state(env, state);
     }
 
     // unifex_release_state(env, state);
@@ -71,46 +213,279 @@ UNIFEX_TERM create(UnifexEnv *env, char* pix_fmt, int width, int height) {
 }
 
 UNIFEX_TERM decode(UnifexEnv *env, UnifexPayload* payload, int64_t timestamp, State* state) {
+    if (state->dec == NULL) return decode_result_error(env, "not_a_decoder");
+
     UNIFEX_TERM res;
+    vector<UnifexPayload*> frames;
+    vector<int64_t> pts;
 
     try {
-        state->dec->process(payload->data, payload->size, timestamp);
-        auto [frames, pts] = getDecodedFrames(env, state);
+        processPayload(env, state, payload, timestamp);
+        getDecodedFrames(env, state, frames, pts);
 
         res = decode_result_ok(env, frames.data(), frames.size(), pts.data(), pts.size());
-
-        for (auto frame : frames) {
-            unifex_payload_release(frame);
-            unifex_free(frame);
-        }
     } catch (exception& e) {
         res = decode_result_error(env, e.what());
     }
   
+    releaseFrames(frames);
     return res;
 }
 
+// Queues all the access units in a single call. The frames are collected
+// after each of them, as the output plane only has room for a few.
+UNIFEX_TERM decode_batch(UnifexEnv *env, UnifexPayload** payloads, unsigned int payloads_length,
+    int64_t* timestamps, unsigned int timestamps_length, State* state) {
+    if (state->dec == NULL) return decode_batch_result_error(env, "not_a_decoder");
+
+    UNIFEX_TERM res;
+    vector<UnifexPayload*> frames;
+    vector<int64_t> pts;
+
+    if (payloads_length != timestamps_length) {
+        return decode_batch_result_error(env, "timestamps_mismatch");
+    }
+
+    try {
+        for (unsigned int i = 0; i < payloads_length; i++) {
+            processPayload(env, state, payloads[i], timestamps[i]);
+            getDecodedFrames(env, state, frames, pts);
+        }
+
+        res = decode_batch_result_ok(env, frames.data(), frames.size(), pts.data(), pts.size());
+    } catch (exception& e) {
+        res = decode_batch_result_error(env, e.what());
+    }
+
+    releaseFrames(frames);
+    return res;
+}
+
+UNIFEX_TERM decode_surfaces(UnifexEnv *env, UnifexPayload* payload, int64_t timestamp, State* state) {
+    if (state->dec == NULL) return decode_surfaces_result_error(env, "not_a_decoder");
+
+    UNIFEX_TERM res;
+    vector<State*> frames;
+    vector<int64_t> pts;
+
+    try {
+        processPayload(env, state, payload, timestamp);
+        getDecodedSurfaces(env, state, frames, pts);
+
+        res = decode_surfaces_result_ok(env, frames.data(), frames.size(), pts.data(), pts.size());
+    } catch (exception& e) {
+        res = decode_surfaces_result_error(env, e.what());
+    }
+
+    for (auto frame : frames) unifex_release_state(env, frame);
+    return res;
+}
+
+UNIFEX_TERM decode_surfaces_batch(UnifexEnv *env, UnifexPayload** payloads,
+    unsigned int payloads_length, int64_t* timestamps, unsigned int timestamps_length,
+    State* state) {
+    if (state->dec == NULL) return decode_surfaces_batch_result_error(env, "not_a_decoder");
+
+    UNIFEX_TERM res;
+    vector<State*> frames;
+    vector<int64_t> pts;
+
+    if (payloads_length != timestamps_length) {
+        return decode_surfaces_batch_result_error(env, "timestamps_mismatch");
+    }
+
+    try {
+        for (unsigned int i = 0; i < payloads_length; i++) {
+            processPayload(env, state, payloads[i], timestamps[i]);
+            getDecodedSurfaces(env, state, frames, pts);
+        }
+
+        res = decode_surfaces_batch_result_ok(env, frames.data(), frames.size(), pts.data(),
+            pts.size());
+    } catch (exception& e) {
+        res = decode_surfaces_batch_result_error(env, e.what());
+    }
+
+    for (auto frame : frames) unifex_release_state(env, frame);
+    return res;
+}
+
+UNIFEX_TERM queued_input_buffers(UnifexEnv* env, State* state) {
+    if (state->dec == NULL) return queued_input_buffers_result_error(env, "not_a_decoder");
+
+    return queued_input_buffers_result_ok(env, state->dec->queuedInputBuffers());
+}
+
 UNIFEX_TERM flush(UnifexEnv* env, State* state) {
+    if (state->dec == NULL) return decode_result_error(env, "not_a_decoder");
+
     UNIFEX_TERM res;
 
+    vector<UnifexPayload*> frames;
+    vector<int64_t> pts;
+
     try {
         state->dec->flush();
-        auto [frames, pts] = getDecodedFrames(env, state);
+        getDecodedFrames(env, state, frames, pts);
 
         res = decode_result_ok(env, frames.data(), frames.size(), pts.data(), pts.size());
-    
-        for (auto frame : frames) {
-            unifex_payload_release(frame);
-            unifex_free(frame);
-        }
     } catch (exception& e) {
         res = decode_result_error(env, e.what());
     }
 
+    releaseFrames(frames);
     return res;
 }
 
+UNIFEX_TERM flush_surfaces(UnifexEnv* env, State* state) {
+    if (state->dec == NULL) return flush_surfaces_result_error(env, "not_a_decoder");
+
+    UNIFEX_TERM res;
+
+    vector<State*> frames;
+    vector<int64_t> pts;
+
+    try {
+        state->dec->flush();
+        getDecodedSurfaces(env, state, frames, pts);
+
+        res = flush_surfaces_result_ok(env, frames.data(), frames.size(), pts.data(), pts.size());
+    } catch (exception& e) {
+        res = flush_surfaces_result_error(env, e.what());
+    }
+
+    for (auto frame : frames) unifex_release_state(env, frame);
+    return res;
+}
+
+UNIFEX_TERM set_output_size(UnifexEnv* env, int output, int width, int height, State* state) {
+    if (state->dec == NULL) return set_output_size_result_error(env, "not_a_decoder");
+
+    try {
+        if (output < 0) throw std::runtime_error("unknown output");
+        state->dec->setOutputSize(output, width, height);
+        return set_output_size_result_ok(env);
+    } catch (exception& e) {
+        return set_output_size_result_error(env, e.what());
+    }
+}
+
+UNIFEX_TERM set_crop(UnifexEnv* env, int x, int y, int width, int height, State* state) {
+    if (state->dec == NULL) return set_crop_result_error(env, "not_a_decoder");
+
+    try {
+        state->dec->setCrop(x, y, width, height);
+        return set_crop_result_ok(env);
+    } catch (exception& e) {
+        return set_crop_result_error(env, e.what());
+    }
+}
+
+UNIFEX_TERM get_stats(UnifexEnv* env, State* state) {
+    if (state->dec == NULL) return get_stats_result_error(env, "not_a_decoder");
+
+    DecoderStats stats = state->dec->stats();
+    NvElementProfiler::NvElementProfilerData& profiler = stats.profiler;
+    uint64_t profiling_time_usec =
+        profiler.profiling_time.tv_sec * 1000000L + profiler.profiling_time.tv_usec;
+
+    return get_stats_result_ok(env, profiler.total_processed_units, profiling_time_usec,
+        profiler.average_latency_usec, profiler.min_latency_usec, profiler.max_latency_usec,
+        stats.latency.p50_usec, stats.latency.p99_usec, stats.latency.p999_usec,
+        stats.queuedInputBuffers, stats.queuedCaptureBuffers, stats.transforms,
+        stats.transformTimeUsec, stats.copies, stats.copyTimeUsec, stats.tooManyProfiledElements);
+}
+
+UNIFEX_TERM start_resource_sampler(UnifexEnv* env, int interval_ms) {
+    NvResourceSampler::getInstance().start(max(interval_ms, 1));
+    return start_resource_sampler_result_ok(env);
+}
+
+UNIFEX_TERM stop_resource_sampler(UnifexEnv* env) {
+    NvResourceSampler::getInstance().stop();
+    return stop_resource_sampler_result_ok(env);
+}
+
+UNIFEX_TERM resource_samples(UnifexEnv* env) {
+    vector<NvResourceSample> samples = NvResourceSampler::getInstance().getSamples();
+    vector<uint64_t> timestamps, intervals, cpu_times, rss, decoder_dma_buffers, thread_cpu_times;
+    vector<int> thread_counts, thread_ids;
+    vector<const char*> thread_names;
+
+    for (NvResourceSample& sample : samples) {
+        timestamps.push_back(sample.timestamp_usec);
+        intervals.push_back(sample.interval_usec);
+        cpu_times.push_back(sample.cpu_time_usec);
+        rss.push_back(sample.rss_bytes);
+        // Only the surfaces allocated by this library, the decoders
+        decoder_dma_buffers.push_back(sample.dma_buffer_bytes);
+        thread_counts.push_back(sample.num_threads);
+
+        for (uint32_t i = 0; i < sample.num_threads; i++) {
+            thread_ids.push_back(sample.threads[i].tid);
+            thread_names.push_back(sample.threads[i].name);
+            thread_cpu_times.push_back(sample.threads[i].cpu_time_usec);
+        }
+    }
+
+    return resource_samples_result_ok(env, timestamps.data(), timestamps.size(),
+        intervals.data(), intervals.size(), cpu_times.data(), cpu_times.size(), rss.data(),
+        rss.size(), decoder_dma_buffers.data(), decoder_dma_buffers.size(),
+        thread_counts.data(), thread_counts.size(), thread_ids.data(), thread_ids.size(), thread_names.data(),
+        thread_names.size(), thread_cpu_times.data(), thread_cpu_times.size());
+}
+
+UNIFEX_TERM download(UnifexEnv* env, State* frame) {
+    UNIFEX_TERM res;
+
+    if (frame->owner == NULL) return download_result_error(env, "not_a_frame");
+
+    UnifexPayload payload;
+
+    try {
+        NvBufSurface* surface = frame->owner->dec->surfaceForCpu(frame->dmabuf_fd);
+        unifex_payload_alloc(env, UNIFEX_PAYLOAD_BINARY, surfaceFrameSize(surface), &payload);
+        surfaceToPayload(frame->owner->dec, surface, &payload);
+        res = download_result_ok(env, &payload);
+        unifex_payload_release(&payload);
+    } catch (exception& e) {
+        res = download_result_error(env, e.what());
+    }
+
+    return res;
+}
+
+UNIFEX_TERM surface_info(UnifexEnv* env, State* frame) {
+    if (frame->owner == NULL) return surface_info_result_error(env, "not_a_frame");
+
+    try {
+        NvBufSurfaceParams& params = frame->owner->dec->surface(frame->dmabuf_fd)->surfaceList[0];
+        uint num_planes = params.planeParams.num_planes;
+        int pitches[NVBUF_MAX_PLANES];
+        int offsets[NVBUF_MAX_PLANES];
+        for (uint plane = 0; plane < num_planes; plane++) {
+            pitches[plane] = params.planeParams.pitch[plane];
+            offsets[plane] = params.planeParams.offset[plane];
+        }
+
+        return surface_info_result_ok(env, frame->dmabuf_fd, pitches, num_planes, offsets,
+            num_planes);
+    } catch (exception& e) {
+        return surface_info_result_error(env, e.what());
+    }
+}
+
 void handle_destroy_state(UnifexEnv* env, State* state) {
+    if (state->owner != NULL) {
+        // Destructors can't report errors, a surface that can't be released
+        // is left to its decoder
+        try {
+            state->owner->dec->releaseSurface(state->dmabuf_fd);
+        } catch (exception&) {
+        }
+        unifex_release_state(env, state->owner);
+    }
+
     if (state->dec != NULL) delete state->dec;
 
     UNIFEX_UNUSED(env);
@@ -0,0 +1,137 @@
+#include "device_poll.h"
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <pthread.h>
+#include <thread>
+
+// Runs the expired deadlines in order on a thread started with the first one
+class PollDeadlines
+{
+private:
+    typedef chrono::steady_clock::time_point TimePoint;
+    typedef multimap<TimePoint, pair<uint64_t, function<void()>>> Deadlines;
+
+    mutex m_lock;
+    condition_variable m_changed;
+    condition_variable m_expired;
+    Deadlines m_deadlines;
+    map<uint64_t, Deadlines::iterator> m_armed;
+    uint64_t m_nextId = 1;
+    // Deadline whose callback is running, 0 if none
+    uint64_t m_running = 0;
+    bool m_stopping = false;
+    thread m_thread;
+
+    PollDeadlines() = default;
+
+    void run()
+    {
+        unique_lock<mutex> lock(m_lock);
+
+        while (!m_stopping) {
+            if (m_deadlines.empty()) {
+                m_changed.wait(lock);
+                continue;
+            }
+
+            // The deadline may be cancelled while waiting for it
+            auto next = m_deadlines.begin();
+            TimePoint deadline = next->first;
+            if (deadline > chrono::steady_clock::now()) {
+                m_changed.wait_until(lock, deadline);
+                continue;
+            }
+
+            auto [id, expire] = next->second;
+            m_armed.erase(id);
+            m_deadlines.erase(next);
+            m_running = id;
+
+            lock.unlock();
+            expire();
+            lock.lock();
+
+            m_running = 0;
+            m_expired.notify_all();
+        }
+    }
+
+public:
+    static PollDeadlines& getInstance()
+    {
+        static PollDeadlines deadlines;
+        return deadlines;
+    }
+
+    ~PollDeadlines()
+    {
+        {
+            lock_guard<mutex> guard(m_lock);
+            m_stopping = true;
+        }
+        m_changed.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    uint64_t arm(int timeout_ms, function<void()> expire)
+    {
+        lock_guard<mutex> guard(m_lock);
+        if (!m_thread.joinable()) {
+            m_thread = thread(&PollDeadlines::run, this);
+            pthread_setname_np(m_thread.native_handle(), "PollDeadlines");
+        }
+
+        uint64_t id = m_nextId++;
+        TimePoint deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+        auto it = m_deadlines.emplace(deadline, make_pair(id, expire));
+        m_armed[id] = it;
+        if (it == m_deadlines.begin()) m_changed.notify_all();
+        return id;
+    }
+
+    bool expired(uint64_t id)
+    {
+        lock_guard<mutex> guard(m_lock);
+        return m_armed.count(id) == 0;
+    }
+
+    bool cancel(uint64_t id)
+    {
+        unique_lock<mutex> lock(m_lock);
+        auto it = m_armed.find(id);
+        if (it != m_armed.end()) {
+            m_deadlines.erase(it->second);
+            m_armed.erase(it);
+            return false;
+        }
+
+        m_expired.wait(lock, [this, id]() { return m_running != id; });
+        return true;
+    }
+};
+
+PollDeadline::PollDeadline(int timeout_ms, function<void()> expire)
+{
+    m_id = PollDeadlines::getInstance().arm(timeout_ms, expire);
+}
+
+PollDeadline::~PollDeadline()
+{
+    this->cancel();
+}
+
+bool PollDeadline::expired()
+{
+    return m_done ? m_expired : PollDeadlines::getInstance().expired(m_id);
+}
+
+bool PollDeadline::cancel()
+{
+    if (!m_done) {
+        m_expired = PollDeadlines::getInstance().cancel(m_id);
+        m_done = true;
+    }
+    return m_expired;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstring>
+#include <functional>
+#include <poll.h>
+#include <stdexcept>
+#include <stdint.h>
+#include "v4l2_nv_extensions.h"
+
+using namespace std;
+
+// Calls `expire` from a timer thread if it's still armed `timeout_ms` after
+// being created. Shared by all the deadlines of the native library.
+class PollDeadline
+{
+private:
+    uint64_t m_id;
+    bool m_done = false;
+    bool m_expired = false;
+public:
+    PollDeadline(int timeout_ms, function<void()> expire);
+    ~PollDeadline();
+
+    bool expired();
+    // Disarms the deadline, returns whether it expired. If `expire` is
+    // running, waits for it to return.
+    bool cancel();
+};
+
+// Waits for events of an NvVideoDecoder or NvVideoEncoder for at most
+// `timeout_ms`. DevicePoll can't time out by itself, so it's interrupted with
+// SetPollInterrupt once the deadline passes. Returns the events received, 0 on
+// timeout, and throws if the device reports an error.
+template <typename Device>
+uint16_t pollDevice(Device* device, uint16_t events, int timeout_ms)
+{
+    struct v4l2_ctrl_video_device_poll devicepoll;
+
+    memset(&devicepoll, 0, sizeof(devicepoll));
+    devicepoll.req_events = events | POLLERR;
+
+    PollDeadline deadline(timeout_ms, [device]() { device->SetPollInterrupt(); });
+    int ret;
+    do {
+        devicepoll.resp_events = 0;
+        ret = device->DevicePoll(&devicepoll);
+    } while (ret >= 0 && devicepoll.resp_events == 0 && !deadline.expired());
+
+    // The interrupt stays set until cleared, failing the next polls
+    bool expired = deadline.cancel();
+    if (expired) device->ClearPollInterrupt();
+
+    if (ret < 0 && !expired) throw std::runtime_error("could not poll the device");
+    if (ret < 0) return 0;
+    if (devicepoll.resp_events & POLLERR) throw std::runtime_error("device error");
+    return devicepoll.resp_events;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "video_encoder.h"
+
+typedef struct _encoder_state {
+    Encoder *enc;
+} State;
+
+#include "_generated/encoder.h"
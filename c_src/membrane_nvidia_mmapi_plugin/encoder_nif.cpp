@@ -0,0 +1,125 @@
+#include "encoder.h"
+#include "common/NvResourceSampler.h"
+
+using namespace std;
+
+// Copies the access units ready to be returned, giving their capture plane
+// buffer back to the encoder right away
+void getEncodedFrames(UnifexEnv* env, State* state, vector<UnifexPayload*>& frames,
+    vector<int64_t>& pts_list, vector<int>& keyframes)
+{
+    while (auto frame = state->enc->nextFrame()) {
+        UnifexPayload* payload = (UnifexPayload*)unifex_alloc(sizeof(UnifexPayload));
+        unifex_payload_alloc(env, UNIFEX_PAYLOAD_BINARY, frame->size, payload);
+        memcpy(payload->data, frame->data, frame->size);
+        state->enc->releaseFrame(*frame);
+
+        frames.push_back(payload);
+        pts_list.push_back(frame->pts);
+        keyframes.push_back(frame->keyframe);
+    }
+}
+
+void releaseFrames(vector<UnifexPayload*>& frames)
+{
+    for (auto frame : frames) {
+        unifex_payload_release(frame);
+        unifex_free(frame);
+    }
+}
+
+UNIFEX_TERM create(UnifexEnv* env, char* codec, int width, int height, int framerate_num,
+    int framerate_den, int bitrate, int gop_size, char* profile, char* preset, int max_perf,
+    int input_buffers, int output_buffers, int output_buffer_size) {
+    UNIFEX_TERM res;
+    State* state = unifex_alloc_state(env);
+    state->enc = NULL;
+
+    try {
+        EncoderOptions options;
+        options.pixfmt = encoderPixelFormat(codec);
+        options.width = width;
+        options.height = height;
+        options.framerateNum = framerate_num;
+        options.framerateDen = framerate_den;
+        options.bitrate = bitrate;
+        options.gopSize = gop_size;
+        options.profile = encoderProfile(options.pixfmt, profile);
+        options.preset = encoderPreset(preset);
+        options.maxPerf = max_perf;
+        options.dmabufInput = false;
+        options.inputBuffers = input_buffers;
+        options.outputBuffers = output_buffers;
+        options.outputBufferSize = output_buffer_size;
+
+        state->enc = Encoder::createEncoder(options);
+        res = create_result_ok(env, state);
+    } catch (exception& e) {
+        res = create_result_error(env, e.what());
+    }
+
+    unifex_release_state(env, state);
+    return res;
+}
+
+UNIFEX_TERM encode(UnifexEnv* env, UnifexPayload* payload, int64_t timestamp, State* state) {
+    UNIFEX_TERM res;
+    vector<UnifexPayload*> frames;
+    vector<int64_t> pts;
+    vector<int> keyframes;
+
+    try {
+        state->enc->process(payload->data, payload->size, timestamp);
+        getEncodedFrames(env, state, frames, pts, keyframes);
+
+        res = encode_result_ok(env, frames.data(), frames.size(), pts.data(), pts.size(),
+            keyframes.data(), keyframes.size());
+    } catch (exception& e) {
+        res = encode_result_error(env, e.what());
+    }
+
+    releaseFrames(frames);
+    return res;
+}
+
+UNIFEX_TERM flush(UnifexEnv* env, State* state) {
+    UNIFEX_TERM res;
+    vector<UnifexPayload*> frames;
+    vector<int64_t> pts;
+    vector<int> keyframes;
+
+    try {
+        state->enc->flush();
+        getEncodedFrames(env, state, frames, pts, keyframes);
+
+        res = flush_result_ok(env, frames.data(), frames.size(), pts.data(), pts.size(),
+            keyframes.data(), keyframes.size());
+    } catch (exception& e) {
+        res = flush_result_error(env, e.what());
+    }
+
+    releaseFrames(frames);
+    return res;
+}
+
+UNIFEX_TERM force_keyframe(UnifexEnv* env, State* state) {
+    try {
+        state->enc->forceKeyframe();
+        return force_keyframe_result_ok(env);
+    } catch (exception& e) {
+        return force_keyframe_result_error(env, e.what());
+    }
+}
+
+UNIFEX_TERM dma_buffer_bytes(UnifexEnv* env, uint64_t* timestamps_usec,
+    unsigned int timestamps_usec_length) {
+    vector<uint64_t> bytes = NvResourceSampler::getDmaBufferBytes(
+        vector<uint64_t>(timestamps_usec, timestamps_usec + timestamps_usec_length));
+    return dma_buffer_bytes_result_ok(env, bytes.data(), bytes.size());
+}
+
+void handle_destroy_state(UnifexEnv* env, State* state) {
+    if (state->enc != NULL) delete state->enc;
+
+    UNIFEX_UNUSED(env);
+}
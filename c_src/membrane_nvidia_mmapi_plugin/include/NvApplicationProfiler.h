@@ -0,0 +1,62 @@
+#pragma once
+
+#include <iostream>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+/**
+ * Samples the CPU usage of the whole process from a thread of its own.
+ */
+class NvApplicationProfiler
+{
+public:
+    static const uint64_t DefaultSamplingInterval = 100;
+
+    typedef struct
+    {
+        /** Time between start and stop. */
+        struct timeval total_time;
+        float peak_cpu_usage;
+        float avg_cpu_usage;
+        uint32_t num_cpu_cores;
+        uint32_t cpu_freq_mhz;
+    } NvAppProfilerData;
+
+    static NvApplicationProfiler &getProfilerInstance();
+
+    void start(uint32_t sampling_interval_ms);
+    void stop();
+    void printProfilerData(std::ostream &outstream = std::cout);
+    void getProfilerData(NvAppProfilerData &data);
+
+private:
+    pthread_mutex_t thread_lock;
+    pthread_t profiling_thread;
+    bool running;
+    uint32_t sampling_interval;
+
+    bool check_cpu_usage;
+    uint32_t num_cpu_cores;
+    uint32_t cpu_freq;
+
+    struct
+    {
+        struct timeval start_time;
+        struct timeval stop_time;
+
+        uint32_t num_readings;
+        float min_cpu_usage;
+        float max_cpu_usage;
+
+        struct timespec start_proc_cpu_clock_time;
+        struct timespec stop_proc_cpu_clock_time;
+        struct timespec start_cpu_clock_time;
+        struct timespec stop_cpu_clock_time;
+    } data;
+
+    static void *ProfilerThread(void *);
+    void profile();
+
+    NvApplicationProfiler();
+};
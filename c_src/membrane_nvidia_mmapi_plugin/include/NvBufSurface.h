@@ -0,0 +1,44 @@
+#pragma once
+
+#include "nvbufsurface.h"
+#include "nvbufsurftransform.h"
+
+/**
+ * Helpers allocating and transforming NvBufSurface buffers by their DMABUF
+ * descriptor.
+ */
+namespace NvBufSurf
+{
+
+typedef struct
+{
+    uint32_t width;
+    uint32_t height;
+    NvBufSurfaceColorFormat colorFormat;
+    NvBufSurfaceLayout layout;
+    NvBufSurfaceMemType memType;
+    NvBufSurfaceTag memtag;
+} NvCommonAllocateParams;
+
+typedef struct
+{
+    uint32_t src_top;
+    uint32_t src_left;
+    uint32_t src_width;
+    uint32_t src_height;
+    uint32_t dst_top;
+    uint32_t dst_left;
+    uint32_t dst_width;
+    uint32_t dst_height;
+    NvBufSurfTransform_Transform_Flag flag;
+    NvBufSurfTransform_Flip flip;
+    NvBufSurfTransform_Inter filter;
+} NvCommonTransformParams;
+
+int NvAllocate(NvCommonAllocateParams *allocateParams, uint32_t numBuffers, int *fd);
+int NvDestroy(int fd);
+int NvTransform(NvCommonTransformParams *transformParams, int src_fd, int dst_fd);
+int NvTransformAsync(NvCommonTransformParams *transformParams,
+        NvBufSurfTransformSyncObj_t *syncobj, int src_fd, int dst_fd);
+
+}
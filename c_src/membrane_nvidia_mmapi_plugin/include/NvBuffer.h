@@ -0,0 +1,79 @@
+#pragma once
+
+#include <linux/videodev2.h>
+#include <pthread.h>
+#include <stdint.h>
+#include "v4l2_nv_extensions.h"
+
+/** Maximum number of planes of a buffer. */
+#define MAX_PLANES 3
+
+/**
+ * Buffer of a V4L2 plane or of the application, made of up to MAX_PLANES
+ * planes.
+ */
+class NvBuffer
+{
+public:
+    typedef struct
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t bytesperpixel;
+        /** Bytes per row. */
+        uint32_t stride;
+        uint32_t sizeimage;
+    } NvBufferPlaneFormat;
+
+    typedef struct
+    {
+        NvBufferPlaneFormat fmt;
+        /** Mapped address, NULL if not mapped. */
+        unsigned char *data;
+        uint32_t bytesused;
+        /** DMABUF or device descriptor of the plane. */
+        int fd;
+        /** Offset of the plane in the buffer of the device. */
+        uint32_t mem_offset;
+        uint32_t length;
+    } NvBufferPlane;
+
+    /** Buffer of a V4L2 plane. */
+    NvBuffer(enum v4l2_buf_type buf_type, enum v4l2_memory memory_type,
+            uint32_t n_planes, NvBufferPlaneFormat *fmt, uint32_t index);
+    /** Raw buffer of the application holding a frame of `pixfmt`. */
+    NvBuffer(uint32_t pixfmt, uint32_t width, uint32_t height, uint32_t index);
+    /** Raw buffer of the application holding `size` bytes. */
+    NvBuffer(uint32_t size, uint32_t index);
+    ~NvBuffer();
+
+    int map();
+    void unmap();
+    int allocateMemory();
+    void deallocateMemory();
+
+    int ref();
+    int unref();
+
+    const enum v4l2_buf_type buf_type;
+    const enum v4l2_memory memory_type;
+    const uint32_t index;
+
+    uint32_t n_planes;
+    NvBufferPlane planes[MAX_PLANES];
+
+    static int fill_buffer_plane_format(uint32_t *num_planes,
+            NvBuffer::NvBufferPlaneFormat *planefmts,
+            uint32_t width, uint32_t height, uint32_t raw_pixfmt);
+
+private:
+    uint32_t ref_count;
+    pthread_mutex_t ref_lock;
+
+    bool mapped;
+    bool allocated;
+    /** Buffer queued on another plane along with this one. */
+    NvBuffer *shared_buffer;
+
+    friend class NvV4l2ElementPlane;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <iostream>
+#include "NvElementProfiler.h"
+
+/**
+ * Base class of the elements of the Jetson Multimedia API.
+ */
+class NvElement
+{
+public:
+    virtual ~NvElement() {}
+
+    /** Returns non-zero if the element is in error. */
+    virtual int isInError()
+    {
+        return is_in_error;
+    }
+
+    void getProfilingData(NvElementProfiler::NvElementProfilerData &data);
+    void printProfilingStats(std::ostream &out_stream = std::cout);
+    virtual void enableProfiling();
+    virtual bool isProfilingEnabled();
+
+protected:
+    NvElement(const char *name,
+            NvElementProfiler::ProfilerField = NvElementProfiler::PROFILER_FIELD_ALL);
+
+    int is_in_error;
+    const char *comp_name;
+    NvElementProfiler profiler;
+};
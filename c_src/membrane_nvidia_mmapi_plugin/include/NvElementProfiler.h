@@ -0,0 +1,74 @@
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+/**
+ * Measures the throughput and the processing latency of an element. Only
+ * NvElement and the V4L2 classes start and finish the units.
+ */
+class NvElementProfiler
+{
+public:
+    typedef enum
+    {
+        PROFILER_FIELD_NONE = 0,
+        PROFILER_FIELD_TOTAL_UNITS = 1,
+        PROFILER_FIELD_LATE_UNITS = 2,
+        PROFILER_FIELD_LATENCIES = 4,
+        PROFILER_FIELD_FPS = 8,
+        PROFILER_FIELD_ALL = (PROFILER_FIELD_FPS << 1) - 1,
+    } ProfilerField;
+
+    typedef struct
+    {
+        /** Bitmask of the ProfilerField set in the data. */
+        uint32_t valid_fields;
+
+        float average_fps;
+        uint64_t total_processed_units;
+        uint64_t num_late_units;
+        uint64_t average_latency_usec;
+        uint64_t min_latency_usec;
+        uint64_t max_latency_usec;
+        struct timeval profiling_time;
+    } NvElementProfilerData;
+
+    void getProfilerData(NvElementProfilerData &data);
+    void printProfilerData(std::ostream &out_stream = std::cout);
+
+    uint64_t startProcessing();
+    void finishProcessing(uint64_t id, bool is_late);
+
+    void enableProfiling(bool reset_data);
+    void disableProfiling();
+
+private:
+    pthread_mutex_t profiler_lock;
+    bool enabled;
+
+    uint32_t unit_id_counter;
+    const ProfilerField valid_fields;
+
+    struct NvElementProfilerDataInternal : NvElementProfilerData
+    {
+        struct timeval start_time;
+        struct timeval stop_time;
+        struct timeval accumulated_time;
+        uint64_t total_latency;
+    } data_int;
+
+    std::map<uint64_t, struct timeval> unit_start_time_queue;
+
+    NvElementProfiler(ProfilerField fields);
+    ~NvElementProfiler();
+
+    void reset();
+
+    friend class NvElement;
+    friend class NvV4l2ElementPlane;
+    friend class NvV4l2Element;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstring>
+#include <errno.h>
+#include <iostream>
+
+/**
+ * Logging macros of the Jetson Multimedia API classes. Messages up to
+ * `log_level` are written to stderr, prefixed with the location and the
+ * category (CAT_), the element (COMP_) or the element and plane (PLANE_).
+ */
+
+#define LOG_LEVEL_INFO 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_DEBUG 3
+
+#define DEFAULT_LOG_LEVEL LOG_LEVEL_ERROR
+
+extern int log_level;
+extern const char *log_level_name[];
+
+#define LOG_MSG(level, prefix, str) \
+    if (log_level >= level) { \
+        std::cerr << "[" << log_level_name[level] << "] (" << __FILE__ << ":" \
+                  << __LINE__ << ") " << prefix << str << std::endl; \
+    }
+
+#define LOG_SYS_MSG(level, prefix, str) \
+    if (log_level >= level) { \
+        std::cerr << "[" << log_level_name[level] << "] (" << __FILE__ << ":" \
+                  << __LINE__ << ") " << prefix << str << ": " << strerror(errno) \
+                  << std::endl; \
+    }
+
+#define INFO_MSG(str) LOG_MSG(LOG_LEVEL_INFO, "", str)
+#define ERROR_MSG(str) LOG_MSG(LOG_LEVEL_ERROR, "", str)
+#define SYS_ERROR_MSG(str) LOG_SYS_MSG(LOG_LEVEL_ERROR, "", str)
+#define WARN_MSG(str) LOG_MSG(LOG_LEVEL_WARN, "", str)
+#define DEBUG_MSG(str) LOG_MSG(LOG_LEVEL_DEBUG, "", str)
+
+#define CAT_INFO_MSG(str) LOG_MSG(LOG_LEVEL_INFO, "<" CAT_NAME "> ", str)
+#define CAT_ERROR_MSG(str) LOG_MSG(LOG_LEVEL_ERROR, "<" CAT_NAME "> ", str)
+#define CAT_SYS_ERROR_MSG(str) LOG_SYS_MSG(LOG_LEVEL_ERROR, "<" CAT_NAME "> ", str)
+#define CAT_WARN_MSG(str) LOG_MSG(LOG_LEVEL_WARN, "<" CAT_NAME "> ", str)
+#define CAT_DEBUG_MSG(str) LOG_MSG(LOG_LEVEL_DEBUG, "<" CAT_NAME "> ", str)
+
+#define COMP_INFO_MSG(str) LOG_MSG(LOG_LEVEL_INFO, "<" << comp_name << "> ", str)
+#define COMP_ERROR_MSG(str) LOG_MSG(LOG_LEVEL_ERROR, "<" << comp_name << "> ", str)
+#define COMP_SYS_ERROR_MSG(str) LOG_SYS_MSG(LOG_LEVEL_ERROR, "<" << comp_name << "> ", str)
+#define COMP_WARN_MSG(str) LOG_MSG(LOG_LEVEL_WARN, "<" << comp_name << "> ", str)
+#define COMP_DEBUG_MSG(str) LOG_MSG(LOG_LEVEL_DEBUG, "<" << comp_name << "> ", str)
+
+#define PLANE_INFO_MSG(str) \
+    LOG_MSG(LOG_LEVEL_INFO, "<" << comp_name << "> " << plane_name << ": ", str)
+#define PLANE_ERROR_MSG(str) \
+    LOG_MSG(LOG_LEVEL_ERROR, "<" << comp_name << "> " << plane_name << ": ", str)
+#define PLANE_SYS_ERROR_MSG(str) \
+    LOG_SYS_MSG(LOG_LEVEL_ERROR, "<" << comp_name << "> " << plane_name << ": ", str)
+#define PLANE_WARN_MSG(str) \
+    LOG_MSG(LOG_LEVEL_WARN, "<" << comp_name << "> " << plane_name << ": ", str)
+#define PLANE_DEBUG_MSG(str) \
+    LOG_MSG(LOG_LEVEL_DEBUG, "<" << comp_name << "> " << plane_name << ": ", str)
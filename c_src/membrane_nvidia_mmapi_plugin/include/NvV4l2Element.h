@@ -0,0 +1,44 @@
+#pragma once
+
+#include "NvElement.h"
+#include "NvV4l2ElementPlane.h"
+#include "v4l2_nv_extensions.h"
+
+/**
+ * V4L2 M2M element, made of an output plane the application queues its
+ * input on and a capture plane it dequeues the results from.
+ */
+class NvV4l2Element : public NvElement
+{
+public:
+    virtual ~NvV4l2Element();
+
+    int dqEvent(struct v4l2_event &event, uint32_t max_wait_ms);
+    int subscribeEvent(uint32_t type, uint32_t id, uint32_t flags);
+
+    int setControl(uint32_t id, int32_t value);
+    int getControl(uint32_t id, int32_t &value);
+    int setExtControls(struct v4l2_ext_controls &ctl);
+    int getExtControls(struct v4l2_ext_controls &ctl);
+
+    virtual int isInError();
+
+    int abort();
+    int waitForIdle(uint32_t max_wait_ms);
+
+    void enableProfiling();
+
+    void *app_data;
+    /** Descriptor of the device. */
+    int fd;
+
+    NvV4l2ElementPlane output_plane;
+    NvV4l2ElementPlane capture_plane;
+
+protected:
+    uint32_t output_plane_pixfmt;
+    uint32_t capture_plane_pixfmt;
+
+    NvV4l2Element(const char *comp_name, const char *dev_node, int flags,
+            NvElementProfiler::ProfilerField fields);
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <pthread.h>
+#include "NvBuffer.h"
+#include "NvElement.h"
+#include "NvLogging.h"
+
+/**
+ * Called by the dequeue thread of a plane with each buffer dequeued. The
+ * thread stops once it returns false.
+ */
+typedef bool (*dqThreadCallback)(struct v4l2_buffer *v4l2_buf, NvBuffer *buffer,
+        NvBuffer *shared_buffer, void *data);
+
+/**
+ * Output or capture plane of a V4L2 M2M element.
+ */
+class NvV4l2ElementPlane
+{
+public:
+    int setFormat(struct v4l2_format &format);
+    int getFormat(struct v4l2_format &format);
+
+    /**
+     * Requests `num_buffers` buffers of `mem_type`, and maps or allocates
+     * them.
+     */
+    int setupPlane(enum v4l2_memory mem_type, uint32_t num_buffers, bool map, bool allocate);
+    void deinitPlane();
+
+    int setStreamStatus(bool status);
+    bool getStreamStatus();
+    int setStreamParms(struct v4l2_streamparm &parm);
+
+    int reqbufs(enum v4l2_memory mem_type, uint32_t num);
+    int queryBuffer(uint32_t i);
+    int exportBuffer(uint32_t i);
+
+    int qBuffer(struct v4l2_buffer &v4l2_buf, NvBuffer *shared_buffer);
+    int dqBuffer(struct v4l2_buffer &v4l2_buf, NvBuffer **buffer,
+            NvBuffer **shared_buffer, uint32_t num_retries);
+
+    int mapOutputBuffers(struct v4l2_buffer &v4l2_buf, int dmabuff_fd);
+    int unmapOutputBuffers(int index, int dmabuff_fd);
+
+    int getCrop(struct v4l2_crop &crop);
+    int setSelection(uint32_t target, uint32_t flags, struct v4l2_rect &rect);
+
+    uint32_t getNumBuffers()
+    {
+        return num_buffers;
+    }
+
+    uint32_t getNumPlanes()
+    {
+        return n_planes;
+    }
+
+    void setBufferPlaneFormat(int n_planes, NvBuffer::NvBufferPlaneFormat *planefmts);
+
+    uint32_t getNumQueuedBuffers()
+    {
+        return num_queued_buffers;
+    }
+
+    uint32_t getTotalDequeuedBuffers()
+    {
+        return total_dequeued_buffers;
+    }
+
+    uint32_t getTotalQueuedBuffers()
+    {
+        return total_queued_buffers;
+    }
+
+    int waitAllBuffersQueued(uint32_t max_wait_ms);
+    int waitAllBuffersDequeued(uint32_t max_wait_ms);
+
+    bool setDQThreadCallback(dqThreadCallback callback);
+    int startDQThread(void *data);
+    int stopDQThread();
+    int waitForDQThread(uint32_t max_wait_ms);
+
+    int isInError()
+    {
+        return is_in_error;
+    }
+
+    NvBuffer *getNthBuffer(uint32_t n);
+
+    enum v4l2_memory getMemType()
+    {
+        return memory_type;
+    }
+
+    enum v4l2_buf_type getBufType()
+    {
+        return buf_type;
+    }
+
+private:
+    /** Descriptor of the element, opened after the planes are created. */
+    int &fd;
+
+    const char *plane_name;
+    enum v4l2_buf_type buf_type;
+    bool blocking;
+
+    uint32_t num_buffers;
+    NvBuffer **buffers;
+
+    uint8_t n_planes;
+    NvBuffer::NvBufferPlaneFormat planefmts[MAX_PLANES];
+    enum v4l2_memory memory_type;
+
+    uint32_t num_queued_buffers;
+    uint32_t total_queued_buffers;
+    uint32_t total_dequeued_buffers;
+
+    bool streamon;
+
+    bool dqthread_running;
+    bool stop_dqthread;
+    pthread_t dq_thread;
+
+    pthread_mutex_t plane_lock;
+    pthread_cond_t plane_cond;
+
+    dqThreadCallback callback;
+    void *dqThread_data;
+
+    static void *dqThread(void *v4l2_element_plane);
+
+    NvElementProfiler &v4l2elem_profiler;
+
+    int is_in_error;
+    const char *comp_name;
+
+    NvV4l2ElementPlane(enum v4l2_buf_type buf_type, const char *device_name, int &fd,
+            bool blocking, NvElementProfiler &profiler);
+    ~NvV4l2ElementPlane();
+
+    friend class NvV4l2Element;
+};
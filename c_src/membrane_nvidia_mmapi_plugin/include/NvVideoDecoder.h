@@ -0,0 +1,45 @@
+#pragma once
+
+#include "NvV4l2Element.h"
+
+/**
+ * Hardware H.264, H.265, VP8, VP9 and AV1 decoder.
+ */
+class NvVideoDecoder : public NvV4l2Element
+{
+public:
+    static NvVideoDecoder *createVideoDecoder(const char *name, int flags = 0);
+    ~NvVideoDecoder();
+
+    int setCapturePlaneFormat(uint32_t pixfmt, uint32_t width, uint32_t height);
+    int setOutputPlaneFormat(uint32_t pixfmt, uint32_t sizeimage);
+
+    int disableDPB();
+    int disableCompleteFrameInputBuffer();
+    int setFrameInputMode(unsigned int ctrl_value);
+    int getMinimumCapturePlaneBuffers(int &num);
+    int setSkipFrames(enum v4l2_skip_frames_type skip_frames);
+    int setMaxPerfMode(int flag);
+
+    int enableMetadataReporting();
+    int getMetadata(uint32_t buffer_index, v4l2_ctrl_videodec_outputbuf_metadata &metadata);
+    int getInputMetadata(uint32_t buffer_index,
+            v4l2_ctrl_videodec_inputbuf_metadata &input_metadata);
+    int getSAR(uint32_t &sar_width, uint32_t &sar_height);
+    int checkifMasteringDisplayDataPresent(v4l2_ctrl_video_displaydata &displaydata);
+    int MasteringDisplayData(v4l2_ctrl_video_hdrmasteringdisplaydata *hdrmasteringdisplaydata);
+
+    /**
+     * Waits for the events requested in `devicepoll`, or until interrupted
+     * with SetPollInterrupt.
+     */
+    int DevicePoll(v4l2_ctrl_video_device_poll *devicepoll);
+    int SetPollInterrupt();
+    int ClearPollInterrupt();
+
+private:
+    NvVideoDecoder(const char *name, int flags);
+
+    static const NvElementProfiler::ProfilerField valid_fields =
+        NvElementProfiler::PROFILER_FIELD_ALL;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "NvV4l2Element.h"
+
+/**
+ * Hardware H.264 and H.265 encoder.
+ */
+class NvVideoEncoder : public NvV4l2Element
+{
+public:
+    static NvVideoEncoder *createVideoEncoder(const char *name, int flags = 0);
+    ~NvVideoEncoder();
+
+    int setCapturePlaneFormat(uint32_t pixfmt, uint32_t width, uint32_t height,
+            uint32_t sizeimage);
+    int setOutputPlaneFormat(uint32_t pixfmt, uint32_t width, uint32_t height);
+
+    int setFrameRate(uint32_t framerate_num, uint32_t framerate_den);
+    int setBitrate(uint32_t bitrate);
+    int setProfile(uint32_t profile);
+    int setRateControlMode(enum v4l2_mpeg_video_bitrate_mode mode);
+    int setIFrameInterval(uint32_t interval);
+    int setIDRInterval(uint32_t interval);
+    int forceIDR();
+    int setHWPresetType(enum v4l2_enc_hw_preset_type type);
+    int setInsertSpsPpsAtIdrEnabled(bool enabled);
+    int setMaxPerfMode(int flag);
+
+    /**
+     * Waits for the events requested in `devicepoll`, or until interrupted
+     * with SetPollInterrupt.
+     */
+    int DevicePoll(v4l2_ctrl_video_device_poll *devicepoll);
+    int SetPollInterrupt();
+    int ClearPollInterrupt();
+
+private:
+    NvVideoEncoder(const char *name, int flags);
+
+    static const NvElementProfiler::ProfilerField valid_fields =
+        NvElementProfiler::PROFILER_FIELD_ALL;
+};
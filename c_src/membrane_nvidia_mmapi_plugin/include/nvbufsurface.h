@@ -0,0 +1,112 @@
+/*
+ * NvBufSurface types used by the software backend build. The
+ * layout is the backend's own; the hardware build uses the header of the
+ * Jetson Multimedia API.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Maximum number of planes of a surface. */
+#define NVBUF_MAX_PLANES 4
+
+typedef enum
+{
+    NVBUF_MEM_SURFACE_ARRAY,
+} NvBufSurfaceMemType;
+
+typedef enum
+{
+    NVBUF_COLOR_FORMAT_INVALID,
+    NVBUF_COLOR_FORMAT_GRAY8,
+    NVBUF_COLOR_FORMAT_YUV420,
+    NVBUF_COLOR_FORMAT_YUV420_ER,
+    NVBUF_COLOR_FORMAT_NV12,
+    NVBUF_COLOR_FORMAT_NV12_ER,
+    NVBUF_COLOR_FORMAT_RGBA,
+    NVBUF_COLOR_FORMAT_BGRA,
+    NVBUF_COLOR_FORMAT_BGRx,
+} NvBufSurfaceColorFormat;
+
+typedef enum
+{
+    NVBUF_LAYOUT_PITCH,
+} NvBufSurfaceLayout;
+
+typedef enum
+{
+    NVBUF_MAP_READ,
+    NVBUF_MAP_READ_WRITE,
+} NvBufSurfaceMemMapFlags;
+
+typedef enum
+{
+    NvBufSurfaceTag_NONE,
+    NvBufSurfaceTag_VIDEO_CONVERT,
+} NvBufSurfaceTag;
+
+typedef struct
+{
+    uint32_t num_planes;
+    uint32_t width[NVBUF_MAX_PLANES];
+    uint32_t height[NVBUF_MAX_PLANES];
+    uint32_t pitch[NVBUF_MAX_PLANES];
+    uint32_t offset[NVBUF_MAX_PLANES];
+    uint32_t psize[NVBUF_MAX_PLANES];
+    uint32_t bytesPerPix[NVBUF_MAX_PLANES];
+} NvBufSurfacePlaneParams;
+
+typedef struct
+{
+    /** Addresses of the planes mapped with NvBufSurfaceMap. */
+    void *addr[NVBUF_MAX_PLANES];
+} NvBufSurfaceMappedAddr;
+
+typedef struct
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;
+    NvBufSurfaceColorFormat colorFormat;
+    NvBufSurfaceLayout layout;
+    /** DMABUF descriptor of the surface. */
+    uint64_t bufferDesc;
+    uint32_t dataSize;
+    void *dataPtr;
+    NvBufSurfacePlaneParams planeParams;
+    NvBufSurfaceMappedAddr mappedAddr;
+} NvBufSurfaceParams;
+
+typedef struct
+{
+    uint32_t batchSize;
+    uint32_t numFilled;
+    NvBufSurfaceMemType memType;
+    /** Array of batchSize surfaces. */
+    NvBufSurfaceParams *surfaceList;
+} NvBufSurface;
+
+typedef struct
+{
+    uint32_t width;
+    uint32_t height;
+    NvBufSurfaceColorFormat colorFormat;
+    NvBufSurfaceLayout layout;
+    NvBufSurfaceMemType memType;
+} NvBufSurfaceCreateParams;
+
+typedef struct
+{
+    NvBufSurfaceCreateParams params;
+    NvBufSurfaceTag memtag;
+} NvBufSurfaceAllocateParams;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,67 @@
+/*
+ * NvBufSurfTransform parameters of the transforms the software backend
+ * implements: cropping, scaling, flipping and rotating surfaces.
+ */
+
+#pragma once
+
+#include "nvbufsurface.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    NvBufSurfTransform_None,
+    NvBufSurfTransform_Rotate90,
+    NvBufSurfTransform_Rotate180,
+    NvBufSurfTransform_Rotate270,
+    NvBufSurfTransform_FlipX,
+    NvBufSurfTransform_FlipY,
+} NvBufSurfTransform_Flip;
+
+typedef enum
+{
+    NvBufSurfTransformInter_Nearest,
+    NvBufSurfTransformInter_Bilinear,
+} NvBufSurfTransform_Inter;
+
+typedef enum
+{
+    NvBufSurfTransformError_Execution_Error = -2,
+    NvBufSurfTransformError_Success = 0,
+} NvBufSurfTransform_Error;
+
+typedef enum
+{
+    NVBUFSURF_TRANSFORM_CROP_SRC = 1,
+    NVBUFSURF_TRANSFORM_CROP_DST = 1 << 1,
+    NVBUFSURF_TRANSFORM_FILTER = 1 << 2,
+    NVBUFSURF_TRANSFORM_FLIP = 1 << 3,
+} NvBufSurfTransform_Transform_Flag;
+
+typedef struct
+{
+    uint32_t top;
+    uint32_t left;
+    uint32_t width;
+    uint32_t height;
+} NvBufSurfTransformRect;
+
+typedef struct
+{
+    /** Bitmask of NvBufSurfTransform_Transform_Flag. */
+    uint32_t transform_flag;
+    NvBufSurfTransform_Flip transform_flip;
+    NvBufSurfTransform_Inter transform_filter;
+    NvBufSurfTransformRect *src_rect;
+    NvBufSurfTransformRect *dst_rect;
+} NvBufSurfTransformParams;
+
+/** Fence of an asynchronous transform. */
+typedef struct NvBufSurfTransformSyncObj *NvBufSurfTransformSyncObj_t;
+
+#ifdef __cplusplus
+}
+#endif
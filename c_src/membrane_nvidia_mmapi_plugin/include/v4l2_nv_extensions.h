@@ -0,0 +1,113 @@
+/*
+ * NVIDIA extensions to V4L2 used by the plugin: pixel formats, controls,
+ * events and control payloads of the decoder and the encoder.
+ */
+
+#pragma once
+
+#include <linux/videodev2.h>
+
+#define V4L2_PIX_FMT_H265 v4l2_fourcc('H', '2', '6', '5')
+#define V4L2_PIX_FMT_AV1 v4l2_fourcc('A', 'V', '1', '0')
+#define V4L2_PIX_FMT_P010M v4l2_fourcc('P', 'M', '1', '0')
+#define V4L2_PIX_FMT_NV24M v4l2_fourcc('N', 'M', '2', '4')
+#define V4L2_PIX_FMT_NV24_10LE v4l2_fourcc('N', 'V', '1', '0')
+#define V4L2_PIX_FMT_YUV422RM v4l2_fourcc('4', '2', 'R', 'M')
+
+/** Raised by the decoder once the resolution of the stream is known or changes. */
+#define V4L2_EVENT_RESOLUTION_CHANGE 5
+
+#define V4L2_CID_MPEG_VIDEO_DISABLE_COMPLETE_FRAME_INPUT (V4L2_CID_MPEG_BASE+515)
+#define V4L2_CID_MPEG_VIDEO_DISABLE_DPB (V4L2_CID_MPEG_BASE+516)
+#define V4L2_CID_MPEG_VIDEO_ERROR_REPORTING (V4L2_CID_MPEG_BASE+517)
+#define V4L2_CID_MPEG_VIDEO_SKIP_FRAMES (V4L2_CID_MPEG_BASE+518)
+#define V4L2_CID_MPEG_VIDEODEC_METADATA (V4L2_CID_MPEG_BASE+519)
+#define V4L2_CID_MPEG_VIDEODEC_INPUT_METADATA (V4L2_CID_MPEG_BASE+520)
+#define V4L2_CID_MPEG_VIDEOENC_TEMPORAL_TRADEOFF_LEVEL (V4L2_CID_MPEG_BASE+522)
+#define V4L2_CID_MPEG_VIDEOENC_HW_PRESET_TYPE_PARAM (V4L2_CID_MPEG_BASE+530)
+#define V4L2_CID_MPEG_VIDEOENC_INSERT_SPS_PPS_AT_IDR (V4L2_CID_MPEG_BASE+535)
+#define V4L2_CID_MPEG_VIDEO_DEVICE_POLL (V4L2_CID_MPEG_BASE+550)
+#define V4L2_CID_MPEG_SET_POLL_INTERRUPT (V4L2_CID_MPEG_BASE+551)
+#define V4L2_CID_MPEG_VIDEOENC_ENABLE_LOSSLESS (V4L2_CID_MPEG_BASE+560)
+#define V4L2_CID_MPEG_VIDEO_H265_PROFILE (V4L2_CID_MPEG_BASE+561)
+#define V4L2_CID_MPEG_VIDEO_IDR_INTERVAL (V4L2_CID_MPEG_BASE+562)
+#define V4L2_CID_MPEG_VIDEOENC_FORCE_IDR_FRAME (V4L2_CID_MPEG_BASE+563)
+#define V4L2_CID_MPEG_VIDEODEC_SAR_WIDTH (V4L2_CID_MPEG_BASE+569)
+#define V4L2_CID_MPEG_VIDEODEC_SAR_HEIGHT (V4L2_CID_MPEG_BASE+570)
+#define V4L2_CID_VIDEODEC_DISPLAYDATA_PRESENT (V4L2_CID_MPEG_BASE+571)
+#define V4L2_CID_VIDEODEC_HDR_MASTERING_DISPLAY_DATA (V4L2_CID_MPEG_BASE+572)
+#define V4L2_CID_MPEG_VIDEO_MAX_PERFORMANCE (V4L2_CID_MPEG_BASE+577)
+
+enum v4l2_skip_frames_type
+{
+    V4L2_SKIP_FRAMES_TYPE_NONE = 0,
+    V4L2_SKIP_FRAMES_TYPE_NONREF = 1,
+    V4L2_SKIP_FRAMES_TYPE_DECODE_IDR_ONLY = 2,
+};
+
+enum v4l2_mpeg_video_h265_profile
+{
+    V4L2_MPEG_VIDEO_H265_PROFILE_MAIN = 0,
+    V4L2_MPEG_VIDEO_H265_PROFILE_MAIN10 = 1,
+    V4L2_MPEG_VIDEO_H265_PROFILE_MAIN_STILL_PICTURE = 2,
+};
+
+enum v4l2_enc_hw_preset_type
+{
+    V4L2_ENC_HW_PRESET_DISABLE = 0,
+    V4L2_ENC_HW_PRESET_ULTRAFAST = 1,
+    V4L2_ENC_HW_PRESET_FAST,
+    V4L2_ENC_HW_PRESET_MEDIUM,
+    V4L2_ENC_HW_PRESET_SLOW,
+};
+
+/** Payload of V4L2_CID_MPEG_VIDEOENC_HW_PRESET_TYPE_PARAM. */
+typedef struct v4l2_enc_hw_preset_type_param
+{
+    enum v4l2_enc_hw_preset_type hw_preset_type;
+    __u32 set_max_enc_clock;
+} v4l2_enc_hw_preset_type_param;
+
+/** Payload of V4L2_CID_MPEG_VIDEO_DEVICE_POLL. */
+typedef struct v4l2_ctrl_video_device_poll
+{
+    /** Poll events to wait for. */
+    __u16 req_events;
+    /** Poll events received. */
+    __u16 resp_events;
+} v4l2_ctrl_video_device_poll;
+
+typedef struct v4l2_ctrl_videodec_inputbuf_metadata
+{
+    __u32 nBitStreamError;
+} v4l2_ctrl_videodec_inputbuf_metadata;
+
+typedef struct v4l2_ctrl_videodec_outputbuf_metadata
+{
+    __u32 CodecType;
+    __u32 FrameDecStats;
+    __u8 bValidFrameStatus;
+} v4l2_ctrl_videodec_outputbuf_metadata;
+
+/** Payload of V4L2_CID_MPEG_VIDEODEC_METADATA and V4L2_CID_MPEG_VIDEODEC_INPUT_METADATA. */
+typedef struct v4l2_ctrl_video_metadata
+{
+    v4l2_ctrl_videodec_inputbuf_metadata *VideoDecHeaderErrorMetadata;
+    v4l2_ctrl_videodec_outputbuf_metadata *VideoDecMetadata;
+    __u32 buffer_index;
+} v4l2_ctrl_video_metadata;
+
+typedef struct v4l2_ctrl_video_displaydata
+{
+    __u32 masteringdisplaydatapresent;
+} v4l2_ctrl_video_displaydata;
+
+typedef struct v4l2_ctrl_video_hdrmasteringdisplaydata
+{
+    __u16 display_primaries_x[3];
+    __u16 display_primaries_y[3];
+    __u16 white_point_x;
+    __u16 white_point_y;
+    __u32 max_display_mastering_luminance;
+    __u32 min_display_mastering_luminance;
+} v4l2_ctrl_video_hdrmasteringdisplaydata;
@@ -0,0 +1,82 @@
+#include "surface_copy.h"
+#include <cstring>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Copies `height` rows of `row_size` bytes between buffers with different
+// pitches
+static void copyRows(unsigned char* dst, size_t dst_pitch, const unsigned char* src,
+    size_t src_pitch, size_t row_size, size_t height)
+{
+    if (src_pitch == row_size && dst_pitch == row_size) {
+        memcpy(dst, src, row_size * height);
+        return;
+    }
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    for (size_t y = 0; y < height; y++, src += src_pitch, dst += dst_pitch) {
+        size_t x = 0;
+        for (; x + 64 <= row_size; x += 64) {
+            uint8x16_t v0 = vld1q_u8(src + x);
+            uint8x16_t v1 = vld1q_u8(src + x + 16);
+            uint8x16_t v2 = vld1q_u8(src + x + 32);
+            uint8x16_t v3 = vld1q_u8(src + x + 48);
+            vst1q_u8(dst + x, v0);
+            vst1q_u8(dst + x + 16, v1);
+            vst1q_u8(dst + x + 32, v2);
+            vst1q_u8(dst + x + 48, v3);
+        }
+        for (; x + 16 <= row_size; x += 16) {
+            vst1q_u8(dst + x, vld1q_u8(src + x));
+        }
+        if (x < row_size) memcpy(dst + x, src + x, row_size - x);
+    }
+#else
+    for (size_t y = 0; y < height; y++, src += src_pitch, dst += dst_pitch) {
+        memcpy(dst, src, row_size);
+    }
+#endif
+}
+
+int surfaceFrameSize(NvBufSurface* nvbuf_surf)
+{
+    NvBufSurfacePlaneParams& params = nvbuf_surf->surfaceList[0].planeParams;
+    int size = 0;
+
+    for (uint32_t plane = 0; plane < params.num_planes; plane++) {
+        size += params.width[plane] * params.bytesPerPix[plane] * params.height[plane];
+    }
+    return size;
+}
+
+void copySurfaceToBuffer(NvBufSurface* nvbuf_surf, unsigned char* dst)
+{
+    NvBufSurfaceParams& params = nvbuf_surf->surfaceList[0];
+    size_t offset = 0;
+
+    for (uint32_t plane = 0; plane < params.planeParams.num_planes; plane++) {
+        size_t row_size = params.planeParams.width[plane] * params.planeParams.bytesPerPix[plane];
+        size_t height = params.planeParams.height[plane];
+
+        copyRows(dst + offset, row_size, (unsigned char*)params.mappedAddr.addr[plane],
+            params.planeParams.pitch[plane], row_size, height);
+        offset += row_size * height;
+    }
+}
+
+void copyBufferToSurface(const unsigned char* src, NvBufSurface* nvbuf_surf)
+{
+    NvBufSurfaceParams& params = nvbuf_surf->surfaceList[0];
+    size_t offset = 0;
+
+    for (uint32_t plane = 0; plane < params.planeParams.num_planes; plane++) {
+        size_t row_size = params.planeParams.width[plane] * params.planeParams.bytesPerPix[plane];
+        size_t height = params.planeParams.height[plane];
+
+        copyRows((unsigned char*)params.mappedAddr.addr[plane], params.planeParams.pitch[plane],
+            src + offset, row_size, row_size, height);
+        offset += row_size * height;
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "NvBufSurface.h"
+
+// Size of the frame held by the surface once packed
+int surfaceFrameSize(NvBufSurface* nvbuf_surf);
+
+// Packs the planes of a mapped surface, whether planar, semi-planar or packed
+void copySurfaceToBuffer(NvBufSurface* nvbuf_surf, unsigned char* dst);
+
+// Fills the planes of a mapped surface with a packed frame of its format
+void copyBufferToSurface(const unsigned char* src, NvBufSurface* nvbuf_surf);
@@ -0,0 +1,110 @@
+#include "transcoder.h"
+#include <stdexcept>
+
+Transcoder* Transcoder::createTranscoder(const char* input_format, int width, int height,
+    const EncoderOptions& options, int input_buffers, int input_buffer_size)
+{
+    if ((width != -1 && (width <= 0 || width % 2)) ||
+        (height != -1 && (height <= 0 || height % 2))) {
+        throw std::runtime_error("invalid frame size");
+    }
+
+    // The surfaces queued on the encoder are taken from the pool of the
+    // decoder, which grows while they are all in use
+    vector<OutputFormat> outputs = {{width, height, NVBUF_COLOR_FORMAT_YUV420}};
+    Decoder* dec = Decoder::createDecoder(input_format, outputs, false, options.inputBuffers,
+        true, input_buffers, input_buffer_size, false, options.maxPerf,
+        V4L2_SKIP_FRAMES_TYPE_NONE);
+
+    Transcoder* transcoder = new Transcoder();
+    transcoder->m_dec = dec;
+    transcoder->m_encoderOptions = options;
+    transcoder->m_encoderOptions.dmabufInput = true;
+    return transcoder;
+}
+
+Transcoder::~Transcoder()
+{
+    // The decoder owns the surfaces still queued on the encoder
+    delete this->m_enc;
+    delete this->m_dec;
+}
+
+void Transcoder::process(unsigned char* data, int size, int64_t pts,
+    const AccessUnitCallback& on_access_unit)
+{
+    this->m_dec->process(data, size, pts);
+    this->encodeDecodedFrames(on_access_unit);
+}
+
+void Transcoder::forceKeyframe()
+{
+    // The first frame of an encoder is an IDR picture anyway
+    if (m_enc) m_enc->forceKeyframe();
+}
+
+void Transcoder::flush(const AccessUnitCallback& on_access_unit)
+{
+    this->m_dec->flush();
+    this->encodeDecodedFrames(on_access_unit);
+    if (m_enc) this->finishEncoder(on_access_unit);
+}
+
+void Transcoder::encodeDecodedFrames(const AccessUnitCallback& on_access_unit)
+{
+    while (auto frame = this->m_dec->nextFrame()) {
+        int dmabuf_fd = frame->first[0];
+
+        try {
+            this->encodeSurface(dmabuf_fd, frame->second, on_access_unit);
+        } catch (exception& e) {
+            this->m_dec->releaseSurface(dmabuf_fd);
+            throw;
+        }
+    }
+
+    if (m_enc) this->outputAccessUnits(on_access_unit);
+}
+
+// Queues a decoded frame on the encoder, after creating it again if the
+// frame size changed
+void Transcoder::encodeSurface(int dmabuf_fd, int64_t pts,
+    const AccessUnitCallback& on_access_unit)
+{
+    NvBufSurfaceParams& params = this->m_dec->surface(dmabuf_fd)->surfaceList[0];
+    int width = params.width, height = params.height;
+
+    if (m_enc && (width != m_encoderOptions.width || height != m_encoderOptions.height)) {
+        this->finishEncoder(on_access_unit);
+    }
+
+    if (!m_enc) {
+        m_encoderOptions.width = width;
+        m_encoderOptions.height = height;
+        m_enc = Encoder::createEncoder(m_encoderOptions);
+
+        Decoder* dec = this->m_dec;
+        m_enc->setSurfaceCallback([dec](int fd) { dec->releaseSurface(fd); });
+    }
+
+    this->m_enc->processSurface(dmabuf_fd, pts);
+    this->outputAccessUnits(on_access_unit);
+}
+
+void Transcoder::outputAccessUnits(const AccessUnitCallback& on_access_unit)
+{
+    while (auto frame = this->m_enc->nextFrame()) {
+        on_access_unit(*frame);
+        this->m_enc->releaseFrame(*frame);
+    }
+}
+
+// Drains the encoder, which gives all its surfaces back to the decoder
+void Transcoder::finishEncoder(const AccessUnitCallback& on_access_unit)
+{
+    this->m_enc->flush();
+    this->outputAccessUnits(on_access_unit);
+
+    delete this->m_enc;
+    this->m_enc = NULL;
+}
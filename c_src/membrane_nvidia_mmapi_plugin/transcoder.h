@@ -0,0 +1,44 @@
+#pragma once
+
+#include "video_decoder.h"
+#include "video_encoder.h"
+
+// Called with every access unit, which is only valid during the call
+typedef function<void(const EncodedFrame& frame)> AccessUnitCallback;
+
+// Decodes access units and encodes the decoded frames again without them
+// ever reaching CPU memory. The VIC converts every frame into a pooled
+// YUV420 surface, resizing it if requested, and the surface is queued as
+// is on the output plane of the encoder. It goes back to the pool once the
+// encoder is done reading it.
+class Transcoder
+{
+private:
+    Decoder* m_dec;
+    // Created on the first decoded frame, and again when the size of the
+    // frames changes, as the encoder only knows its size upfront
+    Encoder* m_enc = NULL;
+    EncoderOptions m_encoderOptions;
+
+    void encodeDecodedFrames(const AccessUnitCallback& on_access_unit);
+    void encodeSurface(int dmabuf_fd, int64_t pts, const AccessUnitCallback& on_access_unit);
+    void outputAccessUnits(const AccessUnitCallback& on_access_unit);
+    void finishEncoder(const AccessUnitCallback& on_access_unit);
+public:
+    // A width or height of -1 keeps the one of the decoded frames. The
+    // encoder options are used as is, except for the frame size.
+    static Transcoder* createTranscoder(const char* input_format, int width, int height,
+        const EncoderOptions& options, int input_buffers, int input_buffer_size);
+    ~Transcoder();
+
+    void process(unsigned char* data, int size, int64_t pts,
+        const AccessUnitCallback& on_access_unit);
+    void forceKeyframe();
+    void flush(const AccessUnitCallback& on_access_unit);
+};
+
+typedef struct _transcoder_state {
+    Transcoder *transcoder;
+} State;
+
+#include "_generated/transcoder.h"
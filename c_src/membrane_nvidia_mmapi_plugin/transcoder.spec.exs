@@ -0,0 +1,43 @@
+module Membrane.Nvidia.MMAPI.Transcoder.Native
+
+state_type "State"
+
+interface [NIF]
+
+# A width or height of -1 keeps the one of the decoded frames
+spec create(
+       input_codec :: atom,
+       output_codec :: atom,
+       width :: int,
+       height :: int,
+       framerate_num :: int,
+       framerate_den :: int,
+       bitrate :: int,
+       gop_size :: int,
+       profile :: atom,
+       preset :: atom,
+       max_perf :: bool,
+       input_buffers :: int,
+       input_buffer_size :: int,
+       frame_buffers :: int,
+       output_buffers :: int,
+       output_buffer_size :: int
+     ) :: {:ok :: label, state} | {:error :: label, reason :: atom}
+
+# Returns the access units encoded so far, with whether they hold an IDR picture
+spec transcode(payload, timestamp :: int64, state) ::
+       {:ok :: label, [payload], [int64], key_frames :: [bool]}
+       | {:error :: label, reason :: atom}
+
+spec flush(state) ::
+       {:ok :: label, [payload], [int64], key_frames :: [bool]}
+       | {:error :: label, reason :: atom}
+
+# The next frame is encoded as an IDR picture
+spec force_keyframe(state) :: :ok :: label | {:error :: label, reason :: atom}
+
+# DMA buffers allocated by this native library at each monotonic timestamp,
+# summed with the other ones by ResourceSampler
+spec dma_buffer_bytes(timestamps_usec :: [uint64]) :: {:ok :: label, bytes :: [uint64]}
+
+dirty :cpu, transcode: 3, flush: 1
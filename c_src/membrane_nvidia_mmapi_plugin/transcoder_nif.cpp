@@ -0,0 +1,123 @@
+#include "transcoder.h"
+#include "common/NvResourceSampler.h"
+
+using namespace std;
+
+// Copies every access unit into a payload, as its capture plane buffer is
+// given back to the encoder right after the call
+AccessUnitCallback collectAccessUnits(UnifexEnv* env, vector<UnifexPayload*>& frames,
+    vector<int64_t>& pts_list, vector<int>& keyframes)
+{
+    return [env, &frames, &pts_list, &keyframes](const EncodedFrame& frame) {
+        UnifexPayload* payload = (UnifexPayload*)unifex_alloc(sizeof(UnifexPayload));
+        unifex_payload_alloc(env, UNIFEX_PAYLOAD_BINARY, frame.size, payload);
+        memcpy(payload->data, frame.data, frame.size);
+
+        frames.push_back(payload);
+        pts_list.push_back(frame.pts);
+        keyframes.push_back(frame.keyframe);
+    };
+}
+
+void releaseFrames(vector<UnifexPayload*>& frames)
+{
+    for (auto frame : frames) {
+        unifex_payload_release(frame);
+        unifex_free(frame);
+    }
+}
+
+UNIFEX_TERM create(UnifexEnv* env, char* input_codec, char* output_codec, int width,
+    int height, int framerate_num, int framerate_den, int bitrate, int gop_size, char* profile,
+    char* preset, int max_perf, int input_buffers, int input_buffer_size, int frame_buffers,
+    int output_buffers, int output_buffer_size) {
+    UNIFEX_TERM res;
+    State* state = unifex_alloc_state(env);
+    state->transcoder = NULL;
+
+    try {
+        EncoderOptions options;
+        options.pixfmt = encoderPixelFormat(output_codec);
+        options.framerateNum = framerate_num;
+        options.framerateDen = framerate_den;
+        options.bitrate = bitrate;
+        options.gopSize = gop_size;
+        options.profile = encoderProfile(options.pixfmt, profile);
+        options.preset = encoderPreset(preset);
+        options.maxPerf = max_perf;
+        options.inputBuffers = frame_buffers;
+        options.outputBuffers = output_buffers;
+        options.outputBufferSize = output_buffer_size;
+
+        state->transcoder = Transcoder::createTranscoder(input_codec, width, height, options,
+            input_buffers, input_buffer_size);
+        res = create_result_ok(env, state);
+    } catch (exception& e) {
+        res = create_result_error(env, e.what());
+    }
+
+    unifex_release_state(env, state);
+    return res;
+}
+
+UNIFEX_TERM transcode(UnifexEnv* env, UnifexPayload* payload, int64_t timestamp,
+    State* state) {
+    UNIFEX_TERM res;
+    vector<UnifexPayload*> frames;
+    vector<int64_t> pts;
+    vector<int> keyframes;
+
+    try {
+        state->transcoder->process(payload->data, payload->size, timestamp,
+            collectAccessUnits(env, frames, pts, keyframes));
+
+        res = transcode_result_ok(env, frames.data(), frames.size(), pts.data(), pts.size(),
+            keyframes.data(), keyframes.size());
+    } catch (exception& e) {
+        res = transcode_result_error(env, e.what());
+    }
+
+    releaseFrames(frames);
+    return res;
+}
+
+UNIFEX_TERM flush(UnifexEnv* env, State* state) {
+    UNIFEX_TERM res;
+    vector<UnifexPayload*> frames;
+    vector<int64_t> pts;
+    vector<int> keyframes;
+
+    try {
+        state->transcoder->flush(collectAccessUnits(env, frames, pts, keyframes));
+
+        res = flush_result_ok(env, frames.data(), frames.size(), pts.data(), pts.size(),
+            keyframes.data(), keyframes.size());
+    } catch (exception& e) {
+        res = flush_result_error(env, e.what());
+    }
+
+    releaseFrames(frames);
+    return res;
+}
+
+UNIFEX_TERM force_keyframe(UnifexEnv* env, State* state) {
+    try {
+        state->transcoder->forceKeyframe();
+        return force_keyframe_result_ok(env);
+    } catch (exception& e) {
+        return force_keyframe_result_error(env, e.what());
+    }
+}
+
+UNIFEX_TERM dma_buffer_bytes(UnifexEnv* env, uint64_t* timestamps_usec,
+    unsigned int timestamps_usec_length) {
+    vector<uint64_t> bytes = NvResourceSampler::getDmaBufferBytes(
+        vector<uint64_t>(timestamps_usec, timestamps_usec + timestamps_usec_length));
+    return dma_buffer_bytes_result_ok(env, bytes.data(), bytes.size());
+}
+
+void handle_destroy_state(UnifexEnv* env, State* state) {
+    if (state->transcoder != NULL) delete state->transcoder;
+
+    UNIFEX_UNUSED(env);
+}
@@ -0,0 +1,891 @@
+#include "video_decoder.h"
+#include "decoder_manager.h"
+#include "device_poll.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
+
+Decoder* Decoder::createDecoder(const char* pix_fmt, const vector<OutputFormat>& outputs,
+    bool zero_copy, int output_surfaces, bool zero_copy_output, int input_buffers,
+    int input_buffer_size, bool disable_dpb, bool max_perf,
+    enum v4l2_skip_frames_type skip_frames, bool profiling)
+{
+    if (outputs.empty()) throw std::runtime_error("no output");
+
+    // Motion JPEG images go through the same decoder, each buffer holding
+    // a whole image
+    int output_plane_pix_fmt;
+    if (strcmp(pix_fmt, "H264") == 0) output_plane_pix_fmt = V4L2_PIX_FMT_H264;
+    else if (strcmp(pix_fmt, "H265") == 0) output_plane_pix_fmt = V4L2_PIX_FMT_H265;
+    else if (strcmp(pix_fmt, "MJPEG") == 0) output_plane_pix_fmt = V4L2_PIX_FMT_MJPEG;
+    else throw std::runtime_error("unsupported codec");
+
+    NvVideoDecoder *dec = NvVideoDecoder::createVideoDecoder("dec0", O_NONBLOCK);
+    if (!dec) throw std::runtime_error("Failed to create NvVideoDecoder");
+
+    // Must be enabled before the formats of the planes are set
+    if (profiling) dec->enableProfiling();
+
+    if(dec->subscribeEvent(V4L2_EVENT_RESOLUTION_CHANGE, 0, 0) < 0)
+    {
+        delete dec;
+        throw std::runtime_error("Failed to subscribe to event resolution change");
+    }
+
+    if(dec->setOutputPlaneFormat(output_plane_pix_fmt, input_buffer_size) < 0)
+    {
+        delete dec;
+        throw std::runtime_error("Failed to set output plane format");
+    }
+
+    if(dec->setFrameInputMode(0) < 0)
+    {
+        delete dec;
+        throw std::runtime_error("Failed to set frame input mode");
+    }
+
+    // Frames are output as soon as they are decoded instead of when the
+    // reordering allows it, only correct for streams without B frames
+    if(disable_dpb && dec->disableDPB() < 0)
+    {
+        delete dec;
+        throw std::runtime_error("Failed to disable the decoded picture buffer");
+    }
+
+    if(max_perf && dec->setMaxPerfMode(1) < 0)
+    {
+        delete dec;
+        throw std::runtime_error("Failed to enable maximum performance mode");
+    }
+
+    if(skip_frames != V4L2_SKIP_FRAMES_TYPE_NONE && dec->setSkipFrames(skip_frames) < 0)
+    {
+        delete dec;
+        throw std::runtime_error("Failed to set skip frames");
+    }
+
+    // The output plane buffers point to memory owned by the decoder or by the
+    // caller, so there is nothing to allocate upfront.
+    if(dec->output_plane.setupPlane(V4L2_MEMORY_USERPTR, input_buffers, false, false) < 0)
+    {
+        delete dec;
+        throw std::runtime_error("Failed to setup output plane");
+    }
+
+    if(dec->output_plane.setStreamStatus(true) < 0)
+    {
+        delete dec;
+        throw std::runtime_error("Failed to set stream status of output plane");
+    }
+
+    Decoder* decoder = new Decoder();
+    decoder->m_dec = dec;
+    decoder->m_outputs.resize(outputs.size());
+    for (size_t i = 0; i < outputs.size(); i++) {
+        Output& output = decoder->m_outputs[i];
+        output.requestedWidth = outputs[i].width;
+        output.requestedHeight = outputs[i].height;
+        output.width = outputs[i].width;
+        output.height = outputs[i].height;
+        output.colorFormat = outputs[i].color_format;
+    }
+    decoder->m_zeroCopy = zero_copy;
+    decoder->m_outputSurfaces = output_surfaces < 1 ? 1 : output_surfaces;
+    decoder->m_zeroCopyOutput = zero_copy_output;
+    decoder->m_inputBuffers = dec->output_plane.getNumBuffers();
+    // Skipped access units have no frame to wait for
+    decoder->m_lowLatency = disable_dpb && skip_frames == V4L2_SKIP_FRAMES_TYPE_NONE;
+    decoder->m_pixFmt = output_plane_pix_fmt;
+    decoder->m_profiling = profiling;
+
+    for (uint32_t i = 0; i < decoder->m_inputBuffers; i++) {
+        decoder->m_sharedBuffers.push_back(new NvBuffer(input_buffer_size, i));
+    }
+    decoder->m_inputCopies.assign(decoder->m_inputBuffers,
+        vector<unsigned char>(zero_copy ? ZeroCopyMinSize : input_buffer_size));
+    decoder->m_inputPins.resize(decoder->m_inputBuffers);
+    
+    return decoder;
+}
+
+int Decoder::frameSize(size_t index)
+{
+    Output& output = this->outputAt(index);
+
+    switch (output.colorFormat) {
+        case NVBUF_COLOR_FORMAT_RGBA:
+        case NVBUF_COLOR_FORMAT_BGRA:
+        case NVBUF_COLOR_FORMAT_BGRx:
+            return output.width * output.height * 4;
+        default:
+            return output.width * output.height * 3 / 2;
+    }
+}
+
+size_t Decoder::outputs() {return m_outputs.size();}
+
+int Decoder::queuedInputBuffers() {return m_dec->output_plane.getNumQueuedBuffers();}
+
+int Decoder::outputSurfaces() {return m_outputSurfaces;}
+
+bool Decoder::zeroCopyInput() {return m_zeroCopy;}
+bool Decoder::zeroCopyOutput() {return m_zeroCopyOutput;}
+
+Decoder::Output& Decoder::outputAt(size_t index)
+{
+    if (index >= m_outputs.size()) throw std::runtime_error("unknown output");
+    return m_outputs[index];
+}
+
+// Must be called with m_surfacesLock held
+Decoder::Output* Decoder::surfaceOwner(int dmabuf_fd)
+{
+    for (auto& output : m_outputs) {
+        if (output.dstSurfaces.count(dmabuf_fd)) return &output;
+    }
+    throw std::runtime_error("unknown destination surface");
+}
+
+NvBufSurface* Decoder::surface(int dmabuf_fd)
+{
+    lock_guard<mutex> guard(m_surfacesLock);
+    return this->surfaceOwner(dmabuf_fd)->dstSurfaces[dmabuf_fd];
+}
+
+// Returns the mapped destination surface of a frame, synchronized for reading
+NvBufSurface* Decoder::surfaceForCpu(int dmabuf_fd)
+{
+    NvBufSurface* surface = this->surface(dmabuf_fd);
+
+    if (NvDeviceBackend::getBackendInstance().surfaceSyncForCpu(surface, 0, -1) < 0) {
+        throw std::runtime_error("could not sync buf surface");
+    }
+    return surface;
+}
+
+// Gives a surface returned by nextFrame back to the pool. May be called
+// from any thread.
+void Decoder::releaseSurface(int dmabuf_fd)
+{
+    lock_guard<mutex> guard(m_surfacesLock);
+    Output* output = this->surfaceOwner(dmabuf_fd);
+    if (output->staleSurfaces.erase(dmabuf_fd)) this->destroySurface(*output, dmabuf_fd);
+    else output->freeSurfaces.push_back(dmabuf_fd);
+}
+
+// Scales the next frames of an output to a new size. The frames already
+// decoded but not returned yet are converted again, so every frame returned
+// afterwards has the new size. In asynchronous mode, the frames delivered
+// before the change keep the previous size.
+void Decoder::setOutputSize(size_t index, int width, int height)
+{
+    lock_guard<mutex> guard(m_serviceLock);
+    Output& output = this->outputAt(index);
+    output.requestedWidth = width;
+    output.requestedHeight = height;
+    if (this->m_waitingForResolutionEvent ||
+        (width == output.width && height == output.height)) return;
+
+    this->setDestinationSize(output, width, height);
+    this->restartTransforms();
+}
+
+// Restricts the next frames to a region, scaled to the output size. An
+// empty region selects the whole frame again. Offsets and sizes are rounded
+// down to even values, 4:2:0 chroma planes can't be cropped at odd ones.
+// Like the output size, the frames not returned yet are converted again. In
+// asynchronous mode, the frames delivered before the change keep the
+// previous region.
+void Decoder::setCrop(int x, int y, int width, int height)
+{
+    lock_guard<mutex> guard(m_serviceLock);
+    if (x < 0 || y < 0 || width < 0 || height < 0) throw std::runtime_error("invalid crop");
+
+    NvBufSurfTransformRect crop;
+    crop.left = x & ~1;
+    crop.top = y & ~1;
+    crop.width = width & ~1;
+    crop.height = height & ~1;
+    if (crop.width == 0 || crop.height == 0) crop = {0, 0, 0, 0};
+
+    bool changed = crop.left != m_crop.left || crop.top != m_crop.top ||
+        crop.width != m_crop.width || crop.height != m_crop.height;
+    this->m_crop = crop;
+    if (this->m_waitingForResolutionEvent || !changed) return;
+
+    for (auto& output : m_outputs) {
+        pair<int, int> size = this->destinationSize(output);
+        this->setDestinationSize(output, size.first, size.second);
+    }
+    this->restartTransforms();
+}
+
+// Computes the source region of a conversion, returns false when it covers
+// the whole frame. A crop going past the frame is clamped to it, the
+// resolution may have changed since it was set.
+bool Decoder::cropSource(NvBufSurfTransformRect& rect)
+{
+    if (m_crop.width == 0 || m_displayWidth == 0) return false;
+
+    uint32_t display_width = m_displayWidth, display_height = m_displayHeight;
+    rect.left = min(m_crop.left, display_width - 2);
+    rect.top = min(m_crop.top, display_height - 2);
+    rect.width = min(m_crop.width, display_width - rect.left);
+    rect.height = min(m_crop.height, display_height - rect.top);
+    return true;
+}
+
+// Size of an output for the current display resolution and crop
+pair<int, int> Decoder::destinationSize(Output& output)
+{
+    NvBufSurfTransformRect rect = {0, 0, (uint32_t)m_displayWidth, (uint32_t)m_displayHeight};
+    this->cropSource(rect);
+    return make_pair(output.requestedWidth == -1 ? (int)rect.width : output.requestedWidth,
+        output.requestedHeight == -1 ? (int)rect.height : output.requestedHeight);
+}
+
+// Allocates and maps a destination surface of an output
+int Decoder::allocateSurface(Output& output)
+{
+    NvDeviceBackend& backend = NvDeviceBackend::getBackendInstance();
+    NvBufSurface* surface = NULL;
+    int fd = -1;
+
+    if (NvBufSurf::NvAllocate(&output.dstParams, 1, &fd) < 0) {
+        throw std::runtime_error("could not allocate DMA buffer");
+    }
+
+    if (backend.surfaceFromFd(fd, (void**)&surface) < 0 ||
+        backend.surfaceMap(surface, 0, -1, NVBUF_MAP_READ) < 0) {
+        NvBufSurf::NvDestroy(fd);
+        throw std::runtime_error("could not map buf surface");
+    }
+
+    lock_guard<mutex> guard(m_surfacesLock);
+    output.dstSurfaces[fd] = surface;
+    return fd;
+}
+
+// Must be called with m_surfacesLock held
+void Decoder::destroySurface(Output& output, int dmabuf_fd)
+{
+    NvDeviceBackend::getBackendInstance().surfaceUnMap(output.dstSurfaces[dmabuf_fd], 0, -1);
+    NvBufSurf::NvDestroy(dmabuf_fd);
+    output.dstSurfaces.erase(dmabuf_fd);
+}
+
+void Decoder::destroyRetiredSurfaces()
+{
+    lock_guard<mutex> guard(m_surfacesLock);
+    for (auto& output : m_outputs) {
+        for (int fd : output.retiredSurfaces) this->destroySurface(output, fd);
+        output.retiredSurfaces.clear();
+    }
+}
+
+// Allocates the destination surfaces of an output for frames of the given
+// size. The surfaces of the previous size may still hold returned frames,
+// so they are retired instead of being destroyed right away.
+void Decoder::setDestinationSize(Output& output, int width, int height)
+{
+    if (width == output.width && height == output.height && !output.dstSurfaces.empty()) return;
+
+    {
+        lock_guard<mutex> guard(m_surfacesLock);
+        set<int> available(output.freeSurfaces.begin(), output.freeSurfaces.end());
+        available.insert(output.dstDmaFds.begin(), output.dstDmaFds.end());
+
+        for (auto [fd, surface] : output.dstSurfaces) {
+            if (available.count(fd)) output.retiredSurfaces.push_back(fd);
+            else output.staleSurfaces.insert(fd);
+        }
+        output.freeSurfaces.clear();
+        output.dstDmaFds.clear();
+        output.dstIdx = 0;
+
+        output.width = width;
+        output.height = height;
+        output.dstParams.memType = NVBUF_MEM_SURFACE_ARRAY;
+        output.dstParams.width = width;
+        output.dstParams.height = height;
+        output.dstParams.layout = NVBUF_LAYOUT_PITCH;
+        output.dstParams.colorFormat = output.colorFormat;
+        output.dstParams.memtag = NvBufSurfaceTag_VIDEO_CONVERT;
+    }
+
+    // Frames in flight need a surface on top of the ones handed out
+    for (int i = 0; i < m_outputSurfaces + MaxTransformsInFlight; i++) {
+        int fd = this->allocateSurface(output);
+        if (m_zeroCopyOutput) output.freeSurfaces.push_back(fd);
+        else output.dstDmaFds.push_back(fd);
+    }
+}
+
+// Takes a surface from the pool of an output, which grows while the frames
+// handed out are still referenced
+int Decoder::acquireSurface(Output& output)
+{
+    {
+        lock_guard<mutex> guard(m_surfacesLock);
+        if (!output.freeSurfaces.empty()) {
+            int fd = output.freeSurfaces.back();
+            output.freeSurfaces.pop_back();
+            return fd;
+        }
+    }
+
+    return this->allocateSurface(output);
+}
+
+void Decoder::recordCopy(chrono::steady_clock::duration duration)
+{
+    m_copies++;
+    m_copyTimeUsec += chrono::duration_cast<chrono::microseconds>(duration).count();
+}
+
+DecoderStats Decoder::stats()
+{
+    DecoderStats stats;
+
+    this->m_dec->getProfilingData(stats.profiler);
+    bool profiled = NvLatencyRecorder::getLatencyPercentiles(*this->m_dec, stats.latency);
+    if (!profiled) stats.latency = {0, 0, 0};
+    stats.tooManyProfiledElements = m_profiling && !profiled;
+    stats.queuedInputBuffers = this->m_dec->output_plane.getNumQueuedBuffers();
+    stats.queuedCaptureBuffers = this->m_dec->capture_plane.getNumQueuedBuffers();
+    stats.transforms = m_transforms;
+    stats.transformTimeUsec = m_transformTimeUsec;
+    stats.copies = m_copies;
+    stats.copyTimeUsec = m_copyTimeUsec;
+    return stats;
+}
+
+// Switches the decoder to asynchronous mode: once the capture plane is set up,
+// the service thread of the decoder manager converts the decoded frames and
+// hands them to `on_frame` instead of `nextFrame` returning them. Must be
+// called before `process`.
+void Decoder::setFrameCallback(FrameCallback on_frame, ErrorCallback on_error)
+{
+    m_onFrame = on_frame;
+    m_onError = on_error;
+}
+
+void Decoder::process(unsigned char* data, int size, int64_t pts, shared_ptr<void> pin)
+{
+    this->destroyRetiredSurfaces();
+    if (m_onFrame) this->reclaimOutputBuffers();
+    this->qBuffer(data, size, pts, move(pin));
+    if (m_serviced) DecoderManager::getInstance().wake(this);
+    if (m_lowLatency && !m_onFrame) m_framesOwed += m_pictures.count(m_pixFmt, data, size);
+    if (this->m_waitingForResolutionEvent) this->setCapturePlane();
+}
+
+void Decoder::flush()
+{
+    this->m_eos = true;
+    this->destroyRetiredSurfaces();
+    if (m_onFrame) this->reclaimOutputBuffers();
+    this->qBuffer(nullptr, 0, 0, nullptr);
+    if (m_serviced) DecoderManager::getInstance().wake(this);
+
+    // In asynchronous mode, wait for the service thread to deliver the
+    // last frame, as long as it keeps delivering frames
+    if (m_serviced) {
+        unique_lock<mutex> lock(m_captureLock);
+        while (!m_captureFinished) {
+            uint64_t delivered = m_delivered;
+            bool finished = m_captureDone.wait_for(lock, chrono::milliseconds(DeviceTimeoutMs),
+                [this]() { return m_captureFinished; });
+            if (!finished && m_delivered == delivered) {
+                throw std::runtime_error("timed out waiting for the decoder");
+            }
+        }
+    }
+}
+
+optional<pair<vector<int>, int64_t>> Decoder::nextFrame()
+{
+    // Frames are handed to the frame callback by the service thread
+    if (m_onFrame) return nullopt;
+
+    struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[MAX_PLANES];
+    NvBuffer* buffer = NULL;
+
+    // Start converting the frames already decoded before waiting for
+    // the oldest conversion
+    while (m_pendingTransforms.size() < MaxTransformsInFlight)
+    {
+        memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+        memset(planes, 0, sizeof(planes));
+        v4l2_buf.m.planes = planes;
+
+        if (this->m_dec->capture_plane.dqBuffer(v4l2_buf, &buffer, NULL, 0) == 0) {
+            this->startTransform(v4l2_buf, buffer);
+            continue;
+        }
+
+        if (errno != EAGAIN) {
+            throw std::runtime_error("could not dequeue buffer from capture plane");
+        }
+
+        if (!m_pendingTransforms.empty()) break;
+        if (this->handleResolutionChange()) continue;
+
+        // Skipped access units give their buffer back without a frame, so
+        // a full output plane may only need its consumed buffers dequeued
+        this->dequeueOutputBuffers();
+        bool full_output_plane = this->m_dec->output_plane.getNumQueuedBuffers() == m_inputBuffers;
+
+        // If it's the end of stream, we'll wait for all the frames to be decoded.
+        // In low latency mode, we'll wait for the frames of the access units
+        // already queued. If all the buffers are queued, we'll wait for the
+        // decoder to decode or skip at least one access unit.
+        int last_buf = v4l2_buf.flags & V4L2_BUF_FLAG_LAST;
+        if (this->m_eos && !last_buf) {
+            this->waitForCapture();
+            continue;
+        }
+        if (m_framesOwed > 0) {
+            // Some access units are consumed without a frame (second fields,
+            // corrupt pictures), so the frames still owed once the decoder
+            // took all of them and nothing followed are given up on
+            if (this->m_dec->output_plane.getNumQueuedBuffers() > 0) {
+                this->waitForCapture(true);
+                continue;
+            }
+            if (pollDevice(this->m_dec, POLLIN | POLLPRI, FrameDelayMs) != 0) continue;
+            m_framesOwed = 0;
+        }
+        if (full_output_plane) {
+            this->waitForCapture(true);
+            continue;
+        }
+        return nullopt;
+    }
+
+    auto frame = this->finishTransform();
+    this->dequeueOutputBuffers();
+
+    return make_optional(frame);
+}
+
+// Starts converting the frame into the next destination surface of the ring
+// of each output, or into a surface of their pool
+void Decoder::startTransform(struct v4l2_buffer& v4l2_buf, NvBuffer* buffer)
+{
+    PendingTransform transform;
+    transform.index = v4l2_buf.index;
+    transform.pts = v4l2_buf.timestamp.tv_sec * Microsecond + v4l2_buf.timestamp.tv_usec;
+    if (m_framesOwed > 0) m_framesOwed--;
+    this->convert(transform, buffer->planes[0].fd);
+}
+
+// Issues one conversion per output, all reading the same capture buffer
+void Decoder::convert(PendingTransform& transform, int src_fd)
+{
+    NvBufSurf::NvCommonTransformParams transform_params = {};
+    NvBufSurfTransformRect src_rect;
+    transform_params.flag = NVBUFSURF_TRANSFORM_FILTER;
+    transform_params.flip = NvBufSurfTransform_None;
+    transform_params.filter = NvBufSurfTransformInter_Nearest;
+    if (this->cropSource(src_rect)) {
+        transform_params.flag = (NvBufSurfTransform_Transform_Flag)
+            (NVBUFSURF_TRANSFORM_FILTER | NVBUFSURF_TRANSFORM_CROP_SRC);
+        transform_params.src_top = src_rect.top;
+        transform_params.src_left = src_rect.left;
+        transform_params.src_width = src_rect.width;
+        transform_params.src_height = src_rect.height;
+    }
+
+    transform.dst_fds.clear();
+    transform.sync_objs.clear();
+    transform.started = chrono::steady_clock::now();
+    for (auto& output : m_outputs) {
+        int dst_fd;
+        if (m_zeroCopyOutput) {
+            dst_fd = this->acquireSurface(output);
+        } else {
+            dst_fd = output.dstDmaFds[output.dstIdx];
+            output.dstIdx = (output.dstIdx + 1) % output.dstDmaFds.size();
+        }
+
+        NvBufSurfTransformSyncObj_t sync_obj;
+        if (NvBufSurf::NvTransformAsync(&transform_params, &sync_obj, src_fd, dst_fd) < 0)
+        {
+            this->waitForTransforms(transform);
+            throw std::runtime_error("could not transform DMA buffer");
+        }
+
+        transform.dst_fds.push_back(dst_fd);
+        transform.sync_objs.push_back(sync_obj);
+    }
+
+    m_pendingTransforms.push_back(transform);
+}
+
+// Converts the pending frames again into the current destination surfaces
+void Decoder::restartTransforms()
+{
+    deque<PendingTransform> transforms;
+    transforms.swap(m_pendingTransforms);
+
+    for (auto& transform : transforms) {
+        this->waitForTransforms(transform);
+        if (m_zeroCopyOutput) {
+            for (int fd : transform.dst_fds) this->releaseSurface(fd);
+        }
+
+        NvBuffer* buffer = this->m_dec->capture_plane.getNthBuffer(transform.index);
+        this->convert(transform, buffer->planes[0].fd);
+    }
+}
+
+// Waits for the conversions of a capture buffer issued so far, returns
+// false if one of them failed
+bool Decoder::waitForTransforms(PendingTransform& transform)
+{
+    NvDeviceBackend& backend = NvDeviceBackend::getBackendInstance();
+    bool ok = true;
+
+    for (auto& sync_obj : transform.sync_objs) {
+        if (backend.syncObjWait(sync_obj, DeviceTimeoutMs) < 0) ok = false;
+        backend.syncObjDestroy(&sync_obj);
+    }
+    transform.sync_objs.clear();
+    return ok;
+}
+
+// Waits for the oldest conversions and gives their capture buffer back
+// to the decoder
+pair<vector<int>, int64_t> Decoder::finishTransform()
+{
+    PendingTransform transform = m_pendingTransforms.front();
+    m_pendingTransforms.pop_front();
+
+    if (!this->waitForTransforms(transform))
+    {
+        throw std::runtime_error("could not transform DMA buffer");
+    }
+
+    auto elapsed = chrono::steady_clock::now() - transform.started;
+    m_transforms++;
+    m_transformTimeUsec += chrono::duration_cast<chrono::microseconds>(elapsed).count();
+
+    struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[MAX_PLANES];
+
+    memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+    memset(planes, 0, sizeof(planes));
+    v4l2_buf.index = transform.index;
+    v4l2_buf.m.planes = planes;
+
+    if (this->m_dec->capture_plane.qBuffer(v4l2_buf, NULL) < 0)
+    {
+        throw std::runtime_error("could not queue buffer to capture plane");
+    }
+
+    return make_pair(transform.dst_fds, transform.pts);
+}
+
+bool Decoder::serviceCapture()
+{
+    bool running;
+
+    try {
+        lock_guard<mutex> guard(m_serviceLock);
+        running = this->dequeueCapture();
+    } catch (exception& e) {
+        m_onError(e.what());
+        running = false;
+    }
+
+    if (!running) {
+        lock_guard<mutex> guard(m_captureLock);
+        m_captureFinished = true;
+        m_captureDone.notify_all();
+    }
+    return running;
+}
+
+// Converts and delivers everything the capture plane holds without waiting
+// on the device, returns false once the last frame has been delivered.
+// Called whenever the device has a buffer or an event to dequeue.
+bool Decoder::dequeueCapture()
+{
+    struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[MAX_PLANES];
+    NvBuffer* buffer = NULL;
+
+    while (true) {
+        memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+        memset(planes, 0, sizeof(planes));
+        v4l2_buf.m.planes = planes;
+
+        if (this->m_dec->capture_plane.dqBuffer(v4l2_buf, &buffer, NULL, 0) == 0) {
+            this->startTransform(v4l2_buf, buffer);
+            while (m_pendingTransforms.size() >= MaxTransformsInFlight) this->deliverFrame();
+            continue;
+        }
+
+        if (errno != EAGAIN) {
+            throw std::runtime_error("could not dequeue buffer from capture plane");
+        }
+
+        // Nothing else to convert for now, deliver the pending frames
+        while (!m_pendingTransforms.empty()) this->deliverFrame();
+
+        if (this->m_eos && (v4l2_buf.flags & V4L2_BUF_FLAG_LAST)) return false;
+        if (!this->handleResolutionChange()) return true;
+    }
+}
+
+uint64_t Decoder::deliveredFrames()
+{
+    return m_delivered;
+}
+
+void Decoder::deliverFrame()
+{
+    auto [fds, pts] = this->finishTransform();
+    m_onFrame(fds, pts);
+    m_delivered++;
+}
+
+Decoder::~Decoder()
+{
+    if (m_serviced) DecoderManager::getInstance().remove(this);
+    for (auto& transform : m_pendingTransforms) this->waitForTransforms(transform);
+    while(dqBuffer() == 0);
+    // The output plane buffers were never allocated by the plane, release
+    // them before deinitPlane tries to
+    m_dec->output_plane.setStreamStatus(false);
+    m_dec->output_plane.reqbufs(V4L2_MEMORY_USERPTR, 0);
+    m_inputPins.clear();
+    delete this->m_dec;
+    lock_guard<mutex> guard(m_surfacesLock);
+    for (auto& output : m_outputs) {
+        while (!output.dstSurfaces.empty()) {
+            this->destroySurface(output, output.dstSurfaces.begin()->first);
+        }
+    }
+    for (auto buffer : m_sharedBuffers) delete buffer;
+}
+
+void Decoder::qBuffer(unsigned char* data, int size, int64_t pts, shared_ptr<void> pin)
+{
+    struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[MAX_PLANES];
+
+    NvBuffer* buffer = this->m_dec->output_plane.getNthBuffer(this->m_bufIdx);
+    NvBuffer* shared_buffer = m_sharedBuffers[m_bufIdx];
+    vector<unsigned char>& copy = m_inputCopies[m_bufIdx];
+
+    if (m_zeroCopy && data && size >= ZeroCopyMinSize) {
+        // Pinned until the buffer is dequeued from the output plane
+        shared_buffer->planes[0].data = data;
+        shared_buffer->planes[0].length = size;
+        m_inputPins[m_bufIdx] = move(pin);
+    } else {
+        if ((size_t)size > copy.size()) copy.resize(size);
+        if (data) memcpy(copy.data(), data, size);
+        shared_buffer->planes[0].data = copy.data();
+        shared_buffer->planes[0].length = copy.size();
+    }
+    shared_buffer->planes[0].bytesused = data ? size : 0;
+    buffer->planes[0].bytesused = shared_buffer->planes[0].bytesused;
+
+    memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+    memset(planes, 0, sizeof(planes));
+
+    v4l2_buf.index = this->m_bufIdx;
+    v4l2_buf.m.planes = planes;
+    v4l2_buf.m.planes[0].bytesused = buffer->planes[0].bytesused;
+    v4l2_buf.m.planes[0].length = shared_buffer->planes[0].length;
+    
+    if (data) {
+        v4l2_buf.flags |= V4L2_BUF_FLAG_TIMESTAMP_COPY;
+        v4l2_buf.timestamp.tv_sec = pts / Microsecond;
+        v4l2_buf.timestamp.tv_usec = pts % Microsecond;
+    }
+
+    this->m_bufIdx = (this->m_bufIdx + 1) % m_inputBuffers;
+
+    if(this->m_dec->output_plane.qBuffer(v4l2_buf, shared_buffer) < 0)
+    {
+        m_inputPins[v4l2_buf.index].reset();
+        throw std::runtime_error("could not queue buffer to output plane");
+    }
+}
+
+int Decoder::dqBuffer() {
+    struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[MAX_PLANES];
+
+    memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+    memset(planes, 0, sizeof(planes));
+
+    v4l2_buf.m.planes = planes;
+
+    int ret = this->m_dec->output_plane.dqBuffer(v4l2_buf, NULL, NULL, -1);
+    if (ret == 0) m_inputPins[v4l2_buf.index].reset();
+    return ret;
+}
+
+// Dequeues the output plane buffers the decoder is done with
+void Decoder::dequeueOutputBuffers()
+{
+    while (this->m_dec->output_plane.getNumQueuedBuffers() > 0 && dqBuffer() == 0);
+}
+
+// Sleeps until a buffer can be dequeued from the capture plane, or from
+// the output plane as well if `output` is set, instead of spinning on the
+// non-blocking dequeue. A decoder that doesn't respond in time is considered
+// stuck.
+void Decoder::waitForCapture(bool output)
+{
+    // Resolution changes are signaled as priority events
+    uint16_t events = POLLIN | POLLPRI | (output ? POLLOUT : 0);
+
+    if (pollDevice(this->m_dec, events, DeviceTimeoutMs) == 0) {
+        throw std::runtime_error("timed out waiting for the decoder");
+    }
+}
+
+void Decoder::waitForOutput()
+{
+    if (pollDevice(this->m_dec, POLLOUT, DeviceTimeoutMs) == 0) {
+        throw std::runtime_error("timed out waiting for the decoder");
+    }
+}
+
+// In asynchronous mode nothing dequeues the consumed output plane buffers
+// on the way out, so release them before queueing a new one.
+void Decoder::reclaimOutputBuffers()
+{
+    this->dequeueOutputBuffers();
+
+    while (this->m_dec->output_plane.getNumQueuedBuffers() == m_inputBuffers) {
+        this->waitForOutput();
+        if (dqBuffer() < 0 && errno != EAGAIN) {
+            throw std::runtime_error("could not dequeue buffer from output plane");
+        }
+    }
+}
+
+void Decoder::setCapturePlane() 
+{
+    NvVideoDecoder* dec = this->m_dec;
+    struct v4l2_event event;
+
+    do {
+        if (dec->dqEvent(event, 1000) < 0)
+        {
+            throw std::runtime_error("could not dequeue event");
+        }
+    } while (event.type != V4L2_EVENT_RESOLUTION_CHANGE);
+
+    this->configureCapturePlane();
+    this->m_waitingForResolutionEvent = false;
+
+    if (m_onFrame) {
+        bool pollable = NvDeviceBackend::getBackendInstance().pollableDevices();
+        DecoderManager::getInstance().add(this, pollable ? dec->fd : -1);
+        this->m_serviced = true;
+    }
+}
+
+// Handles a resolution change after the first one, called once the capture
+// plane is found empty. The decoder signals it after decoding the frames of
+// the previous resolution, only the capture plane is set up again while the
+// output plane keeps streaming. Returns whether the capture plane should be
+// checked again.
+bool Decoder::handleResolutionChange()
+{
+    struct v4l2_event event;
+
+    if (!m_resolutionChangePending) {
+        if (this->m_dec->dqEvent(event, 0) < 0) return false;
+        if (event.type != V4L2_EVENT_RESOLUTION_CHANGE) return false;
+
+        // Frames may have been decoded since the capture plane was found
+        // empty, they are dequeued before the buffers are released.
+        m_resolutionChangePending = true;
+        return true;
+    }
+
+    this->configureCapturePlane();
+    m_resolutionChangePending = false;
+    return true;
+}
+
+// Sets up the capture plane and the destination surfaces for the
+// current coded resolution
+void Decoder::configureCapturePlane()
+{
+    NvVideoDecoder* dec = this->m_dec;
+    NvV4l2ElementPlane& capture_plane = dec->capture_plane;
+    v4l2_format format;
+    v4l2_crop crop;
+    int32_t min_dec_capture_buffers;
+
+    if (capture_plane.getFormat(format) < 0) {
+        throw std::runtime_error("could not get format from capture plane");
+    }
+
+    if (capture_plane.getCrop(crop) < 0) {
+        throw std::runtime_error("could not get crop from capture plane");
+    }
+
+    this->m_displayWidth = crop.c.width;
+    this->m_displayHeight = crop.c.height;
+
+    for (auto& output : m_outputs) {
+        pair<int, int> size = this->destinationSize(output);
+        this->setDestinationSize(output, size.first, size.second);
+    }
+
+    // Same as deinitPlane, which waits for the capture thread and so can't
+    // be called from it
+    capture_plane.setStreamStatus(false);
+    for (uint32_t i = 0; i < capture_plane.getNumBuffers(); i++) {
+        capture_plane.getNthBuffer(i)->unmap();
+    }
+    capture_plane.reqbufs(V4L2_MEMORY_MMAP, 0);
+
+    if (dec->getMinimumCapturePlaneBuffers(min_dec_capture_buffers) < 0) {
+        throw std::runtime_error("could not get minimum capture plane buffers");
+    }
+
+    int ret = dec->setCapturePlaneFormat(format.fmt.pix_mp.pixelformat, 
+                                    format.fmt.pix_mp.width, 
+                                    format.fmt.pix_mp.height);
+    if (ret < 0) {
+        throw std::runtime_error("could not set capture plane format");
+    }
+
+    if (capture_plane.setupPlane(V4L2_MEMORY_MMAP, min_dec_capture_buffers, false, false) < 0) {
+        throw std::runtime_error("could not setup capture plane");
+    }
+    
+    if (capture_plane.setStreamStatus(true) < 0) {
+        throw std::runtime_error("could not set stream status of capture plane");
+    }
+
+    for (uint32_t i = 0; i < capture_plane.getNumBuffers(); i++)
+    {
+        struct v4l2_buffer v4l2_buf;
+        struct v4l2_plane planes[MAX_PLANES];
+
+        memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+        memset(planes, 0, sizeof(planes));
+
+        v4l2_buf.index = i;
+        v4l2_buf.m.planes = planes;
+        v4l2_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        v4l2_buf.memory = V4L2_MEMORY_MMAP;
+        if (capture_plane.qBuffer(v4l2_buf, NULL) < 0) {
+            throw std::runtime_error("could not queue buffer on capture plane");
+        }
+    }
+}
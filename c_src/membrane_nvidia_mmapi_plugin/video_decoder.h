@@ -0,0 +1,215 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <vector>
+#include "NvVideoDecoder.h"
+#include "NvBufSurface.h"
+#include "common/NvDeviceBackend.h"
+#include "common/NvLatencyRecorder.h"
+#include "common/NvPictureCounter.h"
+
+using namespace std;
+
+// Called from the decoder service thread with the destination surfaces
+// holding the converted frame, one per output. The surfaces are reused once the
+// callback returns.
+typedef function<void(const vector<int>& dmabuf_fds, int64_t pts)> FrameCallback;
+typedef function<void(const char* reason)> ErrorCallback;
+
+// Size and color format of an output of the decoder. A size of -1 follows
+// the cropped display resolution.
+struct OutputFormat {
+    int width;
+    int height;
+    NvBufSurfaceColorFormat color_format;
+};
+
+// The conversions of a capture buffer running on the VIC, one per output
+struct PendingTransform {
+    uint32_t index;
+    int64_t pts;
+    vector<int> dst_fds;
+    vector<NvBufSurfTransformSyncObj_t> sync_objs;
+    chrono::steady_clock::time_point started;
+};
+
+// Snapshot of the activity of a decoder. The latencies, from queueing an
+// access unit to dequeueing its frame, are only measured with profiling
+// enabled.
+struct DecoderStats {
+    NvElementProfiler::NvElementProfilerData profiler;
+    NvLatencyPercentiles latency;
+    int queuedInputBuffers;
+    int queuedCaptureBuffers;
+    uint64_t transforms;
+    uint64_t transformTimeUsec;
+    uint64_t copies;
+    uint64_t copyTimeUsec;
+    // Profiling was requested, but all the latency recorders are in use
+    bool tooManyProfiledElements;
+};
+
+class Decoder
+{
+private:
+    static const int Microsecond = 1000000;
+    // Access units smaller than this are copied even in zero-copy mode,
+    // small binaries live on the process heap and may be moved by the GC.
+    static const int ZeroCopyMinSize = 4096;
+    // Conversions issued ahead of the frame being returned. Each of them
+    // needs a destination surface on top of the ones handed out.
+    static const int MaxTransformsInFlight = 2;
+    // Longest wait for the decoder or the VIC before giving up on them
+    static constexpr int DeviceTimeoutMs = 2000;
+    // How long a frame may follow the consumption of its access unit
+    static constexpr int FrameDelayMs = 50;
+
+    // Destination surfaces of an output. Frames are converted into the next
+    // surface of the ring, or with zero-copy output into one of the pool.
+    struct Output {
+        // Requested size, -1 to follow the cropped display resolution
+        int requestedWidth;
+        int requestedHeight;
+        int width;
+        int height;
+        // The VIC converts the decoded frames to this format while
+        // scaling them
+        NvBufSurfaceColorFormat colorFormat;
+        NvBufSurf::NvCommonAllocateParams dstParams;
+        vector<int> dstDmaFds;
+        int dstIdx = 0;
+        vector<int> freeSurfaces;
+        // Destination surfaces stay mapped for the lifetime of the decoder
+        map<int, NvBufSurface*> dstSurfaces;
+        // Surfaces of the previous output size, destroyed on the next call
+        // to `process` or `flush` (retired), or when released (stale).
+        vector<int> retiredSurfaces;
+        set<int> staleSurfaces;
+    };
+
+    NvVideoDecoder* m_dec;
+    // Every decoded frame is converted once per output
+    vector<Output> m_outputs;
+    // Region of the decoded frames scaled into the destination surfaces,
+    // the whole frame when empty. Clamped to the display resolution.
+    NvBufSurfTransformRect m_crop {0, 0, 0, 0};
+    int m_displayWidth = 0;
+    int m_displayHeight = 0;
+    int m_outputSurfaces;
+    // With zero-copy output, frames are converted into surfaces taken from
+    // a pool instead of the ring, and stay there until released.
+    bool m_zeroCopyOutput = false;
+    // Guards the surfaces of all the outputs
+    mutex m_surfacesLock;
+    deque<PendingTransform> m_pendingTransforms;
+    int m_bufIdx;
+    bool m_waitingForResolutionEvent = true;
+    bool m_resolutionChangePending = false;
+    atomic<bool> m_eos {false};
+    bool m_zeroCopy = false;
+    uint32_t m_inputBuffers;
+    // The output plane buffers point either to the caller's payloads or to
+    // these copies, which grow when an access unit doesn't fit.
+    vector<NvBuffer*> m_sharedBuffers;
+    vector<vector<unsigned char>> m_inputCopies;
+    // Keep the payloads queued in place alive, dropped once their buffer is
+    // dequeued from the output plane
+    vector<shared_ptr<void>> m_inputPins;
+    // With the DPB disabled every picture yields its frame right away, so
+    // `nextFrame` waits for the frames of the queued access units.
+    bool m_lowLatency = false;
+    bool m_profiling = false;
+    uint32_t m_pixFmt;
+    NvPictureCounter m_pictures;
+    int m_framesOwed = 0;
+    FrameCallback m_onFrame;
+    ErrorCallback m_onError;
+    // Updated from the service thread in asynchronous mode, read by `stats`
+    atomic<uint64_t> m_transforms {0};
+    atomic<uint64_t> m_transformTimeUsec {0};
+    atomic<uint64_t> m_copies {0};
+    atomic<uint64_t> m_copyTimeUsec {0};
+    // In asynchronous mode, the capture plane is serviced by the decoder
+    // manager once set up, until the last frame has been delivered
+    bool m_serviced = false;
+    // Frames delivered by the service thread, read by a flush waiting for it
+    // and by the decoder manager
+    atomic<uint64_t> m_delivered {0};
+    // Held while the capture plane is serviced, the outputs are changed
+    // between two services
+    mutex m_serviceLock;
+    mutex m_captureLock;
+    condition_variable m_captureDone;
+    bool m_captureFinished = false;
+
+    void qBuffer(unsigned char* data, int size, int64_t pts, shared_ptr<void> pin);
+    int dqBuffer();
+    void dequeueOutputBuffers();
+    void waitForCapture(bool output = false);
+    void waitForOutput();
+    void reclaimOutputBuffers();
+    void startTransform(struct v4l2_buffer& v4l2_buf, NvBuffer* buffer);
+    void convert(PendingTransform& transform, int src_fd);
+    void restartTransforms();
+    bool cropSource(NvBufSurfTransformRect& rect);
+    pair<int, int> destinationSize(Output& output);
+    bool waitForTransforms(PendingTransform& transform);
+    pair<vector<int>, int64_t> finishTransform();
+    bool dequeueCapture();
+    void deliverFrame();
+    Output& outputAt(size_t index);
+    Output* surfaceOwner(int dmabuf_fd);
+    int allocateSurface(Output& output);
+    int acquireSurface(Output& output);
+    void destroySurface(Output& output, int dmabuf_fd);
+    void destroyRetiredSurfaces();
+    void setDestinationSize(Output& output, int width, int height);
+    void setCapturePlane();
+    void configureCapturePlane();
+    bool handleResolutionChange();
+public:
+    static Decoder* createDecoder(const char* pix_fmt, const vector<OutputFormat>& outputs,
+        bool zero_copy, int output_surfaces, bool zero_copy_output, int input_buffers,
+        int input_buffer_size, bool disable_dpb, bool max_perf,
+        enum v4l2_skip_frames_type skip_frames, bool profiling = false);
+    ~Decoder();
+
+    int frameSize(size_t output = 0);
+    size_t outputs();
+    int queuedInputBuffers();
+    int outputSurfaces();
+    bool zeroCopyInput();
+    bool zeroCopyOutput();
+    NvBufSurface* surface(int dmabuf_fd);
+    NvBufSurface* surfaceForCpu(int dmabuf_fd);
+    void releaseSurface(int dmabuf_fd);
+    // Accounts for copying a frame out of its surface
+    void recordCopy(chrono::steady_clock::duration duration);
+    DecoderStats stats();
+    void setOutputSize(size_t output, int width, int height);
+    void setCrop(int x, int y, int width, int height);
+    void setFrameCallback(FrameCallback on_frame, ErrorCallback on_error);
+    // In zero-copy mode the payload is read in place, `pin` is held until the
+    // decoder is done with it. Payloads that are copied drop it right away.
+    void process(unsigned char* data, int size, int64_t pts, shared_ptr<void> pin = nullptr);
+    // Returns a surface per output. They are overwritten after
+    // `outputSurfaces` calls, unless they come from the pool and must be
+    // released instead.
+    optional<pair<vector<int>, int64_t>> nextFrame();
+    void flush();
+    // Runs on a worker of the decoder manager, returns false once the
+    // capture plane needs no more servicing
+    bool serviceCapture();
+    // Frames delivered so far in asynchronous mode, the decoder manager backs
+    // off sweeping a device while it stays the same
+    uint64_t deliveredFrames();
+};
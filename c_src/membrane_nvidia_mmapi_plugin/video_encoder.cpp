@@ -0,0 +1,444 @@
+#include "video_encoder.h"
+#include "device_poll.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
+
+// Whether the access unit holds an IDR picture, judged by the type of its
+// NAL units
+static bool isKeyframe(const unsigned char* data, uint32_t size, bool h264)
+{
+    for (uint32_t i = 0; i + 3 < size; i++) {
+        if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) continue;
+
+        if (h264) {
+            uint8_t type = data[i + 3] & 0x1f;
+            if (type == 5) return true;
+            if (type == 1) return false;
+        } else {
+            uint8_t type = (data[i + 3] >> 1) & 0x3f;
+            if (type == 19 || type == 20) return true;
+            if (type < 32) return false;
+        }
+    }
+    return false;
+}
+
+uint32_t encoderPixelFormat(const char* codec)
+{
+    if (strcmp(codec, "H264") == 0) return V4L2_PIX_FMT_H264;
+    if (strcmp(codec, "H265") == 0) return V4L2_PIX_FMT_H265;
+    throw std::runtime_error("unsupported codec");
+}
+
+int encoderProfile(uint32_t pixfmt, const char* profile)
+{
+    if (strcmp(profile, "default") == 0) return -1;
+
+    if (pixfmt == V4L2_PIX_FMT_H264) {
+        if (strcmp(profile, "baseline") == 0) return V4L2_MPEG_VIDEO_H264_PROFILE_BASELINE;
+        if (strcmp(profile, "main") == 0) return V4L2_MPEG_VIDEO_H264_PROFILE_MAIN;
+        if (strcmp(profile, "high") == 0) return V4L2_MPEG_VIDEO_H264_PROFILE_HIGH;
+    } else {
+        if (strcmp(profile, "main") == 0) return V4L2_MPEG_VIDEO_H265_PROFILE_MAIN;
+        if (strcmp(profile, "main_10") == 0) return V4L2_MPEG_VIDEO_H265_PROFILE_MAIN10;
+    }
+    throw std::runtime_error("unsupported profile");
+}
+
+enum v4l2_enc_hw_preset_type encoderPreset(const char* preset)
+{
+    if (strcmp(preset, "ultrafast") == 0) return V4L2_ENC_HW_PRESET_ULTRAFAST;
+    if (strcmp(preset, "fast") == 0) return V4L2_ENC_HW_PRESET_FAST;
+    if (strcmp(preset, "medium") == 0) return V4L2_ENC_HW_PRESET_MEDIUM;
+    if (strcmp(preset, "slow") == 0) return V4L2_ENC_HW_PRESET_SLOW;
+    throw std::runtime_error("unknown preset");
+}
+
+Encoder* Encoder::createEncoder(const EncoderOptions& options)
+{
+    if (options.width <= 0 || options.height <= 0 || options.width % 2 || options.height % 2) {
+        throw std::runtime_error("invalid frame size");
+    }
+    if (options.framerateNum <= 0 || options.framerateDen <= 0) {
+        throw std::runtime_error("invalid framerate");
+    }
+    if (options.bitrate <= 0) throw std::runtime_error("invalid bitrate");
+    if (options.gopSize <= 0) throw std::runtime_error("invalid gop size");
+
+    NvVideoEncoder *enc = NvVideoEncoder::createVideoEncoder("enc0", O_NONBLOCK);
+    if (!enc) throw std::runtime_error("Failed to create NvVideoEncoder");
+
+    // The capture plane format has to be set first
+    if(enc->setCapturePlaneFormat(options.pixfmt, options.width, options.height,
+        options.outputBufferSize) < 0)
+    {
+        delete enc;
+        throw std::runtime_error("Failed to set capture plane format");
+    }
+
+    if(enc->setOutputPlaneFormat(V4L2_PIX_FMT_YUV420M, options.width, options.height) < 0)
+    {
+        delete enc;
+        throw std::runtime_error("Failed to set output plane format");
+    }
+
+    if(enc->setBitrate(options.bitrate) < 0)
+    {
+        delete enc;
+        throw std::runtime_error("Failed to set bitrate");
+    }
+
+    if(options.profile >= 0 && enc->setProfile(options.profile) < 0)
+    {
+        delete enc;
+        throw std::runtime_error("Failed to set profile");
+    }
+
+    if(enc->setRateControlMode(V4L2_MPEG_VIDEO_BITRATE_MODE_CBR) < 0)
+    {
+        delete enc;
+        throw std::runtime_error("Failed to set rate control mode");
+    }
+
+    // Every I frame is an IDR picture, so each GOP can be decoded on its own
+    if(enc->setIDRInterval(options.gopSize) < 0 || enc->setIFrameInterval(options.gopSize) < 0)
+    {
+        delete enc;
+        throw std::runtime_error("Failed to set GOP size");
+    }
+
+    // Streams can be joined at any IDR picture
+    if(enc->setInsertSpsPpsAtIdrEnabled(true) < 0)
+    {
+        delete enc;
+        throw std::runtime_error("Failed to insert parameter sets at IDR");
+    }
+
+    if(enc->setFrameRate(options.framerateNum, options.framerateDen) < 0)
+    {
+        delete enc;
+        throw std::runtime_error("Failed to set frame rate");
+    }
+
+    if(enc->setHWPresetType(options.preset) < 0)
+    {
+        delete enc;
+        throw std::runtime_error("Failed to set preset");
+    }
+
+    if(options.maxPerf && enc->setMaxPerfMode(1) < 0)
+    {
+        delete enc;
+        throw std::runtime_error("Failed to enable maximum performance mode");
+    }
+
+    // Frames are copied into the output plane buffers, which stay mapped,
+    // unless the caller queues its own DMA buffers
+    enum v4l2_memory memory = options.dmabufInput ? V4L2_MEMORY_DMABUF : V4L2_MEMORY_MMAP;
+    if(enc->output_plane.setupPlane(memory, options.inputBuffers, !options.dmabufInput, false) < 0)
+    {
+        delete enc;
+        throw std::runtime_error("Failed to setup output plane");
+    }
+
+    if(enc->capture_plane.setupPlane(V4L2_MEMORY_MMAP, options.outputBuffers, true, false) < 0)
+    {
+        delete enc;
+        throw std::runtime_error("Failed to setup capture plane");
+    }
+
+    if(enc->output_plane.setStreamStatus(true) < 0 || enc->capture_plane.setStreamStatus(true) < 0)
+    {
+        delete enc;
+        throw std::runtime_error("Failed to set stream status");
+    }
+
+    Encoder* encoder = new Encoder();
+    encoder->m_enc = enc;
+    encoder->m_h264 = options.pixfmt == V4L2_PIX_FMT_H264;
+    encoder->m_dmabufInput = options.dmabufInput;
+    encoder->m_inputSurfaces.assign(enc->output_plane.getNumBuffers(), -1);
+
+    try {
+        for (uint32_t i = 0; i < enc->capture_plane.getNumBuffers(); i++) {
+            encoder->queueCaptureBuffer(i);
+        }
+    } catch (exception& e) {
+        delete encoder;
+        throw;
+    }
+
+    return encoder;
+}
+
+Encoder::~Encoder()
+{
+    delete this->m_enc;
+}
+
+int Encoder::frameSize()
+{
+    NvBuffer* buffer = this->m_enc->output_plane.getNthBuffer(0);
+    int size = 0;
+
+    for (uint32_t plane = 0; plane < buffer->n_planes; plane++) {
+        NvBuffer::NvBufferPlaneFormat& fmt = buffer->planes[plane].fmt;
+        size += fmt.width * fmt.bytesperpixel * fmt.height;
+    }
+    return size;
+}
+
+// Copies the packed planes of the frame into the next output plane buffer
+void Encoder::process(const unsigned char* data, int size, int64_t pts)
+{
+    if (m_dmabufInput) throw std::runtime_error("encoder expects DMA buffers");
+    if (m_eos) throw std::runtime_error("encoder flushed");
+    if (size != this->frameSize()) throw std::runtime_error("invalid frame size");
+
+    NvBuffer* buffer = this->acquireInputBuffer();
+
+    for (uint32_t plane = 0; plane < buffer->n_planes; plane++) {
+        NvBuffer::NvBufferPlane& dst = buffer->planes[plane];
+        size_t row_size = dst.fmt.width * dst.fmt.bytesperpixel;
+
+        for (uint32_t y = 0; y < dst.fmt.height; y++) {
+            memcpy(dst.data + y * dst.fmt.stride, data + y * row_size, row_size);
+        }
+        data += row_size * dst.fmt.height;
+        dst.bytesused = dst.fmt.stride * dst.fmt.height;
+    }
+
+    NvBufSurface* surface = NULL;
+    NvDeviceBackend& backend = NvDeviceBackend::getBackendInstance();
+    if (backend.surfaceFromFd(buffer->planes[0].fd, (void**)&surface) < 0 ||
+        backend.surfaceSyncForDevice(surface, 0, -1) < 0) {
+        throw std::runtime_error("could not sync buf surface");
+    }
+
+    this->qBuffer(buffer, pts);
+}
+
+void Encoder::processSurface(int dmabuf_fd, int64_t pts)
+{
+    if (!m_dmabufInput) throw std::runtime_error("encoder expects raw frames");
+    if (m_eos) throw std::runtime_error("encoder flushed");
+
+    NvBuffer* buffer = this->acquireInputBuffer();
+    this->qBuffer(buffer, pts, dmabuf_fd);
+}
+
+void Encoder::setSurfaceCallback(SurfaceCallback on_released)
+{
+    m_onSurfaceReleased = on_released;
+}
+
+void Encoder::forceKeyframe()
+{
+    if (this->m_enc->forceIDR() < 0) throw std::runtime_error("could not force IDR");
+}
+
+// Queues an empty frame, the encoder signals the end of stream once all
+// the access units are output
+void Encoder::flush()
+{
+    if (m_eos) return;
+
+    // The end of stream buffer refers to the last DMA buffer queued, with
+    // none queued there is nothing to drain
+    if (m_dmabufInput && m_lastSurface < 0) {
+        this->m_eos = true;
+        this->m_drained = true;
+        return;
+    }
+
+    NvBuffer* buffer = this->acquireInputBuffer();
+    for (uint32_t plane = 0; plane < buffer->n_planes; plane++) {
+        buffer->planes[plane].bytesused = 0;
+    }
+
+    this->m_eos = true;
+    this->qBuffer(buffer, 0);
+}
+
+optional<EncodedFrame> Encoder::nextFrame()
+{
+    struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[MAX_PLANES];
+    NvBuffer* buffer = NULL;
+
+    while (!m_drained) {
+        memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+        memset(planes, 0, sizeof(planes));
+        v4l2_buf.m.planes = planes;
+
+        if (this->m_enc->capture_plane.dqBuffer(v4l2_buf, &buffer, NULL, 0) == 0) {
+            uint32_t size = buffer->planes[0].bytesused;
+
+            if (size == 0) {
+                this->m_drained = true;
+                this->queueCaptureBuffer(v4l2_buf.index);
+                this->releaseInputSurfaces();
+                break;
+            }
+
+            int64_t pts = v4l2_buf.timestamp.tv_sec * (int64_t)Microsecond +
+                v4l2_buf.timestamp.tv_usec;
+            return EncodedFrame {v4l2_buf.index, buffer->planes[0].data, size, pts,
+                isKeyframe(buffer->planes[0].data, size, m_h264)};
+        }
+
+        if (errno != EAGAIN) {
+            throw std::runtime_error("could not dequeue buffer from capture plane");
+        }
+
+        if (v4l2_buf.flags & V4L2_BUF_FLAG_LAST) {
+            this->m_drained = true;
+            this->releaseInputSurfaces();
+            break;
+        }
+
+        // Once flushed, wait for the access units of all the queued frames
+        if (!m_eos) break;
+        this->waitForCapture();
+    }
+
+    return nullopt;
+}
+
+void Encoder::releaseFrame(const EncodedFrame& frame)
+{
+    this->queueCaptureBuffer(frame.index);
+}
+
+// Returns an output plane buffer that can be filled, waiting for the
+// encoder to consume a frame if they are all queued
+NvBuffer* Encoder::acquireInputBuffer()
+{
+    NvV4l2ElementPlane& output_plane = this->m_enc->output_plane;
+    struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[MAX_PLANES];
+    NvBuffer* buffer = NULL;
+
+    if (m_unusedBuffers < output_plane.getNumBuffers()) {
+        return output_plane.getNthBuffer(m_unusedBuffers++);
+    }
+
+    while (true) {
+        memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+        memset(planes, 0, sizeof(planes));
+        v4l2_buf.m.planes = planes;
+
+        if (output_plane.dqBuffer(v4l2_buf, &buffer, NULL, 0) == 0) {
+            this->releaseInputSurface(buffer->index);
+            return buffer;
+        }
+
+        if (errno != EAGAIN) {
+            throw std::runtime_error("could not dequeue buffer from output plane");
+        }
+        this->waitForOutput();
+    }
+}
+
+void Encoder::qBuffer(NvBuffer* buffer, int64_t pts, int dmabuf_fd)
+{
+    struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[MAX_PLANES];
+
+    memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+    memset(planes, 0, sizeof(planes));
+
+    v4l2_buf.index = buffer->index;
+    v4l2_buf.m.planes = planes;
+    v4l2_buf.flags |= V4L2_BUF_FLAG_TIMESTAMP_COPY;
+    v4l2_buf.timestamp.tv_sec = pts / Microsecond;
+    v4l2_buf.timestamp.tv_usec = pts % Microsecond;
+
+    if (dmabuf_fd >= 0) {
+        NvBufSurface* surface = NULL;
+        if (NvDeviceBackend::getBackendInstance().surfaceFromFd(dmabuf_fd, (void**)&surface) < 0) {
+            throw std::runtime_error("unknown DMA buffer");
+        }
+
+        // Every plane of the frame lives in the same DMA buffer
+        for (uint32_t plane = 0; plane < buffer->n_planes; plane++) {
+            planes[plane].m.fd = dmabuf_fd;
+            planes[plane].bytesused = surface->surfaceList[0].planeParams.psize[plane];
+        }
+    } else if (m_dmabufInput) {
+        // The empty buffer marking the end of stream still has to refer to
+        // a DMA buffer
+        for (uint32_t plane = 0; plane < buffer->n_planes; plane++) {
+            planes[plane].m.fd = m_lastSurface;
+        }
+    }
+
+    if (this->m_enc->output_plane.qBuffer(v4l2_buf, NULL) < 0) {
+        throw std::runtime_error("could not queue buffer to output plane");
+    }
+
+    if (dmabuf_fd >= 0) {
+        m_inputSurfaces[buffer->index] = dmabuf_fd;
+        m_lastSurface = dmabuf_fd;
+    }
+}
+
+// Hands the DMA buffer of a dequeued output plane buffer back to the caller
+void Encoder::releaseInputSurface(uint32_t index)
+{
+    int dmabuf_fd = m_inputSurfaces[index];
+    if (dmabuf_fd < 0) return;
+
+    m_inputSurfaces[index] = -1;
+    if (m_onSurfaceReleased) m_onSurfaceReleased(dmabuf_fd);
+}
+
+// Once drained, the encoder is done with all the frames queued on the
+// output plane
+void Encoder::releaseInputSurfaces()
+{
+    NvV4l2ElementPlane& output_plane = this->m_enc->output_plane;
+    struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[MAX_PLANES];
+    NvBuffer* buffer = NULL;
+
+    while (output_plane.getNumQueuedBuffers() > 0) {
+        memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+        memset(planes, 0, sizeof(planes));
+        v4l2_buf.m.planes = planes;
+
+        if (output_plane.dqBuffer(v4l2_buf, &buffer, NULL, 0) < 0) break;
+        this->releaseInputSurface(buffer->index);
+    }
+}
+
+void Encoder::queueCaptureBuffer(uint32_t index)
+{
+    struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[MAX_PLANES];
+
+    memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+    memset(planes, 0, sizeof(planes));
+
+    v4l2_buf.index = index;
+    v4l2_buf.m.planes = planes;
+
+    if (this->m_enc->capture_plane.qBuffer(v4l2_buf, NULL) < 0) {
+        throw std::runtime_error("could not queue buffer on capture plane");
+    }
+}
+
+void Encoder::waitForCapture()
+{
+    if (pollDevice(this->m_enc, POLLIN, DeviceTimeoutMs) == 0) {
+        throw std::runtime_error("timed out waiting for the encoder");
+    }
+}
+
+void Encoder::waitForOutput()
+{
+    if (pollDevice(this->m_enc, POLLOUT, DeviceTimeoutMs) == 0) {
+        throw std::runtime_error("timed out waiting for the encoder");
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <vector>
+#include "NvVideoEncoder.h"
+#include "NvBufSurface.h"
+#include "common/NvDeviceBackend.h"
+
+using namespace std;
+
+// Called when the encoder is done reading a DMA buffer queued with
+// `processSurface`
+typedef function<void(int dmabuf_fd)> SurfaceCallback;
+
+// Structure and rate control of the encoded stream
+struct EncoderOptions {
+    // V4L2_PIX_FMT_H264 or V4L2_PIX_FMT_H265
+    uint32_t pixfmt;
+    int width;
+    int height;
+    int framerateNum;
+    int framerateDen;
+    int bitrate;
+    // Frames between two IDR pictures, every I frame is an IDR picture
+    int gopSize;
+    // V4L2 profile of the codec, -1 to keep the default of the encoder
+    int profile;
+    enum v4l2_enc_hw_preset_type preset;
+    bool maxPerf;
+    // Frames are queued as DMA buffers of the caller instead of being copied
+    // into the output plane buffers
+    bool dmabufInput;
+    int inputBuffers;
+    int outputBuffers;
+    int outputBufferSize;
+};
+
+// An access unit held by a capture plane buffer until it is released
+struct EncodedFrame {
+    uint32_t index;
+    const unsigned char* data;
+    uint32_t size;
+    int64_t pts;
+    bool keyframe;
+};
+
+// Map the codec, profile and preset names of the elements to their V4L2
+// values, throwing on unsupported ones. A `default` profile maps to -1.
+uint32_t encoderPixelFormat(const char* codec);
+int encoderProfile(uint32_t pixfmt, const char* profile);
+enum v4l2_enc_hw_preset_type encoderPreset(const char* preset);
+
+class Encoder
+{
+private:
+    static const int Microsecond = 1000000;
+    // Longest wait for the encoder before giving up on it
+    static constexpr int DeviceTimeoutMs = 2000;
+
+    NvVideoEncoder* m_enc;
+    bool m_h264;
+    // Output plane buffers are handed out in order until all of them have
+    // been queued once, they are dequeued from the encoder afterwards.
+    uint32_t m_unusedBuffers = 0;
+    bool m_eos = false;
+    bool m_drained = false;
+    bool m_dmabufInput = false;
+    // DMA buffer held by each output plane buffer, -1 when there is none
+    vector<int> m_inputSurfaces;
+    int m_lastSurface = -1;
+    SurfaceCallback m_onSurfaceReleased;
+
+    NvBuffer* acquireInputBuffer();
+    void qBuffer(NvBuffer* buffer, int64_t pts, int dmabuf_fd = -1);
+    void releaseInputSurface(uint32_t index);
+    void releaseInputSurfaces();
+    void queueCaptureBuffer(uint32_t index);
+    void waitForCapture();
+    void waitForOutput();
+public:
+    static Encoder* createEncoder(const EncoderOptions& options);
+    ~Encoder();
+
+    // Size of a packed I420 frame
+    int frameSize();
+    void process(const unsigned char* data, int size, int64_t pts);
+    // Queues a YUV420 surface of the frame size as is. It must not be written
+    // until handed to the callback set with `setSurfaceCallback`.
+    void processSurface(int dmabuf_fd, int64_t pts);
+    void setSurfaceCallback(SurfaceCallback on_released);
+    // Returns the next access unit, which stays valid until released. Once
+    // flushed, waits for the encoder to output all of them.
+    optional<EncodedFrame> nextFrame();
+    void releaseFrame(const EncodedFrame& frame);
+    void forceKeyframe();
+    void flush();
+};
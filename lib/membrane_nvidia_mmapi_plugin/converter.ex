@@ -0,0 +1,199 @@
+defmodule Membrane.Nvidia.MMAPI.Converter do
+  @moduledoc """
+  Membrane element that scales, crops, flips and converts raw video frames using the `VIC` hardware accelerator.
+
+  Each frame is copied into a pooled hardware surface, converted by the `VIC` into another
+  pooled surface and copied out. Up to `conversions_in_flight` frames are converted at once,
+  so that copying a frame in overlaps the conversion of the previous ones, each buffer is
+  output once that many frames have been received.
+
+  Frames in `I420`, `NV12`, `RGBA` and `BGRA` formats are accepted and can be converted to any
+  of them. Buffers holding a `Membrane.Nvidia.MMAPI.Frame` are downloaded first. A new stream
+  format flushes the converter and creates it again.
+  """
+
+  use Membrane.Filter
+
+  alias __MODULE__.Native
+  alias Membrane.{Buffer, RawVideo}
+  alias Membrane.Nvidia.MMAPI.Frame
+
+  def_options width: [
+                spec: pos_integer() | nil,
+                default: nil,
+                description: """
+                Scale the frames to the provided width.
+
+                If height is not provided, it'll be calculated to keep the aspect ratio.
+                """
+              ],
+              height: [
+                spec: pos_integer() | nil,
+                default: nil,
+                description: """
+                Scale the frames to the provided height.
+
+                If width is not provided, it'll be calculated to keep the aspect ratio.
+                """
+              ],
+              pixel_format: [
+                spec: :I420 | :NV12 | :RGBA | :BGRA | nil,
+                default: nil,
+                description: """
+                Pixel format of the output frames, defaults to the one of the input frames.
+                """
+              ],
+              crop: [
+                spec:
+                  {non_neg_integer(), non_neg_integer(), pos_integer(), pos_integer()} | nil,
+                default: nil,
+                description: """
+                Region of the input frames to output, as `{x, y, width, height}`.
+
+                The region is scaled to the output size, which defaults to the size of the
+                region. Offsets and sizes of `I420` and `NV12` frames are rounded down to even
+                values, the region must fit in the input frames.
+                """
+              ],
+              flip: [
+                spec: :none | :horizontal | :vertical | :rotate_180,
+                default: :none,
+                description: """
+                Flip the frames around the vertical axis (`:horizontal`), the horizontal
+                axis (`:vertical`) or both (`:rotate_180`).
+                """
+              ],
+              conversions_in_flight: [
+                spec: pos_integer(),
+                default: 2,
+                description: """
+                Number of frames converted at once, each of them needs a source and a
+                destination surface. With `1`, every frame is output as soon as it's received.
+                """
+              ]
+
+  def_input_pad :input,
+    flow_control: :auto,
+    accepted_format:
+      %RawVideo{pixel_format: pixel_format, aligned: true}
+      when pixel_format in [:I420, :NV12, :RGBA, :BGRA]
+
+  def_output_pad :output,
+    flow_control: :auto,
+    accepted_format:
+      %RawVideo{pixel_format: pixel_format, aligned: true}
+      when pixel_format in [:I420, :NV12, :RGBA, :BGRA]
+
+  @impl true
+  def handle_init(_ctx, opts) do
+    state = Map.merge(Map.from_struct(opts), %{converter_ref: nil, input_format: nil})
+    {[], state}
+  end
+
+  @impl true
+  def handle_stream_format(:input, stream_format, _ctx, %{input_format: stream_format} = state),
+    do: {[], state}
+
+  @impl true
+  def handle_stream_format(:input, stream_format, _ctx, state) do
+    {actions, state} =
+      if state.converter_ref,
+        do: flush(state),
+        else: {[], state}
+
+    output_format = output_format(stream_format, state)
+
+    converter_ref =
+      Native.create!(
+        {stream_format.width, stream_format.height, stream_format.pixel_format},
+        {output_format.width, output_format.height, output_format.pixel_format},
+        crop: state.crop,
+        flip: state.flip,
+        conversions_in_flight: state.conversions_in_flight
+      )
+
+    {actions ++ [stream_format: {:output, output_format}],
+     %{state | converter_ref: converter_ref, input_format: stream_format}}
+  end
+
+  @impl true
+  def handle_buffer(:input, buffer, _ctx, state) do
+    case Native.convert(payload(buffer.payload), buffer.pts || 0, state.converter_ref) do
+      {:ok, frames, pts_list} ->
+        {wrap_frames(frames, pts_list), state}
+
+      {:error, reason} ->
+        raise "Native converter failed to convert the frame: #{inspect(reason)}"
+    end
+  end
+
+  @impl true
+  def handle_end_of_stream(:input, _ctx, %{converter_ref: nil} = state),
+    do: {[end_of_stream: :output], state}
+
+  @impl true
+  def handle_end_of_stream(:input, _ctx, state) do
+    {actions, state} = flush(state)
+    {actions ++ [end_of_stream: :output], state}
+  end
+
+  defp flush(state) do
+    case Native.flush(state.converter_ref) do
+      {:ok, frames, pts_list} ->
+        {wrap_frames(frames, pts_list), %{state | converter_ref: nil}}
+
+      {:error, reason} ->
+        raise "Native converter failed to flush: #{inspect(reason)}"
+    end
+  end
+
+  defp payload(%Frame{} = frame), do: Frame.download(frame)
+  defp payload(payload), do: payload
+
+  defp wrap_frames([], []), do: []
+
+  defp wrap_frames(frames, pts_list) do
+    buffers = Enum.zip_with(frames, pts_list, &%Buffer{pts: &2, payload: &1})
+    [buffer: {:output, buffers}]
+  end
+
+  defp output_format(stream_format, state) do
+    {width, height} =
+      stream_format
+      |> source_size(state.crop)
+      |> scaled_size(state)
+
+    %RawVideo{
+      width: width,
+      height: height,
+      pixel_format: state.pixel_format || stream_format.pixel_format,
+      aligned: true,
+      framerate: stream_format.framerate
+    }
+  end
+
+  # Size of the cropped region, rounded like the native converter does
+  defp source_size(%{width: width, height: height}, nil), do: {width, height}
+
+  defp source_size(%{pixel_format: pixel_format}, {_x, _y, width, height})
+       when pixel_format in [:I420, :NV12],
+       do: {even(width), even(height)}
+
+  defp source_size(_stream_format, {_x, _y, width, height}), do: {width, height}
+
+  defp even(value), do: value - rem(value, 2)
+
+  defp scaled_size({width, height}, %{width: nil, height: nil}), do: {width, height}
+
+  defp scaled_size({width, height}, %{width: scaled_width, height: nil}) do
+    h = div(scaled_width * height, width)
+    {scaled_width, h + rem(h, 2)}
+  end
+
+  defp scaled_size({width, height}, %{width: nil, height: scaled_height}) do
+    w = div(scaled_height * width, height)
+    {w + rem(w, 2), scaled_height}
+  end
+
+  defp scaled_size(_size, %{width: width, height: height}), do: {width, height}
+end
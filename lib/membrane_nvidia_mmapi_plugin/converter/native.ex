@@ -0,0 +1,34 @@
+defmodule Membrane.Nvidia.MMAPI.Converter.Native do
+  @moduledoc false
+  use Unifex.Loader
+
+  @default_conversions_in_flight 2
+
+  # `input` and `output` are `{width, height, pixel_format}` tuples
+  def create({in_width, in_height, in_format}, {out_width, out_height, out_format}, opts \\ []) do
+    crop =
+      case Keyword.get(opts, :crop) do
+        nil -> []
+        {x, y, width, height} -> [x, y, width, height]
+      end
+
+    create(
+      in_format,
+      in_width,
+      in_height,
+      out_format,
+      out_width,
+      out_height,
+      crop,
+      Keyword.get(opts, :flip, :none),
+      Keyword.get(opts, :conversions_in_flight, @default_conversions_in_flight)
+    )
+  end
+
+  def create!(input, output, opts \\ []) do
+    case create(input, output, opts) do
+      {:ok, converter_ref} -> converter_ref
+      {:error, reason} -> raise "could not create converter due to #{inspect(reason)}"
+    end
+  end
+end
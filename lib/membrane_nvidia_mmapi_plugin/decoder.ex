@@ -3,15 +3,41 @@ defmodule Membrane.Nvidia.MMAPI.Decoder do
   Membrane element that decodes video in H264 or H265 format using the Jetson hardware decoder based on V4L2 interface.
 
   The element expects the received buffers to contain an integral access units.
-  It also supports scaling the decoded frames using the `VIC` hardware accelerator.
+  It also supports scaling the decoded frames and converting them to another pixel format
+  using the `VIC` hardware accelerator.
+
+  Resolution changes within a stream are handled by the decoder without restarting it,
+  the frames following a new stream format are scaled to the new output size.
+
+  Several renditions of the stream can be output from a single decode, each `:rendition`
+  pad linked to the element gets the frames scaled to its own size and pixel format, on top
+  of the `:output` pad. The `VIC` converts each frame once per rendition, which is much
+  cheaper than decoding the stream again. Linking or unlinking a rendition while decoding
+  flushes the decoder and creates it again.
+
+  A region of the decoded frames can be selected with `crop`, the `VIC` scales only that
+  region into the output frames. The region can be changed while decoding by sending
+  `{:crop, region}` to the element as a parent notification.
+
+  With `zero_copy_output` the output buffers hold a `Membrane.Nvidia.MMAPI.Frame` instead of
+  a binary, the frame is copied only when its payload is read.
+
+  In `async` mode, the frames of all the decoders of the VM are converted and copied out by a
+  pool of up to 4 native threads. A decoder is serviced by one of them at a time, which waits
+  for the `VIC` conversions of its frames and copies them, so with more streams than threads
+  the frames of a stream wait for the copies of the other streams. The aggregate throughput is
+  bounded by what these threads can copy. On Jetson the decoder devices can't be polled, so
+  each async decoder also has a native thread sleeping until its device has a frame.
   """
 
   use Membrane.Filter
 
   require Membrane.Logger
+  require Membrane.Pad
 
   alias __MODULE__.Native
-  alias Membrane.{Buffer, H264, H265}
+  alias Membrane.{Buffer, H264, H265, Pad}
+  alias Membrane.Nvidia.MMAPI.Frame
   alias Membrane.RawVideo
 
   def_options width: [
@@ -31,6 +57,172 @@ defmodule Membrane.Nvidia.MMAPI.Decoder do
 
                 If width is not provided, it'll be calculated to keep the aspect ratio.
                 """
+              ],
+              pixel_format: [
+                spec: :I420 | :NV12 | :RGBA | :BGRA,
+                default: :I420,
+                description: """
+                Pixel format of the output frames.
+
+                The decoded frames are converted by the `VIC` while being scaled, at no extra cost.
+                """
+              ],
+              crop: [
+                spec:
+                  {non_neg_integer(), non_neg_integer(), pos_integer(), pos_integer()} | nil,
+                default: nil,
+                description: """
+                Region of the decoded picture to output, as `{x, y, width, height}`.
+
+                The region is cropped by the `VIC` and scaled to the output size, which defaults
+                to the size of the region. Offsets and sizes are rounded down to even values and
+                the region is clamped to the decoded picture.
+                """
+              ],
+              zero_copy_input: [
+                spec: boolean(),
+                default: false,
+                description: """
+                Queue the payload of the input buffers directly to the decoder instead of
+                copying them to the decoder buffers.
+
+                The decoder keeps a reference to the payloads until it's done with them.
+                """
+              ],
+              async: [
+                spec: boolean(),
+                default: false,
+                description: """
+                Decode asynchronously.
+
+                Input buffers are submitted to the decoder without waiting for decoded frames.
+                The frames are converted on a native thread and sent to the element as messages,
+                so the hardware queue stays full and no scheduler is blocked waiting for the decoder.
+
+                A small pool of native threads serves all the async decoders of the VM, see the
+                module documentation for its limits.
+                """
+              ],
+              output_surfaces: [
+                spec: pos_integer(),
+                default: 4,
+                description: """
+                Number of surfaces the decoded frames are converted into before being copied out.
+
+                Up to this number of frames are converted at once, returning their capture buffers
+                to the decoder before the frames are copied.
+
+                With `zero_copy_output`, it's the initial size of the surface pool.
+                """
+              ],
+              zero_copy_output: [
+                spec: boolean(),
+                default: false,
+                description: """
+                Output the decoded frames as `Membrane.Nvidia.MMAPI.Frame` holding the hardware
+                surface instead of copying them into binaries.
+
+                The surface goes back to the pool once the frame is garbage collected, the pool
+                grows while downstream elements keep references to the frames.
+                Not supported in `async` mode.
+                """
+              ],
+              batch_size: [
+                spec: pos_integer(),
+                default: 1,
+                description: """
+                Number of access units decoded in a single native call.
+
+                Input buffers are held until the batch is full, the stream format changes or the
+                stream ends. For small resolutions, the cost of a native call outweighs the
+                decoding itself, batching trades latency for less overhead.
+                """
+              ],
+              batch_timeout: [
+                spec: Membrane.Time.non_neg() | nil,
+                default: nil,
+                description: """
+                Maximum time an input buffer is held waiting for the batch to fill up.
+
+                Only used when `batch_size` is greater than 1.
+                """
+              ],
+              latency: [
+                spec: :normal | :low,
+                default: :normal,
+                description: """
+                Decoding latency mode.
+
+                With `:low`, the decoded picture buffer is disabled and the decoder runs at
+                maximum clock rates, each frame is output as soon as its access unit is decoded.
+                Meant for live streams without B frames (e.g. IPPP camera streams), frames of
+                streams with reordering are output in decoding order.
+                """
+              ],
+              disable_dpb: [
+                spec: boolean() | nil,
+                default: nil,
+                description: """
+                Disable the decoded picture buffer, defaults to `true` with `latency: :low`.
+                """
+              ],
+              max_perf: [
+                spec: boolean() | nil,
+                default: nil,
+                description: """
+                Run the decoder at maximum clock rates, defaults to `true` with `latency: :low`.
+                """
+              ],
+              skip_frames: [
+                spec: :none | :non_ref | :idr_only,
+                default: :none,
+                description: """
+                Access units the decoder skips instead of decoding them.
+
+                  * `:none` - decode every access unit.
+                  * `:non_ref` - skip the pictures no other picture refers to.
+                  * `:idr_only` - decode only the IDR pictures, e.g. to extract thumbnails.
+
+                Skipped access units produce no output buffer.
+                """
+              ],
+              input_buffers: [
+                spec: pos_integer() | nil,
+                default: nil,
+                description: """
+                Number of access units queued to the decoder at once.
+
+                Defaults to a value based on the resolution of the stream.
+                """
+              ],
+              input_buffer_size: [
+                spec: pos_integer() | nil,
+                default: nil,
+                description: """
+                Initial size in bytes of the buffers holding the access units.
+
+                Defaults to a value based on the codec and resolution of the stream. A buffer
+                grows when an access unit doesn't fit, so this only avoids reallocations.
+                """
+              ],
+              stats_interval: [
+                spec: Membrane.Time.non_neg() | nil,
+                default: nil,
+                description: """
+                Interval at which the statistics of the decoder are emitted as a
+                `[:membrane_nvidia_mmapi, :decoder, :stats]` telemetry event.
+
+                The measurements hold the decoded frames, the average frame rate and the
+                latencies of the decoder from queueing an access unit to dequeueing its frame,
+                with their 50th, 99th and 99.9th percentiles, the buffers queued on both planes
+                and the average time spent converting and copying out a frame. The metadata
+                holds the `name` of the element. Enabling it turns on the profiling of the
+                decoder, which is cheap enough to leave on.
+
+                Up to 256 decoders of the VM can be profiled at once, the latencies of the
+                other ones stay at 0 and their `too_many_profiled_elements` measurement is
+                `true`.
+                """
               ]
 
   def_input_pad :input,
@@ -43,98 +235,419 @@ defmodule Membrane.Nvidia.MMAPI.Decoder do
 
   def_output_pad :output,
     flow_control: :auto,
-    accepted_format: %RawVideo{pixel_format: :I420, aligned: true}
+    accepted_format:
+      %RawVideo{pixel_format: pixel_format, aligned: true}
+      when pixel_format in [:I420, :NV12, :RGBA, :BGRA]
+
+  def_output_pad :rendition,
+    availability: :on_request,
+    flow_control: :auto,
+    accepted_format:
+      %RawVideo{pixel_format: pixel_format, aligned: true}
+      when pixel_format in [:I420, :NV12, :RGBA, :BGRA],
+    options: [
+      width: [
+        spec: non_neg_integer() | nil,
+        default: nil,
+        description: """
+        Width of the rendition, calculated to keep the aspect ratio if not provided.
+        """
+      ],
+      height: [
+        spec: non_neg_integer() | nil,
+        default: nil,
+        description: """
+        Height of the rendition, calculated to keep the aspect ratio if not provided.
+        """
+      ],
+      pixel_format: [
+        spec: :I420 | :NV12 | :RGBA | :BGRA,
+        default: :I420,
+        description: """
+        Pixel format of the rendition.
+        """
+      ]
+    ]
 
   @impl true
   def handle_init(_ctx, opts) do
-    state = Map.merge(Map.from_struct(opts), %{decoder_ref: nil})
+    state =
+      Map.merge(Map.from_struct(opts), %{
+        decoder_ref: nil,
+        decoder_crop: nil,
+        codec: nil,
+        outputs: [],
+        renditions: [],
+        flushed_outputs: :queue.new(),
+        batch: []
+      })
+
     {[], state}
   end
 
+  @impl true
+  def handle_playing(_ctx, %{stats_interval: nil} = state), do: {[], state}
+
+  @impl true
+  def handle_playing(_ctx, state), do: {[start_timer: {:stats, state.stats_interval}], state}
+
   @impl true
   def handle_stream_format(:input, stream_format, ctx, state) do
-    old_stream_format = ctx.pads.output.stream_format
+    configure(stream_format, ctx, state)
+  end
 
-    {width, height} = dimensions(stream_format, state)
-    framerate = stream_format.framerate || {0, 1}
+  @impl true
+  def handle_pad_added(Pad.ref(:rendition, _id) = pad, ctx, state) do
+    reconfigure(ctx, %{state | renditions: state.renditions ++ [pad]})
+  end
 
-    if is_nil(old_stream_format) or old_stream_format != stream_format do
-      codec =
-        case stream_format do
-          %H264{} -> :H264
-          %H265{} -> :H265
-        end
+  @impl true
+  def handle_pad_removed(Pad.ref(:rendition, _id) = pad, ctx, state) do
+    # The frames still to be flushed for the removed pad are dropped
+    outputs =
+      Enum.map(state.outputs, fn
+        {^pad, format} -> {nil, format}
+        output -> output
+      end)
 
-      stream_format = %RawVideo{
-        width: width,
-        height: height,
-        pixel_format: :I420,
-        aligned: true,
-        framerate: framerate
-      }
-
-      {actions, state} =
-        if state.decoder_ref,
-          do: flush(state),
-          else: {[], state}
-
-      {actions ++ [stream_format: {:output, stream_format}],
-       %{state | decoder_ref: Native.create!(codec, width, height)}}
-    else
-      {[], state}
-    end
+    reconfigure(ctx, %{state | renditions: List.delete(state.renditions, pad), outputs: outputs})
+  end
+
+  @impl true
+  def handle_parent_notification({:crop, crop}, ctx, state) do
+    reconfigure(ctx, %{state | crop: crop})
   end
 
   @impl true
-  def handle_buffer(:input, buffer, _ctx, %{decoder_ref: decoder_ref} = state) do
-    case Native.decode(buffer.payload, buffer.pts || 0, decoder_ref) do
+  def handle_parent_notification(_notification, _ctx, state) do
+    {[], state}
+  end
+
+  @impl true
+  def handle_buffer(:input, buffer, _ctx, %{batch_size: 1, decoder_ref: decoder_ref} = state) do
+    case decode(buffer.payload, buffer.pts || 0, decoder_ref, state) do
       {:ok, frames, pts_list} ->
-        {wrap_frames(frames, pts_list), state}
+        {wrap_frames(frames, pts_list, state.outputs, state), state}
 
       {:error, reason} ->
         raise "Native decoder failed to decode the payload: #{inspect(reason)}"
     end
   end
 
+  @impl true
+  def handle_buffer(:input, buffer, _ctx, state) do
+    timer_actions =
+      if state.batch == [] and state.batch_timeout,
+        do: [start_timer: {:batch, state.batch_timeout}],
+        else: []
+
+    state = %{state | batch: [buffer | state.batch]}
+
+    if length(state.batch) >= state.batch_size do
+      {actions, state} = decode_batch(state)
+      {timer_actions ++ actions, state}
+    else
+      {timer_actions, state}
+    end
+  end
+
+  @impl true
+  def handle_tick(:batch, _ctx, state) do
+    decode_batch(state)
+  end
+
+  @impl true
+  def handle_tick(:stats, _ctx, %{decoder_ref: nil} = state), do: {[], state}
+
+  @impl true
+  def handle_tick(:stats, ctx, state) do
+    case Native.stats(state.decoder_ref) do
+      {:ok, stats} ->
+        :telemetry.execute([:membrane_nvidia_mmapi, :decoder, :stats], stats, %{name: ctx.name})
+
+      {:error, reason} ->
+        Membrane.Logger.warning("Could not get the decoder statistics: #{inspect(reason)}")
+    end
+
+    {[], state}
+  end
+
   @impl true
   def handle_end_of_stream(:input, _ctx, state) do
-    {actions, state} = flush(state)
-    {actions ++ [end_of_stream: :output], state}
+    flush(state, Enum.map([:output | state.renditions], &{:end_of_stream, &1}))
+  end
+
+  # The frames sent before a flush or a change of the outputs belong to the previous outputs
+  @impl true
+  def handle_info({:decoded_frame, frames, pts}, _ctx, state) do
+    outputs =
+      case :queue.peek(state.flushed_outputs) do
+        {:value, outputs} -> outputs
+        :empty -> state.outputs
+      end
+
+    {wrap_frames(frames, [pts], outputs, state), state}
+  end
+
+  @impl true
+  def handle_info({:decoding_error, reason}, _ctx, _state) do
+    raise "Native decoder failed to decode the payload: #{inspect(reason)}"
+  end
+
+  @impl true
+  def handle_info({:flushed, actions}, _ctx, state) do
+    {actions, %{state | flushed_outputs: :queue.drop(state.flushed_outputs)}}
+  end
+
+  defp reconfigure(ctx, state) do
+    case ctx.pads.input.stream_format do
+      nil -> {[], state}
+      stream_format -> configure(stream_format, ctx, state)
+    end
+  end
+
+  # Sets the decoder up for the input stream format, the current crop and renditions
+  defp configure(stream_format, ctx, state) do
+    codec =
+      case stream_format do
+        %H264{} -> :H264
+        %H265{} -> :H265
+      end
+
+    outputs =
+      Enum.map([:output | state.renditions], fn pad ->
+        options = if pad == :output, do: state, else: ctx.pads[pad].options
+        {pad, output_format(stream_format, options, state)}
+      end)
+
+    format_actions =
+      for {pad, format} <- outputs, ctx.pads[pad].stream_format != format,
+          do: {:stream_format, {pad, format}}
+
+    same_pads? = Enum.map(outputs, &elem(&1, 0)) == Enum.map(state.outputs, &elem(&1, 0))
+
+    cond do
+      format_actions == [] and same_pads? and state.decoder_crop == state.crop ->
+        {[], state}
+
+      # The decoder follows the coded resolution, only the output sizes and crop change
+      state.decoder_ref && same_pads? && state.codec == codec ->
+        {actions, state} = decode_batch(state)
+
+        outputs
+        |> Enum.with_index()
+        |> Enum.each(fn {{_pad, format}, index} ->
+          case Native.set_output_size(index, format.width, format.height, state.decoder_ref) do
+            :ok -> :ok
+            {:error, reason} -> raise "could not change the output size due to #{inspect(reason)}"
+          end
+        end)
+
+        {x, y, crop_width, crop_height} = state.crop || {0, 0, 0, 0}
+
+        case Native.set_crop(x, y, crop_width, crop_height, state.decoder_ref) do
+          :ok -> :ok
+          {:error, reason} -> raise "could not change the crop due to #{inspect(reason)}"
+        end
+
+        state = %{state | decoder_crop: state.crop}
+
+        if state.async do
+          # The frames converted before the change may still be in the mailbox
+          send(self(), {:flushed, format_actions})
+          flushed_outputs = :queue.in(state.outputs, state.flushed_outputs)
+          {actions, %{state | outputs: outputs, flushed_outputs: flushed_outputs}}
+        else
+          {actions ++ format_actions, %{state | outputs: outputs}}
+        end
+
+      true ->
+        {actions, state} =
+          if state.decoder_ref,
+            do: flush(state, format_actions),
+            else: {format_actions, state}
+
+        [{:output, format} | renditions] = outputs
+
+        decoder_ref =
+          Native.create!(codec, format.width, format.height,
+            zero_copy_input: state.zero_copy_input,
+            async: state.async,
+            output_surfaces: state.output_surfaces,
+            zero_copy_output: state.zero_copy_output,
+            input_buffers: state.input_buffers || default_input_buffers(stream_format),
+            input_buffer_size:
+              state.input_buffer_size || default_input_buffer_size(codec, stream_format),
+            disable_dpb: low_latency_option(state.disable_dpb, state),
+            max_perf: low_latency_option(state.max_perf, state),
+            skip_frames: state.skip_frames,
+            pixel_format: format.pixel_format,
+            crop: state.crop,
+            renditions:
+              Enum.map(renditions, fn {_pad, format} ->
+                {format.width, format.height, format.pixel_format}
+              end),
+            profiling: state.stats_interval != nil
+          )
+
+        {actions,
+         %{
+           state
+           | decoder_ref: decoder_ref,
+             decoder_crop: state.crop,
+             codec: codec,
+             outputs: outputs
+         }}
+    end
   end
 
-  defp flush(state) do
-    case Native.flush(state.decoder_ref) do
+  defp output_format(stream_format, options, state) do
+    {width, height} = dimensions(stream_format, state.crop, options)
+
+    %RawVideo{
+      width: width,
+      height: height,
+      pixel_format: options.pixel_format,
+      aligned: true,
+      framerate: stream_format.framerate || {0, 1}
+    }
+  end
+
+  # `actions` are returned once all the frames of the decoder have been sent.
+  # In async mode the remaining frames are still in the mailbox when the
+  # flush returns, so the actions are delayed until they are handled.
+  defp flush(state, actions) do
+    {batch_actions, state} = decode_batch(state)
+
+    flush_result =
+      if state.zero_copy_output,
+        do: Native.flush_surfaces(state.decoder_ref),
+        else: Native.flush(state.decoder_ref)
+
+    case flush_result do
       {:ok, frames, pts_list} ->
-        {wrap_frames(frames, pts_list), state}
+        frames = wrap_frames(frames, pts_list, state.outputs, state)
+
+        if state.async do
+          send(self(), {:flushed, actions})
+          flushed_outputs = :queue.in(state.outputs, state.flushed_outputs)
+          {batch_actions ++ frames, %{state | flushed_outputs: flushed_outputs}}
+        else
+          {batch_actions ++ frames ++ actions, state}
+        end
 
       {:error, reason} ->
         raise "Native decoder failed to flush: #{inspect(reason)}"
     end
   end
 
-  defp wrap_frames([], []), do: []
+  defp decode(payload, pts, decoder_ref, %{zero_copy_output: true}),
+    do: Native.decode_surfaces(payload, pts, decoder_ref)
+
+  defp decode(payload, pts, decoder_ref, _state), do: Native.decode(payload, pts, decoder_ref)
+
+  defp decode_batch(%{batch: []} = state), do: {[], state}
+
+  defp decode_batch(state) do
+    buffers = Enum.reverse(state.batch)
+    payloads = Enum.map(buffers, & &1.payload)
+    pts = Enum.map(buffers, &(&1.pts || 0))
+
+    result =
+      if state.zero_copy_output,
+        do: Native.decode_surfaces_batch(payloads, pts, state.decoder_ref),
+        else: Native.decode_batch(payloads, pts, state.decoder_ref)
+
+    case result do
+      {:ok, frames, pts_list} ->
+        timer_actions = if state.batch_timeout, do: [stop_timer: :batch], else: []
+        state = %{state | batch: []}
+        {timer_actions ++ wrap_frames(frames, pts_list, state.outputs, state), state}
+
+      {:error, reason} ->
+        raise "Native decoder failed to decode the payload: #{inspect(reason)}"
+    end
+  end
+
+  # The decoder returns the frame of every output in turn, the frames are
+  # sent on the pad of their output
+  defp wrap_frames([], [], _outputs, _state), do: []
 
-  defp wrap_frames(frames, pts_list) do
-    Enum.zip(frames, pts_list)
-    |> Enum.map(fn {frame, pts} ->
-      %Buffer{pts: pts, payload: frame}
+  defp wrap_frames(frames, pts_list, outputs, state) do
+    frames
+    |> Enum.chunk_every(length(outputs))
+    |> Enum.zip_with(pts_list, fn output_frames, pts ->
+      Enum.zip_with(outputs, output_frames, fn {_pad, format}, frame ->
+        %Buffer{pts: pts, payload: wrap_payload(frame, format, state)}
+      end)
     end)
-    |> then(&[buffer: {:output, &1}])
+    |> Enum.zip_with(& &1)
+    |> Enum.zip_with(outputs, fn buffers, {pad, _format} -> {pad, buffers} end)
+    |> Enum.reject(fn {pad, _buffers} -> pad == nil end)
+    |> Enum.map(&{:buffer, &1})
   end
 
-  defp dimensions(%{width: width, height: height}, %{width: nil, height: nil}),
+  defp wrap_payload(frame, format, %{zero_copy_output: true}),
+    do: %Frame{ref: frame, size: frame_size(format.width, format.height, format.pixel_format)}
+
+  defp wrap_payload(frame, _format, _state), do: frame
+
+  defp frame_size(width, height, pixel_format) when pixel_format in [:RGBA, :BGRA],
+    do: width * height * 4
+
+  defp frame_size(width, height, _pixel_format), do: div(width * height * 3, 2)
+
+  # An access unit rarely exceeds half the size of the raw frame for H264 and a
+  # quarter for H265, the buffers grow if it does.
+  @min_input_buffer_size 65_536
+
+  defp default_input_buffer_size(codec, %{width: width, height: height})
+       when is_integer(width) and is_integer(height) do
+    ratio = if codec == :H264, do: 2, else: 4
+    max(div(frame_size(width, height, :I420), ratio), @min_input_buffer_size)
+  end
+
+  defp default_input_buffer_size(_codec, _stream_format), do: 4_000_000
+
+  defp default_input_buffers(%{width: width, height: height})
+       when is_integer(width) and is_integer(height) and width * height > 1920 * 1088,
+       do: 10
+
+  defp default_input_buffers(_stream_format), do: 6
+
+  defp low_latency_option(nil, state), do: state.latency == :low
+  defp low_latency_option(value, _state), do: value
+
+  defp dimensions(stream_format, crop, options) do
+    stream_format
+    |> source_size(crop)
+    |> scaled_size(options)
+  end
+
+  # Size of the cropped region, rounded and clamped like the native decoder does
+  defp source_size(%{width: width, height: height}, nil), do: {width, height}
+
+  defp source_size(%{width: width, height: height}, {x, y, crop_width, crop_height}) do
+    left = min(even(x), width - 2)
+    top = min(even(y), height - 2)
+    {min(even(crop_width), width - left), min(even(crop_height), height - top)}
+  end
+
+  defp even(value), do: value - rem(value, 2)
+
+  defp scaled_size({width, height}, %{width: nil, height: nil}),
     do: {width, height}
 
-  defp dimensions(%{width: width, height: height}, %{width: scaled_width, height: nil}) do
+  defp scaled_size({width, height}, %{width: scaled_width, height: nil}) do
     h = div(scaled_width * height, width)
     {scaled_width, h + rem(h, 2)}
   end
 
-  defp dimensions(%{width: width, height: height}, %{width: nil, height: scaled_height}) do
+  defp scaled_size({width, height}, %{width: nil, height: scaled_height}) do
     w = div(scaled_height * width, height)
     {w + rem(w, 2), scaled_height}
   end
 
-  defp dimensions(_stream_format, %{width: scaled_width, height: scaled_height}),
+  defp scaled_size(_size, %{width: scaled_width, height: scaled_height}),
     do: {scaled_width, scaled_height}
 end
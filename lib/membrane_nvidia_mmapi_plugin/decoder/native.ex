@@ -2,10 +2,83 @@ defmodule Membrane.Nvidia.MMAPI.Decoder.Native do
   @moduledoc false
   use Unifex.Loader
 
-  def create!(codec, width, height) do
-    case create(codec, width, height) do
+  @default_output_surfaces 4
+  @default_input_buffers 10
+  @default_input_buffer_size 4_000_000
+
+  # Each rendition, given as `{width, height, pixel_format}`, adds an output to the
+  # decoder. The frames of every output are returned one after the other.
+  def create(codec, width, height, opts \\ []) do
+    renditions = Keyword.get(opts, :renditions, [])
+
+    create(
+      codec,
+      width,
+      height,
+      Keyword.get(opts, :zero_copy_input, false),
+      Keyword.get(opts, :async, false),
+      Keyword.get(opts, :output_surfaces, @default_output_surfaces),
+      Keyword.get(opts, :zero_copy_output, false),
+      Keyword.get(opts, :input_buffers, @default_input_buffers),
+      Keyword.get(opts, :input_buffer_size, @default_input_buffer_size),
+      Keyword.get(opts, :disable_dpb, false),
+      Keyword.get(opts, :max_perf, false),
+      Keyword.get(opts, :skip_frames, :none),
+      Keyword.get(opts, :pixel_format, :I420),
+      crop_list(Keyword.get(opts, :crop)),
+      Enum.map(renditions, &elem(&1, 0)),
+      Enum.map(renditions, &elem(&1, 1)),
+      Enum.map(renditions, &elem(&1, 2)),
+      Keyword.get(opts, :profiling, false)
+    )
+  end
+
+  def create!(codec, width, height, opts \\ []) do
+    case create(codec, width, height, opts) do
       {:ok, decoder_ref} -> decoder_ref
       {:error, reason} -> raise "could not create decoder due to #{inspect(reason)}"
     end
   end
+
+  def set_output_size(width, height, decoder_ref),
+    do: set_output_size(0, width, height, decoder_ref)
+
+  # Latencies are only measured by decoders created with `profiling: true`
+  def stats(decoder_ref) do
+    with {:ok, decoded_frames, profiling_time_usec, average_latency_usec, min_latency_usec,
+          max_latency_usec, p50_latency_usec, p99_latency_usec, p999_latency_usec,
+          queued_input_buffers, queued_capture_buffers, transforms, transform_time_usec, copies,
+          copy_time_usec, too_many_profiled_elements} <- get_stats(decoder_ref) do
+      {:ok,
+       %{
+         decoded_frames: decoded_frames,
+         average_fps: rate(decoded_frames, profiling_time_usec),
+         average_latency_usec: average_latency_usec,
+         min_latency_usec: min_latency_usec,
+         max_latency_usec: max_latency_usec,
+         p50_latency_usec: p50_latency_usec,
+         p99_latency_usec: p99_latency_usec,
+         p999_latency_usec: p999_latency_usec,
+         queued_input_buffers: queued_input_buffers,
+         queued_capture_buffers: queued_capture_buffers,
+         transforms: transforms,
+         average_transform_usec: average(transform_time_usec, transforms),
+         copies: copies,
+         average_copy_usec: average(copy_time_usec, copies),
+         too_many_profiled_elements: too_many_profiled_elements
+       }}
+    end
+  end
+
+  # The first frame starts the profiling time
+  defp rate(frames, time_usec) when frames > 1 and time_usec > 0,
+    do: (frames - 1) * 1_000_000 / time_usec
+
+  defp rate(_frames, _time_usec), do: 0.0
+
+  defp average(_total, 0), do: 0
+  defp average(total, count), do: div(total, count)
+
+  defp crop_list(nil), do: []
+  defp crop_list({x, y, width, height}), do: [x, y, width, height]
 end
@@ -0,0 +1,202 @@
+defmodule Membrane.Nvidia.MMAPI.Encoder do
+  @moduledoc """
+  Membrane element that encodes video to H264 or H265 format using the Jetson hardware encoder based on V4L2 interface.
+
+  The element expects `I420` frames and outputs access units in Annex B format. Every I frame
+  is an IDR picture preceded by the parameter sets, so the stream can be joined at any
+  keyframe. The encoder uses constant bitrate rate control and doesn't produce B frames, the
+  decoding timestamps of the buffers are their presentation timestamps.
+
+  A `Membrane.KeyframeRequestEvent` received on the output pad makes the encoder output the
+  next frame as an IDR picture. A new stream format flushes the encoder and creates it again.
+  """
+
+  use Membrane.Filter
+
+  alias __MODULE__.Native
+  alias Membrane.{Buffer, H264, H265, KeyframeRequestEvent, RawVideo}
+
+  def_options codec: [
+                spec: :H264 | :H265,
+                default: :H264,
+                description: """
+                Codec of the output stream.
+                """
+              ],
+              bitrate: [
+                spec: pos_integer(),
+                default: 4_000_000,
+                description: """
+                Target bitrate in bits per second.
+                """
+              ],
+              gop_size: [
+                spec: pos_integer(),
+                default: 30,
+                description: """
+                Number of frames between two keyframes.
+                """
+              ],
+              profile: [
+                spec: :baseline | :main | :high | :main_10 | nil,
+                default: nil,
+                description: """
+                Profile of the output stream, `:baseline`, `:main` or `:high` for H264 and
+                `:main` or `:main_10` for H265.
+
+                Defaults to the profile chosen by the encoder.
+                """
+              ],
+              preset: [
+                spec: :ultrafast | :fast | :medium | :slow,
+                default: :ultrafast,
+                description: """
+                Hardware preset of the encoder, slower presets trade encoding speed for quality.
+                """
+              ],
+              max_perf: [
+                spec: boolean(),
+                default: false,
+                description: """
+                Run the encoder at maximum clock rates.
+                """
+              ]
+
+  def_input_pad :input,
+    flow_control: :auto,
+    accepted_format: %RawVideo{pixel_format: :I420, aligned: true}
+
+  def_output_pad :output,
+    flow_control: :auto,
+    accepted_format:
+      any_of(
+        %H264{alignment: :au, stream_structure: :annexb},
+        %H265{alignment: :au, stream_structure: :annexb}
+      )
+
+  @default_framerate {30, 1}
+
+  @impl true
+  def handle_init(_ctx, opts) do
+    state = Map.merge(Map.from_struct(opts), %{encoder_ref: nil, input_format: nil})
+    {[], state}
+  end
+
+  @impl true
+  def handle_stream_format(:input, stream_format, _ctx, %{input_format: stream_format} = state),
+    do: {[], state}
+
+  @impl true
+  def handle_stream_format(:input, stream_format, _ctx, state) do
+    {actions, state} =
+      if state.encoder_ref,
+        do: flush(state),
+        else: {[], state}
+
+    framerate = framerate(stream_format.framerate)
+
+    encoder_ref =
+      Native.create!(state.codec, stream_format.width, stream_format.height,
+        framerate: framerate,
+        bitrate: state.bitrate,
+        gop_size: state.gop_size,
+        profile: state.profile,
+        preset: state.preset,
+        max_perf: state.max_perf
+      )
+
+    output_format = output_format(stream_format, framerate, state)
+
+    {actions ++ [stream_format: {:output, output_format}],
+     %{state | encoder_ref: encoder_ref, input_format: stream_format}}
+  end
+
+  @impl true
+  def handle_buffer(:input, buffer, _ctx, state) do
+    case Native.encode(buffer.payload, buffer.pts || 0, state.encoder_ref) do
+      {:ok, frames, pts_list, key_frames} ->
+        {wrap_frames(frames, pts_list, key_frames, state), state}
+
+      {:error, reason} ->
+        raise "Native encoder failed to encode the frame: #{inspect(reason)}"
+    end
+  end
+
+  @impl true
+  def handle_event(:output, %KeyframeRequestEvent{}, _ctx, %{encoder_ref: nil} = state),
+    do: {[], state}
+
+  @impl true
+  def handle_event(:output, %KeyframeRequestEvent{}, _ctx, state) do
+    case Native.force_keyframe(state.encoder_ref) do
+      :ok -> {[], state}
+      {:error, reason} -> raise "could not force a keyframe due to #{inspect(reason)}"
+    end
+  end
+
+  @impl true
+  def handle_event(pad, event, ctx, state), do: super(pad, event, ctx, state)
+
+  @impl true
+  def handle_end_of_stream(:input, _ctx, %{encoder_ref: nil} = state),
+    do: {[end_of_stream: :output], state}
+
+  @impl true
+  def handle_end_of_stream(:input, _ctx, state) do
+    {actions, state} = flush(state)
+    {actions ++ [end_of_stream: :output], state}
+  end
+
+  defp flush(state) do
+    case Native.flush(state.encoder_ref) do
+      {:ok, frames, pts_list, key_frames} ->
+        {wrap_frames(frames, pts_list, key_frames, state), %{state | encoder_ref: nil}}
+
+      {:error, reason} ->
+        raise "Native encoder failed to flush: #{inspect(reason)}"
+    end
+  end
+
+  defp wrap_frames([], [], [], _state), do: []
+
+  defp wrap_frames(frames, pts_list, key_frames, state) do
+    metadata_key = if state.codec == :H264, do: :h264, else: :h265
+
+    buffers =
+      Enum.zip_with([frames, pts_list, key_frames], fn [frame, pts, key_frame?] ->
+        %Buffer{
+          pts: pts,
+          dts: pts,
+          payload: frame,
+          metadata: %{metadata_key => %{key_frame?: key_frame?}}
+        }
+      end)
+
+    [buffer: {:output, buffers}]
+  end
+
+  defp output_format(stream_format, framerate, %{codec: :H264} = state) do
+    %H264{
+      width: stream_format.width,
+      height: stream_format.height,
+      framerate: framerate,
+      profile: state.profile,
+      alignment: :au,
+      stream_structure: :annexb
+    }
+  end
+
+  defp output_format(stream_format, framerate, %{codec: :H265} = state) do
+    %H265{
+      width: stream_format.width,
+      height: stream_format.height,
+      framerate: framerate,
+      profile: state.profile,
+      alignment: :au,
+      stream_structure: :annexb
+    }
+  end
+
+  defp framerate({num, den}) when num > 0 and den > 0, do: {num, den}
+  defp framerate(_framerate), do: @default_framerate
+end
@@ -0,0 +1,37 @@
+defmodule Membrane.Nvidia.MMAPI.Encoder.Native do
+  @moduledoc false
+  use Unifex.Loader
+
+  @default_bitrate 4_000_000
+  @default_gop_size 30
+  @default_input_buffers 6
+  @default_output_buffers 6
+  @default_output_buffer_size 2 * 1024 * 1024
+
+  def create(codec, width, height, opts \\ []) do
+    {framerate_num, framerate_den} = Keyword.get(opts, :framerate, {30, 1})
+
+    create(
+      codec,
+      width,
+      height,
+      framerate_num,
+      framerate_den,
+      Keyword.get(opts, :bitrate, @default_bitrate),
+      Keyword.get(opts, :gop_size, @default_gop_size),
+      Keyword.get(opts, :profile) || :default,
+      Keyword.get(opts, :preset, :ultrafast),
+      Keyword.get(opts, :max_perf, false),
+      Keyword.get(opts, :input_buffers, @default_input_buffers),
+      Keyword.get(opts, :output_buffers, @default_output_buffers),
+      Keyword.get(opts, :output_buffer_size, @default_output_buffer_size)
+    )
+  end
+
+  def create!(codec, width, height, opts \\ []) do
+    case create(codec, width, height, opts) do
+      {:ok, encoder_ref} -> encoder_ref
+      {:error, reason} -> raise "could not create encoder due to #{inspect(reason)}"
+    end
+  end
+end
@@ -0,0 +1,46 @@
+defmodule Membrane.Nvidia.MMAPI.Frame do
+  @moduledoc """
+  Decoded frame kept in a hardware surface.
+
+  The surface is returned to the decoder pool once the frame is garbage collected.
+  Use `download/1` to copy the frame into a binary.
+  """
+
+  alias Membrane.Nvidia.MMAPI.Decoder.Native
+
+  @enforce_keys [:ref, :size]
+  defstruct @enforce_keys
+
+  @type t :: %__MODULE__{ref: reference(), size: non_neg_integer()}
+
+  @doc """
+  Copies the frame into a binary in the pixel format of the decoder output.
+  """
+  @spec download(t()) :: binary()
+  def download(%__MODULE__{ref: ref}) do
+    case Native.download(ref) do
+      {:ok, payload} -> payload
+      {:error, reason} -> raise "could not download frame due to #{inspect(reason)}"
+    end
+  end
+
+  defimpl Membrane.Payload do
+    alias Membrane.Nvidia.MMAPI.Frame
+
+    @impl true
+    def size(frame), do: frame.size
+
+    @impl true
+    def split_at(frame, at_pos),
+      do: frame |> Frame.download() |> Membrane.Payload.split_at(at_pos)
+
+    @impl true
+    def drop(frame, bytes), do: frame |> Frame.download() |> Membrane.Payload.drop(bytes)
+
+    @impl true
+    def to_binary(frame), do: Frame.download(frame)
+
+    @impl true
+    def module(_frame), do: Frame
+  end
+end
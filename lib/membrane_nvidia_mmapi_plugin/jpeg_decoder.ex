@@ -0,0 +1,275 @@
+defmodule Membrane.Nvidia.MMAPI.JPEGDecoder do
+  @moduledoc """
+  Membrane element that decodes Motion JPEG streams using the Jetson hardware decoder based on V4L2 interface.
+
+  The input is a stream of concatenated JPEG images, as output by MJPEG cameras, it's split
+  into images regardless of how it's chunked into buffers. Each image is decoded by the same
+  native decoder as `Membrane.Nvidia.MMAPI.Decoder`, and scaled and converted to `I420` or
+  `NV12` by the `VIC`.
+
+  The output size follows the size of the images, read from their frame header. An image of
+  another size flushes the decoder, creates it again and sends a new stream format.
+  """
+
+  use Membrane.Filter
+
+  require Membrane.Logger
+
+  alias Membrane.{Buffer, RawVideo, RemoteStream}
+  alias Membrane.Nvidia.MMAPI.Decoder.Native
+
+  def_options width: [
+                spec: pos_integer() | nil,
+                default: nil,
+                description: """
+                Scale the decoded images to the provided width.
+
+                If height is not provided, it'll be calculated to keep the aspect ratio.
+                """
+              ],
+              height: [
+                spec: pos_integer() | nil,
+                default: nil,
+                description: """
+                Scale the decoded images to the provided height.
+
+                If width is not provided, it'll be calculated to keep the aspect ratio.
+                """
+              ],
+              pixel_format: [
+                spec: :I420 | :NV12,
+                default: :I420,
+                description: """
+                Pixel format of the output frames.
+                """
+              ],
+              framerate: [
+                spec: {pos_integer(), pos_integer()} | nil,
+                default: nil,
+                description: """
+                Frame rate of the stream.
+
+                When provided, the timestamps of the frames are generated from it. Otherwise
+                each frame gets the timestamp of the buffer its image starts in.
+                """
+              ],
+              max_perf: [
+                spec: boolean(),
+                default: false,
+                description: """
+                Run the decoder at maximum clock rates.
+                """
+              ]
+
+  def_input_pad :input,
+    flow_control: :auto,
+    accepted_format: %RemoteStream{}
+
+  def_output_pad :output,
+    flow_control: :auto,
+    accepted_format: %RawVideo{pixel_format: pixel_format, aligned: true}
+                     when pixel_format in [:I420, :NV12]
+
+  # An image rarely exceeds half the size of the raw frame, the buffers grow if it does
+  @min_input_buffer_size 65_536
+
+  @impl true
+  def handle_init(_ctx, opts) do
+    state =
+      Map.merge(Map.from_struct(opts), %{
+        decoder_ref: nil,
+        image_size: nil,
+        partial: <<>>,
+        partial_pts: nil,
+        frames: 0
+      })
+
+    {[], state}
+  end
+
+  @impl true
+  def handle_stream_format(:input, _stream_format, _ctx, state), do: {[], state}
+
+  @impl true
+  def handle_buffer(:input, buffer, _ctx, state) do
+    {data, pts} =
+      if state.partial == <<>>,
+        do: {buffer.payload, buffer.pts},
+        else: {state.partial <> buffer.payload, state.partial_pts}
+
+    {images, rest} = split_images(data, [])
+
+    # The first image may have started in a previous buffer
+    pts_list = [pts | List.duplicate(buffer.pts, length(images))]
+
+    state = %{
+      state
+      | partial: rest,
+        partial_pts: if(images == [], do: pts, else: buffer.pts)
+    }
+
+    images
+    |> Enum.zip(pts_list)
+    |> Enum.flat_map_reduce(state, fn {image, pts}, state -> decode(image, pts, state) end)
+  end
+
+  @impl true
+  def handle_end_of_stream(:input, _ctx, state) do
+    if state.partial != <<>>,
+      do: Membrane.Logger.warning("Dropping #{byte_size(state.partial)} bytes of a partial image")
+
+    {actions, state} = flush(%{state | partial: <<>>})
+    {actions ++ [end_of_stream: :output], state}
+  end
+
+  defp decode({image, image_size}, pts, state) do
+    {actions, state} =
+      if image_size == state.image_size,
+        do: {[], state},
+        else: configure(image_size, state)
+
+    {pts, state} = timestamp(pts, state)
+
+    case Native.decode(image, pts || 0, state.decoder_ref) do
+      {:ok, frames, pts_list} ->
+        {actions ++ wrap_frames(frames, pts_list), state}
+
+      {:error, reason} ->
+        raise "Native decoder failed to decode the image: #{inspect(reason)}"
+    end
+  end
+
+  defp configure({width, height} = image_size, state) do
+    {actions, state} = flush(state)
+    {out_width, out_height} = scaled_size(image_size, state)
+
+    decoder_ref =
+      Native.create!(:MJPEG, out_width, out_height,
+        pixel_format: state.pixel_format,
+        input_buffer_size: max(div(width * height * 3, 4), @min_input_buffer_size),
+        max_perf: state.max_perf
+      )
+
+    output_format = %RawVideo{
+      width: out_width,
+      height: out_height,
+      pixel_format: state.pixel_format,
+      aligned: true,
+      framerate: state.framerate || {0, 1}
+    }
+
+    {actions ++ [stream_format: {:output, output_format}],
+     %{state | decoder_ref: decoder_ref, image_size: image_size}}
+  end
+
+  defp flush(%{decoder_ref: nil} = state), do: {[], state}
+
+  defp flush(state) do
+    case Native.flush(state.decoder_ref) do
+      {:ok, frames, pts_list} ->
+        {wrap_frames(frames, pts_list), %{state | decoder_ref: nil, image_size: nil}}
+
+      {:error, reason} ->
+        raise "Native decoder failed to flush: #{inspect(reason)}"
+    end
+  end
+
+  defp timestamp(pts, %{framerate: nil} = state), do: {pts, state}
+
+  defp timestamp(_pts, %{framerate: {num, den}} = state) do
+    pts = div(state.frames * den * Membrane.Time.second(), num)
+    {pts, %{state | frames: state.frames + 1}}
+  end
+
+  defp wrap_frames([], []), do: []
+
+  defp wrap_frames(frames, pts_list) do
+    buffers = Enum.zip_with(frames, pts_list, &%Buffer{pts: &2, payload: &1})
+    [buffer: {:output, buffers}]
+  end
+
+  # Splits the complete images off the start of `data`, each with its size
+  defp split_images(data, images) do
+    case parse_image(data) do
+      {:ok, image_length, image_size} ->
+        <<image::binary-size(image_length), rest::binary>> = data
+        split_images(rest, [{image, image_size} | images])
+
+      :incomplete ->
+        {Enum.reverse(images), data}
+
+      :resync ->
+        split_images(resync(data), images)
+    end
+  end
+
+  # Bytes before the start of an image are dropped
+  defp resync(data) do
+    case :binary.match(data, <<0xFF, 0xD8>>, scope: {1, byte_size(data) - 1}) do
+      {position, 2} ->
+        Membrane.Logger.warning("Dropping #{position} bytes before the start of an image")
+        binary_part(data, position, byte_size(data) - position)
+
+      # The last byte may be the first one of a start of image marker
+      :nomatch when binary_part(data, byte_size(data) - 1, 1) == <<0xFF>> ->
+        <<0xFF>>
+
+      :nomatch ->
+        <<>>
+    end
+  end
+
+  defp parse_image(<<0xFF, 0xD8, rest::binary>>), do: parse_segments(rest, 2, nil)
+  defp parse_image(<<0xFF>>), do: :incomplete
+  defp parse_image(<<>>), do: :incomplete
+  defp parse_image(_data), do: :resync
+
+  # Walks the segments up to the start of scan, the image ends at the first
+  # EOI marker after it as markers can't appear in the entropy coded data
+  defp parse_segments(<<0xFF, 0xFF, rest::binary>>, offset, size),
+    do: parse_segments(<<0xFF, rest::binary>>, offset + 1, size)
+
+  defp parse_segments(<<0xFF, 0xDA, length::16, _rest::binary>> = data, offset, size) do
+    scan_offset = 2 + length
+
+    with true <- byte_size(data) >= scan_offset,
+         scope = {scan_offset, byte_size(data) - scan_offset},
+         {position, 2} <- :binary.match(data, <<0xFF, 0xD9>>, scope: scope) do
+      # Images without a frame header are dropped
+      if size, do: {:ok, offset + position + 2, size}, else: :resync
+    else
+      _incomplete -> :incomplete
+    end
+  end
+
+  defp parse_segments(<<0xFF, marker, length::16, rest::binary>>, offset, size)
+       when length >= 2 and byte_size(rest) >= length - 2 do
+    <<segment::binary-size(length - 2), rest::binary>> = rest
+    parse_segments(rest, offset + 2 + length, frame_size(marker, segment) || size)
+  end
+
+  defp parse_segments(<<0xFF, _rest::binary>>, _offset, _size), do: :incomplete
+  defp parse_segments(<<>>, _offset, _size), do: :incomplete
+  defp parse_segments(_data, _offset, _size), do: :resync
+
+  # Every SOFn marker but DHT, JPG and DAC, which share the range
+  defp frame_size(marker, <<_precision, height::16, width::16, _rest::binary>>)
+       when marker in 0xC0..0xCF and marker not in [0xC4, 0xC8, 0xCC],
+       do: {width, height}
+
+  defp frame_size(_marker, _segment), do: nil
+
+  defp scaled_size({width, height}, %{width: nil, height: nil}), do: {width, height}
+
+  defp scaled_size({width, height}, %{width: scaled_width, height: nil}) do
+    h = div(scaled_width * height, width)
+    {scaled_width, h + rem(h, 2)}
+  end
+
+  defp scaled_size({width, height}, %{width: nil, height: scaled_height}) do
+    w = div(scaled_height * width, height)
+    {w + rem(w, 2), scaled_height}
+  end
+
+  defp scaled_size(_size, %{width: width, height: height}), do: {width, height}
+end
@@ -0,0 +1,95 @@
+defmodule Membrane.Nvidia.MMAPI.ResourceSampler do
+  @moduledoc """
+  Samples the resources used by the process, to correlate the throughput of
+  the elements with their cost.
+
+  Every interval a native thread records the CPU time of the process and of each
+  of its threads (schedulers, dirty schedulers, dequeue threads of the devices,
+  the decoder service thread...), the resident memory and the size of the DMA
+  buffers allocated by the elements. The last 64 samples are kept.
+
+  The decoder, encoder, transcoder and converter native libraries each count the
+  DMA buffers they allocate, `dma_buffer_bytes` is the sum of their counters at
+  the time of the sample.
+  """
+
+  alias Membrane.Nvidia.MMAPI.{Converter, Encoder, Transcoder}
+  alias Membrane.Nvidia.MMAPI.Decoder.Native
+
+  @type thread_sample :: %{
+          id: non_neg_integer(),
+          name: String.t(),
+          cpu_time_usec: non_neg_integer(),
+          cpu_usage: float()
+        }
+
+  @typedoc """
+  Resources used at the end of an interval. CPU usages are percentages of a
+  single core over the interval, only the 128 busiest threads are listed.
+  """
+  @type sample :: %{
+          timestamp_usec: non_neg_integer(),
+          interval_usec: non_neg_integer(),
+          cpu_time_usec: non_neg_integer(),
+          cpu_usage: float(),
+          rss_bytes: non_neg_integer(),
+          dma_buffer_bytes: non_neg_integer(),
+          threads: [thread_sample()]
+        }
+
+  @doc """
+  Clears the samples and starts sampling every `interval_ms` milliseconds.
+  """
+  @spec start(pos_integer()) :: :ok
+  def start(interval_ms \\ 100), do: Native.start_resource_sampler(interval_ms)
+
+  @spec stop() :: :ok
+  def stop(), do: Native.stop_resource_sampler()
+
+  @doc """
+  Returns the samples taken since the sampler was started, oldest first.
+  """
+  @spec samples() :: [sample()]
+  def samples() do
+    {:ok, timestamps, intervals, cpu_times, rss, decoder_dma_buffers, thread_counts, thread_ids,
+     thread_names, thread_cpu_times} = Native.resource_samples()
+
+    {:ok, encoder_dma_buffers} = Encoder.Native.dma_buffer_bytes(timestamps)
+    {:ok, transcoder_dma_buffers} = Transcoder.Native.dma_buffer_bytes(timestamps)
+    {:ok, converter_dma_buffers} = Converter.Native.dma_buffer_bytes(timestamps)
+
+    dma_buffers =
+      Enum.zip_with(
+        [decoder_dma_buffers, encoder_dma_buffers, transcoder_dma_buffers, converter_dma_buffers],
+        &Enum.sum/1
+      )
+
+    threads =
+      Enum.zip_with([thread_ids, thread_names, thread_cpu_times], fn [id, name, cpu_time] ->
+        %{id: id, name: name, cpu_time_usec: cpu_time}
+      end)
+
+    [timestamps, intervals, cpu_times, rss, dma_buffers, thread_counts]
+    |> Enum.zip()
+    |> Enum.map_reduce(threads, fn {timestamp, interval, cpu_time, rss, dma, count}, threads ->
+      {sample_threads, threads} = Enum.split(threads, count)
+
+      sample = %{
+        timestamp_usec: timestamp,
+        interval_usec: interval,
+        cpu_time_usec: cpu_time,
+        cpu_usage: usage(cpu_time, interval),
+        rss_bytes: rss,
+        dma_buffer_bytes: dma,
+        threads:
+          Enum.map(sample_threads, &Map.put(&1, :cpu_usage, usage(&1.cpu_time_usec, interval)))
+      }
+
+      {sample, threads}
+    end)
+    |> elem(0)
+  end
+
+  defp usage(_cpu_time, 0), do: 0.0
+  defp usage(cpu_time, interval), do: cpu_time * 100 / interval
+end
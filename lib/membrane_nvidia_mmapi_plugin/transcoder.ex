@@ -0,0 +1,250 @@
+defmodule Membrane.Nvidia.MMAPI.Transcoder do
+  @moduledoc """
+  Membrane element that transcodes H264 or H265 streams on the Jetson hardware decoder and encoder.
+
+  Unlike a `Membrane.Nvidia.MMAPI.Decoder` linked to a `Membrane.Nvidia.MMAPI.Encoder`, the
+  decoded frames never reach CPU memory. The VIC converts them into DMA buffers, resizing them
+  if requested, and the encoder reads those buffers directly. The output stream has the same
+  structure as the one of the encoder element, see its documentation.
+
+  A `Membrane.KeyframeRequestEvent` received on the output pad makes the encoder output the
+  next frame as an IDR picture. A new stream format flushes the transcoder and creates it again.
+  """
+
+  use Membrane.Filter
+
+  alias __MODULE__.Native
+  alias Membrane.{Buffer, H264, H265, KeyframeRequestEvent}
+
+  def_options codec: [
+                spec: :H264 | :H265,
+                default: :H264,
+                description: """
+                Codec of the output stream.
+                """
+              ],
+              width: [
+                spec: pos_integer() | nil,
+                default: nil,
+                description: """
+                Width of the output stream, calculated to keep the aspect ratio if not provided.
+
+                The frames keep the decoded size when neither the width nor the height is
+                provided.
+                """
+              ],
+              height: [
+                spec: pos_integer() | nil,
+                default: nil,
+                description: """
+                Height of the output stream, calculated to keep the aspect ratio if not provided.
+                """
+              ],
+              bitrate: [
+                spec: pos_integer(),
+                default: 4_000_000,
+                description: """
+                Target bitrate in bits per second.
+                """
+              ],
+              gop_size: [
+                spec: pos_integer(),
+                default: 30,
+                description: """
+                Number of frames between two keyframes.
+                """
+              ],
+              profile: [
+                spec: :baseline | :main | :high | :main_10 | nil,
+                default: nil,
+                description: """
+                Profile of the output stream, see `Membrane.Nvidia.MMAPI.Encoder`.
+                """
+              ],
+              preset: [
+                spec: :ultrafast | :fast | :medium | :slow,
+                default: :ultrafast,
+                description: """
+                Hardware preset of the encoder, slower presets trade encoding speed for quality.
+                """
+              ],
+              max_perf: [
+                spec: boolean(),
+                default: false,
+                description: """
+                Run the decoder and the encoder at maximum clock rates.
+                """
+              ]
+
+  def_input_pad :input,
+    flow_control: :auto,
+    accepted_format:
+      any_of(
+        %H264{alignment: :au, stream_structure: :annexb},
+        %H265{alignment: :au, stream_structure: :annexb}
+      )
+
+  def_output_pad :output,
+    flow_control: :auto,
+    accepted_format:
+      any_of(
+        %H264{alignment: :au, stream_structure: :annexb},
+        %H265{alignment: :au, stream_structure: :annexb}
+      )
+
+  @default_framerate {30, 1}
+
+  @impl true
+  def handle_init(_ctx, opts) do
+    state = Map.merge(Map.from_struct(opts), %{transcoder_ref: nil, input_format: nil})
+    {[], state}
+  end
+
+  @impl true
+  def handle_stream_format(:input, stream_format, _ctx, %{input_format: stream_format} = state),
+    do: {[], state}
+
+  @impl true
+  def handle_stream_format(:input, stream_format, _ctx, state) do
+    {actions, state} =
+      if state.transcoder_ref,
+        do: flush(state),
+        else: {[], state}
+
+    input_codec =
+      case stream_format do
+        %H264{} -> :H264
+        %H265{} -> :H265
+      end
+
+    framerate = framerate(stream_format.framerate)
+    {width, height} = dimensions(stream_format, state)
+
+    transcoder_ref =
+      Native.create!(input_codec, state.codec, width, height,
+        framerate: framerate,
+        bitrate: state.bitrate,
+        gop_size: state.gop_size,
+        profile: state.profile,
+        preset: state.preset,
+        max_perf: state.max_perf
+      )
+
+    output_format =
+      output_format(
+        width || stream_format.width,
+        height || stream_format.height,
+        framerate,
+        state
+      )
+
+    {actions ++ [stream_format: {:output, output_format}],
+     %{state | transcoder_ref: transcoder_ref, input_format: stream_format}}
+  end
+
+  @impl true
+  def handle_buffer(:input, buffer, _ctx, state) do
+    case Native.transcode(buffer.payload, buffer.pts || 0, state.transcoder_ref) do
+      {:ok, frames, pts_list, key_frames} ->
+        {wrap_frames(frames, pts_list, key_frames, state), state}
+
+      {:error, reason} ->
+        raise "Native transcoder failed to transcode the payload: #{inspect(reason)}"
+    end
+  end
+
+  @impl true
+  def handle_event(:output, %KeyframeRequestEvent{}, _ctx, %{transcoder_ref: nil} = state),
+    do: {[], state}
+
+  @impl true
+  def handle_event(:output, %KeyframeRequestEvent{}, _ctx, state) do
+    case Native.force_keyframe(state.transcoder_ref) do
+      :ok -> {[], state}
+      {:error, reason} -> raise "could not force a keyframe due to #{inspect(reason)}"
+    end
+  end
+
+  @impl true
+  def handle_event(pad, event, ctx, state), do: super(pad, event, ctx, state)
+
+  @impl true
+  def handle_end_of_stream(:input, _ctx, %{transcoder_ref: nil} = state),
+    do: {[end_of_stream: :output], state}
+
+  @impl true
+  def handle_end_of_stream(:input, _ctx, state) do
+    {actions, state} = flush(state)
+    {actions ++ [end_of_stream: :output], state}
+  end
+
+  defp flush(state) do
+    case Native.flush(state.transcoder_ref) do
+      {:ok, frames, pts_list, key_frames} ->
+        {wrap_frames(frames, pts_list, key_frames, state), %{state | transcoder_ref: nil}}
+
+      {:error, reason} ->
+        raise "Native transcoder failed to flush: #{inspect(reason)}"
+    end
+  end
+
+  defp wrap_frames([], [], [], _state), do: []
+
+  defp wrap_frames(frames, pts_list, key_frames, state) do
+    metadata_key = if state.codec == :H264, do: :h264, else: :h265
+
+    buffers =
+      Enum.zip_with([frames, pts_list, key_frames], fn [frame, pts, key_frame?] ->
+        %Buffer{
+          pts: pts,
+          dts: pts,
+          payload: frame,
+          metadata: %{metadata_key => %{key_frame?: key_frame?}}
+        }
+      end)
+
+    [buffer: {:output, buffers}]
+  end
+
+  # `nil` dimensions follow the decoded frames, even through resolution changes
+  defp dimensions(_stream_format, %{width: nil, height: nil}), do: {nil, nil}
+
+  defp dimensions(%{width: width, height: height}, %{width: scaled_width, height: nil})
+       when is_integer(width) and is_integer(height) do
+    h = div(scaled_width * height, width)
+    {scaled_width, h + rem(h, 2)}
+  end
+
+  defp dimensions(%{width: width, height: height}, %{width: nil, height: scaled_height})
+       when is_integer(width) and is_integer(height) do
+    w = div(scaled_height * width, height)
+    {w + rem(w, 2), scaled_height}
+  end
+
+  defp dimensions(_stream_format, %{width: width, height: height}), do: {width, height}
+
+  defp output_format(width, height, framerate, %{codec: :H264} = state) do
+    %H264{
+      width: width,
+      height: height,
+      framerate: framerate,
+      profile: state.profile,
+      alignment: :au,
+      stream_structure: :annexb
+    }
+  end
+
+  defp output_format(width, height, framerate, %{codec: :H265} = state) do
+    %H265{
+      width: width,
+      height: height,
+      framerate: framerate,
+      profile: state.profile,
+      alignment: :au,
+      stream_structure: :annexb
+    }
+  end
+
+  defp framerate({num, den}) when num > 0 and den > 0, do: {num, den}
+  defp framerate(_framerate), do: @default_framerate
+end
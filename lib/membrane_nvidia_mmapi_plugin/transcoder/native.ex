@@ -0,0 +1,43 @@
+defmodule Membrane.Nvidia.MMAPI.Transcoder.Native do
+  @moduledoc false
+  use Unifex.Loader
+
+  @default_bitrate 4_000_000
+  @default_gop_size 30
+  @default_input_buffers 6
+  @default_input_buffer_size 2 * 1024 * 1024
+  @default_frame_buffers 4
+  @default_output_buffers 6
+  @default_output_buffer_size 2 * 1024 * 1024
+
+  # A `nil` width or height keeps the one of the decoded frames
+  def create(input_codec, output_codec, width, height, opts \\ []) do
+    {framerate_num, framerate_den} = Keyword.get(opts, :framerate, {30, 1})
+
+    create(
+      input_codec,
+      output_codec,
+      width || -1,
+      height || -1,
+      framerate_num,
+      framerate_den,
+      Keyword.get(opts, :bitrate, @default_bitrate),
+      Keyword.get(opts, :gop_size, @default_gop_size),
+      Keyword.get(opts, :profile) || :default,
+      Keyword.get(opts, :preset, :ultrafast),
+      Keyword.get(opts, :max_perf, false),
+      Keyword.get(opts, :input_buffers, @default_input_buffers),
+      Keyword.get(opts, :input_buffer_size, @default_input_buffer_size),
+      Keyword.get(opts, :frame_buffers, @default_frame_buffers),
+      Keyword.get(opts, :output_buffers, @default_output_buffers),
+      Keyword.get(opts, :output_buffer_size, @default_output_buffer_size)
+    )
+  end
+
+  def create!(input_codec, output_codec, width, height, opts \\ []) do
+    case create(input_codec, output_codec, width, height, opts) do
+      {:ok, transcoder_ref} -> transcoder_ref
+      {:error, reason} -> raise "could not create transcoder due to #{inspect(reason)}"
+    end
+  end
+end
@@ -0,0 +1,58 @@
+defmodule ConverterTest do
+  use ExUnit.Case, async: true
+  use Membrane.Pipeline
+
+  import Membrane.Testing.Assertions
+
+  alias Membrane.{H264, RawVideo}
+  alias Membrane.Testing.Pipeline
+
+  defp make_pipeline(converter) do
+    Pipeline.start_link_supervised!(
+      spec:
+        child(:file_src, %Membrane.File.Source{
+          chunk_size: 40_960,
+          location: "test/fixtures/h264/input-100-240p.h264"
+        })
+        |> child(:parser, %H264.Parser{
+          generate_best_effort_timestamps: %{framerate: {30, 1}}
+        })
+        |> child(:decoder, Membrane.Nvidia.MMAPI.Decoder)
+        |> child(:converter, converter)
+        |> child(:sink, Membrane.Testing.Sink)
+    )
+  end
+
+  test "scale and convert decoded frames" do
+    pid = make_pipeline(%Membrane.Nvidia.MMAPI.Converter{width: 160, pixel_format: :RGBA})
+
+    assert_sink_stream_format(pid, :sink, %RawVideo{
+      width: 160,
+      height: 120,
+      pixel_format: :RGBA
+    })
+
+    for _index <- 1..100 do
+      assert_sink_buffer(pid, :sink, buffer)
+      assert byte_size(buffer.payload) == 160 * 120 * 4
+    end
+
+    assert_end_of_stream(pid, :sink, :input, 5000)
+    Pipeline.terminate(pid)
+  end
+
+  test "crop and flip decoded frames" do
+    pid =
+      make_pipeline(%Membrane.Nvidia.MMAPI.Converter{crop: {0, 0, 160, 120}, flip: :vertical})
+
+    assert_sink_stream_format(pid, :sink, %RawVideo{width: 160, height: 120, pixel_format: :I420})
+
+    for _index <- 1..100 do
+      assert_sink_buffer(pid, :sink, buffer)
+      assert byte_size(buffer.payload) == div(160 * 120 * 3, 2)
+    end
+
+    assert_end_of_stream(pid, :sink, :input, 5000)
+    Pipeline.terminate(pid)
+  end
+end
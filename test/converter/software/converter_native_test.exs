@@ -0,0 +1,95 @@
+defmodule Converter.Software.NativeTest do
+  use ExUnit.Case, async: false
+
+  alias Membrane.Nvidia.MMAPI.Converter.Native
+
+  @moduletag :software_backend
+
+  # 8x4 I420 frame with a luma ramp and neutral chroma
+  @luma for index <- 0..31, into: <<>>, do: <<index * 7>>
+  @i420_frame @luma <> :binary.copy(<<128>>, 16)
+
+  defp convert_frames(converter_ref, frames) do
+    {converted, pts_list} =
+      frames
+      |> Enum.with_index()
+      |> Enum.reduce({[], []}, fn {frame, index}, {converted, pts_list} ->
+        assert {:ok, new_frames, new_pts} = Native.convert(frame, index * 1_000, converter_ref)
+        {converted ++ new_frames, pts_list ++ new_pts}
+      end)
+
+    assert {:ok, flushed, flushed_pts} = Native.flush(converter_ref)
+    {converted ++ flushed, pts_list ++ flushed_pts}
+  end
+
+  defp pixels(rgba_frame), do: for(<<r, g, b, a <- rgba_frame>>, do: {r, g, b, a})
+
+  test "convert I420 frames to RGBA" do
+    assert {:ok, converter_ref} = Native.create({8, 4, :I420}, {8, 4, :RGBA})
+    {[frame], [0]} = convert_frames(converter_ref, [@i420_frame])
+
+    assert byte_size(frame) == 8 * 4 * 4
+    assert Enum.all?(pixels(frame), fn {r, g, b, a} -> r == g and g == b and a == 255 end)
+
+    # Limited range luma is expanded to full range
+    assert [{0, 0, 0, 255} | _rest] = pixels(frame)
+    assert {234, 234, 234, 255} = List.last(pixels(frame))
+  end
+
+  test "convert RGBA frames to I420" do
+    rgba_frame = for index <- 0..7, into: <<>>, do: <<index * 30, index * 30, index * 30, 255>>
+
+    assert {:ok, converter_ref} = Native.create({4, 2, :RGBA}, {4, 2, :I420})
+    {[frame], _pts_list} = convert_frames(converter_ref, [rgba_frame])
+
+    assert <<luma::binary-size(8), 128, 128>> = frame
+    assert luma == <<16, 42, 68, 93, 119, 145, 171, 196>>
+  end
+
+  test "scale and crop the frames" do
+    assert {:ok, converter_ref} =
+             Native.create({8, 4, :I420}, {4, 2, :NV12}, crop: {4, 0, 4, 4})
+
+    {[frame], _pts_list} = convert_frames(converter_ref, [@i420_frame])
+    assert byte_size(frame) == div(4 * 2 * 3, 2)
+
+    # Every pixel comes from the right half of the ramp
+    <<luma::binary-size(8), _chroma::binary>> = frame
+    assert Enum.all?(:binary.bin_to_list(luma), &(rem(div(&1, 7), 8) >= 4))
+  end
+
+  test "flip the frames" do
+    assert {:ok, converter_ref} = Native.create({8, 4, :I420}, {8, 4, :I420}, flip: :rotate_180)
+    {[frame], _pts_list} = convert_frames(converter_ref, [@i420_frame])
+
+    <<luma::binary-size(32), _chroma::binary>> = frame
+    assert luma == @luma |> :binary.bin_to_list() |> Enum.reverse() |> :binary.list_to_bin()
+  end
+
+  test "keep conversions in flight until flushed" do
+    assert {:ok, converter_ref} =
+             Native.create({8, 4, :I420}, {8, 4, :BGRA}, conversions_in_flight: 3)
+
+    assert {:ok, [], []} = Native.convert(@i420_frame, 0, converter_ref)
+    assert {:ok, [], []} = Native.convert(@i420_frame, 1_000, converter_ref)
+    assert {:ok, [_frame], [0]} = Native.convert(@i420_frame, 2_000, converter_ref)
+
+    {frames, pts_list} = convert_frames(converter_ref, List.duplicate(@i420_frame, 10))
+    assert length(frames) == 12
+    assert pts_list == [1_000, 2_000] ++ Enum.map(0..9, &(&1 * 1_000))
+  end
+
+  test "reject frames of another size" do
+    assert {:ok, converter_ref} = Native.create({8, 4, :I420}, {8, 4, :RGBA})
+    assert {:error, :"invalid frame size"} = Native.convert(<<0::size(80)>>, 0, converter_ref)
+  end
+
+  test "reject invalid settings" do
+    assert {:error, :"invalid frame size"} = Native.create({7, 4, :I420}, {8, 4, :RGBA})
+    assert {:error, :"invalid crop"} =
+             Native.create({8, 4, :I420}, {8, 4, :RGBA}, crop: {4, 0, 8, 4})
+
+    assert {:error, :"unknown flip method"} =
+             Native.create({8, 4, :I420}, {8, 4, :RGBA}, flip: :up)
+  end
+end
@@ -4,7 +4,9 @@ defmodule DecoderTest do
 
   import Membrane.Testing.Assertions
 
-  alias Membrane.H264
+  require Membrane.Pad
+
+  alias Membrane.{H264, Pad}
   alias Membrane.Testing.Pipeline
 
   defp prepare_paths(filename, tmp_dir) do
@@ -14,14 +16,14 @@ defmodule DecoderTest do
     {in_path, reference_path, out_path}
   end
 
-  defp make_pipeline(in_path, out_path) do
+  defp make_pipeline(in_path, out_path, decoder \\ Membrane.Nvidia.MMAPI.Decoder) do
     Pipeline.start_link_supervised!(
       spec:
         child(:file_src, %Membrane.File.Source{chunk_size: 40_960, location: in_path})
         |> child(:parser, %H264.Parser{
           generate_best_effort_timestamps: %{framerate: {30, 1}}
         })
-        |> child(:decoder, Membrane.Nvidia.MMAPI.Decoder)
+        |> child(:decoder, decoder)
         |> child(:sink, %Membrane.File.Sink{location: out_path})
     )
   end
@@ -32,10 +34,15 @@ defmodule DecoderTest do
     assert a == b
   end
 
-  defp perform_decoding_test(filename, tmp_dir, timeout) do
+  defp perform_decoding_test(
+         filename,
+         tmp_dir,
+         timeout,
+         decoder \\ Membrane.Nvidia.MMAPI.Decoder
+       ) do
     {in_path, ref_path, out_path} = prepare_paths(filename, tmp_dir)
 
-    pid = make_pipeline(in_path, out_path)
+    pid = make_pipeline(in_path, out_path, decoder)
     assert_end_of_stream(pid, :sink, :input, timeout)
     assert_files_equal(out_path, ref_path)
     Pipeline.terminate(pid)
@@ -51,6 +58,130 @@ defmodule DecoderTest do
       perform_decoding_test("100-240p", ctx.tmp_dir, 5000)
     end
 
+    test "decode 100 240p frames in batches", ctx do
+      decoder = %Membrane.Nvidia.MMAPI.Decoder{
+        batch_size: 8,
+        batch_timeout: Membrane.Time.milliseconds(10)
+      }
+
+      perform_decoding_test("100-240p", ctx.tmp_dir, 5000, decoder)
+    end
+
+    test "decode 100 240p frames in low latency mode", ctx do
+      decoder = %Membrane.Nvidia.MMAPI.Decoder{latency: :low}
+      perform_decoding_test("100-240p", ctx.tmp_dir, 5000, decoder)
+    end
+
+    test "decode only the IDR frame of 100 240p frames", ctx do
+      {in_path, ref_path, out_path} = prepare_paths("100-240p", ctx.tmp_dir)
+
+      decoder = %Membrane.Nvidia.MMAPI.Decoder{skip_frames: :idr_only}
+      pid = make_pipeline(in_path, out_path, decoder)
+      assert_end_of_stream(pid, :sink, :input, 5000)
+
+      assert <<ref_frame::bytes-size(115_200), _rest::binary>> = File.read!(ref_path)
+      assert File.read!(out_path) == ref_frame
+      Pipeline.terminate(pid)
+    end
+
+    test "decode only the reference frames of 100 240p frames", ctx do
+      {in_path, ref_path, out_path} = prepare_paths("100-240p", ctx.tmp_dir)
+
+      decoder = %Membrane.Nvidia.MMAPI.Decoder{skip_frames: :non_ref}
+      pid = make_pipeline(in_path, out_path, decoder)
+      assert_end_of_stream(pid, :sink, :input, 5000)
+
+      ref_frames = for <<frame::bytes-size(115_200) <- File.read!(ref_path)>>, do: frame
+      frames = for <<frame::bytes-size(115_200) <- File.read!(out_path)>>, do: frame
+      assert length(frames) == 51
+      assert Enum.all?(frames, &(&1 in ref_frames))
+      Pipeline.terminate(pid)
+    end
+
+    test "decode 100 240p frames to NV12", ctx do
+      {in_path, ref_path, out_path} = prepare_paths("100-240p", ctx.tmp_dir)
+
+      decoder = %Membrane.Nvidia.MMAPI.Decoder{pixel_format: :NV12}
+      pid = make_pipeline(in_path, out_path, decoder)
+      assert_end_of_stream(pid, :sink, :input, 5000)
+
+      ref_frames =
+        for <<y::bytes-size(76_800), u::bytes-size(19_200), v::bytes-size(19_200) <-
+              File.read!(ref_path)>>,
+            into: <<>> do
+          uv = Enum.zip_with(:binary.bin_to_list(u), :binary.bin_to_list(v), &<<&1, &2>>)
+          IO.iodata_to_binary([y | uv])
+        end
+
+      assert File.read!(out_path) == ref_frames
+      Pipeline.terminate(pid)
+    end
+
+    test "decode a region of 100 240p frames", ctx do
+      {in_path, ref_path, out_path} = prepare_paths("100-240p", ctx.tmp_dir)
+
+      decoder = %Membrane.Nvidia.MMAPI.Decoder{crop: {80, 60, 160, 120}}
+      pid = make_pipeline(in_path, out_path, decoder)
+      assert_end_of_stream(pid, :sink, :input, 5000)
+
+      ref_frames =
+        for <<y::bytes-size(76_800), u::bytes-size(19_200), v::bytes-size(19_200) <-
+              File.read!(ref_path)>>,
+            into: <<>> do
+          [{y, 320, 1}, {u, 160, 2}, {v, 160, 2}]
+          |> Enum.map(fn {plane, stride, ratio} ->
+            for row <- div(60, ratio)..div(179, ratio),
+                do: binary_part(plane, row * stride + div(80, ratio), div(160, ratio))
+          end)
+          |> IO.iodata_to_binary()
+        end
+
+      assert File.read!(out_path) == ref_frames
+      Pipeline.terminate(pid)
+    end
+
+    test "decode 100 240p frames into several renditions", ctx do
+      {in_path, ref_path, out_path} = prepare_paths("100-240p", ctx.tmp_dir)
+      nv12_path = Path.join(ctx.tmp_dir, "output-nv12.raw")
+      small_path = Path.join(ctx.tmp_dir, "output-small.raw")
+
+      pid =
+        Pipeline.start_link_supervised!(
+          spec: [
+            child(:file_src, %Membrane.File.Source{chunk_size: 40_960, location: in_path})
+            |> child(:parser, %H264.Parser{
+              generate_best_effort_timestamps: %{framerate: {30, 1}}
+            })
+            |> child(:decoder, Membrane.Nvidia.MMAPI.Decoder)
+            |> child(:sink, %Membrane.File.Sink{location: out_path}),
+            get_child(:decoder)
+            |> via_out(Pad.ref(:rendition, :nv12), options: [pixel_format: :NV12])
+            |> child(:nv12_sink, %Membrane.File.Sink{location: nv12_path}),
+            get_child(:decoder)
+            |> via_out(Pad.ref(:rendition, :small), options: [width: 160, height: 120])
+            |> child(:small_sink, %Membrane.File.Sink{location: small_path})
+          ]
+        )
+
+      assert_end_of_stream(pid, :sink, :input, 5000)
+      assert_end_of_stream(pid, :nv12_sink, :input, 5000)
+      assert_end_of_stream(pid, :small_sink, :input, 5000)
+
+      assert_files_equal(out_path, ref_path)
+
+      ref_frames =
+        for <<y::bytes-size(76_800), u::bytes-size(19_200), v::bytes-size(19_200) <-
+              File.read!(ref_path)>>,
+            into: <<>> do
+          uv = Enum.zip_with(:binary.bin_to_list(u), :binary.bin_to_list(v), &<<&1, &2>>)
+          IO.iodata_to_binary([y | uv])
+        end
+
+      assert File.read!(nv12_path) == ref_frames
+      assert byte_size(File.read!(small_path)) == 100 * 28_800
+      Pipeline.terminate(pid)
+    end
+
     test "decode 10 720p frames with B frames in main profile", ctx do
       perform_decoding_test("10-720p-main", ctx.tmp_dir, 5000)
     end
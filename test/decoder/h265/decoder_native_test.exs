@@ -18,4 +18,55 @@ defmodule Decoder.H265.NativeTest do
     assert <<ref_frame::bytes-size(460_800), _rest::binary>> = ref_file
     assert Payload.to_binary(frame) == ref_frame
   end
+
+  test "Decode 30 480p frames without B frames in low latency mode" do
+    in_path = "test/fixtures/h265/input-30-480p-no-bframes.h265"
+    ref_path = "test/fixtures/h265/reference-30-480p-no-bframes.raw"
+
+    assert {:ok, file} = File.read(in_path)
+    assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, disable_dpb: true, max_perf: true)
+
+    {frames, latencies} =
+      file
+      |> access_units()
+      |> Enum.with_index()
+      |> Enum.flat_map(fn {access_unit, pts} ->
+        assert {:ok, frames, pts_list} = Native.decode(access_unit, pts, decoder_ref)
+        Enum.zip(frames, Enum.map(pts_list, &(pts - &1)))
+      end)
+      |> Enum.unzip()
+
+    assert {:ok, [], _pts_list} = Native.flush(decoder_ref)
+    assert Enum.all?(latencies, &(&1 == 0))
+
+    assert {:ok, ref_file} = File.read(ref_path)
+    ref_frames = for <<frame::bytes-size(460_800) <- ref_file>>, do: frame
+    assert Enum.map(frames, &Payload.to_binary/1) == ref_frames
+  end
+
+  # Splits an Annex B stream into access units, a new one starts at the
+  # first parameter set, prefix SEI or slice of a picture following a slice
+  defp access_units(stream) do
+    stream
+    |> :binary.split([<<0, 0, 0, 1>>, <<0, 0, 1>>], [:global, :trim_all])
+    |> Enum.chunk_while(
+      [],
+      fn nalu, acc ->
+        if starts_picture?(nalu) and Enum.any?(acc, &slice?/1),
+          do: {:cont, Enum.reverse(acc), [nalu]},
+          else: {:cont, [nalu | acc]}
+      end,
+      &{:cont, Enum.reverse(&1), []}
+    )
+    |> Enum.map(fn nalus -> Enum.map_join(nalus, &(<<0, 0, 0, 1>> <> &1)) end)
+  end
+
+  defp slice?(<<_forbidden::1, type::6, _rest::bitstring>>), do: type < 32
+
+  defp starts_picture?(<<_forbidden::1, type::6, _header::9, first_slice::1, _rest::bitstring>>)
+       when type < 32,
+       do: first_slice == 1
+
+  defp starts_picture?(<<_forbidden::1, type::6, _rest::bitstring>>),
+    do: type in 32..35 or type == 39
 end
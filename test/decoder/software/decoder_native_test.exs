@@ -0,0 +1,716 @@
+defmodule Decoder.Software.NativeTest do
+  use ExUnit.Case, async: false
+
+  alias Membrane.Nvidia.MMAPI.Decoder.Native
+  alias Membrane.Nvidia.MMAPI.{Frame, ResourceSampler}
+  alias Membrane.Payload
+
+  @moduletag :software_backend
+
+  @in_path "test/fixtures/h265/input-10-320p-mainstillpicture.h265"
+  @ref_path "test/fixtures/h265/reference-10-320p-mainstillpicture.raw"
+  @frame_size 230_400
+
+  setup do
+    System.put_env("MMAPI_SW_RESOLUTION", "480x320")
+    System.put_env("MMAPI_SW_REPLAY", @ref_path)
+
+    on_exit(fn ->
+      System.delete_env("MMAPI_SW_RESOLUTION")
+      System.delete_env("MMAPI_SW_REPLAY")
+    end)
+  end
+
+  test "replay reference frames through the software device" do
+    assert {:ok, decoder_ref} = Native.create(:H265, -1, -1)
+    assert {:ok, file} = File.read(@in_path)
+    assert {:ok, ref_file} = File.read(@ref_path)
+
+    assert {:ok, frames, _pts_list} = Native.decode(file, 0, decoder_ref)
+    assert {:ok, flushed, _pts_list} = Native.flush(decoder_ref)
+    assert [frame | _rest] = frames ++ flushed
+
+    assert Payload.size(frame) == @frame_size
+    assert <<ref_frame::bytes-size(@frame_size), _rest::binary>> = ref_file
+    assert Payload.to_binary(frame) == ref_frame
+  end
+
+  test "scale replayed frames" do
+    assert {:ok, decoder_ref} = Native.create(:H265, 240, 160)
+    assert {:ok, file} = File.read(@in_path)
+
+    assert {:ok, frames, _pts_list} = Native.decode(file, 0, decoder_ref)
+    assert {:ok, flushed, _pts_list} = Native.flush(decoder_ref)
+    assert [frame | _rest] = frames ++ flushed
+    assert Payload.size(frame) == 57_600
+  end
+
+  test "decode without copying the input" do
+    assert {:ok, decoder_ref} =
+             Native.create(:H265, -1, -1, zero_copy_input: true, output_surfaces: 1)
+
+    assert {:ok, file} = File.read(@in_path)
+    assert {:ok, ref_file} = File.read(@ref_path)
+
+    assert {:ok, frames, _pts_list} = Native.decode(file, 0, decoder_ref)
+    assert {:ok, queued} = Native.queued_input_buffers(decoder_ref)
+    assert queued in 0..1
+    assert {:ok, flushed, _pts_list} = Native.flush(decoder_ref)
+    assert [frame | _rest] = frames ++ flushed
+
+    assert <<ref_frame::bytes-size(@frame_size), _rest::binary>> = ref_file
+    assert Payload.to_binary(frame) == ref_frame
+  end
+
+  test "keep the input alive while the decoder reads it in place" do
+    System.put_env("MMAPI_SW_DECODE_LATENCY_US", "2000")
+    on_exit(fn -> System.delete_env("MMAPI_SW_DECODE_LATENCY_US") end)
+
+    assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, zero_copy_input: true)
+
+    # The access units are only referenced by the decoder once the process
+    # that decoded them is gone
+    {frames, pts_list} =
+      Task.async(fn ->
+        Enum.reduce(0..9, {[], []}, fn pts, {frames, pts_list} ->
+          access_unit = :binary.copy(<<0, 0, 1, pts>>, 2048)
+          assert {:ok, new_frames, new_pts} = Native.decode(access_unit, pts, decoder_ref)
+          {frames ++ new_frames, pts_list ++ new_pts}
+        end)
+      end)
+      |> Task.await()
+
+    :erlang.garbage_collect()
+    assert {:ok, flushed, flushed_pts_list} = Native.flush(decoder_ref)
+    assert length(frames ++ flushed) == 10
+    assert pts_list ++ flushed_pts_list == Enum.to_list(0..9)
+  end
+
+  test "send frames from the capture thread" do
+    assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, async: true, output_surfaces: 1)
+    assert {:ok, file} = File.read(@in_path)
+    assert {:ok, ref_file} = File.read(@ref_path)
+
+    assert {:ok, [], []} = Native.decode(file, 1_000, decoder_ref)
+    assert {:ok, [], []} = Native.flush(decoder_ref)
+    assert_received {:decoded_frame, [frame], 1_000}
+
+    assert <<ref_frame::bytes-size(@frame_size), _rest::binary>> = ref_file
+    assert Payload.to_binary(frame) == ref_frame
+  end
+
+  test "send frames of many async decoders to their owners" do
+    assert_async_decoders(16)
+  end
+
+  test "send frames of async decoders whose device can't be polled" do
+    System.put_env("MMAPI_SW_UNPOLLABLE", "1")
+    on_exit(fn -> System.delete_env("MMAPI_SW_UNPOLLABLE") end)
+
+    assert_async_decoders(16)
+  end
+
+  test "report the statistics of the decoder" do
+    assert {:ok, decoder_ref} = Native.create(:H265, 240, 160, profiling: true)
+
+    frames =
+      Enum.flat_map(0..9, fn pts ->
+        access_unit = :binary.copy(<<0, 0, 1, pts>>, 16)
+        assert {:ok, frames, _pts_list} = Native.decode(access_unit, pts, decoder_ref)
+        frames
+      end)
+
+    assert {:ok, flushed, _pts_list} = Native.flush(decoder_ref)
+    assert length(frames ++ flushed) == 10
+
+    assert {:ok, stats} = Native.stats(decoder_ref)
+    assert %{decoded_frames: 10, queued_input_buffers: 0, transforms: 10, copies: 10} = stats
+    refute stats.too_many_profiled_elements
+    assert stats.min_latency_usec <= stats.average_latency_usec
+    assert stats.average_latency_usec <= stats.max_latency_usec
+    assert stats.p50_latency_usec <= stats.p99_latency_usec
+    assert stats.p99_latency_usec <= stats.p999_latency_usec
+    # Percentiles are the upper bounds of buckets 1/16 of their value wide
+    assert stats.p999_latency_usec <= stats.max_latency_usec * 17 / 16 + 1
+    assert stats.queued_capture_buffers > 0
+
+    assert {:ok, decoder_ref} = Native.create(:H265, 240, 160)
+    assert {:ok, _frames, _pts_list} = Native.decode(<<0, 0, 1, 0>>, 0, decoder_ref)
+    assert {:ok, %{decoded_frames: 0, average_fps: +0.0}} = Native.stats(decoder_ref)
+  end
+
+  test "sample the resources used by the process" do
+    assert :ok = ResourceSampler.start(10)
+    on_exit(&ResourceSampler.stop/0)
+
+    assert {:ok, decoder_ref} = Native.create(:H265, -1, -1)
+    assert {:ok, file} = File.read(@in_path)
+    assert {:ok, frames, _pts_list} = Native.decode(file, 0, decoder_ref)
+    assert {:ok, flushed, _pts_list} = Native.flush(decoder_ref)
+    assert length(frames ++ flushed) == 10
+
+    Process.sleep(50)
+    assert :ok = ResourceSampler.stop()
+
+    samples = ResourceSampler.samples()
+    assert length(samples) in 1..64
+    assert Enum.all?(samples, &(&1.interval_usec > 0 and &1.rss_bytes > 0))
+
+    timestamps = Enum.map(samples, & &1.timestamp_usec)
+    assert timestamps == Enum.sort(timestamps)
+
+    # The capture buffers are held by the decoder until it's garbage collected
+    assert List.last(samples).dma_buffer_bytes > 0
+    assert Enum.any?(samples, fn sample -> Enum.any?(sample.threads, &(&1.name != "")) end)
+  end
+
+  test "convert frames into a ring of surfaces" do
+    # Frames pile up in the decoder and are converted in batches on flush
+    System.put_env("MMAPI_SW_DECODE_LATENCY_US", "1000")
+    on_exit(fn -> System.delete_env("MMAPI_SW_DECODE_LATENCY_US") end)
+
+    assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, output_surfaces: 3)
+    assert {:ok, ref_file} = File.read(@ref_path)
+
+    frames =
+      Enum.flat_map(0..9, fn pts ->
+        access_unit = :binary.copy(<<0, 0, 1, pts>>, 16)
+        assert {:ok, frames, _pts_list} = Native.decode(access_unit, pts, decoder_ref)
+        frames
+      end)
+
+    assert {:ok, flushed, _pts_list} = Native.flush(decoder_ref)
+
+    ref_frames = for <<frame::bytes-size(@frame_size) <- ref_file>>, do: frame
+    assert Enum.map(frames ++ flushed, &Payload.to_binary/1) == ref_frames
+  end
+
+  test "keep decoded frames in pooled surfaces" do
+    assert {:ok, decoder_ref} =
+             Native.create(:H265, -1, -1, output_surfaces: 1, zero_copy_output: true)
+
+    assert {:ok, file} = File.read(@in_path)
+    assert {:ok, ref_file} = File.read(@ref_path)
+
+    assert {:ok, frames, _pts_list} = Native.decode_surfaces(file, 0, decoder_ref)
+    assert {:ok, flushed, _pts_list} = Native.flush_surfaces(decoder_ref)
+    assert [frame | _rest] = frames ++ flushed
+
+    assert {:ok, fd, [512, 256, 256], [0 | _offsets]} = Native.surface_info(frame)
+    assert fd >= 0
+    assert {:error, :not_a_frame} = Native.download(decoder_ref)
+
+    assert <<ref_frame::bytes-size(@frame_size), _rest::binary>> = ref_file
+    assert {:ok, ^ref_frame} = Native.download(frame)
+    assert Payload.to_binary(%Frame{ref: frame, size: @frame_size}) == ref_frame
+  end
+
+  test "reject a frame in place of the decoder" do
+    assert {:ok, decoder_ref} =
+             Native.create(:H265, -1, -1, output_surfaces: 1, zero_copy_output: true)
+
+    assert {:ok, file} = File.read(@in_path)
+    assert {:ok, frames, _pts_list} = Native.decode_surfaces(file, 0, decoder_ref)
+    assert {:ok, flushed, _pts_list} = Native.flush_surfaces(decoder_ref)
+    assert [frame | _rest] = frames ++ flushed
+
+    assert {:error, :not_a_decoder} = Native.decode(file, 0, frame)
+    assert {:error, :not_a_decoder} = Native.decode_batch([file], [0], frame)
+    assert {:error, :not_a_decoder} = Native.decode_surfaces(file, 0, frame)
+    assert {:error, :not_a_decoder} = Native.decode_surfaces_batch([file], [0], frame)
+    assert {:error, :not_a_decoder} = Native.queued_input_buffers(frame)
+    assert {:error, :not_a_decoder} = Native.flush(frame)
+    assert {:error, :not_a_decoder} = Native.flush_surfaces(frame)
+    assert {:error, :not_a_decoder} = Native.set_output_size(0, 320, 240, frame)
+    assert {:error, :not_a_decoder} = Native.set_crop(0, 0, 320, 240, frame)
+    assert {:error, :not_a_decoder} = Native.get_stats(frame)
+  end
+
+  test "change the output size of an async decoder" do
+    assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, async: true, output_surfaces: 1)
+    assert {:ok, file} = File.read(@in_path)
+
+    assert {:ok, [], []} = Native.decode(file, 0, decoder_ref)
+    assert_receive {:decoded_frame, [frame], 0}
+    assert Payload.size(frame) == @frame_size
+
+    assert :ok = Native.set_output_size(0, 240, 160, decoder_ref)
+    assert :ok = Native.set_crop(0, 0, 240, 160, decoder_ref)
+    assert {:ok, [], []} = Native.decode(file, 1, decoder_ref)
+    assert {:ok, [], []} = Native.flush(decoder_ref)
+    assert_received {:decoded_frame, [frame], 1}
+    assert Payload.size(frame) == 57_600
+  end
+
+  test "reject zero copy output in async mode" do
+    assert {:error, _reason} =
+             Native.create(:H265, -1, -1, async: true, output_surfaces: 1, zero_copy_output: true)
+  end
+
+  test "follow resolution changes without restarting the decoder" do
+    System.put_env("MMAPI_SW_RESOLUTION_CHANGES", "4:240x160,7:480x320")
+    on_exit(fn -> System.delete_env("MMAPI_SW_RESOLUTION_CHANGES") end)
+
+    assert {:ok, decoder_ref} = Native.create(:H265, -1, -1)
+
+    frames =
+      Enum.flat_map(0..9, fn pts ->
+        access_unit = :binary.copy(<<0, 0, 1, pts>>, 16)
+        assert {:ok, frames, _pts_list} = Native.decode(access_unit, pts, decoder_ref)
+        frames
+      end)
+
+    assert {:ok, flushed, _pts_list} = Native.flush(decoder_ref)
+
+    assert Enum.map(frames ++ flushed, &Payload.size/1) ==
+             List.duplicate(@frame_size, 4) ++
+               List.duplicate(57_600, 3) ++ List.duplicate(@frame_size, 3)
+  end
+
+  test "decode a batch of access units" do
+    assert {:ok, decoder_ref} = Native.create(:H265, -1, -1)
+    assert {:ok, ref_file} = File.read(@ref_path)
+
+    access_units = for pts <- 0..9, do: :binary.copy(<<0, 0, 1, pts>>, 16)
+    timestamps = Enum.to_list(0..9)
+
+    assert {:ok, frames, pts_list} = Native.decode_batch(access_units, timestamps, decoder_ref)
+    assert {:ok, flushed, _pts_list} = Native.flush(decoder_ref)
+    assert pts_list == Enum.take(0..9, length(pts_list))
+
+    ref_frames = for <<frame::bytes-size(@frame_size) <- ref_file>>, do: frame
+    assert Enum.map(frames ++ flushed, &Payload.to_binary/1) == ref_frames
+
+    assert {:error, :timestamps_mismatch} = Native.decode_batch(access_units, [0], decoder_ref)
+  end
+
+  test "grow the input buffers for access units larger than their size" do
+    assert {:ok, file} = File.read(@in_path)
+    assert byte_size(file) > 4096
+
+    assert {:ok, decoder_ref} =
+             Native.create(:H265, -1, -1, input_buffers: 2, input_buffer_size: 4096)
+
+    assert {:ok, ref_file} = File.read(@ref_path)
+
+    assert {:ok, frames, _pts_list} = Native.decode(file, 0, decoder_ref)
+    assert {:ok, flushed, _pts_list} = Native.flush(decoder_ref)
+    assert [frame | _rest] = frames ++ flushed
+
+    assert <<ref_frame::bytes-size(@frame_size), _rest::binary>> = ref_file
+    assert Payload.to_binary(frame) == ref_frame
+  end
+
+  describe "frame latency" do
+    setup do
+      System.put_env("MMAPI_SW_DPB_FRAMES", "3")
+      on_exit(fn -> System.delete_env("MMAPI_SW_DPB_FRAMES") end)
+    end
+
+    test "is the reordering delay of the DPB by default" do
+      assert {:ok, decoder_ref} = Native.create(:H265, -1, -1)
+      assert frame_latencies(decoder_ref) == List.duplicate(3, 7)
+    end
+
+    test "is zero with the DPB disabled" do
+      assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, disable_dpb: true, max_perf: true)
+      assert frame_latencies(decoder_ref) == List.duplicate(0, 10)
+    end
+
+    test "is zero with the DPB disabled and a slow decoder" do
+      System.put_env("MMAPI_SW_DECODE_LATENCY_US", "2000")
+      on_exit(fn -> System.delete_env("MMAPI_SW_DECODE_LATENCY_US") end)
+
+      assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, disable_dpb: true)
+      assert frame_latencies(decoder_ref) == List.duplicate(0, 10)
+    end
+
+    test "is zero with the DPB disabled after an access unit without a picture" do
+      assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, disable_dpb: true)
+
+      # VPS and SPS only
+      parameter_sets = <<0, 0, 1, 0x40, 1, 0xAA, 0, 0, 1, 0x42, 1, 0xAA>>
+      assert {:ok, [], []} = Native.decode(parameter_sets, 0, decoder_ref)
+      assert frame_latencies(decoder_ref) == List.duplicate(0, 10)
+    end
+
+    test "is one frame per field pair with the DPB disabled" do
+      assert {:ok, decoder_ref} = Native.create(:H264, -1, -1, disable_dpb: true)
+
+      # Baseline SPS coding fields, with a 4 bit frame number
+      sps =
+        nal_unit(
+          0x67,
+          <<66, 0, 30>> <>
+            <<ue(0)::bitstring, ue(0)::bitstring, ue(0)::bitstring, ue(0)::bitstring,
+              ue(1)::bitstring, 0::1, ue(19)::bitstring, ue(9)::bitstring, 0::4>>
+        )
+
+      pps = nal_unit(0x68, <<ue(0)::bitstring, ue(0)::bitstring, 0::2>>)
+
+      # Top field then bottom field of each frame, the first pair is IDR
+      fields =
+        for frame <- 0..9, bottom <- [0, 1] do
+          {header, slice_type, idr_pic_id} =
+            if frame == 0, do: {0x65, ue(7), ue(0)}, else: {0x41, ue(5), <<>>}
+
+          nal_unit(
+            header,
+            <<ue(0)::bitstring, slice_type::bitstring, ue(0)::bitstring, frame::4, 1::1,
+              bottom::1, idr_pic_id::bitstring, ue(0)::bitstring>>
+          )
+        end
+
+      fields = List.update_at(fields, 0, &(sps <> pps <> &1))
+
+      {time, frame_counts} =
+        :timer.tc(fn ->
+          fields
+          |> Enum.with_index()
+          |> Enum.map(fn {field, pts} ->
+            assert {:ok, frames, _pts_list} = Native.decode(field, pts, decoder_ref)
+            length(frames)
+          end)
+        end)
+
+      assert frame_counts == List.flatten(List.duplicate([1, 0], 10))
+      # Waiting for a frame a second field doesn't yield takes 50 ms
+      assert time < 250_000
+    end
+  end
+
+  describe "skipping frames" do
+    # IDR, TRAIL_R and TRAIL_N slices
+    @access_units for type <- [19, 1, 0, 1, 0, 19, 1, 0, 1, 0],
+                      do: <<0, 0, 1, type * 2, 1>> <> :binary.copy(<<0xAA>>, 16)
+
+    test "decode only the IDR pictures" do
+      assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, skip_frames: :idr_only)
+      assert decoded_timestamps(decoder_ref) == [0, 5]
+    end
+
+    test "decode only the reference pictures" do
+      assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, skip_frames: :non_ref)
+      assert decoded_timestamps(decoder_ref) == [0, 1, 3, 5, 6, 8]
+    end
+
+    test "with every input buffer holding a skipped access unit" do
+      assert {:ok, decoder_ref} =
+               Native.create(:H265, -1, -1, skip_frames: :idr_only, input_buffers: 2)
+
+      assert decoded_timestamps(decoder_ref) == [0, 5]
+    end
+
+    test "match the latencies to the frames of the decoded access units" do
+      assert {:ok, decoder_ref} =
+               Native.create(:H265, -1, -1, skip_frames: :idr_only, profiling: true)
+
+      @access_units
+      |> Enum.with_index()
+      |> Enum.each(fn {access_unit, pts} ->
+        assert {:ok, _frames, _pts_list} = Native.decode(access_unit, pts, decoder_ref)
+        Process.sleep(20)
+      end)
+
+      assert {:ok, _frames, _pts_list} = Native.flush(decoder_ref)
+      assert {:ok, %{decoded_frames: 2} = stats} = Native.stats(decoder_ref)
+      # Paired with the skipped access unit 1, frame 5 would take 80 ms
+      assert stats.max_latency_usec < 40_000
+    end
+
+    test "reject an unknown mode" do
+      assert {:error, _reason} = Native.create(:H265, -1, -1, skip_frames: :b_frames)
+    end
+
+    defp decoded_timestamps(decoder_ref) do
+      timestamps = Enum.to_list(0..9)
+      assert {:ok, frames, pts_list} = Native.decode_batch(@access_units, timestamps, decoder_ref)
+      assert {:ok, flushed, flushed_pts_list} = Native.flush(decoder_ref)
+
+      {:ok, ref_file} = File.read(@ref_path)
+      ref_frames = for <<frame::bytes-size(@frame_size) <- ref_file>>, do: frame
+      pts_list = pts_list ++ flushed_pts_list
+
+      assert Enum.map(frames ++ flushed, &Payload.to_binary/1) ==
+               Enum.map(pts_list, &Enum.at(ref_frames, &1))
+
+      pts_list
+    end
+  end
+
+  describe "converting frames" do
+    test "to NV12" do
+      assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, pixel_format: :NV12)
+      assert {:ok, [frame | _rest]} = decode_file(decoder_ref)
+      {y, u, v} = ref_planes()
+
+      uv =
+        Enum.zip_with(:binary.bin_to_list(u), :binary.bin_to_list(v), &<<&1, &2>>)
+        |> IO.iodata_to_binary()
+
+      assert Payload.to_binary(frame) == y <> uv
+    end
+
+    test "to RGBA" do
+      assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, pixel_format: :RGBA)
+      assert {:ok, [frame | _rest]} = decode_file(decoder_ref)
+      assert Payload.size(frame) == 480 * 320 * 4
+
+      assert {<<y, _y::binary>>, <<u, _u::binary>>, <<v, _v::binary>>} = ref_planes()
+      assert <<r, g, b, 255, _rest::binary>> = Payload.to_binary(frame)
+      assert [r, g, b] == rgb(y, u, v)
+    end
+
+    test "to BGRA in pooled surfaces" do
+      assert {:ok, decoder_ref} =
+               Native.create(:H265, -1, -1, pixel_format: :BGRA, zero_copy_output: true)
+
+      assert {:ok, file} = File.read(@in_path)
+      assert {:ok, frames, _pts_list} = Native.decode_surfaces(file, 0, decoder_ref)
+      assert {:ok, flushed, _pts_list} = Native.flush_surfaces(decoder_ref)
+      assert [frame | _rest] = frames ++ flushed
+
+      assert {:ok, _fd, [pitch], [0]} = Native.surface_info(frame)
+      assert pitch >= 480 * 4
+      assert {:ok, payload} = Native.download(frame)
+      assert byte_size(payload) == 480 * 320 * 4
+    end
+
+    test "to an unsupported format" do
+      assert {:error, _reason} = Native.create(:H265, -1, -1, pixel_format: :YUY2)
+    end
+
+    defp decode_file(decoder_ref) do
+      {:ok, file} = File.read(@in_path)
+      {:ok, frames, _pts_list} = Native.decode(file, 0, decoder_ref)
+      {:ok, flushed, _pts_list} = Native.flush(decoder_ref)
+      {:ok, frames ++ flushed}
+    end
+
+    # Planes of the first reference frame
+    defp ref_planes() do
+      {:ok, ref_file} = File.read(@ref_path)
+      <<y::bytes-size(153_600), u::bytes-size(38_400), v::bytes-size(38_400), _rest::binary>> =
+        ref_file
+
+      {y, u, v}
+    end
+
+    # BT.601 limited range
+    defp rgb(y, u, v) do
+      c = 298 * (y - 16)
+      d = u - 128
+      e = v - 128
+
+      Enum.map(
+        [c + 409 * e, c - 100 * d - 208 * e, c + 516 * d],
+        &((&1 + 128) |> Bitwise.bsr(8) |> max(0) |> min(255))
+      )
+    end
+  end
+
+  describe "cropping frames" do
+    test "to a region of the picture" do
+      assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, crop: {100, 50, 200, 120})
+      assert {:ok, [frame | _rest]} = decode_file(decoder_ref)
+      assert Payload.to_binary(frame) == cropped_ref_frame({100, 50, 200, 120})
+    end
+
+    test "rounding the region and clamping it to the picture" do
+      assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, crop: {401, 301, 200, 200})
+      assert {:ok, [frame | _rest]} = decode_file(decoder_ref)
+      assert Payload.to_binary(frame) == cropped_ref_frame({400, 300, 80, 20})
+    end
+
+    test "to a region scaled to the output size" do
+      assert {:ok, decoder_ref} = Native.create(:H265, 100, 60, crop: {100, 50, 200, 120})
+      assert {:ok, [frame | _rest]} = decode_file(decoder_ref)
+      assert Payload.size(frame) == 9000
+    end
+
+    test "with a region changed on a running decoder" do
+      assert {:ok, decoder_ref} = Native.create(:H265, -1, -1)
+      assert {:ok, file} = File.read(@in_path)
+
+      assert {:ok, frames, _pts_list} = Native.decode(file, 0, decoder_ref)
+      assert :ok = Native.set_crop(100, 50, 200, 120, decoder_ref)
+      assert {:ok, more_frames, _pts_list} = Native.decode(file, 1, decoder_ref)
+      assert {:ok, flushed, _pts_list} = Native.flush(decoder_ref)
+
+      assert Enum.all?(frames, &(Payload.size(&1) == @frame_size))
+      assert [frame | _rest] = more_frames ++ flushed
+      assert Payload.to_binary(frame) == cropped_ref_frame({100, 50, 200, 120})
+
+      assert :ok = Native.set_crop(0, 0, 0, 0, decoder_ref)
+      assert {:ok, [frame | _rest]} = decode_file(decoder_ref)
+      assert Payload.size(frame) == @frame_size
+    end
+
+    test "with an invalid region" do
+      assert {:error, _reason} = Native.create(:H265, -1, -1, crop: {-2, 0, 100, 100})
+      assert {:ok, decoder_ref} = Native.create(:H265, -1, -1)
+      assert {:error, _reason} = Native.set_crop(0, 0, -100, 100, decoder_ref)
+    end
+
+    # First reference frame restricted to a region
+    defp cropped_ref_frame({left, top, width, height}) do
+      {y, u, v} = ref_planes()
+
+      [{y, 480, 1}, {u, 240, 2}, {v, 240, 2}]
+      |> Enum.map(fn {plane, stride, ratio} ->
+        for row <- div(top, ratio)..(div(top + height, ratio) - 1), into: <<>> do
+          binary_part(plane, row * stride + div(left, ratio), div(width, ratio))
+        end
+      end)
+      |> IO.iodata_to_binary()
+    end
+  end
+
+  describe "decoding renditions" do
+    test "in several sizes and pixel formats" do
+      assert {:ok, decoder_ref} =
+               Native.create(:H265, -1, -1, renditions: [{240, 160, :I420}, {480, 320, :NV12}])
+
+      assert {:ok, frames} = decode_file(decoder_ref)
+      assert rem(length(frames), 3) == 0
+      assert [frame, small_frame, nv12_frame | _rest] = frames
+
+      {y, u, v} = ref_planes()
+      assert Payload.to_binary(frame) == y <> u <> v
+      assert Payload.size(small_frame) == 57_600
+
+      uv =
+        Enum.zip_with(:binary.bin_to_list(u), :binary.bin_to_list(v), &<<&1, &2>>)
+        |> IO.iodata_to_binary()
+
+      assert Payload.to_binary(nv12_frame) == y <> uv
+    end
+
+    test "in pooled surfaces" do
+      assert {:ok, decoder_ref} =
+               Native.create(:H265, -1, -1,
+                 zero_copy_output: true,
+                 renditions: [{240, 160, :BGRA}]
+               )
+
+      assert {:ok, file} = File.read(@in_path)
+      assert {:ok, frames, pts_list} = Native.decode_surfaces(file, 0, decoder_ref)
+      assert {:ok, flushed, flushed_pts} = Native.flush_surfaces(decoder_ref)
+      assert length(frames ++ flushed) == 2 * length(pts_list ++ flushed_pts)
+
+      assert [frame, small_frame | _rest] = frames ++ flushed
+      assert {:ok, payload} = Native.download(frame)
+      assert byte_size(payload) == @frame_size
+      assert {:ok, payload} = Native.download(small_frame)
+      assert byte_size(payload) == 240 * 160 * 4
+    end
+
+    test "sent from the capture thread" do
+      assert {:ok, decoder_ref} =
+               Native.create(:H265, -1, -1, async: true, renditions: [{240, 160, :I420}])
+
+      assert {:ok, file} = File.read(@in_path)
+      assert {:ok, [], []} = Native.decode(file, 1_000, decoder_ref)
+      assert {:ok, [], []} = Native.flush(decoder_ref)
+      assert_received {:decoded_frame, [frame, small_frame], 1_000}
+
+      assert Payload.size(frame) == @frame_size
+      assert Payload.size(small_frame) == 57_600
+    end
+
+    test "with the size of a rendition changed on a running decoder" do
+      assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, renditions: [{240, 160, :I420}])
+      assert {:ok, file} = File.read(@in_path)
+
+      assert {:ok, _frames, _pts_list} = Native.decode(file, 0, decoder_ref)
+      assert :ok = Native.set_output_size(1, 120, 80, decoder_ref)
+      assert {:error, _reason} = Native.set_output_size(2, 120, 80, decoder_ref)
+      assert {:ok, more_frames, _pts_list} = Native.decode(file, 1, decoder_ref)
+      assert {:ok, flushed, _pts_list} = Native.flush(decoder_ref)
+
+      assert [_frame | _rest] = more_frames ++ flushed
+
+      (more_frames ++ flushed)
+      |> Enum.chunk_every(2)
+      |> Enum.each(fn [frame, small_frame] ->
+        assert Payload.size(frame) == @frame_size
+        assert Payload.size(small_frame) == 14_400
+      end)
+    end
+
+    test "in an unsupported pixel format" do
+      assert {:error, _reason} = Native.create(:H265, -1, -1, renditions: [{240, 160, :YUY2}])
+    end
+  end
+
+  test "change the output size of a running decoder" do
+    assert {:ok, decoder_ref} = Native.create(:H265, 480, 320)
+    assert {:ok, file} = File.read(@in_path)
+
+    assert {:ok, frames, _pts_list} = Native.decode(file, 0, decoder_ref)
+    assert :ok = Native.set_output_size(240, 160, decoder_ref)
+    assert {:ok, more_frames, _pts_list} = Native.decode(file, 1, decoder_ref)
+    assert {:ok, flushed, _pts_list} = Native.flush(decoder_ref)
+
+    assert Enum.all?(frames, &(Payload.size(&1) == @frame_size))
+    assert [_frame | _rest] = more_frames ++ flushed
+    assert Enum.all?(more_frames ++ flushed, &(Payload.size(&1) == 57_600))
+  end
+
+  # Number of access units queued after the one of each frame returned by
+  # `decode`, the frames returned by `flush` are left out
+  defp frame_latencies(decoder_ref) do
+    Enum.flat_map(0..9, fn pts ->
+      access_unit = :binary.copy(<<0, 0, 1, pts>>, 16)
+      assert {:ok, _frames, pts_list} = Native.decode(access_unit, pts, decoder_ref)
+      Enum.map(pts_list, &(pts - &1))
+    end)
+  end
+
+  defp ue(value) do
+    size = length(Integer.digits(value + 1, 2))
+    <<0::size(size - 1), (value + 1)::size(size)>>
+  end
+
+  # Annex B NAL unit with the RBSP trailing bits and emulation prevention
+  defp nal_unit(header, bits) do
+    padding = rem(8 - rem(bit_size(bits) + 1, 8), 8)
+    <<0, 0, 0, 1, header>> <> escape(<<bits::bitstring, 1::1, 0::size(padding)>>)
+  end
+
+  defp escape(<<0, 0, byte, rest::binary>>) when byte <= 3,
+    do: <<0, 0, 3>> <> escape(<<byte, rest::binary>>)
+
+  defp escape(<<byte, rest::binary>>), do: <<byte>> <> escape(rest)
+  defp escape(<<>>), do: <<>>
+
+  # Each decoder gets its frames in order, and only its own
+  defp assert_async_decoders(count) do
+    results =
+      1..count
+      |> Task.async_stream(
+        fn id ->
+          assert {:ok, decoder_ref} = Native.create(:H265, -1, -1, async: true)
+
+          for pts <- 0..9 do
+            access_unit = :binary.copy(<<0, 0, 1, pts>>, 16)
+            assert {:ok, [], []} = Native.decode(access_unit, id * 100 + pts, decoder_ref)
+          end
+
+          assert {:ok, [], []} = Native.flush(decoder_ref)
+
+          for pts <- 0..9 do
+            expected_pts = id * 100 + pts
+            assert_received {:decoded_frame, [_frame], ^expected_pts}
+          end
+
+          refute_received {:decoded_frame, _frames, _pts}
+          :ok
+        end,
+        max_concurrency: count
+      )
+      |> Enum.to_list()
+
+    assert Enum.all?(results, &(&1 == {:ok, :ok}))
+  end
+end
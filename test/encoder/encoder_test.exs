@@ -0,0 +1,46 @@
+defmodule EncoderTest do
+  use ExUnit.Case, async: true
+
+  import Membrane.Testing.Assertions
+
+  alias Membrane.{H264, H265}
+  alias Membrane.Nvidia.MMAPI.H264Pipeline
+  alias Membrane.Testing.Pipeline
+
+  defp make_pipeline(codec) do
+    H264Pipeline.start_link_supervised!(
+      decoder: Membrane.Nvidia.MMAPI.Decoder,
+      encoder: %Membrane.Nvidia.MMAPI.Encoder{codec: codec, gop_size: 30}
+    )
+  end
+
+  test "encode decoded frames to H264" do
+    pid = make_pipeline(:H264)
+
+    assert_sink_stream_format(pid, :sink, %H264{alignment: :au})
+    buffers = H264Pipeline.collect_buffers(pid, 100)
+    assert_end_of_stream(pid, :sink, :input, 5000)
+
+    key_frames =
+      for {%{metadata: %{h264: %{key_frame?: true}}}, index} <- Enum.with_index(buffers),
+          do: index
+
+    assert key_frames == [0, 30, 60, 90]
+    assert Enum.all?(buffers, &(&1.dts == &1.pts))
+    assert Enum.map(buffers, & &1.pts) == Enum.sort(Enum.map(buffers, & &1.pts))
+
+    Pipeline.terminate(pid)
+  end
+
+  test "encode decoded frames to H265" do
+    pid = make_pipeline(:H265)
+
+    assert_sink_stream_format(pid, :sink, %H265{alignment: :au})
+    [first | _rest] = H264Pipeline.collect_buffers(pid, 100)
+    assert_end_of_stream(pid, :sink, :input, 5000)
+
+    assert %{h265: %{key_frame?: true}} = first.metadata
+
+    Pipeline.terminate(pid)
+  end
+end
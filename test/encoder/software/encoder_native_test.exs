@@ -0,0 +1,119 @@
+defmodule Encoder.Software.NativeTest do
+  use ExUnit.Case, async: false
+
+  alias Membrane.Nvidia.MMAPI.Encoder.Native
+  alias Membrane.Nvidia.MMAPI.ResourceSampler
+
+  @moduletag :software_backend
+
+  @width 320
+  @height 240
+  @frame_size 115_200
+
+  defp frame(index), do: :binary.copy(<<rem(index, 256)>>, @frame_size)
+
+  defp encode_frames(encoder_ref, count) do
+    {frames, pts_list, key_frames} =
+      Enum.reduce(0..(count - 1), {[], [], []}, fn index, {frames, pts_list, key_frames} ->
+        assert {:ok, new_frames, new_pts, new_key_frames} =
+                 Native.encode(frame(index), index * 1_000, encoder_ref)
+
+        {frames ++ new_frames, pts_list ++ new_pts, key_frames ++ new_key_frames}
+      end)
+
+    assert {:ok, flushed, flushed_pts, flushed_key_frames} = Native.flush(encoder_ref)
+    {frames ++ flushed, pts_list ++ flushed_pts, key_frames ++ flushed_key_frames}
+  end
+
+  test "encode a frame per access unit" do
+    assert {:ok, encoder_ref} = Native.create(:H264, @width, @height, gop_size: 10)
+    {frames, pts_list, key_frames} = encode_frames(encoder_ref, 30)
+
+    assert length(frames) == 30
+    assert pts_list == Enum.map(0..29, &(&1 * 1_000))
+    assert Enum.all?(frames, &match?(<<0, 0, 0, 1, _rest::binary>>, &1))
+
+    key_frame_indexes = for {true, index} <- Enum.with_index(key_frames), do: index
+    assert key_frame_indexes == [0, 10, 20]
+  end
+
+  test "count the DMA buffers of the encoder in the resource samples" do
+    assert :ok = ResourceSampler.start(10)
+    on_exit(&ResourceSampler.stop/0)
+
+    assert {:ok, encoder_ref} = Native.create(:H264, @width, @height)
+    Process.sleep(50)
+    assert :ok = ResourceSampler.stop()
+
+    sample = List.last(ResourceSampler.samples())
+    assert {:ok, [encoder_bytes]} = Native.dma_buffer_bytes([sample.timestamp_usec])
+    assert encoder_bytes > 0
+    assert sample.dma_buffer_bytes >= encoder_bytes
+
+    # The buffers are held until the encoder is garbage collected
+    assert {:ok, _frames, _pts_list, _key_frames} = Native.flush(encoder_ref)
+  end
+
+  test "precede every IDR picture with the parameter sets" do
+    assert {:ok, encoder_ref} = Native.create(:H264, @width, @height, gop_size: 5)
+    {frames, _pts_list, key_frames} = encode_frames(encoder_ref, 10)
+
+    Enum.zip_with(frames, key_frames, fn frame, key_frame? ->
+      # SPS then PPS, followed by the IDR slice
+      assert match?(<<0, 0, 0, 1, 0x67, _rest::binary>>, frame) == key_frame?
+    end)
+  end
+
+  test "encode H265 access units" do
+    assert {:ok, encoder_ref} = Native.create(:H265, @width, @height, gop_size: 4)
+    {[first | _rest] = frames, _pts_list, key_frames} = encode_frames(encoder_ref, 8)
+
+    assert length(frames) == 8
+    assert <<0, 0, 0, 1, 0x40, 0x01, _rest::binary>> = first
+    assert key_frames == [true, false, false, false, true, false, false, false]
+  end
+
+  test "size the access units after the bitrate" do
+    sizes =
+      for bitrate <- [1_000_000, 2_000_000] do
+        assert {:ok, encoder_ref} =
+                 Native.create(:H264, @width, @height, bitrate: bitrate, framerate: {25, 1})
+
+        {frames, _pts_list, _key_frames} = encode_frames(encoder_ref, 25)
+        frames |> Enum.map(&byte_size/1) |> Enum.sum()
+      end
+
+    [low, high] = sizes
+    assert_in_delta high / low, 2, 0.01
+  end
+
+  test "force a keyframe" do
+    assert {:ok, encoder_ref} = Native.create(:H264, @width, @height, gop_size: 100)
+    assert {:ok, [_frame], [0], [true]} = Native.encode(frame(0), 0, encoder_ref)
+    assert {:ok, [_frame], [1], [false]} = Native.encode(frame(1), 1, encoder_ref)
+    assert :ok = Native.force_keyframe(encoder_ref)
+    assert {:ok, [_frame], [2], [true]} = Native.encode(frame(2), 2, encoder_ref)
+    assert {:ok, [_frame], [3], [false]} = Native.encode(frame(3), 3, encoder_ref)
+  end
+
+  test "encode frames on the device thread" do
+    System.put_env("MMAPI_SW_DECODE_LATENCY_US", "1000")
+    on_exit(fn -> System.delete_env("MMAPI_SW_DECODE_LATENCY_US") end)
+
+    assert {:ok, encoder_ref} = Native.create(:H264, @width, @height, input_buffers: 2)
+    {frames, pts_list, _key_frames} = encode_frames(encoder_ref, 20)
+
+    assert length(frames) == 20
+    assert pts_list == Enum.map(0..19, &(&1 * 1_000))
+  end
+
+  test "reject invalid frames and settings" do
+    assert {:ok, encoder_ref} = Native.create(:H264, @width, @height)
+    assert {:error, :"invalid frame size"} = Native.encode(<<0, 1, 2>>, 0, encoder_ref)
+
+    assert {:error, :"unsupported profile"} =
+             Native.create(:H265, @width, @height, profile: :high)
+
+    assert {:error, :"invalid frame size"} = Native.create(:H264, 321, @height)
+  end
+end
@@ -0,0 +1,63 @@
+defmodule JPEGDecoderTest do
+  use ExUnit.Case, async: true
+  use Membrane.Pipeline
+
+  import Membrane.Testing.Assertions
+
+  alias Membrane.RawVideo
+  alias Membrane.Testing.Pipeline
+
+  @in_path "test/fixtures/mjpeg/input-30-240p.mjpeg"
+
+  defp make_pipeline(decoder, chunk_size) do
+    Pipeline.start_link_supervised!(
+      spec:
+        child(:file_src, %Membrane.File.Source{chunk_size: chunk_size, location: @in_path})
+        |> child(:decoder, decoder)
+        |> child(:sink, Membrane.Testing.Sink)
+    )
+  end
+
+  defp collect_frames(pid, count, frame_size) do
+    buffers =
+      for _index <- 1..count do
+        assert_sink_buffer(pid, :sink, buffer)
+        assert byte_size(buffer.payload) == frame_size
+        buffer
+      end
+
+    assert_end_of_stream(pid, :sink, :input, 5000)
+    buffers
+  end
+
+  test "decode an MJPEG stream" do
+    pid = make_pipeline(%Membrane.Nvidia.MMAPI.JPEGDecoder{framerate: {30, 1}}, 40_960)
+
+    assert_sink_stream_format(pid, :sink, %RawVideo{width: 320, height: 240, pixel_format: :I420})
+    buffers = collect_frames(pid, 30, div(320 * 240 * 3, 2))
+
+    # Timestamps are generated from the frame rate
+    assert Enum.map(buffers, & &1.pts) == Enum.map(0..29, &div(&1 * Membrane.Time.second(), 30))
+
+    Pipeline.terminate(pid)
+  end
+
+  test "decode images split across small buffers" do
+    pid = make_pipeline(%Membrane.Nvidia.MMAPI.JPEGDecoder{}, 1_000)
+
+    assert_sink_stream_format(pid, :sink, %RawVideo{width: 320, height: 240})
+    collect_frames(pid, 30, div(320 * 240 * 3, 2))
+
+    Pipeline.terminate(pid)
+  end
+
+  test "scale and convert the images to NV12" do
+    pid =
+      make_pipeline(%Membrane.Nvidia.MMAPI.JPEGDecoder{width: 160, pixel_format: :NV12}, 40_960)
+
+    assert_sink_stream_format(pid, :sink, %RawVideo{width: 160, height: 120, pixel_format: :NV12})
+    collect_frames(pid, 30, div(160 * 120 * 3, 2))
+
+    Pipeline.terminate(pid)
+  end
+end
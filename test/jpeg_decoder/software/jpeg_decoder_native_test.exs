@@ -0,0 +1,75 @@
+defmodule JPEGDecoder.Software.NativeTest do
+  use ExUnit.Case, async: false
+
+  alias Membrane.Nvidia.MMAPI.Decoder.Native
+
+  @moduletag :software_backend
+
+  @in_path "test/fixtures/mjpeg/input-30-240p.mjpeg"
+
+  setup do
+    # The size of the images takes precedence over the configured one
+    System.put_env("MMAPI_SW_RESOLUTION", "640x480")
+    on_exit(fn -> System.delete_env("MMAPI_SW_RESOLUTION") end)
+  end
+
+  defp images(path) do
+    path
+    |> File.read!()
+    |> :binary.split(<<0xFF, 0xD9>>, [:global, :trim])
+    |> Enum.map(&(&1 <> <<0xFF, 0xD9>>))
+  end
+
+  # Start of image and baseline frame header of a 4:2:0 image, without any scan
+  defp image_header(width, height) do
+    <<0xFF, 0xD8, 0xFF, 0xC0, 17::16, 8, height::16, width::16, 3, 1, 0x22, 0, 2, 0x11, 1, 3,
+      0x11, 1, 0xFF, 0xD9>>
+  end
+
+  defp decode_images(decoder_ref, images) do
+    {frames, pts_list} =
+      images
+      |> Enum.with_index()
+      |> Enum.reduce({[], []}, fn {image, index}, {frames, pts_list} ->
+        assert {:ok, new_frames, new_pts} = Native.decode(image, index, decoder_ref)
+        {frames ++ new_frames, pts_list ++ new_pts}
+      end)
+
+    assert {:ok, flushed, flushed_pts} = Native.flush(decoder_ref)
+    {frames ++ flushed, pts_list ++ flushed_pts}
+  end
+
+  test "decode a frame per image" do
+    assert {:ok, decoder_ref} = Native.create(:MJPEG, -1, -1)
+    {frames, pts_list} = decode_images(decoder_ref, images(@in_path))
+
+    assert length(frames) == 30
+    assert pts_list == Enum.to_list(0..29)
+    assert Enum.all?(frames, &(byte_size(&1) == div(320 * 240 * 3, 2)))
+  end
+
+  test "convert and scale the images" do
+    assert {:ok, decoder_ref} = Native.create(:MJPEG, 160, 120, pixel_format: :NV12)
+    {frames, _pts_list} = decode_images(decoder_ref, images(@in_path))
+
+    assert length(frames) == 30
+    assert Enum.all?(frames, &(byte_size(&1) == div(160 * 120 * 3, 2)))
+  end
+
+  test "follow the size of the images" do
+    images =
+      List.duplicate(image_header(160, 120), 3) ++ List.duplicate(image_header(320, 240), 2)
+
+    assert {:ok, decoder_ref} = Native.create(:MJPEG, -1, -1)
+    {frames, pts_list} = decode_images(decoder_ref, images)
+
+    assert pts_list == Enum.to_list(0..4)
+
+    assert Enum.map(frames, &byte_size/1) ==
+             List.duplicate(div(160 * 120 * 3, 2), 3) ++ List.duplicate(div(320 * 240 * 3, 2), 2)
+  end
+
+  test "reject an unknown codec" do
+    assert {:error, :"unsupported codec"} = Native.create(:VP9, -1, -1)
+  end
+end
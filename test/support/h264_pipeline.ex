@@ -0,0 +1,46 @@
+defmodule Membrane.Nvidia.MMAPI.H264Pipeline do
+  @moduledoc false
+
+  # Testing pipelines reading the 240p H264 fixture, shared by the tests of the
+  # elements consuming H264 access units
+
+  import Membrane.ChildrenSpec
+  import Membrane.Testing.Assertions
+
+  alias Membrane.H264
+  alias Membrane.Testing.Pipeline
+
+  @doc """
+  Starts a pipeline feeding the parsed fixture through `elements`, a list of
+  `{name, element}` linked in order, into a `:sink`.
+  """
+  @spec start_link_supervised!([{atom(), struct() | module()}]) :: pid()
+  def start_link_supervised!(elements) do
+    source =
+      child(:file_src, %Membrane.File.Source{
+        chunk_size: 40_960,
+        location: "test/fixtures/h264/input-100-240p.h264"
+      })
+      |> child(:parser, %H264.Parser{
+        generate_best_effort_timestamps: %{framerate: {30, 1}}
+      })
+
+    spec =
+      elements
+      |> Enum.reduce(source, fn {name, element}, spec -> child(spec, name, element) end)
+      |> child(:sink, Membrane.Testing.Sink)
+
+    Pipeline.start_link_supervised!(spec: spec)
+  end
+
+  @doc """
+  Waits for the next `count` buffers of the sink.
+  """
+  @spec collect_buffers(pid(), pos_integer()) :: [Membrane.Buffer.t()]
+  def collect_buffers(pid, count) do
+    for _index <- 1..count do
+      assert_sink_buffer(pid, :sink, buffer)
+      buffer
+    end
+  end
+end
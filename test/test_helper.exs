@@ -1 +1,7 @@
-ExUnit.start(capture_log: true)
+# Tests tagged with `:software_backend` run against the software stand-in
+# of the Jetson decoder, encoder and VIC, build and run them with `MMAPI_BACKEND=software`.
+if System.get_env("MMAPI_BACKEND") == "software" do
+  ExUnit.start(capture_log: true, exclude: [:test], include: [:software_backend])
+else
+  ExUnit.start(capture_log: true, exclude: [:software_backend])
+end
@@ -0,0 +1,84 @@
+defmodule Transcoder.Software.NativeTest do
+  use ExUnit.Case, async: false
+
+  alias Membrane.Nvidia.MMAPI.Transcoder.Native
+
+  @moduletag :software_backend
+
+  # The software decoder outputs a frame per access unit, whatever its content
+  defp access_unit(0), do: <<0, 0, 0, 1, 0x65, 0x88, 0x84, 0x00>>
+  defp access_unit(_index), do: <<0, 0, 0, 1, 0x41, 0x9A, 0x02, 0x00>>
+
+  defp transcode(transcoder_ref, count) do
+    {frames, pts_list, key_frames} =
+      Enum.reduce(0..(count - 1), {[], [], []}, fn index, {frames, pts_list, key_frames} ->
+        assert {:ok, new_frames, new_pts, new_key_frames} =
+                 Native.transcode(access_unit(index), index * 1_000, transcoder_ref)
+
+        {frames ++ new_frames, pts_list ++ new_pts, key_frames ++ new_key_frames}
+      end)
+
+    assert {:ok, flushed, flushed_pts, flushed_key_frames} = Native.flush(transcoder_ref)
+    {frames ++ flushed, pts_list ++ flushed_pts, key_frames ++ flushed_key_frames}
+  end
+
+  defp key_frame_indexes(key_frames),
+    do: for({true, index} <- Enum.with_index(key_frames), do: index)
+
+  test "transcode every access unit" do
+    assert {:ok, transcoder_ref} = Native.create(:H264, :H265, nil, nil, gop_size: 10)
+    {frames, pts_list, key_frames} = transcode(transcoder_ref, 30)
+
+    assert length(frames) == 30
+    assert pts_list == Enum.map(0..29, &(&1 * 1_000))
+    assert Enum.all?(frames, &match?(<<0, 0, 0, 1, _rest::binary>>, &1))
+    assert <<0, 0, 0, 1, 0x40, 0x01, _rest::binary>> = hd(frames)
+    assert key_frame_indexes(key_frames) == [0, 10, 20]
+  end
+
+  test "resize the frames before encoding them" do
+    assert {:ok, transcoder_ref} = Native.create(:H264, :H264, 160, 120, gop_size: 10)
+    {frames, _pts_list, key_frames} = transcode(transcoder_ref, 20)
+
+    assert length(frames) == 20
+    assert key_frame_indexes(key_frames) == [0, 10]
+  end
+
+  test "restart the encoder on resolution changes" do
+    System.put_env("MMAPI_SW_RESOLUTION_CHANGES", "10:640x480")
+    on_exit(fn -> System.delete_env("MMAPI_SW_RESOLUTION_CHANGES") end)
+
+    assert {:ok, transcoder_ref} = Native.create(:H264, :H264, nil, nil, gop_size: 7)
+    {frames, pts_list, key_frames} = transcode(transcoder_ref, 30)
+
+    assert length(frames) == 30
+    assert pts_list == Enum.map(0..29, &(&1 * 1_000))
+    # The new encoder starts a new GOP with the first frame of the new resolution
+    assert key_frame_indexes(key_frames) == [0, 7, 10, 17, 24]
+  end
+
+  test "transcode on the device threads" do
+    System.put_env("MMAPI_SW_DECODE_LATENCY_US", "1000")
+    on_exit(fn -> System.delete_env("MMAPI_SW_DECODE_LATENCY_US") end)
+
+    assert {:ok, transcoder_ref} = Native.create(:H264, :H264, nil, nil, frame_buffers: 2)
+    {frames, pts_list, _key_frames} = transcode(transcoder_ref, 20)
+
+    assert length(frames) == 20
+    assert pts_list == Enum.map(0..19, &(&1 * 1_000))
+  end
+
+  test "force a keyframe" do
+    assert {:ok, transcoder_ref} = Native.create(:H264, :H264, nil, nil, gop_size: 100)
+    assert {:ok, [_frame], [0], [true]} = Native.transcode(access_unit(0), 0, transcoder_ref)
+    assert {:ok, [_frame], [1], [false]} = Native.transcode(access_unit(1), 1, transcoder_ref)
+    assert :ok = Native.force_keyframe(transcoder_ref)
+    assert {:ok, [_frame], [2], [true]} = Native.transcode(access_unit(2), 2, transcoder_ref)
+  end
+
+  test "reject invalid settings" do
+    assert {:error, :"invalid frame size"} = Native.create(:H264, :H264, 161, 120)
+    assert {:error, :"unsupported profile"} =
+             Native.create(:H264, :H265, nil, nil, profile: :high)
+  end
+end
@@ -0,0 +1,41 @@
+defmodule TranscoderTest do
+  use ExUnit.Case, async: true
+
+  import Membrane.Testing.Assertions
+
+  alias Membrane.{H264, H265}
+  alias Membrane.Nvidia.MMAPI.H264Pipeline
+  alias Membrane.Testing.Pipeline
+
+  defp make_pipeline(transcoder),
+    do: H264Pipeline.start_link_supervised!(transcoder: transcoder)
+
+  test "transcode H264 to H265" do
+    pid = make_pipeline(%Membrane.Nvidia.MMAPI.Transcoder{codec: :H265, gop_size: 30})
+
+    assert_sink_stream_format(pid, :sink, %H265{alignment: :au})
+    buffers = H264Pipeline.collect_buffers(pid, 100)
+    assert_end_of_stream(pid, :sink, :input, 5000)
+
+    key_frames =
+      for {%{metadata: %{h265: %{key_frame?: true}}}, index} <- Enum.with_index(buffers),
+          do: index
+
+    assert key_frames == [0, 30, 60, 90]
+    assert Enum.all?(buffers, &(&1.dts == &1.pts))
+
+    Pipeline.terminate(pid)
+  end
+
+  test "resize the frames while transcoding" do
+    pid = make_pipeline(%Membrane.Nvidia.MMAPI.Transcoder{width: 160})
+
+    assert_sink_stream_format(pid, :sink, %H264{width: 160, alignment: :au})
+    [first | _rest] = H264Pipeline.collect_buffers(pid, 100)
+    assert_end_of_stream(pid, :sink, :input, 5000)
+
+    assert %{h264: %{key_frame?: true}} = first.metadata
+
+    Pipeline.terminate(pid)
+  end
+end